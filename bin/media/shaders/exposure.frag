@@ -0,0 +1,41 @@
+#version 330 core
+// exposure from the luminance histogram, the darkest and brightest tails
+// are left out of the average and the result adapts to it over time
+
+out vec4 FragColor;
+
+uniform sampler2D histogram;        // binCount x 1
+uniform sampler2D previousExposure; // 1x1, last frame's result
+uniform vec2 logRange; // lowest log2 luminance, width of the range
+uniform float binCount;
+uniform float lowPercent;  // fraction of the pixels ignored at the bottom
+uniform float highPercent; // fraction kept from the bottom
+uniform float keyValue;    // the average luminance is mapped to it
+uniform float adaptRate;   // 0 keeps the last exposure, 1 jumps
+
+void main() {
+    int bins = int(binCount);
+    float total = 0.0;
+    for (int i = 0; i < bins; i++) {
+        total += texelFetch(histogram, ivec2(i, 0), 0).r;
+    }
+    float lowCut = total * lowPercent;
+    float highCut = total * highPercent;
+    float seen = 0.0;
+    float logSum = 0.0;
+    float weight = 0.0;
+    for (int i = 0; i < bins; i++) {
+        float count = texelFetch(histogram, ivec2(i, 0), 0).r;
+        // the part of this bin between the cuts
+        float inside = clamp(seen + count, lowCut, highCut) -
+                       clamp(seen, lowCut, highCut);
+        float logLum = logRange.x + (float(i) + 0.5) / binCount * logRange.y;
+        logSum += inside * logLum;
+        weight += inside;
+        seen += count;
+    }
+    float averageLog = weight > 0.0 ? logSum / weight : 0.0;
+    float target = log2(keyValue) - averageLog;
+    float previous = log2(texelFetch(previousExposure, ivec2(0), 0).r);
+    FragColor = vec4(exp2(mix(previous, target, adaptRate)));
+}
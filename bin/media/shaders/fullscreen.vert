@@ -0,0 +1,10 @@
+#version 330 core
+// full screen triangle from the vertex id, no vertex buffer needed
+
+out vec2 TexCoord;
+
+void main() {
+    vec2 pos = vec2(float((gl_VertexID << 1) & 2), float(gl_VertexID & 2));
+    TexCoord = pos;
+    gl_Position = vec4(pos * 2.0 - 1.0, 0.0, 1.0);
+}
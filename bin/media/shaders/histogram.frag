@@ -0,0 +1,6 @@
+#version 330 core
+// every point adds one to its bin
+
+out vec4 FragColor;
+
+void main() { FragColor = vec4(1.0); }
@@ -0,0 +1,16 @@
+#version 330 core
+// one point per luminance texel, moved onto its bin of the histogram row;
+// additive blending does the counting
+
+uniform sampler2D logLuminance;
+uniform vec2 logRange; // lowest log2 luminance, width of the range
+uniform float binCount;
+
+void main() {
+    ivec2 size = textureSize(logLuminance, 0);
+    ivec2 texel = ivec2(gl_VertexID % size.x, gl_VertexID / size.x);
+    float logLum = texelFetch(logLuminance, texel, 0).r;
+    float t = clamp((logLum - logRange.x) / logRange.y, 0.0, 1.0);
+    float bin = min(floor(t * binCount), binCount - 1.0);
+    gl_Position = vec4((bin + 0.5) / binCount * 2.0 - 1.0, 0.0, 0.0, 1.0);
+}
@@ -0,0 +1,16 @@
+#version 330 core
+// log2 luminance of the hdr scene on a small grid for the histogram
+
+in vec2 TexCoord;
+
+out vec4 FragColor;
+
+uniform sampler2D sceneColor;
+uniform vec2 renderSize; // rendered pixels, the texture can be larger
+
+void main() {
+    vec2 uv = TexCoord * renderSize / vec2(textureSize(sceneColor, 0));
+    vec3 color = texture(sceneColor, uv).rgb;
+    float lum = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    FragColor = vec4(log2(max(lum, 0.00001)));
+}
@@ -21,6 +21,22 @@ uniform sampler2D diffuseMap;
 uniform sampler2D specularMap;
 uniform sampler2D normalMap;
 
+// world space positions for shadow lookups
+uniform vec3 viewPos;
+uniform vec3 lightPos;
+
+// shadow related
+uniform int shadowMode; // 0 none, 1 directional cascades, 2 point light
+uniform sampler2DArrayShadow shadowCascades;
+uniform mat4 cascadeMats[4];
+uniform vec4 cascadeSplits; // view depth where each cascade ends
+uniform vec3 cascadeViewDir;
+uniform samplerCubeShadow shadowCube;
+uniform vec3 shadowLightPos;
+uniform float shadowFar;
+
+float computeShadow(vec3 worldPos, vec3 worldNormal, vec3 worldLightDir);
+
 float computeAttenuation(vec3 att, float lfragdist);
 vec3 getSurfaceNormal();
 vec3 getLightDir();
@@ -49,7 +65,10 @@ void main() {
   // adding specular terms
   vec3 specular = getSpecColor(lightDirection, surfaceNormal);
 
-    FragColor = vec4(ambient + diffuse + specular, 1.0);
+  float shadow = computeShadow(FragPos, normalize(Normal),
+                               normalize(lightPos - FragPos));
+
+    FragColor = vec4(ambient + shadow * (diffuse + specular), 1.0);
 }
 
 float computeAttenuation(vec3 att, float lfragdist) {
@@ -81,3 +100,50 @@ vec3 getSpecColor(vec3 lightDir, vec3 normal) {
   float specAngle = max(dot(refdir, hwaydir), 0.0);
   return pow(specAngle, shininess) * spec;
 }
+
+float computeShadow(vec3 worldPos, vec3 worldNormal, vec3 worldLightDir) {
+  // visibility in [0, 1] with pcf over the cached shadow maps
+  if (shadowMode == 0) {
+    return 1.0;
+  }
+  float ndotl = clamp(dot(worldNormal, worldLightDir), 0.0, 1.0);
+  float bias = max(0.005 * (1.0 - ndotl), 0.0005);
+  float visibility = 0.0;
+  if (shadowMode == 1) {
+    float depth = dot(worldPos - viewPos, cascadeViewDir);
+    int cascade = 3;
+    for (int i = 0; i < 4; i++) {
+      if (depth < cascadeSplits[i]) {
+        cascade = i;
+        break;
+      }
+    }
+    vec4 lpos = cascadeMats[cascade] * vec4(worldPos, 1.0);
+    vec3 proj = lpos.xyz * 0.5 + 0.5;
+    if (proj.z > 1.0) {
+      return 1.0;
+    }
+    vec2 texel = 1.0 / vec2(textureSize(shadowCascades, 0).xy);
+    for (int x = -1; x <= 1; x++) {
+      for (int y = -1; y <= 1; y++) {
+        vec4 coord = vec4(proj.xy + vec2(x, y) * texel, float(cascade),
+                          proj.z - bias);
+        visibility += texture(shadowCascades, coord);
+      }
+    }
+    return visibility / 9.0;
+  }
+  vec3 fromLight = worldPos - shadowLightPos;
+  float refDepth = length(fromLight) / shadowFar - bias;
+  // offsets along the cube edges and corners
+  vec3 offsets[8] = vec3[](vec3(1, 1, 1), vec3(1, -1, 1), vec3(-1, -1, 1),
+                           vec3(-1, 1, 1), vec3(1, 1, -1), vec3(1, -1, -1),
+                           vec3(-1, -1, -1), vec3(-1, 1, -1));
+  float diskRadius = 0.002 * length(fromLight);
+  visibility = texture(shadowCube, vec4(fromLight, refDepth));
+  for (int i = 0; i < 8; i++) {
+    vec3 dir = fromLight + offsets[i] * diskRadius;
+    visibility += texture(shadowCube, vec4(dir, refDepth));
+  }
+  return visibility / 9.0;
+}
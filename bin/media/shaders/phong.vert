@@ -1,39 +1,44 @@
 #version 330 core
 
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
-layout (location = 3) in vec3 aTan;
-layout (location = 4) in vec3 aBiTan;
+// tangent frame as a unit quaternion, the sign of w is the bitangent sign
+layout (location = 3) in vec4 aQTangent;
 
-uniform mat4 view;
 uniform mat4 model;
-uniform mat4 projection;
+// computed on the cpu once per object
+uniform mat4 mvp;
+uniform mat3 normalMatrix;
 
 
 uniform vec3 viewPos;
 uniform vec3 lightPos;
 
 out vec3 FragPos;
+out vec3 Normal;
 out vec2 TexCoord;
 out vec3 TbnLightPos;
 out vec3 TbnViewPos;
 out vec3 TbnFragPos;
 
+vec3 quatRotate(vec4 q, vec3 v) {
+  return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
 void main() 
 {
     FragPos = vec3(model * vec4(aPos, 1.0));
     TexCoord = aTexCoord;
-    mat3 nmat = transpose(inverse(mat3(model)));
+    vec4 q = normalize(aQTangent);
     // compute tan world
-    vec4 tanW = model * vec4(aTan, 0.0);
-    vec3 Tan = normalize(vec3(tanW));
+    vec3 Tan = normalize(mat3(model) * quatRotate(q, vec3(1.0, 0.0, 0.0)));
     // compute norm world
-    vec4 norm4 = model * vec4(aNormal, 0.0);
-    vec3 Norm = normalize(vec3(norm4));
+    vec3 Norm = normalize(normalMatrix * quatRotate(q, vec3(0.0, 0.0, 1.0)));
     // make t perpendicular to n
     Tan = normalize(Tan - dot(Tan, Norm) * Norm);
-    vec3 BiTan = cross(Norm, Tan);
+    float handedness = aQTangent.w < 0.0 ? -1.0 : 1.0;
+    vec3 BiTan = handedness * cross(Norm, Tan);
+    Normal = Norm;
 
     // get tbn mat
     mat3 tbn = transpose(mat3(Tan, BiTan, Norm));
@@ -42,5 +47,5 @@ void main()
     TbnFragPos = tbn * FragPos;
 
     // classic gl pos
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = mvp * vec4(aPos, 1.0);
 }
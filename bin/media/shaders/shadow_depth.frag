@@ -0,0 +1,17 @@
+#version 330 core
+// depth only pass for shadow maps
+
+in vec3 WorldPos;
+
+uniform int linearDepth; // 1 for point light cube maps
+uniform vec3 shadowLightPos;
+uniform float shadowFar;
+
+void main() {
+    if (linearDepth == 1) {
+        // distance to the light, compared against in the lighting shaders
+        gl_FragDepth = length(WorldPos - shadowLightPos) / shadowFar;
+    } else {
+        gl_FragDepth = gl_FragCoord.z;
+    }
+}
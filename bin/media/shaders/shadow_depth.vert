@@ -0,0 +1,14 @@
+#version 330 core
+// depth only pass for shadow maps
+
+layout (location = 0) in vec3 aPos;
+
+uniform mat4 model;
+uniform mat4 lightSpace;
+
+out vec3 WorldPos;
+
+void main() {
+    WorldPos = vec3(model * vec4(aPos, 1.0));
+    gl_Position = lightSpace * vec4(WorldPos, 1.0);
+}
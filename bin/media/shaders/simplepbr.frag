@@ -19,6 +19,24 @@ uniform vec3 lightColor;
 // camera related
 uniform vec3 viewPos;
 
+// shadow related
+uniform int shadowMode; // 0 none, 1 directional cascades, 2 point light
+uniform sampler2DArrayShadow shadowCascades;
+uniform mat4 cascadeMats[4];
+uniform vec4 cascadeSplits; // view depth where each cascade ends
+uniform vec3 cascadeViewDir;
+uniform samplerCubeShadow shadowCube;
+uniform vec3 shadowLightPos;
+uniform float shadowFar;
+
+float computeShadow(vec3 worldPos, vec3 worldNormal, vec3 worldLightDir);
+
+#ifdef USE_LAMBDA_LUT
+// r: bsLamdaTFn, g: roughnessToAlpha, see lut.hpp for the coordinates
+uniform sampler2D lambdaLUT;
+uniform vec2 lambdaLutScaleBias;
+#endif
+
 // pi value
 const float PI = 3.14159265;
 
@@ -179,7 +197,8 @@ void main() {
 
   float t2 = 4.0 * outDir * inDir;
   vec3 specular = t1 / max(t2, 0.0001);
-  L_out = (kd * albedo.r / PI + specular) * radiance * inDir;
+  float shadow = computeShadow(WorldPos, normalize(Normal), lightDir);
+  L_out = (kd * albedo.r / PI + specular) * radiance * inDir * shadow;
 
   // end light source loop done
   // ambient coefficient k_a
@@ -378,8 +397,18 @@ float bsLamdaTFn(vec3 normal, vec3 halfDir, float roughness) {
   // lambda for traditional Beckmann Spizzichino Distribution
   // partly taken from
   // taken from pbr-book 3rd edition Pharr, Jakob
+#ifdef USE_LAMBDA_LUT
+  float costheta = abs(getCosTheta(normal, halfDir));
+  float u = 0.5 * (sqrt(costheta) + 1.0 - sqrt(1.0 - min(costheta, 1.0)));
+  // rows are spaced on sqrt(roughness), see lambdaLutRoughnessCoord
+  float v = sqrt(clamp(roughness, 0.0, 1.0));
+  vec2 uv = vec2(u, v) * lambdaLutScaleBias.x +
+            lambdaLutScaleBias.y;
+  return texture(lambdaLUT, uv).r;
+#else
   float alpha = roughnessToAlpha(roughness);
   return bsLambdaFn(normal, halfDir, alpha);
+#endif
 }
 
 void bsLamdaTFnIO(vec3 normal, vec3 halfDir, vec3 viewDir, float roughness,
@@ -418,7 +447,14 @@ float trowReitzLambdaT(vec3 normal, vec3 halfway, float roughness) {
   // partly taken from
   // taken from pbr-book 3rd edition Pharr, Jakob
   // \frac{-1 + \sqrt{1 + {\alpha}^2 * tan^2(\theta)} }{2}
+#ifdef USE_LAMBDA_LUT
+  float v = sqrt(clamp(roughness, 0.0, 1.0));
+  vec2 uv = vec2(0.5, v) * lambdaLutScaleBias.x +
+            lambdaLutScaleBias.y;
+  float alpha = texture(lambdaLUT, uv).g;
+#else
   float alpha = roughnessToAlpha(roughness);
+#endif
   return trowReitzLambda(normal, halfway, alpha);
 }
 void trowReitzLambdaTIO(vec3 normal, vec3 halfDir, vec3 viewDir,
@@ -442,3 +478,50 @@ vec3 getFresnelSchlick(float costheta, vec3 refAtZero) {
   //
   return refAtZero + (1.0 - refAtZero) * pow(1.0 - costheta, 5.0);
 }
+
+float computeShadow(vec3 worldPos, vec3 worldNormal, vec3 worldLightDir) {
+  // visibility in [0, 1] with pcf over the cached shadow maps
+  if (shadowMode == 0) {
+    return 1.0;
+  }
+  float ndotl = clamp(dot(worldNormal, worldLightDir), 0.0, 1.0);
+  float bias = max(0.005 * (1.0 - ndotl), 0.0005);
+  float visibility = 0.0;
+  if (shadowMode == 1) {
+    float depth = dot(worldPos - viewPos, cascadeViewDir);
+    int cascade = 3;
+    for (int i = 0; i < 4; i++) {
+      if (depth < cascadeSplits[i]) {
+        cascade = i;
+        break;
+      }
+    }
+    vec4 lpos = cascadeMats[cascade] * vec4(worldPos, 1.0);
+    vec3 proj = lpos.xyz * 0.5 + 0.5;
+    if (proj.z > 1.0) {
+      return 1.0;
+    }
+    vec2 texel = 1.0 / vec2(textureSize(shadowCascades, 0).xy);
+    for (int x = -1; x <= 1; x++) {
+      for (int y = -1; y <= 1; y++) {
+        vec4 coord = vec4(proj.xy + vec2(x, y) * texel, float(cascade),
+                          proj.z - bias);
+        visibility += texture(shadowCascades, coord);
+      }
+    }
+    return visibility / 9.0;
+  }
+  vec3 fromLight = worldPos - shadowLightPos;
+  float refDepth = length(fromLight) / shadowFar - bias;
+  // offsets along the cube edges and corners
+  vec3 offsets[8] = vec3[](vec3(1, 1, 1), vec3(1, -1, 1), vec3(-1, -1, 1),
+                           vec3(-1, 1, 1), vec3(1, 1, -1), vec3(1, -1, -1),
+                           vec3(-1, -1, -1), vec3(-1, 1, -1));
+  float diskRadius = 0.002 * length(fromLight);
+  visibility = texture(shadowCube, vec4(fromLight, refDepth));
+  for (int i = 0; i < 8; i++) {
+    vec3 dir = fromLight + offsets[i] * diskRadius;
+    visibility += texture(shadowCube, vec4(dir, refDepth));
+  }
+  return visibility / 9.0;
+}
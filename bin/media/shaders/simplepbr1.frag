@@ -6,18 +6,125 @@ out vec4 FragColor;
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoord;
+in vec4 Tangent;
 
 // texture related
+#if defined(VIRTUAL_TEXTURE)
+// pages of every material streamed into a cache texture per map type, the
+// page table says which cache slot holds the best page, see vtexture.hpp
+uniform sampler2D albedoCache;
+uniform sampler2D normalCache;
+uniform sampler2D metallicCache;
+uniform sampler2D aoCache;
+uniform sampler2D roughnessCache;
+uniform usampler2DArray vtIndirection;
+uniform float vtPages;      // pages per side at mip 0
+uniform float vtMaxMip;     // a single page
+uniform float vtPageTexels;
+uniform vec3 vtCache;       // padded page, border, page over the cache size
+uniform float vtLodBias;
+flat in int MaterialLayer;
+
+vec2 vtCacheCoord() {
+  // the mip the feedback pass asks for at this pixel
+  vec2 texel = TexCoord * vtPages * vtPageTexels;
+  vec2 dx = dFdx(texel);
+  vec2 dy = dFdy(texel);
+  float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vtLodBias;
+  int mip = int(clamp(floor(lod), 0.0, vtMaxMip));
+  vec2 uv = fract(TexCoord);
+  int pages = int(vtPages) >> mip;
+  ivec2 page = min(ivec2(uv * float(pages)), ivec2(pages - 1));
+  uvec4 entry = texelFetch(vtIndirection, ivec3(page, MaterialLayer), mip);
+  // the entry may hold a coarser page covering this one
+  float residentPages = float(int(vtPages) >> int(entry.z));
+  vec2 local = fract(uv * residentPages);
+  return vec2(entry.xy) * vtCache.x + vtCache.y + local * vtCache.z;
+}
+// the cache has no mips, the coordinate jumps between pages
+vec3 albedoTexel() {
+  return textureLod(albedoCache, vtCacheCoord(), 0.0).rgb;
+}
+vec3 normalTexel() {
+  return textureLod(normalCache, vtCacheCoord(), 0.0).rgb;
+}
+vec3 metallicTexel() {
+  return textureLod(metallicCache, vtCacheCoord(), 0.0).rgb;
+}
+vec3 aoTexel() { return textureLod(aoCache, vtCacheCoord(), 0.0).rgb; }
+vec3 roughnessTexel() {
+  return textureLod(roughnessCache, vtCacheCoord(), 0.0).rgb;
+}
+#elif defined(MATERIAL_BATCH)
+// one array per map type, the layer is the material of the instance
+uniform sampler2DArray albedoMaps;
+uniform sampler2DArray normalMaps;
+uniform sampler2DArray metallicMaps;
+uniform sampler2DArray aoMaps;
+uniform sampler2DArray roughnessMaps;
+flat in int MaterialLayer;
+
+vec3 albedoTexel() {
+  return texture(albedoMaps, vec3(TexCoord, MaterialLayer)).rgb;
+}
+vec3 normalTexel() {
+  return texture(normalMaps, vec3(TexCoord, MaterialLayer)).rgb;
+}
+vec3 metallicTexel() {
+  return texture(metallicMaps, vec3(TexCoord, MaterialLayer)).rgb;
+}
+vec3 aoTexel() { return texture(aoMaps, vec3(TexCoord, MaterialLayer)).rgb; }
+vec3 roughnessTexel() {
+  return texture(roughnessMaps, vec3(TexCoord, MaterialLayer)).rgb;
+}
+#else
 uniform sampler2D albedoMap;
 uniform sampler2D normalMap;
 uniform sampler2D metallicMap;
 uniform sampler2D aoMap;
 uniform sampler2D roughnessMap;
 
+vec3 albedoTexel() { return texture(albedoMap, TexCoord).rgb; }
+vec3 normalTexel() { return texture(normalMap, TexCoord).rgb; }
+vec3 metallicTexel() { return texture(metallicMap, TexCoord).rgb; }
+vec3 aoTexel() { return texture(aoMap, TexCoord).rgb; }
+vec3 roughnessTexel() { return texture(roughnessMap, TexCoord).rgb; }
+#endif
+
 // light pos
 uniform vec3 lightPos;
 uniform vec3 viewPos;
 
+// shadow related
+uniform int shadowMode; // 0 none, 1 directional cascades, 2 point light
+uniform sampler2DArrayShadow shadowCascades;
+uniform mat4 cascadeMats[4];
+uniform vec4 cascadeSplits; // view depth where each cascade ends
+uniform vec3 cascadeViewDir;
+uniform samplerCubeShadow shadowCube;
+uniform vec3 shadowLightPos;
+uniform float shadowFar;
+
+float computeShadow(vec3 worldPos, vec3 worldNormal, vec3 worldLightDir);
+
+// image based lighting
+uniform int iblEnabled;
+uniform samplerCube irradianceMap;
+uniform samplerCube prefilterMap;
+uniform sampler2D brdfLUT;
+uniform float prefilterMaxLod;
+
+vec3 getFresnelSchlickRoughness(float costheta, vec3 refAtZero,
+                                float roughness);
+vec3 getAmbientIbl(vec3 normal, vec3 viewDir, vec3 albedo, vec3 refAtZero,
+                   float metallic, float roughness, vec3 ao);
+
+#ifdef USE_LAMBDA_LUT
+// r: bsLamdaTFn, g: roughnessToAlpha, see lut.hpp for the coordinates
+uniform sampler2D lambdaLUT;
+uniform vec2 lambdaLutScaleBias;
+#endif
+
 // pi value
 const float PI = 3.14159265;
 
@@ -63,13 +170,13 @@ void main() {
   vec3 albedo = getAlbedo();
 
   // get metallic
-  vec3 metallic = texture(metallicMap, TexCoord).rgb;
+  vec3 metallic = metallicTexel();
 
   // get ao map
-  vec3 ao = texture(aoMap, TexCoord).rgb;
+  vec3 ao = aoTexel();
 
   // get roughness map
-  vec3 rough = texture(roughnessMap, TexCoord).rgb;
+  vec3 rough = roughnessTexel();
 
   // lightout
   vec3 L_out = vec3(0.0);
@@ -85,6 +192,10 @@ void main() {
 
   vec3 refAtZero = vec3(0.04);
   refAtZero = mix(refAtZero, albedo, metallic.r);
+  if (iblEnabled == 1) {
+    ambient = getAmbientIbl(surfaceNormal, viewDir, albedo, refAtZero,
+                            metallic.r, rough.r, ao);
+  }
   //refAtZero = mix(metallic, albedo, 0.5);
   float hcostheta = getCosTheta(surfaceNormal, halfDir);
   float fresnelCostheta = getCosTheta(halfDir, viewDir);
@@ -106,11 +217,11 @@ void main() {
   float t2 = 4.0 * outDir * inDir;
   vec3 specular = t1 / max(t2, 0.0001);
 
-  L_out = (kd * albedo / PI + specular) * 1.0f * inDir;
+  float shadow = computeShadow(FragPos, normalize(Normal), lightDir);
+  L_out = (kd * albedo / PI + specular) * 1.0f * inDir * shadow;
 
   L_out += ambient;
-  L_out = L_out / (L_out + vec3(1.0));
-  L_out = pow(L_out, vec3(1.0/2.2));
+  // hdr radiance, exposure and tonemapping run once per pixel afterwards
 
   //FragColor = vec4(hcostheta * refAtZero, 1.0);
   FragColor = vec4(L_out, 1.0);
@@ -118,14 +229,12 @@ void main() {
 
 vec3 getLightDir() { return normalize(lightPos - FragPos); }
 vec3 getSurfaceNormal() {
-  vec3 normal = normalize(texture(normalMap, TexCoord).rgb * 2 - 1.0);
-  vec3 q1 = dFdx(FragPos);
-  vec3 q2 = dFdy(FragPos);
-  vec2 tex1 = dFdx(TexCoord);
-  vec2 tex2 = dFdy(TexCoord);
+  vec3 normal = normalize(normalTexel() * 2 - 1.0);
+  // per vertex tangent frame, no screen space derivatives
   vec3 N = normalize(Normal);
-  vec3 T = normalize(q1 * tex2.t - q2 * tex1.t);
-  vec3 B = -normalize(cross(N, T));
+  vec3 T = normalize(Tangent.xyz - dot(Tangent.xyz, N) * N);
+  // green of the normal map points down v, as with the derivative frame
+  vec3 B = -Tangent.w * cross(N, T);
   mat3 TBN = mat3(T, B, N);
   return normalize(TBN * normal);
 }
@@ -179,14 +288,34 @@ float roughnessToAlpha(float roughness) {
 
 
 vec3 getAlbedo() {
-  vec3 albedo = pow(texture(albedoMap, TexCoord).rgb, vec3(2.2));
-  return albedo;
+  // albedo maps are srgb textures, sampling already returns linear values
+  return albedoTexel();
 }
 vec3 getFresnelSchlick(float costheta, vec3 refAtZero) {
   // taken from https://learnopengl.com/PBR/Lighting
   //
   return refAtZero + (1.0 - refAtZero) * pow(1.0 - costheta, 5.0);
 }
+vec3 getFresnelSchlickRoughness(float costheta, vec3 refAtZero,
+                                float roughness) {
+  // taken from https://learnopengl.com/PBR/IBL/Diffuse-irradiance
+  vec3 rmax = max(vec3(1.0 - roughness), refAtZero);
+  return refAtZero + (rmax - refAtZero) * pow(1.0 - costheta, 5.0);
+}
+vec3 getAmbientIbl(vec3 normal, vec3 viewDir, vec3 albedo, vec3 refAtZero,
+                   float metallic, float roughness, vec3 ao) {
+  // split sum approximation with the precomputed maps
+  float ndotv = max(dot(normal, viewDir), 0.0);
+  vec3 fresnel = getFresnelSchlickRoughness(ndotv, refAtZero, roughness);
+  vec3 kd = (vec3(1.0) - fresnel) * (1.0 - metallic);
+  vec3 diffuse = texture(irradianceMap, normal).rgb * albedo;
+  vec3 refdir = reflect(-viewDir, normal);
+  vec3 prefiltered =
+      textureLod(prefilterMap, refdir, roughness * prefilterMaxLod).rgb;
+  vec2 brdf = texture(brdfLUT, vec2(ndotv, roughness)).rg;
+  vec3 specular = prefiltered * (fresnel * brdf.x + brdf.y);
+  return (kd * diffuse + specular) * ao;
+}
 // traditional version of beckmann spizzichino
 float bsLambdaFn(vec3 normal, vec3 halfDir, float alpha) {
   // lambda for anisoptric Beckmann Spizzichino Distribution
@@ -220,8 +349,18 @@ float bsLamdaTFn(vec3 normal, vec3 halfDir, float roughness) {
   // lambda for traditional Beckmann Spizzichino Distribution
   // partly taken from
   // taken from pbr-book 3rd edition Pharr, Jakob
+#ifdef USE_LAMBDA_LUT
+  float costheta = abs(getCosTheta(normal, halfDir));
+  float u = 0.5 * (sqrt(costheta) + 1.0 - sqrt(1.0 - min(costheta, 1.0)));
+  // rows are spaced on sqrt(roughness), see lambdaLutRoughnessCoord
+  float v = sqrt(clamp(roughness, 0.0, 1.0));
+  vec2 uv = vec2(u, v) * lambdaLutScaleBias.x +
+            lambdaLutScaleBias.y;
+  return texture(lambdaLUT, uv).r;
+#else
   float alpha = roughnessToAlpha(roughness);
   return bsLambdaFn(normal, halfDir, alpha);
+#endif
 }
 void bsLamdaTFnIO(vec3 normal, vec3 halfDir, vec3 viewDir, float roughness,
                   float lambdaArr[2]) {
@@ -234,4 +373,49 @@ float geometryInOut(float lambdaIn, float lambdaOut) {
   return 1 / (1 + lambdaIn + lambdaOut);
 }
 
-
+float computeShadow(vec3 worldPos, vec3 worldNormal, vec3 worldLightDir) {
+  // visibility in [0, 1] with pcf over the cached shadow maps
+  if (shadowMode == 0) {
+    return 1.0;
+  }
+  float ndotl = clamp(dot(worldNormal, worldLightDir), 0.0, 1.0);
+  float bias = max(0.005 * (1.0 - ndotl), 0.0005);
+  float visibility = 0.0;
+  if (shadowMode == 1) {
+    float depth = dot(worldPos - viewPos, cascadeViewDir);
+    int cascade = 3;
+    for (int i = 0; i < 4; i++) {
+      if (depth < cascadeSplits[i]) {
+        cascade = i;
+        break;
+      }
+    }
+    vec4 lpos = cascadeMats[cascade] * vec4(worldPos, 1.0);
+    vec3 proj = lpos.xyz * 0.5 + 0.5;
+    if (proj.z > 1.0) {
+      return 1.0;
+    }
+    vec2 texel = 1.0 / vec2(textureSize(shadowCascades, 0).xy);
+    for (int x = -1; x <= 1; x++) {
+      for (int y = -1; y <= 1; y++) {
+        vec4 coord = vec4(proj.xy + vec2(x, y) * texel, float(cascade),
+                          proj.z - bias);
+        visibility += texture(shadowCascades, coord);
+      }
+    }
+    return visibility / 9.0;
+  }
+  vec3 fromLight = worldPos - shadowLightPos;
+  float refDepth = length(fromLight) / shadowFar - bias;
+  // offsets along the cube edges and corners
+  vec3 offsets[8] = vec3[](vec3(1, 1, 1), vec3(1, -1, 1), vec3(-1, -1, 1),
+                           vec3(-1, 1, 1), vec3(1, 1, -1), vec3(1, -1, -1),
+                           vec3(-1, -1, -1), vec3(-1, 1, -1));
+  float diskRadius = 0.002 * length(fromLight);
+  visibility = texture(shadowCube, vec4(fromLight, refDepth));
+  for (int i = 0; i < 8; i++) {
+    vec3 dir = fromLight + offsets[i] * diskRadius;
+    visibility += texture(shadowCube, vec4(dir, refDepth));
+  }
+  return visibility / 9.0;
+}
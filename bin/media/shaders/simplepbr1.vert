@@ -1,23 +1,49 @@
 #version 330 core
 
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+// tangent frame as a unit quaternion, the sign of w is the bitangent sign
+layout (location = 3) in vec4 aQTangent;
 
-uniform mat4 view;
+#ifdef MATERIAL_BATCH
+// per instance attributes of a batched draw, see material.hpp
+layout (location = 4) in mat4 aModel;
+layout (location = 8) in mat4 aMvp;
+layout (location = 12) in mat3 aNormalMatrix;
+layout (location = 15) in int aMaterial;
+flat out int MaterialLayer;
+#define model aModel
+#define mvp aMvp
+#define normalMatrix aNormalMatrix
+#else
 uniform mat4 model;
-uniform mat4 projection;
+// computed on the cpu once per object
+uniform mat4 mvp;
+uniform mat3 normalMatrix;
+#endif
 
 out vec3 FragPos;
 out vec2 TexCoord;
 out vec3 Normal;
+// world tangent and bitangent sign
+out vec4 Tangent;
+
+vec3 quatRotate(vec4 q, vec3 v) {
+  return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
 
 void main() 
 {
     FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+    vec4 q = normalize(aQTangent);
+    Normal = normalMatrix * quatRotate(q, vec3(0.0, 0.0, 1.0));
+    Tangent.xyz = mat3(model) * quatRotate(q, vec3(1.0, 0.0, 0.0));
+    Tangent.w = aQTangent.w < 0.0 ? -1.0 : 1.0;
     TexCoord = aTexCoord;
+#ifdef MATERIAL_BATCH
+    MaterialLayer = aMaterial;
+#endif
 
     // classic gl pos
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    gl_Position = mvp * vec4(aPos, 1.0);
 }
@@ -0,0 +1,23 @@
+#version 330 core
+// exposure and reinhard once per pixel, also upscales the part of the hdr
+// scene texture the frame rendered to. the output stays linear, the srgb
+// backbuffer encodes it
+
+in vec2 TexCoord;
+
+out vec4 FragColor;
+
+uniform sampler2D sceneColor;
+uniform sampler2D exposure; // 1x1, written by the exposure pass
+uniform vec2 renderSize;    // rendered pixels, the texture can be larger
+
+void main() {
+    vec2 texSize = vec2(textureSize(sceneColor, 0));
+    vec2 uv = TexCoord * renderSize / texSize;
+    // keep the filter footprint inside the rendered pixels
+    uv = clamp(uv, 0.5 / texSize, (renderSize - 0.5) / texSize);
+    vec3 color = texture(sceneColor, uv).rgb;
+    color *= texelFetch(exposure, ivec2(0), 0).r;
+    color = color / (color + vec3(1.0));
+    FragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,26 @@
+#version 330 core
+// virtual texture feedback: the page and mip every pixel would sample, read
+// back on the cpu to decide which pages to stream in, see vtexture.hpp
+
+in vec2 TexCoord;
+flat in int MaterialLayer;
+
+out vec4 FragColor;
+
+uniform float vtPages;      // pages per side at mip 0
+uniform float vtMaxMip;     // a single page
+uniform float vtPageTexels;
+// compensates the smaller target, the derivatives here are larger
+uniform float vtLodBias;
+
+void main() {
+    vec2 texel = TexCoord * vtPages * vtPageTexels;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    float lod = 0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + vtLodBias;
+    int mip = int(clamp(floor(lod), 0.0, vtMaxMip));
+    int pages = int(vtPages) >> mip;
+    ivec2 page = min(ivec2(fract(TexCoord) * float(pages)), ivec2(pages - 1));
+    // rgba8 target, the clear value 255 marks pixels without a request
+    FragColor = vec4(vec2(page), float(mip), float(MaterialLayer)) / 255.0;
+}
@@ -0,0 +1,121 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Image loading through the asset pack. A cooked entry with the asked
+// channel count is handed out in place, other cooked entries are converted
+// and images stored as files in the pack are decoded from memory. Without
+// the pack, or when it misses the file, the image is loaded from disk as
+// before. Kept apart from assetpack.hpp since it needs stb, which shader
+// users do not link.
+
+#ifndef ASSETIMAGE_HPP
+#define ASSETIMAGE_HPP
+
+#include <custom/assetpack.hpp>
+#include <custom/trace.hpp>
+
+// the executables define the stb implementation themselves
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include <custom/stb_image.h>
+#endif
+
+#include <cstdlib>
+#include <filesystem>
+
+struct AssetImage {
+  const unsigned char *texels;
+  int width;
+  int height;
+  int channels;
+  // texels were allocated for this image, freeAssetImage releases them
+  bool owned;
+};
+
+void assetConvertChannels_proc(const unsigned char *src, int srcChannels,
+                               unsigned char *dst, int dstChannels,
+                               size_t pixels) {
+  // the same expansion and luminance weights stb uses
+  for (size_t i = 0; i < pixels; i++) {
+    const unsigned char *s = src + i * srcChannels;
+    unsigned char *d = dst + i * dstChannels;
+    unsigned char rgba[4];
+    if (srcChannels < 3) {
+      rgba[0] = rgba[1] = rgba[2] = s[0];
+      rgba[3] = srcChannels == 2 ? s[1] : 255;
+    } else {
+      rgba[0] = s[0];
+      rgba[1] = s[1];
+      rgba[2] = s[2];
+      rgba[3] = srcChannels == 4 ? s[3] : 255;
+    }
+    if (dstChannels < 3) {
+      d[0] = (unsigned char)((rgba[0] * 77 + rgba[1] * 150 + rgba[2] * 29) >>
+                             8);
+      if (dstChannels == 2) {
+        d[1] = rgba[3];
+      }
+    } else {
+      for (int c = 0; c < dstChannels; c++) {
+        d[c] = rgba[c];
+      }
+    }
+  }
+}
+
+// desiredChannels 0 keeps the channels of the image, like stbi_load
+bool loadAssetImage(const std::filesystem::path &path, int desiredChannels,
+                    AssetImage &image) {
+  TRACE_SCOPE_DETAIL("loadAssetImage", path.c_str());
+  image.texels = NULL;
+  image.width = image.height = image.channels = 0;
+  image.owned = true;
+  AssetSpan span;
+  if (!assetPack().findPath(path, span)) {
+    TRACE_SCOPE("stbi_load");
+    image.texels = stbi_load(path.c_str(), &image.width, &image.height,
+                             &image.channels, desiredChannels);
+  } else if ((span.flags & ASSET_ENTRY_TEXTURE) == 0) {
+    // an image the builder could not cook, decode it from the mapping
+    TRACE_SCOPE("stbi_load_from_memory");
+    image.texels = stbi_load_from_memory(span.data, (int)span.size,
+                                         &image.width, &image.height,
+                                         &image.channels, desiredChannels);
+  } else {
+    AssetTextureHeader info;
+    const unsigned char *texels = NULL;
+    if (!assetTexture(span, info, texels)) {
+      std::cout << "asset pack: " << path << " is not a valid image"
+                << std::endl;
+      return false;
+    }
+    image.width = (int)info.width;
+    image.height = (int)info.height;
+    image.channels = (int)info.channels;
+    if (desiredChannels == 0 || desiredChannels == image.channels) {
+      image.texels = texels;
+      image.owned = false;
+      return true;
+    }
+    size_t pixels = (size_t)image.width * image.height;
+    unsigned char *converted =
+        (unsigned char *)std::malloc(pixels * desiredChannels);
+    assetConvertChannels_proc(texels, image.channels, converted,
+                              desiredChannels, pixels);
+    image.texels = converted;
+  }
+  // stb reports the channels of the file, the texels have the asked ones
+  if (desiredChannels != 0) {
+    image.channels = desiredChannels;
+  }
+  return image.texels != NULL;
+}
+
+void freeAssetImage(AssetImage &image) {
+  if (image.owned && image.texels != NULL) {
+    // stb allocates with malloc as well
+    std::free((void *)image.texels);
+  }
+  image.texels = NULL;
+}
+
+#endif
@@ -0,0 +1,532 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Asset pack: the files under media in a single archive built offline by
+// packBuild.out. Entries are aligned and found through an open addressing
+// table keyed by the hash of their name, relative to the media directory.
+// Images are cooked to raw texels so they upload without decoding, other
+// files are stored as they are. An entry may be lz4 compressed (block
+// format, implemented below).
+// At run time the pack is mapped into memory and lookups return spans into
+// the mapping, no read call and no copy. Only compressed entries are
+// decompressed, once, into buffers the pack keeps until it is closed.
+// assetPack() is the pack of the program; Shader and the texture loaders
+// look there first and fall back to the file system when it is not open
+// or misses the file.
+
+#ifndef ASSETPACK_HPP
+#define ASSETPACK_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+const uint32_t ASSET_PACK_MAGIC = 0x4b415042; // "BPAK"
+const uint32_t ASSET_PACK_VERSION = 1;
+// entry data starts on a cache line
+const uint64_t ASSET_PACK_ALIGN = 64;
+
+// entry flags
+const uint32_t ASSET_ENTRY_USED = 1;
+const uint32_t ASSET_ENTRY_LZ4 = 2;
+const uint32_t ASSET_ENTRY_TEXTURE = 4; // starts with an AssetTextureHeader
+
+struct AssetPackHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t entryCount;
+  uint32_t tableSize; // slots, a power of two
+  uint64_t tableOffset;
+  uint64_t namesOffset;
+  uint64_t namesSize;
+};
+
+struct AssetPackEntry {
+  uint64_t hash;
+  uint64_t offset;
+  uint64_t storedSize; // bytes in the pack
+  uint64_t size;       // bytes once decompressed
+  uint32_t nameOffset;
+  uint32_t nameSize;
+  uint32_t flags;
+  uint32_t reserved;
+};
+
+// cooked image, the texels follow top row first, as stb loads them
+struct AssetTextureHeader {
+  uint32_t width;
+  uint32_t height;
+  uint32_t channels;
+  uint32_t reserved;
+};
+
+struct AssetSpan {
+  const unsigned char *data;
+  size_t size;
+  uint32_t flags;
+};
+
+uint64_t assetNameHash(const std::string &name) {
+  // fnv-1a
+  uint64_t hash = 1469598103934665603ull;
+  for (size_t i = 0; i < name.size(); i++) {
+    hash ^= (unsigned char)name[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+// lz4 block format. Greedy parse with a hash of the next four bytes, good
+// enough for offline packing; decompression checks every bound.
+size_t lz4Bound(size_t size) { return size + size / 255 + 16; }
+
+size_t lz4WriteLength(unsigned char *dst, size_t length) {
+  // the part of a length above the 4 bits of the token
+  size_t n = 0;
+  while (length >= 255) {
+    dst[n++] = 255;
+    length -= 255;
+  }
+  dst[n++] = (unsigned char)length;
+  return n;
+}
+
+size_t lz4Compress(const unsigned char *src, size_t size, unsigned char *dst,
+                   size_t capacity) {
+  // returns the compressed size, 0 if it does not fit in capacity
+  const unsigned int HASH_BITS = 16;
+  const uint32_t EMPTY = 0xffffffffu;
+  std::vector<uint32_t> table(1u << HASH_BITS, EMPTY);
+  size_t ip = 0, anchor = 0, op = 0;
+  // the last match starts 12 bytes before the end and leaves the last 5
+  // bytes as literals, as the format requires
+  while (size >= 13 && ip + 12 < size) {
+    uint32_t seq;
+    std::memcpy(&seq, src + ip, 4);
+    uint32_t h = (seq * 2654435761u) >> (32 - HASH_BITS);
+    uint32_t ref = table[h];
+    table[h] = (uint32_t)ip;
+    uint32_t refSeq = 0;
+    if (ref != EMPTY) {
+      std::memcpy(&refSeq, src + ref, 4);
+    }
+    if (ref == EMPTY || ip - ref > 65535 || refSeq != seq) {
+      ip++;
+      continue;
+    }
+    size_t match = 4;
+    while (ip + match < size - 5 && src[ref + match] == src[ip + match]) {
+      match++;
+    }
+    size_t literals = ip - anchor;
+    size_t need = 1 + literals / 255 + 1 + literals + 2 + match / 255 + 1;
+    if (op + need > capacity) {
+      return 0;
+    }
+    unsigned char *token = dst + op++;
+    *token = (unsigned char)((literals < 15 ? literals : 15) << 4);
+    if (literals >= 15) {
+      op += lz4WriteLength(dst + op, literals - 15);
+    }
+    std::memcpy(dst + op, src + anchor, literals);
+    op += literals;
+    uint32_t offset = (uint32_t)(ip - ref);
+    dst[op++] = (unsigned char)(offset & 0xff);
+    dst[op++] = (unsigned char)(offset >> 8);
+    size_t matchCode = match - 4;
+    *token |= (unsigned char)(matchCode < 15 ? matchCode : 15);
+    if (matchCode >= 15) {
+      op += lz4WriteLength(dst + op, matchCode - 15);
+    }
+    ip += match;
+    anchor = ip;
+  }
+  size_t literals = size - anchor;
+  if (op + 1 + literals / 255 + 1 + literals > capacity) {
+    return 0;
+  }
+  unsigned char *token = dst + op++;
+  *token = (unsigned char)((literals < 15 ? literals : 15) << 4);
+  if (literals >= 15) {
+    op += lz4WriteLength(dst + op, literals - 15);
+  }
+  std::memcpy(dst + op, src + anchor, literals);
+  return op + literals;
+}
+
+bool lz4Decompress(const unsigned char *src, size_t srcSize,
+                   unsigned char *dst, size_t dstSize) {
+  // true when the block decodes to exactly dstSize bytes
+  size_t ip = 0, op = 0;
+  while (ip < srcSize) {
+    unsigned char token = src[ip++];
+    size_t literals = token >> 4;
+    if (literals == 15) {
+      unsigned char b;
+      do {
+        if (ip >= srcSize) {
+          return false;
+        }
+        b = src[ip++];
+        literals += b;
+      } while (b == 255);
+    }
+    if (literals > srcSize - ip || literals > dstSize - op) {
+      return false;
+    }
+    std::memcpy(dst + op, src + ip, literals);
+    ip += literals;
+    op += literals;
+    if (ip == srcSize) {
+      // the last sequence has no match
+      break;
+    }
+    if (srcSize - ip < 2) {
+      return false;
+    }
+    size_t offset = src[ip] | (src[ip + 1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > op) {
+      return false;
+    }
+    size_t match = token & 15;
+    if (match == 15) {
+      unsigned char b;
+      do {
+        if (ip >= srcSize) {
+          return false;
+        }
+        b = src[ip++];
+        match += b;
+      } while (b == 255);
+    }
+    match += 4;
+    if (match > dstSize - op) {
+      return false;
+    }
+    // the match may overlap what it copies, byte by byte
+    for (size_t i = 0; i < match; i++) {
+      dst[op + i] = dst[op - offset + i];
+    }
+    op += match;
+  }
+  return op == dstSize;
+}
+
+class AssetPackWriter {
+public:
+  // lz4 is kept only when it saves at least a quarter of the entry
+  void add(const std::string &name, const unsigned char *data, size_t size,
+           uint32_t flags, bool compress);
+  bool write(const std::filesystem::path &packPath) const;
+  size_t count() const { return this->entries.size(); }
+
+private:
+  struct Pending {
+    std::string name;
+    std::vector<unsigned char> stored;
+    uint64_t size;
+    uint32_t flags;
+  };
+  std::vector<Pending> entries;
+};
+
+class AssetPack {
+public:
+  // lookups since open
+  unsigned int hits;
+  unsigned int misses;
+
+  AssetPack();
+  ~AssetPack() { this->close(); }
+  // names are looked up relative to root, the media directory
+  bool open(const std::filesystem::path &packPath,
+            const std::filesystem::path &root);
+  bool isOpen() const { return this->base != NULL; }
+  void close();
+
+  // safe from the loader threads, spans stay valid until close
+  bool find(const std::string &name, AssetSpan &out);
+  // a path under root, as the executables build them
+  bool findPath(const std::filesystem::path &path, AssetSpan &out);
+  void report(std::ostream &out) const;
+
+private:
+  unsigned char *base;
+  size_t mappedSize;
+  std::filesystem::path root;
+  const AssetPackHeader *header;
+  const AssetPackEntry *table;
+  // decompressed entries by slot
+  std::map<uint32_t, std::vector<unsigned char>> unpacked;
+  std::mutex lock;
+};
+
+// zero copy view of a cooked image entry
+bool assetTexture(const AssetSpan &span, AssetTextureHeader &info,
+                  const unsigned char *&texels);
+
+void AssetPackWriter::add(const std::string &name, const unsigned char *data,
+                          size_t size, uint32_t flags, bool compress) {
+  Pending p;
+  p.name = name;
+  p.size = size;
+  p.flags = flags | ASSET_ENTRY_USED;
+  if (compress && size > 0) {
+    p.stored.resize(lz4Bound(size));
+    size_t packed = lz4Compress(data, size, p.stored.data(), size - size / 4);
+    if (packed > 0) {
+      p.stored.resize(packed);
+      p.flags |= ASSET_ENTRY_LZ4;
+      this->entries.push_back(p);
+      return;
+    }
+  }
+  p.stored.assign(data, data + size);
+  this->entries.push_back(p);
+}
+
+bool AssetPackWriter::write(const std::filesystem::path &packPath) const {
+  AssetPackHeader h;
+  h.magic = ASSET_PACK_MAGIC;
+  h.version = ASSET_PACK_VERSION;
+  h.entryCount = (uint32_t)this->entries.size();
+  // at most half full so probes stay short
+  h.tableSize = 16;
+  while (h.tableSize < 2 * h.entryCount) {
+    h.tableSize *= 2;
+  }
+  h.tableOffset = sizeof(AssetPackHeader);
+  h.namesOffset = h.tableOffset + h.tableSize * sizeof(AssetPackEntry);
+  std::vector<AssetPackEntry> slots(h.tableSize);
+  std::memset(slots.data(), 0, slots.size() * sizeof(AssetPackEntry));
+  std::string names;
+  for (unsigned int i = 0; i < this->entries.size(); i++) {
+    names += this->entries[i].name;
+  }
+  h.namesSize = names.size();
+  uint64_t offset = h.namesOffset + h.namesSize;
+  uint32_t nameOffset = 0;
+  std::vector<uint64_t> offsets(this->entries.size());
+  for (unsigned int i = 0; i < this->entries.size(); i++) {
+    const Pending &p = this->entries[i];
+    offset = (offset + ASSET_PACK_ALIGN - 1) / ASSET_PACK_ALIGN *
+             ASSET_PACK_ALIGN;
+    offsets[i] = offset;
+    uint64_t hash = assetNameHash(p.name);
+    uint32_t slot = (uint32_t)hash & (h.tableSize - 1);
+    while (slots[slot].flags & ASSET_ENTRY_USED) {
+      if (slots[slot].hash == hash) {
+        std::cout << "asset pack: " << p.name << " is added twice"
+                  << std::endl;
+        return false;
+      }
+      slot = (slot + 1) & (h.tableSize - 1);
+    }
+    AssetPackEntry &e = slots[slot];
+    e.hash = hash;
+    e.offset = offset;
+    e.storedSize = p.stored.size();
+    e.size = p.size;
+    e.nameOffset = nameOffset;
+    e.nameSize = (uint32_t)p.name.size();
+    e.flags = p.flags;
+    nameOffset += e.nameSize;
+    offset += p.stored.size();
+  }
+
+  if (packPath.has_parent_path()) {
+    std::filesystem::create_directories(packPath.parent_path());
+  }
+  std::filesystem::path tmpPath = packPath;
+  tmpPath += ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary);
+    file.write((const char *)&h, sizeof(h));
+    file.write((const char *)slots.data(),
+               slots.size() * sizeof(AssetPackEntry));
+    file.write(names.data(), names.size());
+    uint64_t at = h.namesOffset + h.namesSize;
+    const char zeros[ASSET_PACK_ALIGN] = {0};
+    for (unsigned int i = 0; i < this->entries.size(); i++) {
+      file.write(zeros, offsets[i] - at);
+      const std::vector<unsigned char> &stored = this->entries[i].stored;
+      file.write((const char *)stored.data(), stored.size());
+      at = offsets[i] + stored.size();
+    }
+    if (!file) {
+      std::cout << "Failed to write asset pack: " << tmpPath << std::endl;
+      return false;
+    }
+  }
+  std::filesystem::rename(tmpPath, packPath);
+  return true;
+}
+
+AssetPack::AssetPack()
+    : hits(0), misses(0), base(NULL), mappedSize(0), header(NULL),
+      table(NULL) {}
+
+bool AssetPack::open(const std::filesystem::path &packPath,
+                     const std::filesystem::path &rootDir) {
+  this->close();
+  int fd = ::open(packPath.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(AssetPackHeader)) {
+    ::close(fd);
+    return false;
+  }
+  void *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  // the mapping keeps the file alive
+  ::close(fd);
+  if (mapped == MAP_FAILED) {
+    std::cout << "asset pack: can not map " << packPath << std::endl;
+    return false;
+  }
+  this->base = (unsigned char *)mapped;
+  this->mappedSize = (size_t)st.st_size;
+  const AssetPackHeader *h = (const AssetPackHeader *)this->base;
+  bool valid = h->magic == ASSET_PACK_MAGIC &&
+               h->version == ASSET_PACK_VERSION && h->tableSize > 0 &&
+               (h->tableSize & (h->tableSize - 1)) == 0 &&
+               h->tableOffset + h->tableSize * sizeof(AssetPackEntry) <=
+                   this->mappedSize &&
+               h->namesOffset + h->namesSize <= this->mappedSize;
+  if (!valid) {
+    std::cout << "asset pack: " << packPath << " is not a pack" << std::endl;
+    this->close();
+    return false;
+  }
+  this->header = h;
+  this->table = (const AssetPackEntry *)(this->base + h->tableOffset);
+  this->root = rootDir;
+  this->hits = 0;
+  this->misses = 0;
+  // the whole pack is read ahead in one go instead of a seek per file
+  madvise(this->base, this->mappedSize, MADV_WILLNEED);
+  return true;
+}
+
+void AssetPack::close() {
+  if (this->base != NULL) {
+    munmap(this->base, this->mappedSize);
+  }
+  this->base = NULL;
+  this->mappedSize = 0;
+  this->header = NULL;
+  this->table = NULL;
+  this->unpacked.clear();
+}
+
+bool AssetPack::find(const std::string &name, AssetSpan &out) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  if (this->base == NULL) {
+    return false;
+  }
+  uint64_t hash = assetNameHash(name);
+  uint32_t mask = this->header->tableSize - 1;
+  const char *names = (const char *)(this->base + this->header->namesOffset);
+  // a valid table always has an empty slot, a damaged one may not
+  uint32_t slot = (uint32_t)hash & mask;
+  for (uint32_t probe = 0; probe < this->header->tableSize;
+       probe++, slot = (slot + 1) & mask) {
+    const AssetPackEntry &e = this->table[slot];
+    if ((e.flags & ASSET_ENTRY_USED) == 0) {
+      this->misses++;
+      return false;
+    }
+    if (e.hash != hash || e.nameSize != name.size() ||
+        e.nameOffset + (uint64_t)e.nameSize > this->header->namesSize ||
+        std::memcmp(names + e.nameOffset, name.data(), e.nameSize) != 0) {
+      continue;
+    }
+    if (e.offset + e.storedSize > this->mappedSize) {
+      std::cout << "asset pack: entry " << name << " is truncated"
+                << std::endl;
+      this->misses++;
+      return false;
+    }
+    out.flags = e.flags;
+    out.size = e.size;
+    if ((e.flags & ASSET_ENTRY_LZ4) == 0) {
+      out.data = this->base + e.offset;
+      this->hits++;
+      return true;
+    }
+    std::map<uint32_t, std::vector<unsigned char>>::iterator it =
+        this->unpacked.find(slot);
+    if (it == this->unpacked.end()) {
+      std::vector<unsigned char> &bytes = this->unpacked[slot];
+      bytes.resize(e.size);
+      if (!lz4Decompress(this->base + e.offset, e.storedSize, bytes.data(),
+                         bytes.size())) {
+        std::cout << "asset pack: entry " << name << " is corrupt"
+                  << std::endl;
+        this->unpacked.erase(slot);
+        this->misses++;
+        return false;
+      }
+      it = this->unpacked.find(slot);
+    }
+    out.data = it->second.data();
+    this->hits++;
+    return true;
+  }
+  this->misses++;
+  return false;
+}
+
+bool AssetPack::findPath(const std::filesystem::path &path, AssetSpan &out) {
+  if (this->base == NULL) {
+    return false;
+  }
+  std::filesystem::path rel = path.lexically_relative(this->root);
+  if (rel.empty() || *rel.begin() == "..") {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->misses++;
+    return false;
+  }
+  return this->find(rel.generic_string(), out);
+}
+
+void AssetPack::report(std::ostream &out) const {
+  out << "asset pack: " << this->hits << " files from the pack, "
+      << this->misses << " from the file system" << std::endl;
+}
+
+bool assetTexture(const AssetSpan &span, AssetTextureHeader &info,
+                  const unsigned char *&texels) {
+  if ((span.flags & ASSET_ENTRY_TEXTURE) == 0 ||
+      span.size < sizeof(AssetTextureHeader)) {
+    return false;
+  }
+  std::memcpy(&info, span.data, sizeof(info));
+  size_t bytes = (size_t)info.width * info.height * info.channels;
+  if (span.size - sizeof(AssetTextureHeader) < bytes) {
+    return false;
+  }
+  texels = span.data + sizeof(AssetTextureHeader);
+  return true;
+}
+
+AssetPack &assetPack() {
+  // one pack per program, opened by main
+  static AssetPack pack;
+  return pack;
+}
+
+#endif
@@ -0,0 +1,244 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Cpu side versions of the microfacet functions in simplepbr.frag and
+// simplepbr1.frag. Angles are passed as cosines between the shading normal
+// and the direction instead of vector pairs, the math is otherwise kept
+// identical to the shaders so results can be compared one to one.
+//
+// The second half holds the same models written out consistently in a
+// local shading frame (z is the normal) together with their importance
+// sampling routines. The path tracer uses those as ground truth.
+
+#ifndef BRDF_HPP
+#define BRDF_HPP
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+const float BRDF_PI = 3.14159265f;
+
+float brdfGetSin2Theta(float cosTheta) { return 1.0f - cosTheta * cosTheta; }
+
+float brdfGetTanTheta(float cosTheta) {
+  // taken from pbr-book 3rd edition Pharr, Jakob
+  float sin2 = brdfGetSin2Theta(cosTheta);
+  return std::sqrt(sin2 > 0.0f ? sin2 : 0.0f) / cosTheta;
+}
+
+float brdfRoughnessToAlpha(float roughness) {
+  // taken from
+  // https://github.com/mmp/pbrt-v3/blob/9f717d847a807793fa966cf0eaa366852efef167/src/core/microfacet.h
+  float rough = roughness > 1e-3f ? roughness : 1e-3f;
+  float rlog = std::log(rough);
+  float t1 = 0.000640711f * rlog * rlog * rlog * rlog;
+  t1 += 0.0171201f * rlog * rlog * rlog;
+  t1 += 0.1734f * rlog * rlog;
+  t1 += 0.819955f * rlog;
+  t1 += 1.62142f;
+  return t1;
+}
+
+float brdfBsLambda(float cosTheta, float alpha) {
+  // lambda for Beckmann Spizzichino Distribution, same rational
+  // approximation as bsLambdaFn
+  float tantheta = std::fabs(brdfGetTanTheta(cosTheta));
+  float aAlpha = 1.0f / (alpha * tantheta);
+  float t2 = aAlpha * aAlpha * 0.396f;
+  float t1 = 1.0f - (aAlpha * 1.259f);
+  t1 += t2;
+  float t3 = 3.535f * aAlpha;
+  float t4 = 2.181f * aAlpha * aAlpha;
+  t3 += t4;
+  return t1 / t3;
+}
+
+float brdfBsLambdaT(float cosTheta, float roughness) {
+  // bsLamdaTFn
+  return brdfBsLambda(cosTheta, brdfRoughnessToAlpha(roughness));
+}
+
+float brdfBsNormalDistTraditional(float cosTheta, float roughness) {
+  // bsNormalDistTraditional, getTan2Theta of the shaders divides tan theta
+  // by itself so the exponent only sees the roughness
+  float tan2Half = 1.0f;
+  float rough2 = roughness * roughness;
+  float cos2 = cosTheta * cosTheta;
+  return std::exp(-tan2Half / rough2) / (cos2 * cos2 * rough2 * BRDF_PI);
+}
+
+float brdfGeometryInOut(float lambdaIn, float lambdaOut) {
+  // geometryInOut
+  return 1.0f / (1.0f + lambdaIn + lambdaOut);
+}
+
+float brdfGetCos2Phi(float cosTheta, float dirX) {
+  // getCos2Phi, the shader divides x of the direction itself by sin theta
+  float sin2 = brdfGetSin2Theta(cosTheta);
+  float radius = std::sqrt(sin2 > 0.0f ? sin2 : 0.0f);
+  float cosPhi =
+      radius == 0.0f ? 1.0f : glm::clamp(dirX / radius, -1.0f, 1.0f);
+  return cosPhi * cosPhi;
+}
+
+float brdfGetAlpha(float cos2Phi, glm::vec2 roughness) {
+  // getAlpha
+  return std::sqrt(cos2Phi * roughness.x * roughness.x +
+                   (1.0f - cos2Phi) * roughness.y * roughness.y);
+}
+
+float brdfBsNormalDistAnisotropic(float cosTheta, float cos2Phi,
+                                  glm::vec2 roughness) {
+  // bsNormalDistAnisotropic, both terms of the shader read cos2phi and
+  // the roughness cancels out of cos2phi / rx * rx
+  float costerm = cos2Phi / roughness.x * roughness.x;
+  float sinterm = cos2Phi / roughness.y * roughness.y;
+  float tan2Half = 1.0f;
+  float cos2 = cosTheta * cosTheta;
+  return std::exp(-tan2Half * (costerm + sinterm)) /
+         (cos2 * cos2 * roughness.x * roughness.y * BRDF_PI);
+}
+
+float brdfTrowReitzTraditional(float cosTheta, float roughness) {
+  // trowReitzTraditional
+  float rough2 = roughness * roughness;
+  float t = cosTheta * cosTheta * (rough2 - 1.0f) + 1.0f;
+  return rough2 / (BRDF_PI * t * t);
+}
+
+float brdfTrowReitzAnisotropic(float cosTheta, float cos2Phi,
+                               glm::vec2 roughness) {
+  // trowReitzAnisotropic, same terms as bsNormalDistAnisotropic
+  float costerm = cos2Phi / roughness.x * roughness.x;
+  float sinterm = cos2Phi / roughness.y * roughness.y;
+  float tan2Half = 1.0f;
+  float tanterm = (costerm + sinterm) * tan2Half + 1.0f;
+  float cos2 = cosTheta * cosTheta;
+  return 1.0f / (cos2 * cos2 * roughness.x * roughness.y * BRDF_PI *
+                 tanterm * tanterm);
+}
+
+float brdfTrowReitzLambda(float alpha) {
+  // trowReitzLambda, getTan2Theta is 1 as above so the direction drops out
+  float tan2Theta = 1.0f;
+  return (std::sqrt(1.0f + alpha * alpha * tan2Theta) - 1.0f) * 0.5f;
+}
+
+// microfacet models in the order of the ndf uniform of simplepbr.frag
+enum BrdfModel {
+  BRDF_BECKMANN = 0,
+  BRDF_BECKMANN_ANISO = 1,
+  BRDF_TROWREITZ = 2,
+  BRDF_TROWREITZ_ANISO = 3
+};
+
+bool brdfIsBeckmann(unsigned int model) {
+  return model == BRDF_BECKMANN || model == BRDF_BECKMANN_ANISO;
+}
+
+// shading frame helpers, taken from pbr-book 3rd edition Pharr, Jakob
+float brdfTan2Theta(const glm::vec3 &w) {
+  float cos2 = w.z * w.z;
+  return (1.0f - cos2) / cos2;
+}
+float brdfCos2Phi(const glm::vec3 &w) {
+  float sin2 = 1.0f - w.z * w.z;
+  if (sin2 <= 0.0f) {
+    return 1.0f;
+  }
+  float c = glm::clamp(w.x / std::sqrt(sin2), -1.0f, 1.0f);
+  return c * c;
+}
+
+float brdfNormalDist(const glm::vec3 &wh, float alphaX, float alphaY,
+                     unsigned int model) {
+  // isotropic models pass the same alpha twice
+  float tan2 = brdfTan2Theta(wh);
+  if (std::isinf(tan2) || std::isnan(tan2)) {
+    return 0.0f;
+  }
+  float cos2 = wh.z * wh.z;
+  float cos2Phi = brdfCos2Phi(wh);
+  float e = tan2 * (cos2Phi / (alphaX * alphaX) +
+                    (1.0f - cos2Phi) / (alphaY * alphaY));
+  if (brdfIsBeckmann(model)) {
+    return std::exp(-e) / (BRDF_PI * alphaX * alphaY * cos2 * cos2);
+  }
+  return 1.0f / (BRDF_PI * alphaX * alphaY * cos2 * cos2 * (1.0f + e) *
+                 (1.0f + e));
+}
+
+float brdfLambda(const glm::vec3 &w, float alphaX, float alphaY,
+                 unsigned int model) {
+  float tan2 = brdfTan2Theta(w);
+  if (std::isinf(tan2) || std::isnan(tan2)) {
+    return 0.0f;
+  }
+  float cos2Phi = brdfCos2Phi(w);
+  float alpha = std::sqrt(cos2Phi * alphaX * alphaX +
+                          (1.0f - cos2Phi) * alphaY * alphaY);
+  float absTan = std::sqrt(tan2);
+  if (brdfIsBeckmann(model)) {
+    float a = 1.0f / (alpha * absTan);
+    if (a >= 1.6f) {
+      return 0.0f;
+    }
+    return (1.0f - 1.259f * a + 0.396f * a * a) /
+           (3.535f * a + 2.181f * a * a);
+  }
+  float alphaTan = alpha * absTan;
+  return (std::sqrt(1.0f + alphaTan * alphaTan) - 1.0f) * 0.5f;
+}
+
+float brdfGeometry(const glm::vec3 &wo, const glm::vec3 &wi, float alphaX,
+                   float alphaY, unsigned int model) {
+  return 1.0f / (1.0f + brdfLambda(wo, alphaX, alphaY, model) +
+                 brdfLambda(wi, alphaX, alphaY, model));
+}
+
+glm::vec3 brdfFresnelSchlick(float cosTheta, const glm::vec3 &refAtZero) {
+  float m = glm::clamp(1.0f - cosTheta, 0.0f, 1.0f);
+  float m2 = m * m;
+  return refAtZero + (glm::vec3(1.0f) - refAtZero) * (m2 * m2 * m);
+}
+
+glm::vec3 brdfSampleHalfVector(const glm::vec3 &wo, float u1, float u2,
+                               float alphaX, float alphaY,
+                               unsigned int model) {
+  // samples D(wh) |cos theta_h|, taken from pbr-book 3rd edition
+  float phi = 2.0f * BRDF_PI * u2;
+  float alpha2;
+  if (alphaX == alphaY) {
+    alpha2 = alphaX * alphaX;
+  } else {
+    phi = std::atan(alphaY / alphaX *
+                    std::tan(2.0f * BRDF_PI * u2 + 0.5f * BRDF_PI));
+    if (u2 > 0.5f) {
+      phi += BRDF_PI;
+    }
+    float c = std::cos(phi);
+    float s = std::sin(phi);
+    alpha2 = 1.0f / (c * c / (alphaX * alphaX) + s * s / (alphaY * alphaY));
+  }
+  float tan2;
+  if (brdfIsBeckmann(model)) {
+    tan2 = -alpha2 * std::log(1.0f - u1);
+  } else {
+    tan2 = alpha2 * u1 / (1.0f - u1);
+  }
+  float cosTheta = 1.0f / std::sqrt(1.0f + tan2);
+  float sinTheta = std::sqrt(std::fmax(0.0f, 1.0f - cosTheta * cosTheta));
+  glm::vec3 wh(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+  if (wo.z * wh.z < 0.0f) {
+    wh = -wh;
+  }
+  return wh;
+}
+
+float brdfHalfVectorPdf(const glm::vec3 &wh, float alphaX, float alphaY,
+                        unsigned int model) {
+  return brdfNormalDist(wh, alphaX, alphaY, model) * std::fabs(wh.z);
+}
+
+#endif
@@ -0,0 +1,191 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Packet kernel of brdfpacket.hpp. There is no include guard, the file is
+// included once per instruction set with BRDF_LANE naming the lane type and
+// BRDF_KERNEL the entry point. Helpers are overloaded on the lane type and
+// follow the scalar functions of brdf.hpp operation by operation.
+
+BRDF_LANE brdfLaneExp(BRDF_LANE x) {
+  // cephes expf, x = n ln2 + r with |r| <= ln2 / 2 and a degree 5
+  // polynomial for exp(r). Results below the normal range flush to zero
+  auto tiny = x < BRDF_LANE(-87.3f);
+  x = brdfLaneMin(brdfLaneMax(x, -87.3f), 88.3762626647949f);
+  BRDF_LANE n = brdfLaneFloor(x * 1.44269504088896341f + 0.5f);
+  x = x - n * 0.693359375f + n * 2.12194440e-4f;
+  BRDF_LANE y = BRDF_LANE(1.9875691500e-4f) * x + 1.3981999507e-3f;
+  y = y * x + 8.3334519073e-3f;
+  y = y * x + 4.1665795894e-2f;
+  y = y * x + 1.6666665459e-1f;
+  y = y * x + 5.0000001201e-1f;
+  y = y * x * x + x + 1.0f;
+  return brdfLaneSelect(tiny, 0.0f, y * brdfLanePow2i(n));
+}
+
+BRDF_LANE brdfLaneLog(BRDF_LANE x) {
+  // cephes logf for x > 0, x = m 2^e with m in [sqrt(1/2), sqrt(2))
+  BRDF_LANE e;
+  BRDF_LANE m = brdfLaneFrexp(x, e);
+  auto small = m < BRDF_LANE(0.707106781186547524f);
+  e = brdfLaneSelect(small, e - 1.0f, e);
+  m = brdfLaneSelect(small, m + m, m) - 1.0f;
+  BRDF_LANE z = m * m;
+  BRDF_LANE y = BRDF_LANE(7.0376836292e-2f) * m - 1.1514610310e-1f;
+  y = y * m + 1.1676998740e-1f;
+  y = y * m - 1.2420140846e-1f;
+  y = y * m + 1.4249322787e-1f;
+  y = y * m - 1.6668057665e-1f;
+  y = y * m + 2.0000714765e-1f;
+  y = y * m - 2.4999993993e-1f;
+  y = y * m + 3.3333331174e-1f;
+  y = y * m * z;
+  y = y - e * 2.12194440e-4f - z * 0.5f;
+  return m + y + e * 0.693359375f;
+}
+
+BRDF_LANE brdfLaneRoughnessToAlpha(BRDF_LANE roughness) {
+  BRDF_LANE rlog = brdfLaneLog(brdfLaneMax(roughness, 1e-3f));
+  BRDF_LANE t1 = BRDF_LANE(0.000640711f) * rlog + 0.0171201f;
+  t1 = t1 * rlog + 0.1734f;
+  t1 = t1 * rlog + 0.819955f;
+  return t1 * rlog + 1.62142f;
+}
+
+BRDF_LANE brdfLaneBsLambda(BRDF_LANE cosTheta, BRDF_LANE alpha) {
+  BRDF_LANE sin2 = 1.0f - cosTheta * cosTheta;
+  BRDF_LANE tantheta =
+      brdfLaneAbs(brdfLaneSqrt(brdfLaneMax(sin2, 0.0f)) / cosTheta);
+  BRDF_LANE aAlpha = 1.0f / (alpha * tantheta);
+  BRDF_LANE t1 = 1.0f - aAlpha * 1.259f + aAlpha * aAlpha * 0.396f;
+  BRDF_LANE t3 = 3.535f * aAlpha + 2.181f * aAlpha * aAlpha;
+  return t1 / t3;
+}
+
+BRDF_LANE brdfLaneBsNormalDistTraditional(BRDF_LANE cosTheta,
+                                          BRDF_LANE roughness) {
+  BRDF_LANE rough2 = roughness * roughness;
+  BRDF_LANE cos2 = cosTheta * cosTheta;
+  return brdfLaneExp(0.0f - 1.0f / rough2) /
+         (cos2 * cos2 * rough2 * BRDF_PI);
+}
+
+BRDF_LANE brdfLaneGetCos2Phi(BRDF_LANE cosTheta, BRDF_LANE dirX) {
+  BRDF_LANE radius =
+      brdfLaneSqrt(brdfLaneMax(1.0f - cosTheta * cosTheta, 0.0f));
+  BRDF_LANE cosPhi = brdfLaneMin(brdfLaneMax(dirX / radius, -1.0f), 1.0f);
+  cosPhi = brdfLaneSelect(radius == BRDF_LANE(0.0f), 1.0f, cosPhi);
+  return cosPhi * cosPhi;
+}
+
+BRDF_LANE brdfLaneGetAlpha(BRDF_LANE cos2Phi, BRDF_LANE roughX,
+                           BRDF_LANE roughY) {
+  return brdfLaneSqrt(cos2Phi * roughX * roughX +
+                      (1.0f - cos2Phi) * roughY * roughY);
+}
+
+BRDF_LANE brdfLaneAnisotropicTerm(BRDF_LANE cos2Phi, BRDF_LANE roughX,
+                                  BRDF_LANE roughY) {
+  // costerm + sinterm of the anisotropic distributions
+  return cos2Phi / roughX * roughX + cos2Phi / roughY * roughY;
+}
+
+BRDF_LANE brdfLaneBsNormalDistAnisotropic(BRDF_LANE cosTheta,
+                                          BRDF_LANE cos2Phi,
+                                          BRDF_LANE roughX,
+                                          BRDF_LANE roughY) {
+  BRDF_LANE cos2 = cosTheta * cosTheta;
+  BRDF_LANE term = brdfLaneAnisotropicTerm(cos2Phi, roughX, roughY);
+  return brdfLaneExp(0.0f - term) /
+         (cos2 * cos2 * roughX * roughY * BRDF_PI);
+}
+
+BRDF_LANE brdfLaneTrowReitzTraditional(BRDF_LANE cosTheta,
+                                       BRDF_LANE roughness) {
+  BRDF_LANE rough2 = roughness * roughness;
+  BRDF_LANE t = cosTheta * cosTheta * (rough2 - 1.0f) + 1.0f;
+  return rough2 / (BRDF_PI * t * t);
+}
+
+BRDF_LANE brdfLaneTrowReitzAnisotropic(BRDF_LANE cosTheta, BRDF_LANE cos2Phi,
+                                       BRDF_LANE roughX, BRDF_LANE roughY) {
+  BRDF_LANE tanterm = brdfLaneAnisotropicTerm(cos2Phi, roughX, roughY) + 1.0f;
+  BRDF_LANE cos2 = cosTheta * cosTheta;
+  return 1.0f /
+         (cos2 * cos2 * roughX * roughY * BRDF_PI * tanterm * tanterm);
+}
+
+BRDF_LANE brdfLaneTrowReitzLambda(BRDF_LANE alpha) {
+  return (brdfLaneSqrt(1.0f + alpha * alpha) - 1.0f) * 0.5f;
+}
+
+void BRDF_KERNEL(BrdfPacket &packet, unsigned int model, unsigned int begin,
+                 unsigned int end) {
+  const unsigned int width = sizeof(BRDF_LANE) / sizeof(float);
+  for (unsigned int i = begin; i < end; i += width) {
+    BRDF_LANE n[3], v[3], l[3], h[3];
+    for (unsigned int c = 0; c < 3; c++) {
+      n[c] = BRDF_LANE::load(&packet.normal[c][i]);
+      v[c] = BRDF_LANE::load(&packet.view[c][i]);
+      l[c] = BRDF_LANE::load(&packet.light[c][i]);
+      h[c] = v[c] + l[c];
+    }
+    BRDF_LANE hlen = brdfLaneSqrt(h[0] * h[0] + h[1] * h[1] + h[2] * h[2]);
+    for (unsigned int c = 0; c < 3; c++) {
+      h[c] = h[c] / hlen;
+    }
+    BRDF_LANE hcostheta = n[0] * h[0] + n[1] * h[1] + n[2] * h[2];
+    BRDF_LANE vcostheta = n[0] * v[0] + n[1] * v[1] + n[2] * v[2];
+    BRDF_LANE lcostheta = n[0] * l[0] + n[1] * l[1] + n[2] * l[2];
+    BRDF_LANE roughX = BRDF_LANE::load(&packet.roughness[0][i]);
+    BRDF_LANE roughY = BRDF_LANE::load(&packet.roughness[1][i]);
+
+    // the model is uniform over the packet like the ndf uniform
+    BRDF_LANE dN, lambdaIn, lambdaOut;
+    if (model == BRDF_BECKMANN) {
+      BRDF_LANE alpha = brdfLaneRoughnessToAlpha(roughX);
+      dN = brdfLaneBsNormalDistTraditional(hcostheta, roughX);
+      lambdaIn = brdfLaneBsLambda(hcostheta, alpha);
+      lambdaOut = brdfLaneBsLambda(vcostheta, alpha);
+    } else if (model == BRDF_BECKMANN_ANISO) {
+      BRDF_LANE hcos2Phi = brdfLaneGetCos2Phi(hcostheta, h[0]);
+      BRDF_LANE vcos2Phi = brdfLaneGetCos2Phi(vcostheta, v[0]);
+      dN = brdfLaneBsNormalDistAnisotropic(hcostheta, hcos2Phi, roughX,
+                                           roughY);
+      lambdaIn = brdfLaneBsLambda(
+          hcostheta, brdfLaneGetAlpha(hcos2Phi, roughX, roughY));
+      lambdaOut = brdfLaneBsLambda(
+          vcostheta, brdfLaneGetAlpha(vcos2Phi, roughX, roughY));
+    } else if (model == BRDF_TROWREITZ) {
+      dN = brdfLaneTrowReitzTraditional(hcostheta, roughX);
+      lambdaIn = brdfLaneTrowReitzLambda(brdfLaneRoughnessToAlpha(roughX));
+      lambdaOut = lambdaIn;
+    } else {
+      BRDF_LANE hcos2Phi = brdfLaneGetCos2Phi(hcostheta, h[0]);
+      BRDF_LANE vcos2Phi = brdfLaneGetCos2Phi(vcostheta, v[0]);
+      dN = brdfLaneTrowReitzAnisotropic(hcostheta, hcos2Phi, roughX, roughY);
+      lambdaIn =
+          brdfLaneTrowReitzLambda(brdfLaneGetAlpha(hcos2Phi, roughX, roughY));
+      lambdaOut =
+          brdfLaneTrowReitzLambda(brdfLaneGetAlpha(vcos2Phi, roughX, roughY));
+    }
+    BRDF_LANE gD = 1.0f / (1.0f + lambdaIn + lambdaOut);
+    BRDF_LANE m = brdfLaneMin(brdfLaneMax(1.0f - hcostheta, 0.0f), 1.0f);
+    BRDF_LANE m5 = m * m;
+    m5 = m5 * m5 * m;
+    BRDF_LANE t2 = brdfLaneMax(4.0f * vcostheta * lcostheta, 0.0001f);
+    BRDF_LANE specularScale = dN * gD / t2;
+    BRDF_LANE metallicX = BRDF_LANE::load(&packet.metallic[0][i]);
+    BRDF_LANE albedoX = BRDF_LANE::load(&packet.albedo[0][i]);
+    BRDF_LANE diffuse = (1.0f - metallicX) * albedoX / BRDF_PI;
+    for (unsigned int c = 0; c < 3; c++) {
+      BRDF_LANE albedo = BRDF_LANE::load(&packet.albedo[c][i]);
+      BRDF_LANE metallic = BRDF_LANE::load(&packet.metallic[c][i]);
+      // mix(vec3(0.04), metallic, albedo)
+      BRDF_LANE refAtZero = 0.04f * (1.0f - albedo) + metallic * albedo;
+      BRDF_LANE fresnel = refAtZero + (1.0f - refAtZero) * m5;
+      BRDF_LANE result =
+          ((1.0f - fresnel) * diffuse + specularScale * fresnel) * lcostheta;
+      result.store(&packet.result[c][i]);
+    }
+  }
+}
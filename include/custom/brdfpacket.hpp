@@ -0,0 +1,524 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Packets of shading samples evaluated with the brdf of simplepbr.frag.
+// Samples are stored as structure of arrays and run 4, 8 or 16 at a time
+// with sse2, avx2 or avx512 kernels. The widest instruction set the cpu
+// supports is picked at runtime, the kernels themselves are compiled from
+// brdfkernel.hpp once per instruction set.
+//
+// A packet evaluates what the light loop of the shader multiplies with the
+// radiance and the shadow term
+//   (kd * albedo.r / PI + specular) * dot(N, L)
+// brdfShaderEval is the scalar reference built from the functions of
+// brdf.hpp.
+
+#ifndef BRDFPACKET_HPP
+#define BRDFPACKET_HPP
+
+#include <glm/glm.hpp>
+
+#include <custom/brdf.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BRDF_USE_SSE 1
+#endif
+
+// avx kernels need per function target attributes
+#if defined(BRDF_USE_SSE) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define BRDF_USE_AVX 1
+#endif
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+// every array of a packet is padded to this many samples so kernels never
+// need a tail loop
+const unsigned int BRDF_PACKET_PAD = 16;
+
+enum BrdfIsa {
+  BRDF_ISA_SCALAR = 0,
+  BRDF_ISA_SSE2 = 1,
+  BRDF_ISA_AVX2 = 2,
+  BRDF_ISA_AVX512 = 3
+};
+
+const char *brdfIsaName(unsigned int isa) {
+  const char *names[] = {"scalar", "sse2", "avx2", "avx512"};
+  return isa <= BRDF_ISA_AVX512 ? names[isa] : "unknown";
+}
+
+struct BrdfPacket {
+  unsigned int count = 0;
+  // unit vectors, light and view point away from the surface
+  std::vector<float> normal[3];
+  std::vector<float> view[3];
+  std::vector<float> light[3];
+  std::vector<float> roughness[2];
+  std::vector<float> albedo[3];
+  std::vector<float> metallic[3];
+  // brdf times cos theta of the light
+  std::vector<float> result[3];
+
+  void resize(unsigned int count);
+  void set(unsigned int i, glm::vec3 normal, glm::vec3 view, glm::vec3 light,
+           glm::vec2 roughness, glm::vec3 albedo, glm::vec3 metallic);
+  glm::vec3 getResult(unsigned int i) const;
+};
+
+void BrdfPacket::resize(unsigned int n) {
+  this->count = n;
+  unsigned int padded = (n + BRDF_PACKET_PAD - 1) / BRDF_PACKET_PAD;
+  padded *= BRDF_PACKET_PAD;
+  for (unsigned int c = 0; c < 3; c++) {
+    // padding lanes hold a valid sample so they stay finite
+    this->normal[c].assign(padded, c == 2 ? 1.0f : 0.0f);
+    this->view[c].assign(padded, c == 2 ? 1.0f : 0.0f);
+    this->light[c].assign(padded, c == 2 ? 1.0f : 0.0f);
+    this->albedo[c].assign(padded, 0.0f);
+    this->metallic[c].assign(padded, 0.0f);
+    this->result[c].assign(padded, 0.0f);
+  }
+  this->roughness[0].assign(padded, 0.5f);
+  this->roughness[1].assign(padded, 0.5f);
+}
+
+void BrdfPacket::set(unsigned int i, glm::vec3 n, glm::vec3 v, glm::vec3 l,
+                     glm::vec2 rough, glm::vec3 alb, glm::vec3 metal) {
+  for (unsigned int c = 0; c < 3; c++) {
+    this->normal[c][i] = n[c];
+    this->view[c][i] = v[c];
+    this->light[c][i] = l[c];
+    this->albedo[c][i] = alb[c];
+    this->metallic[c][i] = metal[c];
+  }
+  this->roughness[0][i] = rough.x;
+  this->roughness[1][i] = rough.y;
+}
+
+glm::vec3 BrdfPacket::getResult(unsigned int i) const {
+  return glm::vec3(this->result[0][i], this->result[1][i],
+                   this->result[2][i]);
+}
+
+glm::vec3 brdfShaderEval(glm::vec3 normal, glm::vec3 viewDir,
+                         glm::vec3 lightDir, glm::vec2 roughness,
+                         glm::vec3 albedo, glm::vec3 metallic,
+                         unsigned int model) {
+  // light loop of simplepbr.frag without radiance and shadow
+  glm::vec3 halfDir = glm::normalize(viewDir + lightDir);
+  float hcostheta = glm::dot(normal, halfDir);
+  float vcostheta = glm::dot(normal, viewDir);
+  float lcostheta = glm::dot(normal, lightDir);
+  glm::vec3 refAtZero = glm::mix(glm::vec3(0.04f), metallic, albedo);
+  glm::vec3 fresnel = brdfFresnelSchlick(hcostheta, refAtZero);
+  float dN, lambdaIn, lambdaOut;
+  if (model == BRDF_BECKMANN) {
+    dN = brdfBsNormalDistTraditional(hcostheta, roughness.x);
+    lambdaIn = brdfBsLambdaT(hcostheta, roughness.x);
+    lambdaOut = brdfBsLambdaT(vcostheta, roughness.x);
+  } else if (model == BRDF_BECKMANN_ANISO) {
+    float hcos2Phi = brdfGetCos2Phi(hcostheta, halfDir.x);
+    float vcos2Phi = brdfGetCos2Phi(vcostheta, viewDir.x);
+    dN = brdfBsNormalDistAnisotropic(hcostheta, hcos2Phi, roughness);
+    lambdaIn = brdfBsLambda(hcostheta, brdfGetAlpha(hcos2Phi, roughness));
+    lambdaOut = brdfBsLambda(vcostheta, brdfGetAlpha(vcos2Phi, roughness));
+  } else if (model == BRDF_TROWREITZ) {
+    dN = brdfTrowReitzTraditional(hcostheta, roughness.x);
+    lambdaIn = brdfTrowReitzLambda(brdfRoughnessToAlpha(roughness.x));
+    lambdaOut = lambdaIn;
+  } else {
+    float hcos2Phi = brdfGetCos2Phi(hcostheta, halfDir.x);
+    float vcos2Phi = brdfGetCos2Phi(vcostheta, viewDir.x);
+    dN = brdfTrowReitzAnisotropic(hcostheta, hcos2Phi, roughness);
+    lambdaIn = brdfTrowReitzLambda(brdfGetAlpha(hcos2Phi, roughness));
+    lambdaOut = brdfTrowReitzLambda(brdfGetAlpha(vcos2Phi, roughness));
+  }
+  float gD = brdfGeometryInOut(lambdaIn, lambdaOut);
+  glm::vec3 kd = (glm::vec3(1.0f) - fresnel) * (1.0f - metallic.x);
+  float t2 = std::fmax(4.0f * vcostheta * lcostheta, 0.0001f);
+  glm::vec3 specular = dN * gD * fresnel / t2;
+  return (kd * albedo.x / BRDF_PI + specular) * lcostheta;
+}
+
+void brdfEvaluateScalar(BrdfPacket &packet, unsigned int model,
+                        unsigned int begin, unsigned int end) {
+  for (unsigned int i = begin; i < end; i++) {
+    glm::vec3 n(packet.normal[0][i], packet.normal[1][i],
+                packet.normal[2][i]);
+    glm::vec3 v(packet.view[0][i], packet.view[1][i], packet.view[2][i]);
+    glm::vec3 l(packet.light[0][i], packet.light[1][i], packet.light[2][i]);
+    glm::vec2 rough(packet.roughness[0][i], packet.roughness[1][i]);
+    glm::vec3 alb(packet.albedo[0][i], packet.albedo[1][i],
+                  packet.albedo[2][i]);
+    glm::vec3 metal(packet.metallic[0][i], packet.metallic[1][i],
+                    packet.metallic[2][i]);
+    glm::vec3 r = brdfShaderEval(n, v, l, rough, alb, metal, model);
+    packet.result[0][i] = r.x;
+    packet.result[1][i] = r.y;
+    packet.result[2][i] = r.z;
+  }
+}
+
+// lane types, a lane type wraps one register and brings the operators and
+// the brdfLane* primitives brdfkernel.hpp is written against
+
+#ifdef BRDF_USE_SSE
+struct BrdfLane4 {
+  __m128 v;
+  BrdfLane4() {}
+  BrdfLane4(__m128 x) : v(x) {}
+  BrdfLane4(float x) : v(_mm_set1_ps(x)) {}
+  static BrdfLane4 load(const float *p) { return _mm_loadu_ps(p); }
+  void store(float *p) const { _mm_storeu_ps(p, this->v); }
+};
+struct BrdfMask4 {
+  __m128 m;
+};
+BrdfLane4 operator+(BrdfLane4 a, BrdfLane4 b) {
+  return _mm_add_ps(a.v, b.v);
+}
+BrdfLane4 operator-(BrdfLane4 a, BrdfLane4 b) {
+  return _mm_sub_ps(a.v, b.v);
+}
+BrdfLane4 operator*(BrdfLane4 a, BrdfLane4 b) {
+  return _mm_mul_ps(a.v, b.v);
+}
+BrdfLane4 operator/(BrdfLane4 a, BrdfLane4 b) {
+  return _mm_div_ps(a.v, b.v);
+}
+BrdfMask4 operator<(BrdfLane4 a, BrdfLane4 b) {
+  return {_mm_cmplt_ps(a.v, b.v)};
+}
+BrdfMask4 operator==(BrdfLane4 a, BrdfLane4 b) {
+  return {_mm_cmpeq_ps(a.v, b.v)};
+}
+BrdfLane4 brdfLaneSelect(BrdfMask4 m, BrdfLane4 a, BrdfLane4 b) {
+  return _mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v));
+}
+BrdfLane4 brdfLaneMin(BrdfLane4 a, BrdfLane4 b) {
+  return _mm_min_ps(a.v, b.v);
+}
+BrdfLane4 brdfLaneMax(BrdfLane4 a, BrdfLane4 b) {
+  return _mm_max_ps(a.v, b.v);
+}
+BrdfLane4 brdfLaneSqrt(BrdfLane4 a) { return _mm_sqrt_ps(a.v); }
+BrdfLane4 brdfLaneAbs(BrdfLane4 a) {
+  return _mm_and_ps(a.v, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)));
+}
+BrdfLane4 brdfLaneFloor(BrdfLane4 a) {
+  // sse2 has no rounding mode instructions, truncate and fix negatives
+  __m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+  return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, a.v), _mm_set1_ps(1.0f)));
+}
+BrdfLane4 brdfLanePow2i(BrdfLane4 n) {
+  // 2^n for integer valued n in [-126, 127]
+  __m128i e = _mm_add_epi32(_mm_cvttps_epi32(n.v), _mm_set1_epi32(127));
+  return _mm_castsi128_ps(_mm_slli_epi32(e, 23));
+}
+BrdfLane4 brdfLaneFrexp(BrdfLane4 x, BrdfLane4 &exponent) {
+  // x = mantissa 2^exponent with the mantissa in [0.5, 1), x > 0
+  __m128i bits = _mm_castps_si128(x.v);
+  __m128i e = _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126));
+  exponent = _mm_cvtepi32_ps(e);
+  bits = _mm_and_si128(bits, _mm_set1_epi32(0x007fffff));
+  return _mm_castsi128_ps(_mm_or_si128(bits, _mm_set1_epi32(0x3f000000)));
+}
+
+#define BRDF_LANE BrdfLane4
+#define BRDF_KERNEL brdfEvaluateSse2
+#include <custom/brdfkernel.hpp>
+#undef BRDF_LANE
+#undef BRDF_KERNEL
+#endif
+
+#ifdef BRDF_USE_AVX
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,fma"))),           \
+                             apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+struct BrdfLane8 {
+  __m256 v;
+  BrdfLane8() {}
+  BrdfLane8(__m256 x) : v(x) {}
+  BrdfLane8(float x) : v(_mm256_set1_ps(x)) {}
+  static BrdfLane8 load(const float *p) { return _mm256_loadu_ps(p); }
+  void store(float *p) const { _mm256_storeu_ps(p, this->v); }
+};
+struct BrdfMask8 {
+  __m256 m;
+};
+BrdfLane8 operator+(BrdfLane8 a, BrdfLane8 b) {
+  return _mm256_add_ps(a.v, b.v);
+}
+BrdfLane8 operator-(BrdfLane8 a, BrdfLane8 b) {
+  return _mm256_sub_ps(a.v, b.v);
+}
+BrdfLane8 operator*(BrdfLane8 a, BrdfLane8 b) {
+  return _mm256_mul_ps(a.v, b.v);
+}
+BrdfLane8 operator/(BrdfLane8 a, BrdfLane8 b) {
+  return _mm256_div_ps(a.v, b.v);
+}
+BrdfMask8 operator<(BrdfLane8 a, BrdfLane8 b) {
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)};
+}
+BrdfMask8 operator==(BrdfLane8 a, BrdfLane8 b) {
+  return {_mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ)};
+}
+BrdfLane8 brdfLaneSelect(BrdfMask8 m, BrdfLane8 a, BrdfLane8 b) {
+  return _mm256_blendv_ps(b.v, a.v, m.m);
+}
+BrdfLane8 brdfLaneMin(BrdfLane8 a, BrdfLane8 b) {
+  return _mm256_min_ps(a.v, b.v);
+}
+BrdfLane8 brdfLaneMax(BrdfLane8 a, BrdfLane8 b) {
+  return _mm256_max_ps(a.v, b.v);
+}
+BrdfLane8 brdfLaneSqrt(BrdfLane8 a) { return _mm256_sqrt_ps(a.v); }
+BrdfLane8 brdfLaneAbs(BrdfLane8 a) {
+  return _mm256_and_ps(a.v,
+                       _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff)));
+}
+BrdfLane8 brdfLaneFloor(BrdfLane8 a) { return _mm256_floor_ps(a.v); }
+BrdfLane8 brdfLanePow2i(BrdfLane8 n) {
+  __m256i e =
+      _mm256_add_epi32(_mm256_cvttps_epi32(n.v), _mm256_set1_epi32(127));
+  return _mm256_castsi256_ps(_mm256_slli_epi32(e, 23));
+}
+BrdfLane8 brdfLaneFrexp(BrdfLane8 x, BrdfLane8 &exponent) {
+  __m256i bits = _mm256_castps_si256(x.v);
+  __m256i e =
+      _mm256_sub_epi32(_mm256_srli_epi32(bits, 23), _mm256_set1_epi32(126));
+  exponent = _mm256_cvtepi32_ps(e);
+  bits = _mm256_and_si256(bits, _mm256_set1_epi32(0x007fffff));
+  return _mm256_castsi256_ps(
+      _mm256_or_si256(bits, _mm256_set1_epi32(0x3f000000)));
+}
+
+#define BRDF_LANE BrdfLane8
+#define BRDF_KERNEL brdfEvaluateAvx2
+#include <custom/brdfkernel.hpp>
+#undef BRDF_LANE
+#undef BRDF_KERNEL
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC pop_options
+#endif
+
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx512f"))),            \
+                             apply_to = function)
+#else
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+// _mm512_undefined_ps trips -Wuninitialized in some gcc versions
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+struct BrdfLane16 {
+  __m512 v;
+  BrdfLane16() {}
+  BrdfLane16(__m512 x) : v(x) {}
+  BrdfLane16(float x) : v(_mm512_set1_ps(x)) {}
+  static BrdfLane16 load(const float *p) { return _mm512_loadu_ps(p); }
+  void store(float *p) const { _mm512_storeu_ps(p, this->v); }
+};
+struct BrdfMask16 {
+  __mmask16 m;
+};
+BrdfLane16 operator+(BrdfLane16 a, BrdfLane16 b) {
+  return _mm512_add_ps(a.v, b.v);
+}
+BrdfLane16 operator-(BrdfLane16 a, BrdfLane16 b) {
+  return _mm512_sub_ps(a.v, b.v);
+}
+BrdfLane16 operator*(BrdfLane16 a, BrdfLane16 b) {
+  return _mm512_mul_ps(a.v, b.v);
+}
+BrdfLane16 operator/(BrdfLane16 a, BrdfLane16 b) {
+  return _mm512_div_ps(a.v, b.v);
+}
+BrdfMask16 operator<(BrdfLane16 a, BrdfLane16 b) {
+  return {_mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ)};
+}
+BrdfMask16 operator==(BrdfLane16 a, BrdfLane16 b) {
+  return {_mm512_cmp_ps_mask(a.v, b.v, _CMP_EQ_OQ)};
+}
+BrdfLane16 brdfLaneSelect(BrdfMask16 m, BrdfLane16 a, BrdfLane16 b) {
+  return _mm512_mask_blend_ps(m.m, b.v, a.v);
+}
+BrdfLane16 brdfLaneMin(BrdfLane16 a, BrdfLane16 b) {
+  return _mm512_min_ps(a.v, b.v);
+}
+BrdfLane16 brdfLaneMax(BrdfLane16 a, BrdfLane16 b) {
+  return _mm512_max_ps(a.v, b.v);
+}
+BrdfLane16 brdfLaneSqrt(BrdfLane16 a) { return _mm512_sqrt_ps(a.v); }
+BrdfLane16 brdfLaneAbs(BrdfLane16 a) {
+  return _mm512_castsi512_ps(_mm512_and_si512(
+      _mm512_castps_si512(a.v), _mm512_set1_epi32(0x7fffffff)));
+}
+BrdfLane16 brdfLaneFloor(BrdfLane16 a) {
+  return _mm512_roundscale_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+}
+BrdfLane16 brdfLanePow2i(BrdfLane16 n) {
+  __m512i e =
+      _mm512_add_epi32(_mm512_cvttps_epi32(n.v), _mm512_set1_epi32(127));
+  return _mm512_castsi512_ps(_mm512_slli_epi32(e, 23));
+}
+BrdfLane16 brdfLaneFrexp(BrdfLane16 x, BrdfLane16 &exponent) {
+  __m512i bits = _mm512_castps_si512(x.v);
+  __m512i e =
+      _mm512_sub_epi32(_mm512_srli_epi32(bits, 23), _mm512_set1_epi32(126));
+  exponent = _mm512_cvtepi32_ps(e);
+  bits = _mm512_and_si512(bits, _mm512_set1_epi32(0x007fffff));
+  return _mm512_castsi512_ps(
+      _mm512_or_si512(bits, _mm512_set1_epi32(0x3f000000)));
+}
+
+#define BRDF_LANE BrdfLane16
+#define BRDF_KERNEL brdfEvaluateAvx512
+#include <custom/brdfkernel.hpp>
+#undef BRDF_LANE
+#undef BRDF_KERNEL
+#if defined(__clang__)
+#pragma clang attribute pop
+#else
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+#endif
+#endif
+
+BrdfIsa brdfDetectIsa() {
+  // widest instruction set of this cpu, the os support for the wider
+  // registers is part of the check
+#ifdef BRDF_USE_AVX
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    return BRDF_ISA_AVX512;
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    return BRDF_ISA_AVX2;
+  }
+#endif
+#ifdef BRDF_USE_SSE
+  return BRDF_ISA_SSE2;
+#else
+  return BRDF_ISA_SCALAR;
+#endif
+}
+
+void brdfEvaluatePacket(BrdfPacket &packet, unsigned int model,
+                        unsigned int begin, unsigned int end, BrdfIsa isa) {
+  // begin is a multiple of BRDF_PACKET_PAD, end is rounded up into the
+  // padding. isa must not be wider than brdfDetectIsa()
+  unsigned int padded = (unsigned int)packet.result[0].size();
+  end = (end + BRDF_PACKET_PAD - 1) / BRDF_PACKET_PAD * BRDF_PACKET_PAD;
+  end = end < padded ? end : padded;
+  switch (isa) {
+#ifdef BRDF_USE_AVX
+  case BRDF_ISA_AVX512:
+    brdfEvaluateAvx512(packet, model, begin, end);
+    break;
+  case BRDF_ISA_AVX2:
+    brdfEvaluateAvx2(packet, model, begin, end);
+    break;
+#endif
+#ifdef BRDF_USE_SSE
+  case BRDF_ISA_SSE2:
+    brdfEvaluateSse2(packet, model, begin, end);
+    break;
+#endif
+  default:
+    brdfEvaluateScalar(packet, model, begin, end);
+  }
+}
+
+void brdfEvaluatePacket(BrdfPacket &packet, unsigned int model) {
+  static BrdfIsa isa = brdfDetectIsa();
+  brdfEvaluatePacket(packet, model, 0, packet.count, isa);
+}
+
+void brdfRandomPacket(BrdfPacket &packet, unsigned int count,
+                      unsigned int seed) {
+  // normals anywhere on the sphere, view and light in the hemisphere of
+  // the normal as the shader sees them on lit front faces
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> uni(0.0f, 1.0f);
+  auto sphere = [&]() {
+    float z = 1.0f - 2.0f * uni(rng);
+    float r = std::sqrt(std::fmax(0.0f, 1.0f - z * z));
+    float phi = 2.0f * BRDF_PI * uni(rng);
+    return glm::vec3(r * std::cos(phi), r * std::sin(phi), z);
+  };
+  auto hemisphere = [&](glm::vec3 n) {
+    glm::vec3 w = sphere();
+    float c = glm::dot(w, n);
+    w = c < 0.0f ? -w : w;
+    // stay away from the horizon where lambda is unbounded
+    return std::fabs(c) < 0.02f ? glm::normalize(w + 0.05f * n) : w;
+  };
+  packet.resize(count);
+  for (unsigned int i = 0; i < count; i++) {
+    glm::vec3 n = sphere();
+    glm::vec3 v = hemisphere(n);
+    glm::vec3 l = hemisphere(n);
+    glm::vec2 rough(0.05f + 0.95f * uni(rng), 0.05f + 0.95f * uni(rng));
+    glm::vec3 albedo(uni(rng), uni(rng), uni(rng));
+    glm::vec3 metallic(uni(rng), uni(rng), uni(rng));
+    packet.set(i, n, v, l, rough, albedo, metallic);
+  }
+}
+
+void reportBrdfPacketAccuracy(BrdfPacket &packet, BrdfIsa isa,
+                              std::ostream &out) {
+  // compares every model of the kernel against brdfShaderEval, errors are
+  // relative with a floor of 1e-2 since the specular peak spans decades
+  const char *modelNames[] = {"beckmann", "beckmann aniso", "trowreitz",
+                              "trowreitz aniso"};
+  for (unsigned int model = 0; model < 4; model++) {
+    brdfEvaluateScalar(packet, model, 0, packet.count);
+    std::vector<glm::vec3> reference(packet.count);
+    for (unsigned int i = 0; i < packet.count; i++) {
+      reference[i] = packet.getResult(i);
+    }
+    brdfEvaluatePacket(packet, model, 0, packet.count, isa);
+    double maxErr = 0.0;
+    double sumErr = 0.0;
+    unsigned int nanMismatch = 0;
+    for (unsigned int i = 0; i < packet.count; i++) {
+      glm::vec3 got = packet.getResult(i);
+      for (unsigned int c = 0; c < 3; c++) {
+        if (std::isnan(got[c]) != std::isnan(reference[i][c])) {
+          nanMismatch++;
+          continue;
+        }
+        if (std::isnan(got[c])) {
+          continue;
+        }
+        double err = std::fabs(got[c] - reference[i][c]) /
+                     std::fmax(std::fabs(reference[i][c]), 1e-2);
+        maxErr = std::fmax(maxErr, err);
+        sumErr += err;
+      }
+    }
+    out << "  " << std::left << std::setw(8) << brdfIsaName(isa)
+        << std::setw(17) << modelNames[model] << std::right
+        << std::scientific << std::setprecision(3) << "max rel " << maxErr
+        << "  mean " << sumErr / (3.0 * packet.count) << std::defaultfloat
+        << "  nan mismatches " << nanMismatch << std::endl;
+  }
+}
+
+#endif
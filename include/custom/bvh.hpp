@@ -0,0 +1,449 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Bounding volume hierarchy over triangles for the cpu path tracer.
+// Built top down with a binned surface area heuristic. Leaves keep their
+// triangles in packs of four laid out as structure of arrays so a ray is
+// tested against four triangles at once with sse.
+
+#ifndef BVH_HPP
+#define BVH_HPP
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define BVH_USE_SSE 1
+#endif
+
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+const uint32_t BVH_BIN_COUNT = 16;
+const uint32_t BVH_PACK_WIDTH = 4;
+const uint32_t BVH_MAX_LEAF_SIZE = 8;
+const uint32_t BVH_MAX_DEPTH = 60;
+const uint32_t BVH_STACK_SIZE = 64;
+const uint32_t BVH_INVALID = 0xffffffffu;
+// relative costs of a box test and a triangle pack test
+const float BVH_TRAVERSAL_COST = 1.0f;
+const float BVH_PACK_COST = 1.0f;
+
+struct BvhRay {
+  glm::vec3 origin;
+  glm::vec3 dir;
+  glm::vec3 invDir;
+  float tMin;
+  float tMax;
+  BvhRay(glm::vec3 o, glm::vec3 d, float tmin = 1e-4f, float tmax = FLT_MAX)
+      : origin(o), dir(d), invDir(1.0f / d), tMin(tmin), tMax(tmax) {}
+};
+
+struct BvhHit {
+  float t;
+  float u, v; // barycentrics of v1 and v2
+  uint32_t triangle;
+};
+
+struct BvhNode {
+  glm::vec3 boundsMin;
+  uint32_t first; // left child for inner nodes, first pack for leaves
+  glm::vec3 boundsMax;
+  uint32_t count; // pack count, 0 for inner nodes
+};
+
+// four triangles as v0 and the two edges, unused lanes have zero edges
+struct alignas(16) BvhTriPack {
+  float v0[3][BVH_PACK_WIDTH];
+  float e1[3][BVH_PACK_WIDTH];
+  float e2[3][BVH_PACK_WIDTH];
+  uint32_t ids[BVH_PACK_WIDTH];
+};
+
+class Bvh {
+public:
+  std::vector<BvhNode> nodes;
+  std::vector<BvhTriPack> packs;
+
+  // positions holds three vertices per triangle
+  void build(const std::vector<glm::vec3> &positions);
+  // closest hit, shortens ray.tMax
+  bool intersect(BvhRay &ray, BvhHit &hit) const;
+  // any hit, for shadow rays
+  bool occluded(const BvhRay &ray) const;
+
+private:
+  struct BuildRef {
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    glm::vec3 centroid;
+    uint32_t id;
+  };
+  void buildNode(uint32_t nodeIndex, std::vector<BuildRef> &refs,
+                 uint32_t begin, uint32_t end, uint32_t depth,
+                 const std::vector<glm::vec3> &positions);
+  void makeLeaf(BvhNode &node, const std::vector<BuildRef> &refs,
+                uint32_t begin, uint32_t end,
+                const std::vector<glm::vec3> &positions);
+  // lane mask of hits inside (tMin, tMax), fills t, u, v per lane
+  int intersectPack(const BvhTriPack &pack, const BvhRay &ray, float t[4],
+                    float u[4], float v[4]) const;
+};
+
+float bvhHalfArea(const glm::vec3 &bmin, const glm::vec3 &bmax) {
+  glm::vec3 d = bmax - bmin;
+  return d.x * d.y + d.y * d.z + d.z * d.x;
+}
+
+bool bvhSlabTest(const BvhNode &node, const BvhRay &ray, float &tEnter) {
+  glm::vec3 t0 = (node.boundsMin - ray.origin) * ray.invDir;
+  glm::vec3 t1 = (node.boundsMax - ray.origin) * ray.invDir;
+  glm::vec3 tNear = glm::min(t0, t1);
+  glm::vec3 tFar = glm::max(t0, t1);
+  float enter = glm::max(glm::max(tNear.x, tNear.y), glm::max(tNear.z, ray.tMin));
+  float exit = glm::min(glm::min(tFar.x, tFar.y), glm::min(tFar.z, ray.tMax));
+  tEnter = enter;
+  return enter <= exit;
+}
+
+void Bvh::build(const std::vector<glm::vec3> &positions) {
+  this->nodes.clear();
+  this->packs.clear();
+  uint32_t triCount = (uint32_t)(positions.size() / 3);
+  if (triCount == 0) {
+    return;
+  }
+  std::vector<BuildRef> refs(triCount);
+  for (uint32_t i = 0; i < triCount; i++) {
+    const glm::vec3 &a = positions[i * 3];
+    const glm::vec3 &b = positions[i * 3 + 1];
+    const glm::vec3 &c = positions[i * 3 + 2];
+    refs[i].boundsMin = glm::min(a, glm::min(b, c));
+    refs[i].boundsMax = glm::max(a, glm::max(b, c));
+    refs[i].centroid = (refs[i].boundsMin + refs[i].boundsMax) * 0.5f;
+    refs[i].id = i;
+  }
+  this->nodes.reserve(2 * triCount);
+  this->nodes.push_back(BvhNode());
+  this->buildNode(0, refs, 0, triCount, 0, positions);
+}
+
+void Bvh::makeLeaf(BvhNode &node, const std::vector<BuildRef> &refs,
+                   uint32_t begin, uint32_t end,
+                   const std::vector<glm::vec3> &positions) {
+  node.first = (uint32_t)this->packs.size();
+  node.count = 0;
+  for (uint32_t i = begin; i < end; i += BVH_PACK_WIDTH) {
+    BvhTriPack pack = {};
+    for (uint32_t lane = 0; lane < BVH_PACK_WIDTH; lane++) {
+      pack.ids[lane] = BVH_INVALID;
+      if (i + lane >= end) {
+        continue;
+      }
+      uint32_t id = refs[i + lane].id;
+      glm::vec3 v0 = positions[id * 3];
+      glm::vec3 e1 = positions[id * 3 + 1] - v0;
+      glm::vec3 e2 = positions[id * 3 + 2] - v0;
+      for (int axis = 0; axis < 3; axis++) {
+        pack.v0[axis][lane] = v0[axis];
+        pack.e1[axis][lane] = e1[axis];
+        pack.e2[axis][lane] = e2[axis];
+      }
+      pack.ids[lane] = id;
+    }
+    this->packs.push_back(pack);
+    node.count++;
+  }
+}
+
+void Bvh::buildNode(uint32_t nodeIndex, std::vector<BuildRef> &refs,
+                    uint32_t begin, uint32_t end, uint32_t depth,
+                    const std::vector<glm::vec3> &positions) {
+  glm::vec3 bmin(FLT_MAX), bmax(-FLT_MAX);
+  glm::vec3 cmin(FLT_MAX), cmax(-FLT_MAX);
+  for (uint32_t i = begin; i < end; i++) {
+    bmin = glm::min(bmin, refs[i].boundsMin);
+    bmax = glm::max(bmax, refs[i].boundsMax);
+    cmin = glm::min(cmin, refs[i].centroid);
+    cmax = glm::max(cmax, refs[i].centroid);
+  }
+  this->nodes[nodeIndex].boundsMin = bmin;
+  this->nodes[nodeIndex].boundsMax = bmax;
+  uint32_t count = end - begin;
+  float packCount = (float)((count + BVH_PACK_WIDTH - 1) / BVH_PACK_WIDTH);
+  float leafCost = packCount * BVH_PACK_COST;
+
+  // binned sah over the centroid bounds of every axis
+  float bestCost = FLT_MAX;
+  int bestAxis = -1;
+  uint32_t bestBin = 0;
+  glm::vec3 extent = cmax - cmin;
+  for (int axis = 0; axis < 3; axis++) {
+    if (extent[axis] <= 0.0f) {
+      continue;
+    }
+    uint32_t binCount[BVH_BIN_COUNT] = {};
+    glm::vec3 binMin[BVH_BIN_COUNT], binMax[BVH_BIN_COUNT];
+    for (uint32_t b = 0; b < BVH_BIN_COUNT; b++) {
+      binMin[b] = glm::vec3(FLT_MAX);
+      binMax[b] = glm::vec3(-FLT_MAX);
+    }
+    float scale = (float)BVH_BIN_COUNT / extent[axis];
+    for (uint32_t i = begin; i < end; i++) {
+      uint32_t b = (uint32_t)((refs[i].centroid[axis] - cmin[axis]) * scale);
+      b = b < BVH_BIN_COUNT ? b : BVH_BIN_COUNT - 1;
+      binCount[b]++;
+      binMin[b] = glm::min(binMin[b], refs[i].boundsMin);
+      binMax[b] = glm::max(binMax[b], refs[i].boundsMax);
+    }
+    // right to left sweep stores the area and count of every suffix
+    float rightArea[BVH_BIN_COUNT];
+    uint32_t rightCount[BVH_BIN_COUNT];
+    glm::vec3 rmin(FLT_MAX), rmax(-FLT_MAX);
+    uint32_t rc = 0;
+    for (uint32_t b = BVH_BIN_COUNT - 1; b > 0; b--) {
+      rmin = glm::min(rmin, binMin[b]);
+      rmax = glm::max(rmax, binMax[b]);
+      rc += binCount[b];
+      rightArea[b] = rc > 0 ? bvhHalfArea(rmin, rmax) : 0.0f;
+      rightCount[b] = rc;
+    }
+    glm::vec3 lmin(FLT_MAX), lmax(-FLT_MAX);
+    uint32_t lc = 0;
+    for (uint32_t b = 0; b + 1 < BVH_BIN_COUNT; b++) {
+      lmin = glm::min(lmin, binMin[b]);
+      lmax = glm::max(lmax, binMax[b]);
+      lc += binCount[b];
+      if (lc == 0 || rightCount[b + 1] == 0) {
+        continue;
+      }
+      // costs are counted per pack since leaves are tested four at a time
+      float lp = (float)((lc + BVH_PACK_WIDTH - 1) / BVH_PACK_WIDTH);
+      float rp =
+          (float)((rightCount[b + 1] + BVH_PACK_WIDTH - 1) / BVH_PACK_WIDTH);
+      float cost = bvhHalfArea(lmin, lmax) * lp + rightArea[b + 1] * rp;
+      if (cost < bestCost) {
+        bestCost = cost;
+        bestAxis = axis;
+        bestBin = b;
+      }
+    }
+  }
+  float parentArea = bvhHalfArea(bmin, bmax);
+  if (bestAxis >= 0 && parentArea > 0.0f) {
+    bestCost = BVH_TRAVERSAL_COST + BVH_PACK_COST * bestCost / parentArea;
+  }
+  bool tooDeep = depth >= BVH_MAX_DEPTH;
+  if (tooDeep || (count <= BVH_MAX_LEAF_SIZE && leafCost <= bestCost)) {
+    this->makeLeaf(this->nodes[nodeIndex], refs, begin, end, positions);
+    return;
+  }
+
+  uint32_t mid = begin;
+  if (bestAxis >= 0) {
+    float scale = (float)BVH_BIN_COUNT / extent[bestAxis];
+    uint32_t i = begin;
+    uint32_t j = end;
+    while (i < j) {
+      uint32_t b =
+          (uint32_t)((refs[i].centroid[bestAxis] - cmin[bestAxis]) * scale);
+      b = b < BVH_BIN_COUNT ? b : BVH_BIN_COUNT - 1;
+      if (b <= bestBin) {
+        i++;
+      } else {
+        std::swap(refs[i], refs[--j]);
+      }
+    }
+    mid = i;
+  }
+  if (mid == begin || mid == end) {
+    // every centroid in one spot, split the range in half
+    mid = begin + count / 2;
+  }
+  uint32_t left = (uint32_t)this->nodes.size();
+  this->nodes.push_back(BvhNode());
+  this->nodes.push_back(BvhNode());
+  this->nodes[nodeIndex].first = left;
+  this->nodes[nodeIndex].count = 0;
+  this->buildNode(left, refs, begin, mid, depth + 1, positions);
+  this->buildNode(left + 1, refs, mid, end, depth + 1, positions);
+}
+
+int Bvh::intersectPack(const BvhTriPack &pack, const BvhRay &ray, float t[4],
+                       float u[4], float v[4]) const {
+  // moller trumbore on four triangles
+#ifdef BVH_USE_SSE
+  __m128 ox = _mm_set1_ps(ray.origin.x);
+  __m128 oy = _mm_set1_ps(ray.origin.y);
+  __m128 oz = _mm_set1_ps(ray.origin.z);
+  __m128 dx = _mm_set1_ps(ray.dir.x);
+  __m128 dy = _mm_set1_ps(ray.dir.y);
+  __m128 dz = _mm_set1_ps(ray.dir.z);
+  __m128 e1x = _mm_load_ps(pack.e1[0]);
+  __m128 e1y = _mm_load_ps(pack.e1[1]);
+  __m128 e1z = _mm_load_ps(pack.e1[2]);
+  __m128 e2x = _mm_load_ps(pack.e2[0]);
+  __m128 e2y = _mm_load_ps(pack.e2[1]);
+  __m128 e2z = _mm_load_ps(pack.e2[2]);
+  // p = d x e2
+  __m128 px = _mm_sub_ps(_mm_mul_ps(dy, e2z), _mm_mul_ps(dz, e2y));
+  __m128 py = _mm_sub_ps(_mm_mul_ps(dz, e2x), _mm_mul_ps(dx, e2z));
+  __m128 pz = _mm_sub_ps(_mm_mul_ps(dx, e2y), _mm_mul_ps(dy, e2x));
+  __m128 det = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e1x, px), _mm_mul_ps(e1y, py)),
+                          _mm_mul_ps(e1z, pz));
+  __m128 absDet = _mm_andnot_ps(_mm_set1_ps(-0.0f), det);
+  __m128 mask = _mm_cmpgt_ps(absDet, _mm_set1_ps(1e-12f));
+  __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+  __m128 tx = _mm_sub_ps(ox, _mm_load_ps(pack.v0[0]));
+  __m128 ty = _mm_sub_ps(oy, _mm_load_ps(pack.v0[1]));
+  __m128 tz = _mm_sub_ps(oz, _mm_load_ps(pack.v0[2]));
+  __m128 uu = _mm_mul_ps(
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(tx, px), _mm_mul_ps(ty, py)),
+                 _mm_mul_ps(tz, pz)),
+      invDet);
+  // q = s x e1
+  __m128 qx = _mm_sub_ps(_mm_mul_ps(ty, e1z), _mm_mul_ps(tz, e1y));
+  __m128 qy = _mm_sub_ps(_mm_mul_ps(tz, e1x), _mm_mul_ps(tx, e1z));
+  __m128 qz = _mm_sub_ps(_mm_mul_ps(tx, e1y), _mm_mul_ps(ty, e1x));
+  __m128 vv = _mm_mul_ps(
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, qx), _mm_mul_ps(dy, qy)),
+                 _mm_mul_ps(dz, qz)),
+      invDet);
+  __m128 tt = _mm_mul_ps(
+      _mm_add_ps(_mm_add_ps(_mm_mul_ps(e2x, qx), _mm_mul_ps(e2y, qy)),
+                 _mm_mul_ps(e2z, qz)),
+      invDet);
+  __m128 zero = _mm_setzero_ps();
+  mask = _mm_and_ps(mask, _mm_cmpge_ps(uu, zero));
+  mask = _mm_and_ps(mask, _mm_cmpge_ps(vv, zero));
+  mask = _mm_and_ps(mask,
+                    _mm_cmple_ps(_mm_add_ps(uu, vv), _mm_set1_ps(1.0f)));
+  mask = _mm_and_ps(mask, _mm_cmpgt_ps(tt, _mm_set1_ps(ray.tMin)));
+  mask = _mm_and_ps(mask, _mm_cmplt_ps(tt, _mm_set1_ps(ray.tMax)));
+  _mm_storeu_ps(t, tt);
+  _mm_storeu_ps(u, uu);
+  _mm_storeu_ps(v, vv);
+  return _mm_movemask_ps(mask);
+#else
+  int mask = 0;
+  for (uint32_t lane = 0; lane < BVH_PACK_WIDTH; lane++) {
+    glm::vec3 e1(pack.e1[0][lane], pack.e1[1][lane], pack.e1[2][lane]);
+    glm::vec3 e2(pack.e2[0][lane], pack.e2[1][lane], pack.e2[2][lane]);
+    glm::vec3 v0(pack.v0[0][lane], pack.v0[1][lane], pack.v0[2][lane]);
+    glm::vec3 p = glm::cross(ray.dir, e2);
+    float det = glm::dot(e1, p);
+    if (std::fabs(det) <= 1e-12f) {
+      continue;
+    }
+    float invDet = 1.0f / det;
+    glm::vec3 s = ray.origin - v0;
+    glm::vec3 q = glm::cross(s, e1);
+    u[lane] = glm::dot(s, p) * invDet;
+    v[lane] = glm::dot(ray.dir, q) * invDet;
+    t[lane] = glm::dot(e2, q) * invDet;
+    if (u[lane] >= 0.0f && v[lane] >= 0.0f && u[lane] + v[lane] <= 1.0f &&
+        t[lane] > ray.tMin && t[lane] < ray.tMax) {
+      mask |= 1 << lane;
+    }
+  }
+  return mask;
+#endif
+}
+
+bool Bvh::intersect(BvhRay &ray, BvhHit &hit) const {
+  if (this->nodes.empty()) {
+    return false;
+  }
+  bool found = false;
+  // entry distance is kept next to the node so subtrees behind a closer
+  // hit found later are skipped without another box test
+  uint32_t stack[BVH_STACK_SIZE];
+  float stackT[BVH_STACK_SIZE];
+  uint32_t top = 0;
+  float tEnter;
+  if (!bvhSlabTest(this->nodes[0], ray, tEnter)) {
+    return false;
+  }
+  stack[top] = 0;
+  stackT[top++] = tEnter;
+  while (top > 0) {
+    top--;
+    if (stackT[top] > ray.tMax) {
+      continue;
+    }
+    const BvhNode &node = this->nodes[stack[top]];
+    if (node.count > 0) {
+      for (uint32_t p = 0; p < node.count; p++) {
+        const BvhTriPack &pack = this->packs[node.first + p];
+        float t[4], u[4], v[4];
+        int mask = this->intersectPack(pack, ray, t, u, v);
+        for (uint32_t lane = 0; mask != 0; lane++, mask >>= 1) {
+          if ((mask & 1) && t[lane] < ray.tMax) {
+            ray.tMax = t[lane];
+            hit.t = t[lane];
+            hit.u = u[lane];
+            hit.v = v[lane];
+            hit.triangle = pack.ids[lane];
+            found = true;
+          }
+        }
+      }
+      continue;
+    }
+    // visit the nearer child first
+    float tLeft, tRight;
+    bool hitLeft = bvhSlabTest(this->nodes[node.first], ray, tLeft);
+    bool hitRight = bvhSlabTest(this->nodes[node.first + 1], ray, tRight);
+    if (hitLeft && hitRight && tLeft <= tRight) {
+      stack[top] = node.first + 1;
+      stackT[top++] = tRight;
+      stack[top] = node.first;
+      stackT[top++] = tLeft;
+    } else if (hitLeft && hitRight) {
+      stack[top] = node.first;
+      stackT[top++] = tLeft;
+      stack[top] = node.first + 1;
+      stackT[top++] = tRight;
+    } else if (hitLeft) {
+      stack[top] = node.first;
+      stackT[top++] = tLeft;
+    } else if (hitRight) {
+      stack[top] = node.first + 1;
+      stackT[top++] = tRight;
+    }
+  }
+  return found;
+}
+
+bool Bvh::occluded(const BvhRay &ray) const {
+  if (this->nodes.empty()) {
+    return false;
+  }
+  uint32_t stack[BVH_STACK_SIZE];
+  uint32_t top = 0;
+  stack[top++] = 0;
+  while (top > 0) {
+    const BvhNode &node = this->nodes[stack[--top]];
+    float tEnter;
+    if (!bvhSlabTest(node, ray, tEnter)) {
+      continue;
+    }
+    if (node.count > 0) {
+      for (uint32_t p = 0; p < node.count; p++) {
+        float t[4], u[4], v[4];
+        if (this->intersectPack(this->packs[node.first + p], ray, t, u, v)) {
+          return true;
+        }
+      }
+      continue;
+    }
+    stack[top++] = node.first;
+    stack[top++] = node.first + 1;
+  }
+  return false;
+}
+
+#endif
@@ -19,14 +19,31 @@ const float PITCH = 0.0f;
 const float SPEED = 2.5f;
 const float SENSITIVITY = 0.00001f;
 const float ZOOM = 45.0f;
+const float NEAR_PLANE = 0.1f;
+const float FAR_PLANE = 100.0f;
+
+// what changed since the matrices were last computed
+const unsigned int CAMERA_DIRTY_VECTORS = 1;
+const unsigned int CAMERA_DIRTY_VIEW = 2;
+const unsigned int CAMERA_DIRTY_PROJECTION = 4;
+
+// frustum planes, xyz is the inward normal, w the offset
+const unsigned int FRUSTUM_LEFT = 0;
+const unsigned int FRUSTUM_RIGHT = 1;
+const unsigned int FRUSTUM_BOTTOM = 2;
+const unsigned int FRUSTUM_TOP = 3;
+const unsigned int FRUSTUM_NEAR = 4;
+const unsigned int FRUSTUM_FAR = 5;
 
 // Abstract camera class
+// The matrices and the frustum are computed when asked for after a change
+// and kept until the next one, culling, uniform uploads and shadows share
+// them. Mouse movement only marks the angles dirty, front, up and right
+// are recomputed once when next asked for, so they are only reachable
+// through their getters. Call invalidate after writing the fields directly.
 class Camera {
 public:
   glm::vec3 pos;
-  glm::vec3 front;
-  glm::vec3 up;
-  glm::vec3 right;
   glm::vec3 worldUp;
   // euler angles
   float yaw;
@@ -50,13 +67,58 @@ public:
          float Speed = SPEED, float Sens = SENSITIVITY, float Zoom = ZOOM);
   void processKeyBoardRotate(Camera_Movement direction, float deltaTime);
   virtual void processKeyboard(Camera_Movement direction, float deltaTime);
-  glm::mat4 getViewMatrix();
   virtual void processMouseMovement(float xoffset, float yoffset,
                                     GLboolean pitchBound = true);
   void processMouseScroll(float yoffset);
 
+  // marks the projection dirty only when one of them changes, so it can be
+  // called every frame with the framebuffer size
+  void setPerspective(float aspect, float nearPlane = NEAR_PLANE,
+                      float farPlane = FAR_PLANE);
+  void invalidate();
+
+  // follow the angles, up to date whenever called
+  glm::vec3 getFront() const;
+  glm::vec3 getRight() const;
+  glm::vec3 getUp() const;
+
+  const glm::mat4 &getViewMatrix();
+  const glm::mat4 &getProjectionMatrix();
+  const glm::mat4 &getViewProjectionMatrix();
+  const glm::mat4 &getInverseViewMatrix();
+  const glm::mat4 &getInverseProjectionMatrix();
+  const glm::mat4 &getInverseViewProjectionMatrix();
+  // six world space planes, indexed by FRUSTUM_LEFT and the others
+  const glm::vec4 *getFrustumPlanes();
+  bool sphereInFrustum(const glm::vec3 &center, float radius);
+  // bumped whenever the matrices change, consumers keeping their own copy,
+  // a uniform buffer say, compare it to skip the upload
+  unsigned int getRevision();
+
+protected:
+  // kept current by resolveVectors, which the const getters call as well
+  mutable glm::vec3 front;
+  mutable glm::vec3 up;
+  mutable glm::vec3 right;
+  mutable unsigned int dirty;
+  // front, right and up from the angles when they changed
+  void resolveVectors() const;
+
 private:
-  void updateCameraVectors();
+  unsigned int revision;
+  float aspect;
+  float nearPlane;
+  float farPlane;
+  glm::mat4 view;
+  glm::mat4 projection;
+  glm::mat4 viewProjection;
+  glm::mat4 inverseView;
+  glm::mat4 inverseProjection;
+  glm::mat4 inverseViewProjection;
+  glm::vec4 frustum[6];
+
+  void updateCameraVectors() const;
+  void updateMatrices();
 };
 
 // first constructor
@@ -70,7 +132,12 @@ Camera::Camera(glm::vec3 Position, glm::vec3 Up, float Yaw, float Pitch,
   this->mouseSensitivity = Sens;
   this->front = Front;
   this->zoom = Zoom;
+  this->aspect = 1.0f;
+  this->nearPlane = NEAR_PLANE;
+  this->farPlane = FAR_PLANE;
+  this->revision = 0;
   this->updateCameraVectors();
+  this->dirty = CAMERA_DIRTY_VIEW | CAMERA_DIRTY_PROJECTION;
 }
 
 // second constructor
@@ -85,9 +152,14 @@ Camera::Camera(float posX, float posY, float posZ, float upX, float upY,
   this->mouseSensitivity = Sens;
   this->zoom = Zoom;
   this->front = Front;
+  this->aspect = 1.0f;
+  this->nearPlane = NEAR_PLANE;
+  this->farPlane = FAR_PLANE;
+  this->revision = 0;
   this->updateCameraVectors();
+  this->dirty = CAMERA_DIRTY_VIEW | CAMERA_DIRTY_PROJECTION;
 }
-void Camera::updateCameraVectors() {
+void Camera::updateCameraVectors() const {
   glm::vec3 front;
   // compute new front
   front.x = cos(glm::radians(this->yaw)) * cos(glm::radians(this->pitch));
@@ -99,7 +171,27 @@ void Camera::updateCameraVectors() {
   this->right = glm::normalize(glm::cross(this->front, this->worldUp));
   this->up = glm::normalize(glm::cross(this->right, this->front));
 }
+void Camera::resolveVectors() const {
+  if (this->dirty & CAMERA_DIRTY_VECTORS) {
+    this->updateCameraVectors();
+    this->dirty &= ~CAMERA_DIRTY_VECTORS;
+  }
+}
+glm::vec3 Camera::getFront() const {
+  this->resolveVectors();
+  return this->front;
+}
+glm::vec3 Camera::getRight() const {
+  this->resolveVectors();
+  return this->right;
+}
+glm::vec3 Camera::getUp() const {
+  this->resolveVectors();
+  return this->up;
+}
 void Camera::processKeyboard(Camera_Movement direction, float deltaTime) {
+  this->resolveVectors();
+  this->dirty |= CAMERA_DIRTY_VIEW;
   float velocity = this->movementSpeed * deltaTime;
   switch (direction) {
   case FORWARD:
@@ -117,30 +209,131 @@ void Camera::processKeyboard(Camera_Movement direction, float deltaTime) {
   }
 }
 
-glm::mat4 Camera::getViewMatrix() {
-  glm::vec3 target = this->pos + this->front;
-  glm::vec3 upvec = this->up;
-  glm::vec3 cameraDirection = glm::normalize(this->pos - target);
-  glm::vec3 right = glm::normalize(glm::cross(upvec, cameraDirection));
-  glm::vec3 realUp = glm::normalize(glm::cross(cameraDirection, right));
-  //
-  glm::mat4 trans(1.0f);
-  trans[3][0] = -this->pos.x;
-  trans[3][1] = -this->pos.y;
-  trans[3][2] = -this->pos.z;
-
-  //
-  glm::mat4 rotation(1.0f);
-  rotation[0][0] = right.x;
-  rotation[1][0] = right.y;
-  rotation[2][0] = right.z;
-  rotation[0][1] = realUp.x;
-  rotation[1][1] = realUp.y;
-  rotation[2][1] = realUp.z;
-  rotation[0][2] = cameraDirection.x;
-  rotation[1][2] = cameraDirection.y;
-  rotation[2][2] = cameraDirection.z;
-  return rotation * trans;
+void Camera::updateMatrices() {
+  this->resolveVectors();
+  if (this->dirty & CAMERA_DIRTY_VIEW) {
+    // front, up and right are orthonormal, the view is the transposed basis
+    // after moving to the position and its inverse needs no general inverse
+    glm::vec3 back = -this->front;
+    glm::mat4 rotation(1.0f);
+    rotation[0][0] = this->right.x;
+    rotation[1][0] = this->right.y;
+    rotation[2][0] = this->right.z;
+    rotation[0][1] = this->up.x;
+    rotation[1][1] = this->up.y;
+    rotation[2][1] = this->up.z;
+    rotation[0][2] = back.x;
+    rotation[1][2] = back.y;
+    rotation[2][2] = back.z;
+    glm::mat4 trans(1.0f);
+    trans[3][0] = -this->pos.x;
+    trans[3][1] = -this->pos.y;
+    trans[3][2] = -this->pos.z;
+    this->view = rotation * trans;
+    this->inverseView = glm::mat4(glm::vec4(this->right, 0.0f),
+                                  glm::vec4(this->up, 0.0f),
+                                  glm::vec4(back, 0.0f),
+                                  glm::vec4(this->pos, 1.0f));
+  }
+  if (this->dirty & CAMERA_DIRTY_PROJECTION) {
+    this->projection = glm::perspective(glm::radians(this->zoom), this->aspect,
+                                        this->nearPlane, this->farPlane);
+    this->inverseProjection = glm::inverse(this->projection);
+  }
+  this->viewProjection = this->projection * this->view;
+  this->inverseViewProjection = this->inverseView * this->inverseProjection;
+
+  // the planes are sums of the rows of the view projection
+  const glm::mat4 &m = this->viewProjection;
+  glm::vec4 x(m[0][0], m[1][0], m[2][0], m[3][0]);
+  glm::vec4 y(m[0][1], m[1][1], m[2][1], m[3][1]);
+  glm::vec4 z(m[0][2], m[1][2], m[2][2], m[3][2]);
+  glm::vec4 w(m[0][3], m[1][3], m[2][3], m[3][3]);
+  this->frustum[FRUSTUM_LEFT] = w + x;
+  this->frustum[FRUSTUM_RIGHT] = w - x;
+  this->frustum[FRUSTUM_BOTTOM] = w + y;
+  this->frustum[FRUSTUM_TOP] = w - y;
+  this->frustum[FRUSTUM_NEAR] = w + z;
+  this->frustum[FRUSTUM_FAR] = w - z;
+  for (unsigned int i = 0; i < 6; i++) {
+    this->frustum[i] /= glm::length(glm::vec3(this->frustum[i]));
+  }
+  this->dirty = 0;
+  this->revision++;
+}
+
+const glm::mat4 &Camera::getViewMatrix() {
+  if (this->dirty != 0) {
+    this->updateMatrices();
+  }
+  return this->view;
+}
+const glm::mat4 &Camera::getProjectionMatrix() {
+  if (this->dirty != 0) {
+    this->updateMatrices();
+  }
+  return this->projection;
+}
+const glm::mat4 &Camera::getViewProjectionMatrix() {
+  if (this->dirty != 0) {
+    this->updateMatrices();
+  }
+  return this->viewProjection;
+}
+const glm::mat4 &Camera::getInverseViewMatrix() {
+  if (this->dirty != 0) {
+    this->updateMatrices();
+  }
+  return this->inverseView;
+}
+const glm::mat4 &Camera::getInverseProjectionMatrix() {
+  if (this->dirty != 0) {
+    this->updateMatrices();
+  }
+  return this->inverseProjection;
+}
+const glm::mat4 &Camera::getInverseViewProjectionMatrix() {
+  if (this->dirty != 0) {
+    this->updateMatrices();
+  }
+  return this->inverseViewProjection;
+}
+const glm::vec4 *Camera::getFrustumPlanes() {
+  if (this->dirty != 0) {
+    this->updateMatrices();
+  }
+  return this->frustum;
+}
+unsigned int Camera::getRevision() {
+  if (this->dirty != 0) {
+    this->updateMatrices();
+  }
+  return this->revision;
+}
+
+bool Camera::sphereInFrustum(const glm::vec3 &center, float radius) {
+  const glm::vec4 *planes = this->getFrustumPlanes();
+  for (unsigned int i = 0; i < 6; i++) {
+    if (glm::dot(glm::vec3(planes[i]), center) + planes[i].w < -radius) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Camera::invalidate() {
+  this->dirty |=
+      CAMERA_DIRTY_VECTORS | CAMERA_DIRTY_VIEW | CAMERA_DIRTY_PROJECTION;
+}
+
+void Camera::setPerspective(float aspectRatio, float near, float far) {
+  if (aspectRatio != this->aspect || near != this->nearPlane ||
+      far != this->farPlane) {
+    this->aspect = aspectRatio;
+    this->nearPlane = near;
+    this->farPlane = far;
+    this->dirty |= CAMERA_DIRTY_PROJECTION;
+  }
 }
 
 void Camera::processMouseMovement(float xoffset, float yoffset,
@@ -160,7 +353,9 @@ void Camera::processMouseMovement(float xoffset, float yoffset,
     }
   }
 
-  this->updateCameraVectors();
+  // several events can arrive between two frames, the trig waits for the
+  // next use
+  this->dirty |= CAMERA_DIRTY_VECTORS | CAMERA_DIRTY_VIEW;
 }
 void Camera::processKeyBoardRotate(Camera_Movement direction, float deltaTime) {
 
@@ -179,7 +374,7 @@ void Camera::processKeyBoardRotate(Camera_Movement direction, float deltaTime) {
     this->yaw -= deltaTime;
     break;
   }
-  this->updateCameraVectors();
+  this->dirty |= CAMERA_DIRTY_VECTORS | CAMERA_DIRTY_VIEW;
 }
 
 void Camera::processMouseScroll(float yoffset) {
@@ -194,6 +389,9 @@ void Camera::processMouseScroll(float yoffset) {
   if (this->zoom >= 45.0f) {
     this->zoom = 45.0f;
   }
+  if (this->zoom != zoom) {
+    this->dirty |= CAMERA_DIRTY_PROJECTION;
+  }
 }
 
 class FpsCamera : public Camera {
@@ -201,6 +399,7 @@ class FpsCamera : public Camera {
 };
 
 void FpsCamera::processKeyboard(Camera_Movement direction, float deltaTime) {
+  this->resolveVectors();
   float velocity = this->movementSpeed * deltaTime;
   switch (direction) {
   case FORWARD:
@@ -217,6 +416,7 @@ void FpsCamera::processKeyboard(Camera_Movement direction, float deltaTime) {
     break;
   }
   this->pos.y = 0.0f;
+  this->dirty |= CAMERA_DIRTY_VIEW;
 }
 
 #endif
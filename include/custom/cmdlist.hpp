@@ -0,0 +1,218 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Command lists recorded away from the gl thread. Workers write compact
+// command streams for object ranges in parallel, only the gl thread replays
+// them, in order. A list keeps its storage across frames so recording stops
+// allocating once the first frames have sized it.
+
+#ifndef CMDLIST_HPP
+#define CMDLIST_HPP
+
+#include <glad/glad.h>
+
+#include <custom/glstate.hpp>
+#include <custom/jobpool.hpp>
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+// command words, the payload follows the op word
+const uint32_t CMD_USE_PROGRAM = 0;       // program
+const uint32_t CMD_BIND_VERTEX_ARRAY = 1; // vao
+const uint32_t CMD_BIND_TEXTURE = 2;      // unit, target, texture
+const uint32_t CMD_UNIFORM_FLOAT = 3;     // location, 1 float
+const uint32_t CMD_UNIFORM_VEC3 = 4;      // location, 3 floats
+const uint32_t CMD_UNIFORM_MAT3 = 5;      // location, 9 floats
+const uint32_t CMD_UNIFORM_MAT4 = 6;      // location, 16 floats
+const uint32_t CMD_DRAW_ELEMENTS = 7;     // mode, count, type
+const uint32_t CMD_DRAW_ARRAYS = 8;       // mode, first, count
+
+class CommandList {
+public:
+  CommandList() : commands(0) {}
+
+  // empties the list, the storage is kept
+  void reset();
+  unsigned int size() const { return this->commands; }
+
+  // recording, no gl call happens here; uniform locations are looked up on
+  // the gl thread beforehand
+  void useProgram(GLuint program);
+  void bindVertexArray(GLuint vao);
+  void bindTexture(unsigned int unit, GLenum target, GLuint tex);
+  void uniformFloat(GLint location, float value);
+  void uniformVec3(GLint location, const glm::vec3 &value);
+  void uniformMat3(GLint location, const glm::mat3 &value);
+  void uniformMat4(GLint location, const glm::mat4 &value);
+  void drawElements(GLenum mode, GLsizei count, GLenum type);
+  void drawArrays(GLenum mode, GLint first, GLsizei count);
+
+  // gl thread only, binds go through the state cache
+  void replay() const;
+
+private:
+  std::vector<uint32_t> words;
+  unsigned int commands;
+
+  void push(uint32_t op);
+  void pushFloats(const float *values, unsigned int count);
+};
+
+// records fn(list, begin, end) over [0, count) in ranges of grain objects on
+// the pool, range k goes to lists[k] so replaying the lists in order draws
+// in the order a serial loop would
+void recordCommandLists(
+    JobPool &pool, std::vector<CommandList> &lists, unsigned int count,
+    unsigned int grain,
+    const std::function<void(CommandList &, unsigned int, unsigned int)> &fn);
+void replayCommandLists(const std::vector<CommandList> &lists);
+
+void CommandList::reset() {
+  this->words.clear();
+  this->commands = 0;
+}
+void CommandList::push(uint32_t op) {
+  this->words.push_back(op);
+  this->commands++;
+}
+void CommandList::pushFloats(const float *values, unsigned int count) {
+  size_t at = this->words.size();
+  this->words.resize(at + count);
+  std::memcpy(&this->words[at], values, count * sizeof(float));
+}
+void CommandList::useProgram(GLuint program) {
+  this->push(CMD_USE_PROGRAM);
+  this->words.push_back(program);
+}
+void CommandList::bindVertexArray(GLuint vao) {
+  this->push(CMD_BIND_VERTEX_ARRAY);
+  this->words.push_back(vao);
+}
+void CommandList::bindTexture(unsigned int unit, GLenum target, GLuint tex) {
+  this->push(CMD_BIND_TEXTURE);
+  this->words.push_back(unit);
+  this->words.push_back(target);
+  this->words.push_back(tex);
+}
+void CommandList::uniformFloat(GLint location, float value) {
+  this->push(CMD_UNIFORM_FLOAT);
+  this->words.push_back(uint32_t(location));
+  this->pushFloats(&value, 1);
+}
+void CommandList::uniformVec3(GLint location, const glm::vec3 &value) {
+  this->push(CMD_UNIFORM_VEC3);
+  this->words.push_back(uint32_t(location));
+  this->pushFloats(&value[0], 3);
+}
+void CommandList::uniformMat3(GLint location, const glm::mat3 &value) {
+  this->push(CMD_UNIFORM_MAT3);
+  this->words.push_back(uint32_t(location));
+  this->pushFloats(&value[0][0], 9);
+}
+void CommandList::uniformMat4(GLint location, const glm::mat4 &value) {
+  this->push(CMD_UNIFORM_MAT4);
+  this->words.push_back(uint32_t(location));
+  this->pushFloats(&value[0][0], 16);
+}
+void CommandList::drawElements(GLenum mode, GLsizei count, GLenum type) {
+  this->push(CMD_DRAW_ELEMENTS);
+  this->words.push_back(mode);
+  this->words.push_back(uint32_t(count));
+  this->words.push_back(type);
+}
+void CommandList::drawArrays(GLenum mode, GLint first, GLsizei count) {
+  this->push(CMD_DRAW_ARRAYS);
+  this->words.push_back(mode);
+  this->words.push_back(uint32_t(first));
+  this->words.push_back(uint32_t(count));
+}
+
+void CommandList::replay() const {
+  const uint32_t *w = this->words.data();
+  const uint32_t *end = w + this->words.size();
+  float values[16];
+  while (w < end) {
+    uint32_t op = *w++;
+    switch (op) {
+    case CMD_USE_PROGRAM:
+      glState().useProgram(w[0]);
+      w += 1;
+      break;
+    case CMD_BIND_VERTEX_ARRAY:
+      glState().bindVertexArray(w[0]);
+      w += 1;
+      break;
+    case CMD_BIND_TEXTURE:
+      glState().bindTexture(w[0], w[1], w[2]);
+      w += 3;
+      break;
+    case CMD_UNIFORM_FLOAT:
+      std::memcpy(values, w + 1, sizeof(float));
+      glUniform1f(GLint(w[0]), values[0]);
+      w += 2;
+      break;
+    case CMD_UNIFORM_VEC3:
+      std::memcpy(values, w + 1, 3 * sizeof(float));
+      glUniform3fv(GLint(w[0]), 1, values);
+      w += 4;
+      break;
+    case CMD_UNIFORM_MAT3:
+      std::memcpy(values, w + 1, 9 * sizeof(float));
+      glUniformMatrix3fv(GLint(w[0]), 1, GL_FALSE, values);
+      w += 10;
+      break;
+    case CMD_UNIFORM_MAT4:
+      std::memcpy(values, w + 1, 16 * sizeof(float));
+      glUniformMatrix4fv(GLint(w[0]), 1, GL_FALSE, values);
+      w += 17;
+      break;
+    case CMD_DRAW_ELEMENTS:
+      glDrawElements(w[0], GLsizei(w[1]), w[2], 0);
+      w += 3;
+      break;
+    case CMD_DRAW_ARRAYS:
+      glDrawArrays(w[0], GLint(w[1]), GLsizei(w[2]));
+      w += 3;
+      break;
+    default:
+      std::cout << "command list: unknown command " << op << std::endl;
+      return;
+    }
+  }
+}
+
+void recordCommandLists(
+    JobPool &pool, std::vector<CommandList> &lists, unsigned int count,
+    unsigned int grain,
+    const std::function<void(CommandList &, unsigned int, unsigned int)> &fn) {
+  if (grain == 0) {
+    grain = 1;
+  }
+  unsigned int chunks = (count + grain - 1) / grain;
+  if (lists.size() < chunks) {
+    lists.resize(chunks);
+  }
+  // lists past the last range would replay what an earlier frame recorded
+  for (unsigned int k = chunks; k < lists.size(); k++) {
+    lists[k].reset();
+  }
+  // parallelFor hands out ranges starting at multiples of grain
+  pool.parallelFor(count, grain, [&](unsigned int begin, unsigned int end) {
+    CommandList &list = lists[begin / grain];
+    list.reset();
+    fn(list, begin, end);
+  });
+}
+void replayCommandLists(const std::vector<CommandList> &lists) {
+  for (unsigned int k = 0; k < lists.size(); k++) {
+    lists[k].replay();
+  }
+}
+
+#endif
@@ -0,0 +1,163 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Dynamic resolution. GpuTimer measures a stretch of gl commands with
+// GL_TIME_ELAPSED queries that are read back frames later, so timing never
+// stalls the pipeline. ResolutionController turns those timings into a
+// render scale: it drops at once when over budget and climbs back slowly
+// only after the timings stayed well under budget, so it does not oscillate
+// around the target. Every query carries the generation of the scale it
+// was issued under, the controller throws away timings of an older scale.
+
+#ifndef DYNRES_HPP
+#define DYNRES_HPP
+
+#include <glad/glad.h>
+
+#include <cmath>
+#include <iostream>
+
+const unsigned int GPU_TIMER_QUERIES = 4;
+
+class GpuTimer {
+public:
+  // milliseconds of the last measurement read back, negative before any
+  double lastMs;
+  // generation given to begin for the query of lastMs
+  unsigned int lastGeneration;
+
+  GpuTimer();
+  void init();
+  void destroy();
+
+  // a frame is skipped when every query is still in flight
+  void begin(unsigned int generation = 0);
+  void end();
+  // reads back the finished queries without waiting, true when one of them
+  // gave a new lastMs
+  bool poll();
+
+private:
+  GLuint queries[GPU_TIMER_QUERIES];
+  unsigned int generations[GPU_TIMER_QUERIES];
+  unsigned int head;
+  unsigned int pending;
+  bool active;
+};
+
+class ResolutionController {
+public:
+  float scale;
+  float minScale;
+  float maxScale;
+  double targetMs;
+  // timings in a row under the low water mark before the scale goes up
+  unsigned int climbDelay;
+  // bumped with every change of scale, tag the timer queries with it
+  unsigned int generation;
+
+  ResolutionController(double targetMs, float minScale = 0.5f,
+                       float maxScale = 1.0f);
+  // a new gpu time of the scaled work, measured under the given
+  // generation; timings of an older scale and negative ones are ignored
+  void update(double gpuMs, unsigned int measuredGeneration);
+  GLsizei scaled(GLsizei size) const;
+
+private:
+  unsigned int underCount;
+};
+
+GpuTimer::GpuTimer()
+    : lastMs(-1.0), lastGeneration(0), head(0), pending(0), active(false) {
+  for (unsigned int i = 0; i < GPU_TIMER_QUERIES; i++) {
+    this->queries[i] = 0;
+    this->generations[i] = 0;
+  }
+}
+void GpuTimer::init() { glGenQueries(GPU_TIMER_QUERIES, this->queries); }
+void GpuTimer::destroy() {
+  glDeleteQueries(GPU_TIMER_QUERIES, this->queries);
+  this->pending = 0;
+}
+
+void GpuTimer::begin(unsigned int generation) {
+  this->active = this->pending < GPU_TIMER_QUERIES;
+  if (!this->active) {
+    return;
+  }
+  unsigned int slot = (this->head + this->pending) % GPU_TIMER_QUERIES;
+  this->generations[slot] = generation;
+  glBeginQuery(GL_TIME_ELAPSED, this->queries[slot]);
+}
+void GpuTimer::end() {
+  if (!this->active) {
+    return;
+  }
+  glEndQuery(GL_TIME_ELAPSED);
+  this->pending++;
+  this->active = false;
+}
+bool GpuTimer::poll() {
+  bool fresh = false;
+  while (this->pending > 0) {
+    GLuint query = this->queries[this->head];
+    GLint available = 0;
+    glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (available == 0) {
+      break;
+    }
+    GLuint64 ns = 0;
+    glGetQueryObjectui64v(query, GL_QUERY_RESULT, &ns);
+    this->lastMs = double(ns) / 1000000.0;
+    this->lastGeneration = this->generations[this->head];
+    this->head = (this->head + 1) % GPU_TIMER_QUERIES;
+    this->pending--;
+    fresh = true;
+  }
+  return fresh;
+}
+
+ResolutionController::ResolutionController(double target, float minS,
+                                           float maxS)
+    : scale(maxS), minScale(minS), maxScale(maxS), targetMs(target),
+      climbDelay(30), generation(0), underCount(0) {}
+
+void ResolutionController::update(double gpuMs,
+                                  unsigned int measuredGeneration) {
+  if (gpuMs <= 0.0 || measuredGeneration != this->generation) {
+    return;
+  }
+  float previous = this->scale;
+  // the cost follows the pixel count, the square of the scale
+  float fit = this->scale * (float)std::sqrt(this->targetMs / gpuMs);
+  if (gpuMs > this->targetMs) {
+    // over budget, go straight to the scale that fits with some headroom
+    this->scale = 0.95f * fit;
+    this->underCount = 0;
+  } else if (gpuMs < 0.8 * this->targetMs) {
+    this->underCount++;
+    if (this->underCount >= this->climbDelay) {
+      float up = this->scale + 0.05f;
+      this->scale = up < fit ? up : fit;
+      this->underCount = 0;
+    }
+  } else {
+    // inside the band, hold
+    this->underCount = 0;
+  }
+  if (this->scale < this->minScale) {
+    this->scale = this->minScale;
+  } else if (this->scale > this->maxScale) {
+    this->scale = this->maxScale;
+  }
+  if (this->scale != previous) {
+    this->generation++;
+    this->underCount = 0;
+  }
+}
+GLsizei ResolutionController::scaled(GLsizei size) const {
+  GLsizei s = (GLsizei)(size * this->scale + 0.5f);
+  return s < 1 ? 1 : s;
+}
+
+#endif
@@ -0,0 +1,170 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Histogram based auto exposure for an hdr scene texture, as frame graph
+// passes. The scene is reduced to a grid of log luminances, a point per
+// grid cell is scattered onto a row of bins with additive blending, and a
+// one pixel pass averages the histogram without its tails and adapts the
+// exposure of the previous frame towards it. The loader stops at gl 4.0, so
+// the histogram is built with blending instead of compute shader atomics.
+
+#ifndef EXPOSURE_HPP
+#define EXPOSURE_HPP
+
+#include <glad/glad.h>
+
+#include <custom/framegraph.hpp>
+#include <custom/glstate.hpp>
+#include <custom/shader.hpp>
+
+#include <cmath>
+#include <filesystem>
+
+const GLsizei EXPOSURE_LUMINANCE_SIZE = 64;
+const GLsizei EXPOSURE_HISTOGRAM_BINS = 256;
+// log2 luminance covered by the histogram
+const float EXPOSURE_MIN_LOG = -10.0f;
+const float EXPOSURE_MAX_LOG = 6.0f;
+
+class AutoExposure {
+public:
+  // the average luminance is mapped to keyValue
+  float keyValue;
+  // fraction of the pixels left out at the bottom, kept from the bottom
+  float lowPercent;
+  float highPercent;
+  // how fast the exposure follows, per second
+  float adaptSpeed;
+
+  AutoExposure(const std::filesystem::path &shaderDir);
+  void destroy();
+
+  // adds the passes reading the rendered part of sceneColor, returns the
+  // 1x1 exposure texture written this frame
+  FgResource addPasses(FrameGraph &graph, FgResource sceneColor,
+                       GLsizei renderWidth, GLsizei renderHeight,
+                       float deltaTime);
+
+private:
+  Shader luminanceShader;
+  Shader histogramShader;
+  Shader exposureShader;
+  // ping pong between frames, the adaptation reads the last result
+  GLuint exposureTex[2];
+  unsigned int current;
+  // the passes draw without vertex buffers
+  GLuint vao;
+};
+
+AutoExposure::AutoExposure(const std::filesystem::path &shaderDir)
+    : keyValue(0.18f), lowPercent(0.5f), highPercent(0.95f), adaptSpeed(1.5f),
+      luminanceShader((shaderDir / "fullscreen.vert").c_str(),
+                      (shaderDir / "luminance.frag").c_str()),
+      histogramShader((shaderDir / "histogram.vert").c_str(),
+                      (shaderDir / "histogram.frag").c_str()),
+      exposureShader((shaderDir / "fullscreen.vert").c_str(),
+                     (shaderDir / "exposure.frag").c_str()),
+      current(0) {
+  glGenVertexArrays(1, &this->vao);
+  glGenTextures(2, this->exposureTex);
+  float one = 1.0f;
+  for (unsigned int i = 0; i < 2; i++) {
+    glState().bindTexture(0, GL_TEXTURE_2D, this->exposureTex[i]);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, 1, 1, 0, GL_RED, GL_FLOAT, &one);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  }
+  float logRange[2] = {EXPOSURE_MIN_LOG, EXPOSURE_MAX_LOG - EXPOSURE_MIN_LOG};
+  this->luminanceShader.useProgram();
+  this->luminanceShader.setIntUni("sceneColor", 0);
+  this->histogramShader.useProgram();
+  this->histogramShader.setIntUni("logLuminance", 0);
+  this->histogramShader.setVec2Uni("logRange", logRange[0], logRange[1]);
+  this->histogramShader.setFloatUni("binCount",
+                                    (float)EXPOSURE_HISTOGRAM_BINS);
+  this->exposureShader.useProgram();
+  this->exposureShader.setIntUni("histogram", 0);
+  this->exposureShader.setIntUni("previousExposure", 1);
+  this->exposureShader.setVec2Uni("logRange", logRange[0], logRange[1]);
+  this->exposureShader.setFloatUni("binCount",
+                                   (float)EXPOSURE_HISTOGRAM_BINS);
+}
+
+void AutoExposure::destroy() {
+  glState().deleteTexture(this->exposureTex[0]);
+  glState().deleteTexture(this->exposureTex[1]);
+  glState().deleteVertexArray(this->vao);
+}
+
+FgResource AutoExposure::addPasses(FrameGraph &graph, FgResource sceneColor,
+                                   GLsizei renderWidth, GLsizei renderHeight,
+                                   float deltaTime) {
+  FgTextureDesc lumDesc = {EXPOSURE_LUMINANCE_SIZE, EXPOSURE_LUMINANCE_SIZE,
+                           GL_R32F};
+  FgTextureDesc histDesc = {EXPOSURE_HISTOGRAM_BINS, 1, GL_R32F};
+  FgTextureDesc exposureDesc = {1, 1, GL_R32F};
+  unsigned int previous = this->current;
+  this->current = 1 - this->current;
+  FgResource lastExposure = graph.importTexture(
+      "lastExposure", this->exposureTex[previous], exposureDesc);
+  FgResource exposure = graph.importTexture(
+      "exposure", this->exposureTex[this->current], exposureDesc);
+  FgResource luminance = FG_INVALID;
+  FgResource histogram = FG_INVALID;
+  float adaptRate = 1.0f - std::exp(-deltaTime * this->adaptSpeed);
+
+  graph.addPass(
+      "luminance",
+      [&](FgPassBuilder &builder) {
+        builder.read(sceneColor);
+        luminance = builder.renderTarget(builder.create("luminance", lumDesc));
+      },
+      [this, &graph, sceneColor, renderWidth, renderHeight]() {
+        this->luminanceShader.useProgram();
+        this->luminanceShader.setVec2Uni("renderSize", (float)renderWidth,
+                                         (float)renderHeight);
+        glState().bindTexture(0, GL_TEXTURE_2D, graph.getTexture(sceneColor));
+        glState().bindVertexArray(this->vao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+      });
+  graph.addPass(
+      "histogram",
+      [&](FgPassBuilder &builder) {
+        builder.read(luminance);
+        histogram = builder.renderTarget(builder.create("histogram", histDesc));
+      },
+      [this, &graph, luminance]() {
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glState().setCapability(GL_BLEND, true);
+        glState().blendFunc(GL_ONE, GL_ONE);
+        this->histogramShader.useProgram();
+        glState().bindTexture(0, GL_TEXTURE_2D, graph.getTexture(luminance));
+        glState().bindVertexArray(this->vao);
+        glDrawArrays(GL_POINTS, 0,
+                     EXPOSURE_LUMINANCE_SIZE * EXPOSURE_LUMINANCE_SIZE);
+        glState().setCapability(GL_BLEND, false);
+      });
+  graph.addPass(
+      "exposure",
+      [&](FgPassBuilder &builder) {
+        builder.read(histogram);
+        builder.read(lastExposure);
+        builder.renderTarget(exposure);
+      },
+      [this, &graph, histogram, lastExposure, adaptRate]() {
+        this->exposureShader.useProgram();
+        this->exposureShader.setFloatUni("lowPercent", this->lowPercent);
+        this->exposureShader.setFloatUni("highPercent", this->highPercent);
+        this->exposureShader.setFloatUni("keyValue", this->keyValue);
+        this->exposureShader.setFloatUni("adaptRate", adaptRate);
+        glState().bindTexture(0, GL_TEXTURE_2D, graph.getTexture(histogram));
+        glState().bindTexture(1, GL_TEXTURE_2D,
+                              graph.getTexture(lastExposure));
+        glState().bindVertexArray(this->vao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+      });
+  return exposure;
+}
+
+#endif
@@ -0,0 +1,532 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Frame graph: a frame is described as passes declaring the textures they
+// read and write, then compiled and executed. Compilation culls passes whose
+// results are never read, computes the lifetime of every transient texture
+// and places transients with disjoint lifetimes and equal descriptions on
+// the same gl texture. Passes run in declaration order, which is a valid
+// order since a pass can only reference handles created before it.
+// Render target writes followed by sampling are ordered by gl itself, a
+// memory barrier is only requested after a storage (image store) write.
+
+#ifndef FRAMEGRAPH_HPP
+#define FRAMEGRAPH_HPP
+
+#include <custom/glstate.hpp>
+#include <custom/trace.hpp>
+#include <glad/glad.h>
+
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+typedef unsigned int FgResource;
+const FgResource FG_INVALID = 0xffffffffu;
+
+struct FgTextureDesc {
+  GLsizei width;
+  GLsizei height;
+  GLenum internalFormat; // GL_RGBA16F, GL_DEPTH_COMPONENT32F, ...
+
+  bool operator==(const FgTextureDesc &d) const {
+    return this->width == d.width && this->height == d.height &&
+           this->internalFormat == d.internalFormat;
+  }
+};
+
+struct FgResourceNode {
+  std::string name;
+  FgTextureDesc desc;
+  bool imported;
+  GLuint texture; // imported texture or the physical transient, 0 default fb
+  unsigned int producer; // last pass writing it
+  unsigned int refCount; // readers left after culling
+  unsigned int firstPass;
+  unsigned int lastPass;
+  bool storageWritten; // last write went through image store
+};
+
+struct FgPass {
+  std::string name;
+  std::vector<FgResource> reads;
+  std::vector<FgResource> writes;
+  std::vector<FgResource> targets;      // writes attached to the framebuffer
+  std::vector<FgResource> storageWrites; // writes through image store
+  bool sideEffect;
+  bool culled;
+  bool needsBarrier;
+  unsigned int refCount;
+  std::function<void()> execute;
+};
+
+class FrameGraph;
+
+// handed to the setup function of a pass
+class FgPassBuilder {
+public:
+  FgPassBuilder(FrameGraph &g, unsigned int p) : graph(g), pass(p) {}
+  // transient texture owned by the graph, alive from its first to its last
+  // use only
+  FgResource create(const std::string &name, const FgTextureDesc &desc);
+  FgResource read(FgResource res);
+  // written by the pass with its own framebuffer, shadow maps for instance
+  FgResource write(FgResource res);
+  // attached to the framebuffer the graph binds before the pass, depth
+  // formats on the depth attachment and the rest as color attachments
+  FgResource renderTarget(FgResource res);
+  // written through image load/store, readers need a memory barrier
+  FgResource writeStorage(FgResource res);
+  // never culled, presenting to the window for instance
+  void sideEffect();
+
+private:
+  FrameGraph &graph;
+  unsigned int pass;
+};
+
+class FrameGraph {
+public:
+  std::vector<FgPass> passes;
+  std::vector<FgResourceNode> resources;
+  // issues the memory barrier between a storage write and its readers,
+  // glMemoryBarrier is not part of the gl 4.0 loader so the owner provides
+  // it when storage writes are used
+  std::function<void()> memoryBarrier;
+
+  // statistics of the last compile
+  unsigned int culledCount;
+  unsigned int barrierCount;
+  unsigned int transientCount;
+  size_t transientBytes; // without aliasing
+  size_t aliasedBytes;   // memory of the physical textures used
+
+  FrameGraph() : culledCount(0), barrierCount(0), transientCount(0),
+                 transientBytes(0), aliasedBytes(0), fbo(0) {}
+  void destroy();
+
+  // graph owned textures stay alive between frames, reset only drops the
+  // passes and the resource handles; compile frees the ones the new frame
+  // did not take, after a resize say
+  void reset();
+  FgResource importTexture(const std::string &name, GLuint tex,
+                           const FgTextureDesc &desc);
+  // texture 0 is the default framebuffer
+  FgResource importBackbuffer(GLsizei width, GLsizei height);
+  unsigned int addPass(const std::string &name,
+                       const std::function<void(FgPassBuilder &)> &setup,
+                       const std::function<void()> &execute);
+  void compile();
+  void execute();
+  // valid inside the execute function of a pass
+  GLuint getTexture(FgResource res) const;
+  void printStats(std::ostream &out) const;
+
+private:
+  struct PhysicalTexture {
+    FgTextureDesc desc;
+    GLuint texture;
+    bool inUse;
+    bool used; // taken by a transient of the current compile
+  };
+  std::vector<PhysicalTexture> physical;
+  std::vector<unsigned int> physicalOf; // per resource, index in physical
+  GLuint fbo;
+
+  unsigned int acquirePhysical(const FgTextureDesc &desc);
+  void releaseUnusedPhysical();
+  void bindTargets(const FgPass &pass);
+
+  friend class FgPassBuilder;
+};
+
+bool fgIsDepthFormat(GLenum internalFormat) {
+  return internalFormat == GL_DEPTH_COMPONENT16 ||
+         internalFormat == GL_DEPTH_COMPONENT24 ||
+         internalFormat == GL_DEPTH_COMPONENT32 ||
+         internalFormat == GL_DEPTH_COMPONENT32F ||
+         internalFormat == GL_DEPTH24_STENCIL8 ||
+         internalFormat == GL_DEPTH32F_STENCIL8;
+}
+
+size_t fgFormatBytes(GLenum internalFormat) {
+  switch (internalFormat) {
+  case GL_R8:
+    return 1;
+  case GL_DEPTH_COMPONENT16:
+    return 2;
+  case GL_RGBA16F:
+  case GL_RG32F:
+  case GL_DEPTH32F_STENCIL8:
+    return 8;
+  case GL_RGBA32F:
+    return 16;
+  default:
+    // rgba8, r32f, rg16f, 24 and 32 bit depth
+    return 4;
+  }
+}
+
+FgResource FgPassBuilder::create(const std::string &name,
+                                 const FgTextureDesc &desc) {
+  FgResourceNode node;
+  node.name = name;
+  node.desc = desc;
+  node.imported = false;
+  node.texture = 0;
+  node.producer = this->pass;
+  node.refCount = 0;
+  node.firstPass = this->pass;
+  node.lastPass = this->pass;
+  node.storageWritten = false;
+  this->graph.resources.push_back(node);
+  return (FgResource)this->graph.resources.size() - 1;
+}
+
+FgResource FgPassBuilder::read(FgResource res) {
+  this->graph.passes[this->pass].reads.push_back(res);
+  return res;
+}
+
+FgResource FgPassBuilder::write(FgResource res) {
+  this->graph.passes[this->pass].writes.push_back(res);
+  this->graph.resources[res].producer = this->pass;
+  return res;
+}
+
+FgResource FgPassBuilder::renderTarget(FgResource res) {
+  this->graph.passes[this->pass].targets.push_back(res);
+  return this->write(res);
+}
+
+FgResource FgPassBuilder::writeStorage(FgResource res) {
+  this->graph.passes[this->pass].storageWrites.push_back(res);
+  return this->write(res);
+}
+
+void FgPassBuilder::sideEffect() {
+  this->graph.passes[this->pass].sideEffect = true;
+}
+
+void FrameGraph::destroy() {
+  for (unsigned int i = 0; i < this->physical.size(); i++) {
+    glState().deleteTexture(this->physical[i].texture);
+  }
+  this->physical.clear();
+  if (this->fbo != 0) {
+    glState().deleteFramebuffer(this->fbo);
+    this->fbo = 0;
+  }
+}
+
+void FrameGraph::reset() {
+  this->passes.clear();
+  this->resources.clear();
+  this->physicalOf.clear();
+  for (unsigned int i = 0; i < this->physical.size(); i++) {
+    this->physical[i].inUse = false;
+    this->physical[i].used = false;
+  }
+}
+
+FgResource FrameGraph::importTexture(const std::string &name, GLuint tex,
+                                     const FgTextureDesc &desc) {
+  FgResourceNode node;
+  node.name = name;
+  node.desc = desc;
+  node.imported = true;
+  node.texture = tex;
+  node.producer = FG_INVALID;
+  node.refCount = 0;
+  node.firstPass = FG_INVALID;
+  node.lastPass = 0;
+  node.storageWritten = false;
+  this->resources.push_back(node);
+  return (FgResource)this->resources.size() - 1;
+}
+
+FgResource FrameGraph::importBackbuffer(GLsizei width, GLsizei height) {
+  FgTextureDesc desc = {width, height, GL_RGBA8};
+  return this->importTexture("backbuffer", 0, desc);
+}
+
+unsigned int
+FrameGraph::addPass(const std::string &name,
+                    const std::function<void(FgPassBuilder &)> &setup,
+                    const std::function<void()> &execute) {
+  FgPass pass;
+  pass.name = name;
+  pass.sideEffect = false;
+  pass.culled = false;
+  pass.needsBarrier = false;
+  pass.refCount = 0;
+  pass.execute = execute;
+  this->passes.push_back(pass);
+  unsigned int index = (unsigned int)this->passes.size() - 1;
+  FgPassBuilder builder(*this, index);
+  setup(builder);
+  return index;
+}
+
+unsigned int FrameGraph::acquirePhysical(const FgTextureDesc &desc) {
+  for (unsigned int i = 0; i < this->physical.size(); i++) {
+    if (!this->physical[i].inUse && this->physical[i].desc == desc) {
+      this->physical[i].inUse = true;
+      this->physical[i].used = true;
+      return i;
+    }
+  }
+  PhysicalTexture p;
+  p.desc = desc;
+  p.inUse = true;
+  p.used = true;
+  bool depth = fgIsDepthFormat(desc.internalFormat);
+  bool stencil = desc.internalFormat == GL_DEPTH24_STENCIL8 ||
+                 desc.internalFormat == GL_DEPTH32F_STENCIL8;
+  GLenum format = stencil ? GL_DEPTH_STENCIL
+                          : (depth ? GL_DEPTH_COMPONENT : GL_RGBA);
+  GLenum type = GL_FLOAT;
+  if (desc.internalFormat == GL_DEPTH24_STENCIL8) {
+    type = GL_UNSIGNED_INT_24_8;
+  } else if (desc.internalFormat == GL_DEPTH32F_STENCIL8) {
+    type = GL_FLOAT_32_UNSIGNED_INT_24_8_REV;
+  }
+  glGenTextures(1, &p.texture);
+  glState().bindTexture(0, GL_TEXTURE_2D, p.texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, desc.internalFormat, desc.width,
+               desc.height, 0, format, type, NULL);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  this->physical.push_back(p);
+  return (unsigned int)this->physical.size() - 1;
+}
+
+void FrameGraph::releaseUnusedPhysical() {
+  // textures no transient of this frame took, their size or format went
+  // out of use; keeping them would grow with every resize
+  std::vector<unsigned int> remap(this->physical.size(), FG_INVALID);
+  unsigned int kept = 0;
+  for (unsigned int i = 0; i < this->physical.size(); i++) {
+    if (!this->physical[i].used) {
+      glState().deleteTexture(this->physical[i].texture);
+      continue;
+    }
+    remap[i] = kept;
+    this->physical[kept++] = this->physical[i];
+  }
+  this->physical.resize(kept);
+  for (unsigned int r = 0; r < this->physicalOf.size(); r++) {
+    if (this->physicalOf[r] != FG_INVALID) {
+      this->physicalOf[r] = remap[this->physicalOf[r]];
+    }
+  }
+}
+
+void FrameGraph::compile() {
+  TRACE_SCOPE("FrameGraph::compile");
+  unsigned int passCount = (unsigned int)this->passes.size();
+  // reference counts, a pass is needed while one of its writes is read or
+  // it writes into an imported texture
+  for (unsigned int p = 0; p < passCount; p++) {
+    FgPass &pass = this->passes[p];
+    pass.refCount = (unsigned int)pass.writes.size();
+    for (unsigned int i = 0; i < pass.writes.size(); i++) {
+      if (this->resources[pass.writes[i]].imported) {
+        pass.sideEffect = true;
+      }
+    }
+    for (unsigned int i = 0; i < pass.reads.size(); i++) {
+      this->resources[pass.reads[i]].refCount++;
+    }
+  }
+  std::vector<FgResource> unused;
+  for (unsigned int r = 0; r < this->resources.size(); r++) {
+    if (this->resources[r].refCount == 0 && !this->resources[r].imported) {
+      unused.push_back(r);
+    }
+  }
+  while (!unused.empty()) {
+    FgResource r = unused.back();
+    unused.pop_back();
+    unsigned int producer = this->resources[r].producer;
+    if (producer == FG_INVALID) {
+      continue;
+    }
+    FgPass &pass = this->passes[producer];
+    if (pass.refCount == 0 || --pass.refCount > 0 || pass.sideEffect) {
+      continue;
+    }
+    pass.culled = true;
+    for (unsigned int i = 0; i < pass.reads.size(); i++) {
+      FgResourceNode &read = this->resources[pass.reads[i]];
+      if (--read.refCount == 0 && !read.imported) {
+        unused.push_back(pass.reads[i]);
+      }
+    }
+  }
+  // a pass without writes has nothing to keep it alive unless flagged
+  for (unsigned int p = 0; p < passCount; p++) {
+    if (this->passes[p].writes.empty() && !this->passes[p].sideEffect) {
+      this->passes[p].culled = true;
+    }
+  }
+
+  // lifetimes and barriers over the surviving passes
+  this->culledCount = 0;
+  this->barrierCount = 0;
+  for (unsigned int r = 0; r < this->resources.size(); r++) {
+    this->resources[r].firstPass = FG_INVALID;
+    this->resources[r].storageWritten = false;
+  }
+  for (unsigned int p = 0; p < passCount; p++) {
+    FgPass &pass = this->passes[p];
+    if (pass.culled) {
+      this->culledCount++;
+      continue;
+    }
+    for (unsigned int i = 0; i < pass.reads.size(); i++) {
+      FgResourceNode &res = this->resources[pass.reads[i]];
+      pass.needsBarrier = pass.needsBarrier || res.storageWritten;
+    }
+    if (pass.needsBarrier) {
+      this->barrierCount++;
+      for (unsigned int i = 0; i < pass.reads.size(); i++) {
+        this->resources[pass.reads[i]].storageWritten = false;
+      }
+    }
+    std::vector<FgResource> used(pass.reads);
+    used.insert(used.end(), pass.writes.begin(), pass.writes.end());
+    for (unsigned int i = 0; i < used.size(); i++) {
+      FgResourceNode &res = this->resources[used[i]];
+      if (res.firstPass == FG_INVALID) {
+        res.firstPass = p;
+      }
+      res.lastPass = p;
+    }
+    for (unsigned int i = 0; i < pass.storageWrites.size(); i++) {
+      this->resources[pass.storageWrites[i]].storageWritten = true;
+    }
+  }
+
+  // aliasing, a transient takes a free physical texture at its first pass
+  // and gives it back after its last one
+  this->physicalOf.assign(this->resources.size(), FG_INVALID);
+  this->transientCount = 0;
+  this->transientBytes = 0;
+  for (unsigned int p = 0; p < passCount; p++) {
+    for (unsigned int r = 0; r < this->resources.size(); r++) {
+      FgResourceNode &res = this->resources[r];
+      if (res.imported || res.firstPass != p) {
+        continue;
+      }
+      this->physicalOf[r] = this->acquirePhysical(res.desc);
+      res.texture = this->physical[this->physicalOf[r]].texture;
+      this->transientCount++;
+      this->transientBytes += (size_t)res.desc.width * res.desc.height *
+                              fgFormatBytes(res.desc.internalFormat);
+    }
+    for (unsigned int r = 0; r < this->resources.size(); r++) {
+      if (this->physicalOf[r] != FG_INVALID &&
+          this->resources[r].lastPass == p) {
+        this->physical[this->physicalOf[r]].inUse = false;
+      }
+    }
+  }
+  this->releaseUnusedPhysical();
+  this->aliasedBytes = 0;
+  for (unsigned int i = 0; i < this->physical.size(); i++) {
+    const FgTextureDesc &d = this->physical[i].desc;
+    this->aliasedBytes +=
+        (size_t)d.width * d.height * fgFormatBytes(d.internalFormat);
+  }
+}
+
+void FrameGraph::bindTargets(const FgPass &pass) {
+  if (pass.targets.empty()) {
+    return;
+  }
+  const FgResourceNode &first = this->resources[pass.targets[0]];
+  if (first.imported && first.texture == 0) {
+    glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+    glState().viewport(0, 0, first.desc.width, first.desc.height);
+    return;
+  }
+  if (this->fbo == 0) {
+    glGenFramebuffers(1, &this->fbo);
+  }
+  glState().bindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+  // attachments of the previous pass may still be there
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                         GL_TEXTURE_2D, 0, 0);
+  std::vector<GLenum> drawBuffers;
+  for (unsigned int i = 0; i < pass.targets.size(); i++) {
+    const FgResourceNode &res = this->resources[pass.targets[i]];
+    GLenum format = res.desc.internalFormat;
+    if (format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8) {
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT,
+                             GL_TEXTURE_2D, res.texture, 0);
+    } else if (fgIsDepthFormat(format)) {
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT,
+                             GL_TEXTURE_2D, res.texture, 0);
+    } else {
+      GLenum attachment = GL_COLOR_ATTACHMENT0 + (GLenum)drawBuffers.size();
+      glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D,
+                             res.texture, 0);
+      drawBuffers.push_back(attachment);
+    }
+  }
+  for (unsigned int i = (unsigned int)drawBuffers.size(); i < 8; i++) {
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i,
+                           GL_TEXTURE_2D, 0, 0);
+  }
+  if (drawBuffers.empty()) {
+    glDrawBuffer(GL_NONE);
+  } else {
+    glDrawBuffers((GLsizei)drawBuffers.size(), drawBuffers.data());
+  }
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    std::cout << "frame graph: incomplete framebuffer in pass " << pass.name
+              << std::endl;
+  }
+  glState().viewport(0, 0, first.desc.width, first.desc.height);
+}
+
+void FrameGraph::execute() {
+  for (unsigned int p = 0; p < this->passes.size(); p++) {
+    const FgPass &pass = this->passes[p];
+    if (pass.culled) {
+      continue;
+    }
+    if (pass.needsBarrier) {
+      if (this->memoryBarrier) {
+        this->memoryBarrier();
+      } else {
+        std::cout << "frame graph: pass " << pass.name
+                  << " reads a storage write but no memory barrier is set"
+                  << std::endl;
+      }
+    }
+    // the name belongs to the graph, it goes in as the detail
+    TRACE_SCOPE_DETAIL("pass", pass.name.c_str());
+    this->bindTargets(pass);
+    pass.execute();
+  }
+  glState().bindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+GLuint FrameGraph::getTexture(FgResource res) const {
+  return this->resources[res].texture;
+}
+
+void FrameGraph::printStats(std::ostream &out) const {
+  out << "frame graph: " << this->passes.size() << " passes, "
+      << this->culledCount << " culled, " << this->barrierCount
+      << " barriers, " << this->transientCount << " transients in "
+      << this->physical.size() << " textures, " << this->transientBytes
+      << " bytes aliased to " << this->aliasedBytes << std::endl;
+}
+
+#endif
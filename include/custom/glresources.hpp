@@ -0,0 +1,528 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Accounting of the gl objects a program holds. install() swaps the glad
+// entry points that create, size and delete buffers, textures, vertex
+// arrays, programs and framebuffers for hooks that record every object:
+// its size as given to glBufferData and glTexImage, the frame it was made
+// in and the code that made it. The rest of the tree keeps calling gl as
+// before.
+// Objects created after beginLoop() belong to a frame. One of them still
+// alive leakFrames frames later is reported, once per creation site, as a
+// likely leak. reportLive() lists what is left when the program ends.
+// Sizes are what the calls ask for, the driver may pad or compress.
+
+#ifndef GLRESOURCES_HPP
+#define GLRESOURCES_HPP
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <deque>
+#include <dlfcn.h>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <unordered_map>
+
+// object kinds
+const unsigned int GL_RESOURCE_BUFFER = 0;
+const unsigned int GL_RESOURCE_TEXTURE = 1;
+const unsigned int GL_RESOURCE_VERTEX_ARRAY = 2;
+const unsigned int GL_RESOURCE_PROGRAM = 3;
+const unsigned int GL_RESOURCE_FRAMEBUFFER = 4;
+const unsigned int GL_RESOURCE_KIND_COUNT = 5;
+
+const char *GL_RESOURCE_NAMES[GL_RESOURCE_KIND_COUNT] = {
+    "buffer", "texture", "vertex array", "program", "framebuffer"};
+
+struct GlResource {
+  uint64_t bytes;
+  unsigned int frame; // frame it was created in
+  const void *site;   // return address of the creating call
+  bool perFrame;      // created inside the render loop
+};
+
+class GlResourceTracker {
+public:
+  // per frame objects older than this are reported
+  unsigned int leakFrames;
+  unsigned int frameCount;
+  // per frame objects reported so far
+  unsigned int suspects;
+
+  GlResourceTracker();
+  // after gladLoadGLLoader, objects made before are not seen
+  void install();
+  void beginLoop() { this->inLoop = true; }
+  void endFrame();
+
+  unsigned int liveCount(unsigned int kind) const {
+    return (unsigned int)this->live[kind].size();
+  }
+  uint64_t liveBytes(unsigned int kind) const { return this->bytes[kind]; }
+  void report(std::ostream &out) const;
+  // objects never deleted, by creation site
+  void reportLive(std::ostream &out) const;
+
+  // called by the hooks
+  void created(unsigned int kind, GLsizei n, const GLuint *names,
+               const void *site);
+  void deleted(unsigned int kind, GLsizei n, const GLuint *names);
+  void bufferData(GLenum target, GLsizeiptr size);
+  void textureImage(GLenum target, GLint level, GLint internalFormat,
+                    GLsizei width, GLsizei height, GLsizei depth);
+  void generateMipmap(GLenum target);
+
+  // the gl entry points the hooks forward to
+  PFNGLGENBUFFERSPROC genBuffers;
+  PFNGLDELETEBUFFERSPROC deleteBuffers;
+  PFNGLBUFFERDATAPROC bufferDataProc;
+  PFNGLGENTEXTURESPROC genTextures;
+  PFNGLDELETETEXTURESPROC deleteTextures;
+  PFNGLTEXIMAGE2DPROC texImage2D;
+  PFNGLTEXIMAGE3DPROC texImage3D;
+  PFNGLGENERATEMIPMAPPROC generateMipmapProc;
+  PFNGLGENVERTEXARRAYSPROC genVertexArrays;
+  PFNGLDELETEVERTEXARRAYSPROC deleteVertexArrays;
+  PFNGLCREATEPROGRAMPROC createProgram;
+  PFNGLDELETEPROGRAMPROC deleteProgram;
+  PFNGLGENFRAMEBUFFERSPROC genFramebuffers;
+  PFNGLDELETEFRAMEBUFFERSPROC deleteFramebuffers;
+
+private:
+  std::unordered_map<GLuint, GlResource> live[GL_RESOURCE_KIND_COUNT];
+  // bytes of every level and cube face of a texture
+  std::unordered_map<GLuint, std::map<uint32_t, uint64_t>> textureLevels;
+  uint64_t bytes[GL_RESOURCE_KIND_COUNT];
+  uint64_t peakBytes[GL_RESOURCE_KIND_COUNT];
+  unsigned int createdCount[GL_RESOURCE_KIND_COUNT];
+  unsigned int deletedCount[GL_RESOURCE_KIND_COUNT];
+  bool installed;
+  bool inLoop;
+  // per frame objects in creation order, checked once they are old enough
+  struct Pending {
+    unsigned int kind;
+    GLuint name;
+    unsigned int frame;
+  };
+  std::deque<Pending> young;
+  std::set<const void *> reportedSites;
+
+  void setBytes(unsigned int kind, GLuint name, uint64_t value);
+};
+
+GlResourceTracker &glResources() {
+  // gl names belong to the context, one tracker like glState()
+  static GlResourceTracker tracker;
+  return tracker;
+}
+
+std::string glResourceSite(const void *site) {
+  // symbol names need -rdynamic, otherwise the module offset is printed
+  // for addr2line
+  Dl_info info;
+  if (site == NULL || dladdr(site, &info) == 0) {
+    return "unknown";
+  }
+  char buf[32];
+  if (info.dli_sname != NULL) {
+    int status = 0;
+    char *name = abi::__cxa_demangle(info.dli_sname, NULL, NULL, &status);
+    std::string s = status == 0 ? name : info.dli_sname;
+    std::free(name);
+    std::snprintf(buf, sizeof(buf), "+0x%lx",
+                  (unsigned long)((const char *)site -
+                                  (const char *)info.dli_saddr));
+    return s + buf;
+  }
+  std::snprintf(buf, sizeof(buf), "+0x%lx",
+                (unsigned long)((const char *)site -
+                                (const char *)info.dli_fbase));
+  return std::string(info.dli_fname) + buf;
+}
+
+uint64_t glTexelBytes(GLint internalFormat) {
+  // three channel formats are counted padded to four, as drivers keep them
+  switch (internalFormat) {
+  case GL_RED:
+  case GL_R8:
+    return 1;
+  case GL_RG:
+  case GL_RG8:
+  case GL_R16F:
+    return 2;
+  case GL_RG16F:
+  case GL_R32F:
+  case GL_DEPTH_COMPONENT:
+  case GL_DEPTH_COMPONENT24:
+  case GL_DEPTH_COMPONENT32F:
+  case GL_DEPTH24_STENCIL8:
+    return 4;
+  case GL_RGB16F:
+  case GL_RGBA16F:
+  case GL_RG32F:
+  case GL_DEPTH32F_STENCIL8:
+    return 8;
+  case GL_RGB32F:
+  case GL_RGBA32F:
+    return 16;
+  default:
+    // rgb, rgba, srgb and the 8 bit integer formats
+    return 4;
+  }
+}
+
+GLenum glTextureBindingOf(GLenum target) {
+  switch (target) {
+  case GL_TEXTURE_2D:
+    return GL_TEXTURE_BINDING_2D;
+  case GL_TEXTURE_2D_ARRAY:
+    return GL_TEXTURE_BINDING_2D_ARRAY;
+  case GL_TEXTURE_3D:
+    return GL_TEXTURE_BINDING_3D;
+  case GL_TEXTURE_1D_ARRAY:
+    return GL_TEXTURE_BINDING_1D_ARRAY;
+  case GL_TEXTURE_RECTANGLE:
+    return GL_TEXTURE_BINDING_RECTANGLE;
+  case GL_TEXTURE_CUBE_MAP:
+  case GL_TEXTURE_CUBE_MAP_POSITIVE_X:
+  case GL_TEXTURE_CUBE_MAP_NEGATIVE_X:
+  case GL_TEXTURE_CUBE_MAP_POSITIVE_Y:
+  case GL_TEXTURE_CUBE_MAP_NEGATIVE_Y:
+  case GL_TEXTURE_CUBE_MAP_POSITIVE_Z:
+  case GL_TEXTURE_CUBE_MAP_NEGATIVE_Z:
+    return GL_TEXTURE_BINDING_CUBE_MAP;
+  default:
+    // proxy targets allocate nothing
+    return 0;
+  }
+}
+
+GLenum glBufferBindingOf(GLenum target) {
+  switch (target) {
+  case GL_ARRAY_BUFFER:
+    return GL_ARRAY_BUFFER_BINDING;
+  case GL_ELEMENT_ARRAY_BUFFER:
+    return GL_ELEMENT_ARRAY_BUFFER_BINDING;
+  case GL_PIXEL_PACK_BUFFER:
+    return GL_PIXEL_PACK_BUFFER_BINDING;
+  case GL_PIXEL_UNPACK_BUFFER:
+    return GL_PIXEL_UNPACK_BUFFER_BINDING;
+  case GL_UNIFORM_BUFFER:
+    return GL_UNIFORM_BUFFER_BINDING;
+  case GL_TEXTURE_BUFFER:
+    return GL_TEXTURE_BINDING_BUFFER;
+  case GL_TRANSFORM_FEEDBACK_BUFFER:
+    return GL_TRANSFORM_FEEDBACK_BUFFER_BINDING;
+  case GL_DRAW_INDIRECT_BUFFER:
+    return GL_DRAW_INDIRECT_BUFFER_BINDING;
+  case GL_COPY_READ_BUFFER:
+  case GL_COPY_WRITE_BUFFER:
+    // the binding queries share the name of the target
+    return target;
+  default:
+    return 0;
+  }
+}
+
+// hooks, the return address is the code that asked for the object
+void APIENTRY glResourceGenBuffers(GLsizei n, GLuint *names) {
+  glResources().genBuffers(n, names);
+  glResources().created(GL_RESOURCE_BUFFER, n, names,
+                        __builtin_return_address(0));
+}
+void APIENTRY glResourceDeleteBuffers(GLsizei n, const GLuint *names) {
+  glResources().deleted(GL_RESOURCE_BUFFER, n, names);
+  glResources().deleteBuffers(n, names);
+}
+void APIENTRY glResourceBufferData(GLenum target, GLsizeiptr size,
+                                   const void *data, GLenum usage) {
+  glResources().bufferDataProc(target, size, data, usage);
+  glResources().bufferData(target, size);
+}
+void APIENTRY glResourceGenTextures(GLsizei n, GLuint *names) {
+  glResources().genTextures(n, names);
+  glResources().created(GL_RESOURCE_TEXTURE, n, names,
+                        __builtin_return_address(0));
+}
+void APIENTRY glResourceDeleteTextures(GLsizei n, const GLuint *names) {
+  glResources().deleted(GL_RESOURCE_TEXTURE, n, names);
+  glResources().deleteTextures(n, names);
+}
+void APIENTRY glResourceTexImage2D(GLenum target, GLint level,
+                                   GLint internalFormat, GLsizei width,
+                                   GLsizei height, GLint border,
+                                   GLenum format, GLenum type,
+                                   const void *pixels) {
+  glResources().texImage2D(target, level, internalFormat, width, height,
+                           border, format, type, pixels);
+  glResources().textureImage(target, level, internalFormat, width, height,
+                             1);
+}
+void APIENTRY glResourceTexImage3D(GLenum target, GLint level,
+                                   GLint internalFormat, GLsizei width,
+                                   GLsizei height, GLsizei depth,
+                                   GLint border, GLenum format, GLenum type,
+                                   const void *pixels) {
+  glResources().texImage3D(target, level, internalFormat, width, height,
+                           depth, border, format, type, pixels);
+  glResources().textureImage(target, level, internalFormat, width, height,
+                             depth);
+}
+void APIENTRY glResourceGenerateMipmap(GLenum target) {
+  glResources().generateMipmapProc(target);
+  glResources().generateMipmap(target);
+}
+void APIENTRY glResourceGenVertexArrays(GLsizei n, GLuint *names) {
+  glResources().genVertexArrays(n, names);
+  glResources().created(GL_RESOURCE_VERTEX_ARRAY, n, names,
+                        __builtin_return_address(0));
+}
+void APIENTRY glResourceDeleteVertexArrays(GLsizei n, const GLuint *names) {
+  glResources().deleted(GL_RESOURCE_VERTEX_ARRAY, n, names);
+  glResources().deleteVertexArrays(n, names);
+}
+GLuint APIENTRY glResourceCreateProgram() {
+  GLuint name = glResources().createProgram();
+  glResources().created(GL_RESOURCE_PROGRAM, 1, &name,
+                        __builtin_return_address(0));
+  return name;
+}
+void APIENTRY glResourceDeleteProgram(GLuint name) {
+  glResources().deleted(GL_RESOURCE_PROGRAM, 1, &name);
+  glResources().deleteProgram(name);
+}
+void APIENTRY glResourceGenFramebuffers(GLsizei n, GLuint *names) {
+  glResources().genFramebuffers(n, names);
+  glResources().created(GL_RESOURCE_FRAMEBUFFER, n, names,
+                        __builtin_return_address(0));
+}
+void APIENTRY glResourceDeleteFramebuffers(GLsizei n, const GLuint *names) {
+  glResources().deleted(GL_RESOURCE_FRAMEBUFFER, n, names);
+  glResources().deleteFramebuffers(n, names);
+}
+
+GlResourceTracker::GlResourceTracker()
+    : leakFrames(120), frameCount(0), suspects(0), installed(false),
+      inLoop(false) {
+  for (unsigned int k = 0; k < GL_RESOURCE_KIND_COUNT; k++) {
+    this->bytes[k] = 0;
+    this->peakBytes[k] = 0;
+    this->createdCount[k] = 0;
+    this->deletedCount[k] = 0;
+  }
+}
+
+void GlResourceTracker::install() {
+  if (this->installed) {
+    return;
+  }
+  this->installed = true;
+  this->genBuffers = glad_glGenBuffers;
+  this->deleteBuffers = glad_glDeleteBuffers;
+  this->bufferDataProc = glad_glBufferData;
+  this->genTextures = glad_glGenTextures;
+  this->deleteTextures = glad_glDeleteTextures;
+  this->texImage2D = glad_glTexImage2D;
+  this->texImage3D = glad_glTexImage3D;
+  this->generateMipmapProc = glad_glGenerateMipmap;
+  this->genVertexArrays = glad_glGenVertexArrays;
+  this->deleteVertexArrays = glad_glDeleteVertexArrays;
+  this->createProgram = glad_glCreateProgram;
+  this->deleteProgram = glad_glDeleteProgram;
+  this->genFramebuffers = glad_glGenFramebuffers;
+  this->deleteFramebuffers = glad_glDeleteFramebuffers;
+  glad_glGenBuffers = glResourceGenBuffers;
+  glad_glDeleteBuffers = glResourceDeleteBuffers;
+  glad_glBufferData = glResourceBufferData;
+  glad_glGenTextures = glResourceGenTextures;
+  glad_glDeleteTextures = glResourceDeleteTextures;
+  glad_glTexImage2D = glResourceTexImage2D;
+  glad_glTexImage3D = glResourceTexImage3D;
+  glad_glGenerateMipmap = glResourceGenerateMipmap;
+  glad_glGenVertexArrays = glResourceGenVertexArrays;
+  glad_glDeleteVertexArrays = glResourceDeleteVertexArrays;
+  glad_glCreateProgram = glResourceCreateProgram;
+  glad_glDeleteProgram = glResourceDeleteProgram;
+  glad_glGenFramebuffers = glResourceGenFramebuffers;
+  glad_glDeleteFramebuffers = glResourceDeleteFramebuffers;
+}
+
+void GlResourceTracker::created(unsigned int kind, GLsizei n,
+                                const GLuint *names, const void *site) {
+  for (GLsizei i = 0; i < n; i++) {
+    if (names[i] == 0) {
+      continue;
+    }
+    GlResource r;
+    r.bytes = 0;
+    r.frame = this->frameCount;
+    r.site = site;
+    r.perFrame = this->inLoop;
+    this->live[kind][names[i]] = r;
+    this->createdCount[kind]++;
+    if (r.perFrame) {
+      Pending p = {kind, names[i], r.frame};
+      this->young.push_back(p);
+    }
+  }
+}
+
+void GlResourceTracker::deleted(unsigned int kind, GLsizei n,
+                                const GLuint *names) {
+  for (GLsizei i = 0; i < n; i++) {
+    std::unordered_map<GLuint, GlResource>::iterator it =
+        this->live[kind].find(names[i]);
+    if (it == this->live[kind].end()) {
+      // 0, a name made before install or deleted twice
+      continue;
+    }
+    this->bytes[kind] -= it->second.bytes;
+    this->live[kind].erase(it);
+    if (kind == GL_RESOURCE_TEXTURE) {
+      this->textureLevels.erase(names[i]);
+    }
+    this->deletedCount[kind]++;
+  }
+}
+
+void GlResourceTracker::setBytes(unsigned int kind, GLuint name,
+                                 uint64_t value) {
+  std::unordered_map<GLuint, GlResource>::iterator it =
+      this->live[kind].find(name);
+  if (it == this->live[kind].end()) {
+    return;
+  }
+  this->bytes[kind] += value - it->second.bytes;
+  it->second.bytes = value;
+  if (this->bytes[kind] > this->peakBytes[kind]) {
+    this->peakBytes[kind] = this->bytes[kind];
+  }
+}
+
+void GlResourceTracker::bufferData(GLenum target, GLsizeiptr size) {
+  GLenum binding = glBufferBindingOf(target);
+  if (binding == 0) {
+    return;
+  }
+  // the binding is client state, asking for it does not stall
+  GLint name = 0;
+  glGetIntegerv(binding, &name);
+  this->setBytes(GL_RESOURCE_BUFFER, (GLuint)name, (uint64_t)size);
+}
+
+void GlResourceTracker::textureImage(GLenum target, GLint level,
+                                     GLint internalFormat, GLsizei width,
+                                     GLsizei height, GLsizei depth) {
+  GLenum binding = glTextureBindingOf(target);
+  if (binding == 0) {
+    return;
+  }
+  GLint name = 0;
+  glGetIntegerv(binding, &name);
+  if (this->live[GL_RESOURCE_TEXTURE].count((GLuint)name) == 0) {
+    return;
+  }
+  uint32_t face = 0;
+  if (target >= GL_TEXTURE_CUBE_MAP_POSITIVE_X &&
+      target <= GL_TEXTURE_CUBE_MAP_NEGATIVE_Z) {
+    face = target - GL_TEXTURE_CUBE_MAP_POSITIVE_X;
+  }
+  std::map<uint32_t, uint64_t> &levels = this->textureLevels[(GLuint)name];
+  levels[(face << 16) | (uint32_t)level] =
+      (uint64_t)width * height * depth * glTexelBytes(internalFormat);
+  uint64_t total = 0;
+  for (std::map<uint32_t, uint64_t>::iterator it = levels.begin();
+       it != levels.end(); it++) {
+    total += it->second;
+  }
+  this->setBytes(GL_RESOURCE_TEXTURE, (GLuint)name, total);
+}
+
+void GlResourceTracker::generateMipmap(GLenum target) {
+  GLenum binding = glTextureBindingOf(target);
+  if (binding == 0) {
+    return;
+  }
+  GLint name = 0;
+  glGetIntegerv(binding, &name);
+  std::unordered_map<GLuint, std::map<uint32_t, uint64_t>>::iterator found =
+      this->textureLevels.find((GLuint)name);
+  if (found == this->textureLevels.end()) {
+    return;
+  }
+  // the chain below a base level adds a third of it, layers do not shrink
+  std::map<uint32_t, uint64_t> &levels = found->second;
+  uint64_t total = 0;
+  for (std::map<uint32_t, uint64_t>::iterator it = levels.begin();
+       it != levels.end(); it++) {
+    if ((it->first & 0xffff) == 0) {
+      total += it->second + it->second / 3;
+    }
+  }
+  this->setBytes(GL_RESOURCE_TEXTURE, (GLuint)name, total);
+}
+
+void GlResourceTracker::endFrame() {
+  this->frameCount++;
+  while (!this->young.empty() &&
+         this->young.front().frame + this->leakFrames <= this->frameCount) {
+    Pending p = this->young.front();
+    this->young.pop_front();
+    std::unordered_map<GLuint, GlResource>::iterator it =
+        this->live[p.kind].find(p.name);
+    // deleted, or the name went to a later object
+    if (it == this->live[p.kind].end() || it->second.frame != p.frame) {
+      continue;
+    }
+    this->suspects++;
+    if (this->reportedSites.insert(it->second.site).second) {
+      std::cout << "gl resource: " << GL_RESOURCE_NAMES[p.kind] << " "
+                << p.name << " made in frame " << p.frame << " by "
+                << glResourceSite(it->second.site) << " is still alive "
+                << this->leakFrames << " frames later" << std::endl;
+    }
+  }
+}
+
+void GlResourceTracker::report(std::ostream &out) const {
+  out << "gl resources after " << this->frameCount << " frames:" << std::endl;
+  for (unsigned int k = 0; k < GL_RESOURCE_KIND_COUNT; k++) {
+    out << "  " << GL_RESOURCE_NAMES[k] << ": " << this->live[k].size()
+        << " live, " << this->bytes[k] / 1024 << " kb, peak "
+        << this->peakBytes[k] / 1024 << " kb, " << this->createdCount[k]
+        << " created, " << this->deletedCount[k] << " deleted"
+        << std::endl;
+  }
+  out << "  per frame objects that outlived " << this->leakFrames
+      << " frames: " << this->suspects << std::endl;
+}
+
+void GlResourceTracker::reportLive(std::ostream &out) const {
+  for (unsigned int k = 0; k < GL_RESOURCE_KIND_COUNT; k++) {
+    // count and bytes per creation site
+    std::map<const void *, std::pair<unsigned int, uint64_t>> sites;
+    for (std::unordered_map<GLuint, GlResource>::const_iterator it =
+             this->live[k].begin();
+         it != this->live[k].end(); it++) {
+      std::pair<unsigned int, uint64_t> &s = sites[it->second.site];
+      s.first++;
+      s.second += it->second.bytes;
+    }
+    for (std::map<const void *, std::pair<unsigned int, uint64_t>>::iterator
+             it = sites.begin();
+         it != sites.end(); it++) {
+      out << "gl resource: " << it->second.first << " "
+          << GL_RESOURCE_NAMES[k] << " (" << it->second.second / 1024
+          << " kb) never deleted, made by " << glResourceSite(it->first)
+          << std::endl;
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,368 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Shadow copy of the gl binding state. Binds and state changes go through
+// glState(), a call setting what is already set is dropped before it
+// reaches the driver. Everything the render loop touches has to go through
+// the cache for the shadow copy to stay right, invalidate() forgets it all
+// after code that talks to gl directly (loading, baking).
+
+#ifndef GLSTATE_HPP
+#define GLSTATE_HPP
+
+#include <glad/glad.h>
+
+#include <iostream>
+
+const unsigned int GL_STATE_TEXTURE_UNITS = 16;
+const GLuint GL_STATE_UNKNOWN = 0xffffffffu;
+
+// call kinds for the statistics
+const unsigned int GL_STATE_PROGRAM = 0;
+const unsigned int GL_STATE_VERTEX_ARRAY = 1;
+const unsigned int GL_STATE_TEXTURE = 2;
+const unsigned int GL_STATE_SAMPLER = 3;
+const unsigned int GL_STATE_FRAMEBUFFER = 4;
+const unsigned int GL_STATE_FIXED = 5; // capabilities, depth, blend, viewport
+const unsigned int GL_STATE_KIND_COUNT = 6;
+
+class GlStateCache {
+public:
+  // calls sent to gl and calls dropped, per kind, since resetCounters
+  unsigned int issued[GL_STATE_KIND_COUNT];
+  unsigned int filtered[GL_STATE_KIND_COUNT];
+  unsigned int frameCount;
+
+  GlStateCache();
+  void invalidate();
+  void resetCounters();
+
+  void useProgram(GLuint program);
+  void bindVertexArray(GLuint vao);
+  // binds to the given unit, the active unit is switched only if needed
+  void bindTexture(unsigned int unit, GLenum target, GLuint tex);
+  void bindSampler(unsigned int unit, GLuint sampler);
+  // GL_FRAMEBUFFER sets both the draw and the read binding
+  void bindFramebuffer(GLenum target, GLuint fbo);
+  GLuint framebuffer(GLenum target);
+  void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+  void getViewport(GLint out[4]);
+  void setCapability(GLenum cap, bool enabled);
+  void depthFunc(GLenum func);
+  void depthMask(GLboolean mask);
+  void blendFunc(GLenum src, GLenum dst);
+
+  // deleting a bound object resets its binding to 0 in gl, the names are
+  // reused by the next glGen call so the cache must see the deletion
+  void deleteVertexArray(GLuint vao);
+  void deleteTexture(GLuint tex);
+  void deleteFramebuffer(GLuint fbo);
+
+  void endFrame() { this->frameCount++; }
+  void report(std::ostream &out) const;
+
+private:
+  GLuint program;
+  GLuint vao;
+  GLuint activeUnit;
+  // 2d, 2d array, cube map and 3d bindings of every unit
+  GLuint textures[GL_STATE_TEXTURE_UNITS][4];
+  GLuint samplers[GL_STATE_TEXTURE_UNITS];
+  GLuint drawFbo;
+  GLuint readFbo;
+  GLint viewportBox[4];
+  bool viewportKnown;
+  // depth test, blend, cull face, depth clamp, seamless cube map, srgb
+  // framebuffer, -1 unknown
+  int capabilities[6];
+  GLenum depthFuncState;
+  int depthMaskState;
+  GLenum blendSrc;
+  GLenum blendDst;
+
+  bool redundant(unsigned int kind, bool same) {
+    if (same) {
+      this->filtered[kind]++;
+    } else {
+      this->issued[kind]++;
+    }
+    return same;
+  }
+};
+
+int glStateTextureSlot(GLenum target) {
+  switch (target) {
+  case GL_TEXTURE_2D:
+    return 0;
+  case GL_TEXTURE_2D_ARRAY:
+    return 1;
+  case GL_TEXTURE_CUBE_MAP:
+    return 2;
+  case GL_TEXTURE_3D:
+    return 3;
+  default:
+    return -1;
+  }
+}
+
+int glStateCapabilitySlot(GLenum cap) {
+  switch (cap) {
+  case GL_DEPTH_TEST:
+    return 0;
+  case GL_BLEND:
+    return 1;
+  case GL_CULL_FACE:
+    return 2;
+  case GL_DEPTH_CLAMP:
+    return 3;
+  case GL_TEXTURE_CUBE_MAP_SEAMLESS:
+    return 4;
+  case GL_FRAMEBUFFER_SRGB:
+    return 5;
+  default:
+    return -1;
+  }
+}
+
+GlStateCache::GlStateCache() {
+  this->invalidate();
+  this->resetCounters();
+}
+
+void GlStateCache::invalidate() {
+  this->program = GL_STATE_UNKNOWN;
+  this->vao = GL_STATE_UNKNOWN;
+  this->activeUnit = GL_STATE_UNKNOWN;
+  for (unsigned int u = 0; u < GL_STATE_TEXTURE_UNITS; u++) {
+    for (unsigned int t = 0; t < 4; t++) {
+      this->textures[u][t] = GL_STATE_UNKNOWN;
+    }
+    this->samplers[u] = GL_STATE_UNKNOWN;
+  }
+  this->drawFbo = GL_STATE_UNKNOWN;
+  this->readFbo = GL_STATE_UNKNOWN;
+  this->viewportKnown = false;
+  for (unsigned int c = 0; c < 6; c++) {
+    this->capabilities[c] = -1;
+  }
+  this->depthFuncState = GL_STATE_UNKNOWN;
+  this->depthMaskState = -1;
+  this->blendSrc = GL_STATE_UNKNOWN;
+  this->blendDst = GL_STATE_UNKNOWN;
+}
+
+void GlStateCache::resetCounters() {
+  for (unsigned int k = 0; k < GL_STATE_KIND_COUNT; k++) {
+    this->issued[k] = 0;
+    this->filtered[k] = 0;
+  }
+  this->frameCount = 0;
+}
+
+void GlStateCache::useProgram(GLuint prog) {
+  if (this->redundant(GL_STATE_PROGRAM, this->program == prog)) {
+    return;
+  }
+  glUseProgram(prog);
+  this->program = prog;
+}
+
+void GlStateCache::bindVertexArray(GLuint array) {
+  if (this->redundant(GL_STATE_VERTEX_ARRAY, this->vao == array)) {
+    return;
+  }
+  glBindVertexArray(array);
+  this->vao = array;
+}
+
+void GlStateCache::bindTexture(unsigned int unit, GLenum target, GLuint tex) {
+  int slot = glStateTextureSlot(target);
+  bool known = slot >= 0 && unit < GL_STATE_TEXTURE_UNITS;
+  if (known && this->redundant(GL_STATE_TEXTURE,
+                               this->textures[unit][slot] == tex)) {
+    return;
+  }
+  // the unit switch is part of the bind, not counted on its own
+  if (this->activeUnit != unit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    this->activeUnit = unit;
+  }
+  glBindTexture(target, tex);
+  if (known) {
+    this->textures[unit][slot] = tex;
+  } else {
+    this->issued[GL_STATE_TEXTURE]++;
+  }
+}
+
+void GlStateCache::bindSampler(unsigned int unit, GLuint sampler) {
+  bool known = unit < GL_STATE_TEXTURE_UNITS;
+  if (known &&
+      this->redundant(GL_STATE_SAMPLER, this->samplers[unit] == sampler)) {
+    return;
+  }
+  glBindSampler(unit, sampler);
+  if (known) {
+    this->samplers[unit] = sampler;
+  } else {
+    this->issued[GL_STATE_SAMPLER]++;
+  }
+}
+
+void GlStateCache::bindFramebuffer(GLenum target, GLuint fbo) {
+  bool same;
+  if (target == GL_DRAW_FRAMEBUFFER) {
+    same = this->drawFbo == fbo;
+  } else if (target == GL_READ_FRAMEBUFFER) {
+    same = this->readFbo == fbo;
+  } else {
+    same = this->drawFbo == fbo && this->readFbo == fbo;
+  }
+  if (this->redundant(GL_STATE_FRAMEBUFFER, same)) {
+    return;
+  }
+  glBindFramebuffer(target, fbo);
+  if (target != GL_READ_FRAMEBUFFER) {
+    this->drawFbo = fbo;
+  }
+  if (target != GL_DRAW_FRAMEBUFFER) {
+    this->readFbo = fbo;
+  }
+}
+
+GLuint GlStateCache::framebuffer(GLenum target) {
+  // asks gl only while the binding is unknown
+  bool read = target == GL_READ_FRAMEBUFFER;
+  GLuint &cached = read ? this->readFbo : this->drawFbo;
+  if (cached == GL_STATE_UNKNOWN) {
+    GLint fbo;
+    glGetIntegerv(read ? GL_READ_FRAMEBUFFER_BINDING
+                       : GL_DRAW_FRAMEBUFFER_BINDING,
+                  &fbo);
+    cached = (GLuint)fbo;
+  }
+  return cached;
+}
+
+void GlStateCache::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+  bool same = this->viewportKnown && this->viewportBox[0] == x &&
+              this->viewportBox[1] == y && this->viewportBox[2] == width &&
+              this->viewportBox[3] == height;
+  if (this->redundant(GL_STATE_FIXED, same)) {
+    return;
+  }
+  glViewport(x, y, width, height);
+  this->viewportBox[0] = x;
+  this->viewportBox[1] = y;
+  this->viewportBox[2] = width;
+  this->viewportBox[3] = height;
+  this->viewportKnown = true;
+}
+
+void GlStateCache::getViewport(GLint out[4]) {
+  if (!this->viewportKnown) {
+    glGetIntegerv(GL_VIEWPORT, this->viewportBox);
+    this->viewportKnown = true;
+  }
+  for (unsigned int i = 0; i < 4; i++) {
+    out[i] = this->viewportBox[i];
+  }
+}
+
+void GlStateCache::setCapability(GLenum cap, bool enabled) {
+  int slot = glStateCapabilitySlot(cap);
+  if (slot >= 0 && this->redundant(GL_STATE_FIXED,
+                                   this->capabilities[slot] == (int)enabled)) {
+    return;
+  }
+  if (enabled) {
+    glEnable(cap);
+  } else {
+    glDisable(cap);
+  }
+  if (slot >= 0) {
+    this->capabilities[slot] = (int)enabled;
+  } else {
+    this->issued[GL_STATE_FIXED]++;
+  }
+}
+
+void GlStateCache::depthFunc(GLenum func) {
+  if (this->redundant(GL_STATE_FIXED, this->depthFuncState == func)) {
+    return;
+  }
+  glDepthFunc(func);
+  this->depthFuncState = func;
+}
+
+void GlStateCache::depthMask(GLboolean mask) {
+  if (this->redundant(GL_STATE_FIXED, this->depthMaskState == (int)mask)) {
+    return;
+  }
+  glDepthMask(mask);
+  this->depthMaskState = (int)mask;
+}
+
+void GlStateCache::blendFunc(GLenum src, GLenum dst) {
+  bool same = this->blendSrc == src && this->blendDst == dst;
+  if (this->redundant(GL_STATE_FIXED, same)) {
+    return;
+  }
+  glBlendFunc(src, dst);
+  this->blendSrc = src;
+  this->blendDst = dst;
+}
+
+void GlStateCache::deleteVertexArray(GLuint array) {
+  glDeleteVertexArrays(1, &array);
+  if (this->vao == array) {
+    this->vao = 0;
+  }
+}
+
+void GlStateCache::deleteTexture(GLuint tex) {
+  glDeleteTextures(1, &tex);
+  for (unsigned int u = 0; u < GL_STATE_TEXTURE_UNITS; u++) {
+    for (unsigned int t = 0; t < 4; t++) {
+      if (this->textures[u][t] == tex) {
+        this->textures[u][t] = 0;
+      }
+    }
+  }
+}
+
+void GlStateCache::deleteFramebuffer(GLuint fbo) {
+  glDeleteFramebuffers(1, &fbo);
+  if (this->drawFbo == fbo) {
+    this->drawFbo = 0;
+  }
+  if (this->readFbo == fbo) {
+    this->readFbo = 0;
+  }
+}
+
+void GlStateCache::report(std::ostream &out) const {
+  const char *names[GL_STATE_KIND_COUNT] = {
+      "program", "vertex array", "texture", "sampler", "framebuffer", "fixed"};
+  float frames = this->frameCount > 0 ? (float)this->frameCount : 1.0f;
+  unsigned int totalIssued = 0;
+  unsigned int totalFiltered = 0;
+  out << "gl state calls per frame over " << this->frameCount
+      << " frames, issued / filtered" << std::endl;
+  for (unsigned int k = 0; k < GL_STATE_KIND_COUNT; k++) {
+    out << "  " << names[k] << " " << this->issued[k] / frames << " / "
+        << this->filtered[k] / frames << std::endl;
+    totalIssued += this->issued[k];
+    totalFiltered += this->filtered[k];
+  }
+  out << "  total " << totalIssued / frames << " / " << totalFiltered / frames
+      << std::endl;
+}
+
+GlStateCache &glState() {
+  // one context per program in these demos
+  static GlStateCache cache;
+  return cache;
+}
+
+#endif
@@ -0,0 +1,293 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Transform hierarchy for imported node trees and animated objects. Local
+// position, rotation, scale and the world matrices are kept in separate
+// arrays, ordered by depth so that every level is one contiguous range and
+// parents come before their children. update walks the levels in order; a
+// level only reads the worlds of the one above it, so its range can be
+// split across a job pool. Only nodes that were changed, and everything
+// under them, are recomputed.
+// Nodes are known by the handle add returns. Adding a node above the
+// deepest level reorders the arrays on the next update, handles stay valid.
+
+#ifndef HIERARCHY_HPP
+#define HIERARCHY_HPP
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <custom/jobpool.hpp>
+#include <custom/trace.hpp>
+
+#include <algorithm>
+#include <vector>
+
+// parent of top level nodes
+const unsigned int HIERARCHY_ROOT = 0xffffffff;
+// nodes per chunk of a level, smaller levels run on the calling thread
+const unsigned int HIERARCHY_GRAIN = 4096;
+
+class TransformHierarchy {
+public:
+  TransformHierarchy() : sorted(true), anyDirty(false) {}
+
+  // the parent has to exist already, returns the handle of the node
+  unsigned int add(unsigned int parent, const glm::vec3 &position,
+                   const glm::quat &rotation, const glm::vec3 &scale);
+  void clear();
+  unsigned int size() const { return (unsigned int)this->parents.size(); }
+
+  void setLocal(unsigned int node, const glm::vec3 &position,
+                const glm::quat &rotation, const glm::vec3 &scale);
+  void setPosition(unsigned int node, const glm::vec3 &position);
+  void setRotation(unsigned int node, const glm::quat &rotation);
+  void setScale(unsigned int node, const glm::vec3 &scale);
+  unsigned int parent(unsigned int node) const;
+
+  // valid after update
+  const glm::mat4 &world(unsigned int node) const {
+    return this->worlds[this->slotOf[node]];
+  }
+
+  // recomputes the world matrices of the changed subtrees
+  void update();
+  void update(JobPool &pool);
+
+private:
+  // by slot, sorted by depth
+  std::vector<glm::vec3> positions;
+  std::vector<glm::quat> rotations;
+  std::vector<glm::vec3> scales;
+  std::vector<glm::mat4> worlds;
+  std::vector<unsigned int> parents;
+  std::vector<unsigned int> depths;
+  std::vector<unsigned char> dirty;
+  // handle to slot and back
+  std::vector<unsigned int> slotOf;
+  std::vector<unsigned int> handleOf;
+  // level l is [levelStarts[l], levelStarts[l + 1])
+  std::vector<unsigned int> levelStarts;
+  bool sorted;
+  bool anyDirty;
+
+  void sortByDepth();
+  void updateRange(unsigned int begin, unsigned int end);
+  void markDirty(unsigned int slot);
+  void clearDirty();
+};
+
+unsigned int TransformHierarchy::add(unsigned int parent,
+                                     const glm::vec3 &position,
+                                     const glm::quat &rotation,
+                                     const glm::vec3 &scale) {
+  unsigned int slot = this->size();
+  unsigned int parentSlot =
+      parent == HIERARCHY_ROOT ? HIERARCHY_ROOT : this->slotOf[parent];
+  unsigned int depth =
+      parent == HIERARCHY_ROOT ? 0 : this->depths[parentSlot] + 1;
+  if (slot > 0 && depth < this->depths[slot - 1]) {
+    this->sorted = false;
+  }
+  this->positions.push_back(position);
+  this->rotations.push_back(rotation);
+  this->scales.push_back(scale);
+  this->worlds.push_back(glm::mat4(1.0f));
+  this->parents.push_back(parentSlot);
+  this->depths.push_back(depth);
+  this->dirty.push_back(1);
+  this->slotOf.push_back(slot);
+  this->handleOf.push_back(slot);
+  this->anyDirty = true;
+  if (this->sorted) {
+    // a new level or one more node in the deepest one
+    if (this->levelStarts.empty()) {
+      this->levelStarts.push_back(0);
+    }
+    if (this->levelStarts.size() < depth + 2) {
+      this->levelStarts.push_back(slot + 1);
+    } else {
+      this->levelStarts.back() = slot + 1;
+    }
+  }
+  return slot;
+}
+
+void TransformHierarchy::clear() {
+  this->positions.clear();
+  this->rotations.clear();
+  this->scales.clear();
+  this->worlds.clear();
+  this->parents.clear();
+  this->depths.clear();
+  this->dirty.clear();
+  this->slotOf.clear();
+  this->handleOf.clear();
+  this->levelStarts.clear();
+  this->sorted = true;
+  this->anyDirty = false;
+}
+
+void TransformHierarchy::markDirty(unsigned int slot) {
+  this->dirty[slot] = 1;
+  this->anyDirty = true;
+}
+
+void TransformHierarchy::setLocal(unsigned int node,
+                                  const glm::vec3 &position,
+                                  const glm::quat &rotation,
+                                  const glm::vec3 &scale) {
+  unsigned int slot = this->slotOf[node];
+  this->positions[slot] = position;
+  this->rotations[slot] = rotation;
+  this->scales[slot] = scale;
+  this->markDirty(slot);
+}
+void TransformHierarchy::setPosition(unsigned int node,
+                                     const glm::vec3 &position) {
+  unsigned int slot = this->slotOf[node];
+  this->positions[slot] = position;
+  this->markDirty(slot);
+}
+void TransformHierarchy::setRotation(unsigned int node,
+                                     const glm::quat &rotation) {
+  unsigned int slot = this->slotOf[node];
+  this->rotations[slot] = rotation;
+  this->markDirty(slot);
+}
+void TransformHierarchy::setScale(unsigned int node, const glm::vec3 &scale) {
+  unsigned int slot = this->slotOf[node];
+  this->scales[slot] = scale;
+  this->markDirty(slot);
+}
+
+unsigned int TransformHierarchy::parent(unsigned int node) const {
+  unsigned int parentSlot = this->parents[this->slotOf[node]];
+  return parentSlot == HIERARCHY_ROOT ? HIERARCHY_ROOT
+                                      : this->handleOf[parentSlot];
+}
+
+void TransformHierarchy::sortByDepth() {
+  // counting sort, stable so siblings added together stay together
+  unsigned int count = this->size();
+  unsigned int levels = 0;
+  for (unsigned int i = 0; i < count; i++) {
+    levels = std::max(levels, this->depths[i] + 1);
+  }
+  this->levelStarts.assign(levels + 1, 0);
+  for (unsigned int i = 0; i < count; i++) {
+    this->levelStarts[this->depths[i] + 1]++;
+  }
+  for (unsigned int l = 0; l < levels; l++) {
+    this->levelStarts[l + 1] += this->levelStarts[l];
+  }
+  std::vector<unsigned int> newSlot(count);
+  std::vector<unsigned int> next(this->levelStarts.begin(),
+                                 this->levelStarts.end() - 1);
+  for (unsigned int i = 0; i < count; i++) {
+    newSlot[i] = next[this->depths[i]]++;
+  }
+
+  std::vector<glm::vec3> newPositions(count);
+  std::vector<glm::quat> newRotations(count);
+  std::vector<glm::vec3> newScales(count);
+  std::vector<glm::mat4> newWorlds(count);
+  std::vector<unsigned int> newParents(count);
+  std::vector<unsigned int> newDepths(count);
+  std::vector<unsigned char> newDirty(count);
+  for (unsigned int i = 0; i < count; i++) {
+    unsigned int s = newSlot[i];
+    newPositions[s] = this->positions[i];
+    newRotations[s] = this->rotations[i];
+    newScales[s] = this->scales[i];
+    newWorlds[s] = this->worlds[i];
+    newParents[s] = this->parents[i] == HIERARCHY_ROOT
+                        ? HIERARCHY_ROOT
+                        : newSlot[this->parents[i]];
+    newDepths[s] = this->depths[i];
+    newDirty[s] = this->dirty[i];
+  }
+  for (unsigned int h = 0; h < count; h++) {
+    this->slotOf[h] = newSlot[this->slotOf[h]];
+    this->handleOf[this->slotOf[h]] = h;
+  }
+  this->positions.swap(newPositions);
+  this->rotations.swap(newRotations);
+  this->scales.swap(newScales);
+  this->worlds.swap(newWorlds);
+  this->parents.swap(newParents);
+  this->depths.swap(newDepths);
+  this->dirty.swap(newDirty);
+  this->sorted = true;
+}
+
+void TransformHierarchy::updateRange(unsigned int begin, unsigned int end) {
+  for (unsigned int i = begin; i < end; i++) {
+    unsigned int p = this->parents[i];
+    bool parentDirty = p != HIERARCHY_ROOT && this->dirty[p] != 0;
+    if (this->dirty[i] == 0 && !parentDirty) {
+      continue;
+    }
+    // the flag tells the level below to follow
+    this->dirty[i] = 1;
+    // translation * rotation * scale without the two products, the
+    // columns of the scaled rotation and the translation
+    glm::mat3 r = glm::mat3_cast(this->rotations[i]);
+    const glm::vec3 &s = this->scales[i];
+    glm::vec3 c0 = r[0] * s.x;
+    glm::vec3 c1 = r[1] * s.y;
+    glm::vec3 c2 = r[2] * s.z;
+    const glm::vec3 &t = this->positions[i];
+    glm::mat4 &w = this->worlds[i];
+    if (p == HIERARCHY_ROOT) {
+      w = glm::mat4(glm::vec4(c0, 0.0f), glm::vec4(c1, 0.0f),
+                    glm::vec4(c2, 0.0f), glm::vec4(t, 1.0f));
+      continue;
+    }
+    // the local matrix is affine, its last row is 0 0 0 1
+    const glm::mat4 &pw = this->worlds[p];
+    w[0] = pw[0] * c0.x + pw[1] * c0.y + pw[2] * c0.z;
+    w[1] = pw[0] * c1.x + pw[1] * c1.y + pw[2] * c1.z;
+    w[2] = pw[0] * c2.x + pw[1] * c2.y + pw[2] * c2.z;
+    w[3] = pw[0] * t.x + pw[1] * t.y + pw[2] * t.z + pw[3];
+  }
+}
+
+void TransformHierarchy::clearDirty() {
+  std::fill(this->dirty.begin(), this->dirty.end(), 0);
+  this->anyDirty = false;
+}
+
+void TransformHierarchy::update() {
+  if (!this->sorted) {
+    this->sortByDepth();
+  }
+  if (!this->anyDirty) {
+    return;
+  }
+  this->updateRange(0, this->size());
+  this->clearDirty();
+}
+
+void TransformHierarchy::update(JobPool &pool) {
+  TRACE_SCOPE("TransformHierarchy::update");
+  if (!this->sorted) {
+    this->sortByDepth();
+  }
+  if (!this->anyDirty) {
+    return;
+  }
+  // a level needs the whole level above it, parallelFor returns once all
+  // of its chunks are done
+  for (unsigned int l = 0; l + 1 < this->levelStarts.size(); l++) {
+    unsigned int begin = this->levelStarts[l];
+    unsigned int end = this->levelStarts[l + 1];
+    pool.parallelFor(end - begin, HIERARCHY_GRAIN,
+                     [&](unsigned int b, unsigned int e) {
+                       this->updateRange(begin + b, begin + e);
+                     });
+  }
+  this->clearDirty();
+}
+
+#endif
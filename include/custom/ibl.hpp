@@ -0,0 +1,579 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Image based lighting precomputation.
+// An equirectangular hdr environment is convolved on the cpu job pool into
+// a diffuse irradiance cube map, a prefiltered specular cube map whose mips
+// follow roughness and a split sum brdf lut. The result is written to a
+// cache file named after the hash of the environment file and the settings
+// so the convolution runs only once per environment.
+
+#ifndef IBL_HPP
+#define IBL_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <custom/assetpack.hpp>
+#include <custom/jobpool.hpp>
+#include <custom/shader.hpp>
+#include <custom/trace.hpp>
+// the executables define the stb implementation themselves
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include <custom/stb_image.h>
+#endif
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+const float IBL_PI = 3.14159265f;
+const uint32_t IBL_CACHE_MAGIC = 0x4c424942; // "BIBL"
+const uint32_t IBL_CACHE_VERSION = 1;
+
+enum IblDistribution { IBL_GGX = 0, IBL_BECKMANN = 1 };
+
+struct IblSettings {
+  uint32_t irradianceSize = 32;
+  uint32_t prefilterSize = 128;
+  uint32_t prefilterMips = 5;
+  uint32_t brdfLutSize = 128;
+  uint32_t sampleCount = 512;
+  uint32_t distribution = IBL_GGX;
+};
+
+struct IblData {
+  IblSettings settings;
+  std::vector<float> irradiance;               // 6 faces, rgb
+  std::vector<std::vector<float>> prefiltered; // per mip, 6 faces, rgb
+  std::vector<float> brdfLut;                  // rg
+};
+
+struct IblTextures {
+  GLuint irradianceMap;
+  GLuint prefilterMap;
+  GLuint brdfLut;
+  float maxLod;
+};
+
+// equirectangular environment with a box filtered pyramid used for
+// filtered importance sampling
+class EquirectEnvironment {
+public:
+  std::vector<std::vector<float>> levels; // rgb rows, row 0 is up
+  std::vector<int> widths;
+  std::vector<int> heights;
+
+  bool load(const char *path);
+  glm::vec3 sample(glm::vec3 dir, float lod) const;
+  float texelSolidAngle() const {
+    return 4.0f * IBL_PI / (float)(this->widths[0] * this->heights[0]);
+  }
+
+private:
+  glm::vec3 sampleLevel(unsigned int level, float u, float v) const;
+};
+
+bool EquirectEnvironment::load(const char *path) {
+  TRACE_SCOPE_DETAIL("stbi_loadf", path);
+  int width, height, nbChannels;
+  // hdr files are packed as they are, decoded from the mapping
+  AssetSpan span;
+  float *data =
+      assetPack().findPath(path, span)
+          ? stbi_loadf_from_memory(span.data, (int)span.size, &width, &height,
+                                   &nbChannels, 3)
+          : stbi_loadf(path, &width, &height, &nbChannels, 3);
+  if (!data) {
+    std::cout << "Failed to load hdr environment: " << path << std::endl;
+    return false;
+  }
+  this->levels.push_back(std::vector<float>(data, data + width * height * 3));
+  this->widths.push_back(width);
+  this->heights.push_back(height);
+  stbi_image_free(data);
+
+  while (this->widths.back() > 1 && this->heights.back() > 1) {
+    const std::vector<float> &src = this->levels.back();
+    int sw = this->widths.back();
+    int dw = sw / 2;
+    int dh = this->heights.back() / 2;
+    std::vector<float> dst(dw * dh * 3);
+    for (int y = 0; y < dh; y++) {
+      for (int x = 0; x < dw; x++) {
+        for (int c = 0; c < 3; c++) {
+          float sum = src[((2 * y) * sw + 2 * x) * 3 + c] +
+                      src[((2 * y) * sw + 2 * x + 1) * 3 + c] +
+                      src[((2 * y + 1) * sw + 2 * x) * 3 + c] +
+                      src[((2 * y + 1) * sw + 2 * x + 1) * 3 + c];
+          dst[(y * dw + x) * 3 + c] = sum * 0.25f;
+        }
+      }
+    }
+    this->levels.push_back(dst);
+    this->widths.push_back(dw);
+    this->heights.push_back(dh);
+  }
+  return true;
+}
+
+glm::vec3 EquirectEnvironment::sampleLevel(unsigned int level, float u,
+                                           float v) const {
+  // bilinear, wraps horizontally and clamps vertically
+  int w = this->widths[level];
+  int h = this->heights[level];
+  const std::vector<float> &img = this->levels[level];
+  float x = u * w - 0.5f;
+  float y = glm::clamp(v * h - 0.5f, 0.0f, (float)(h - 1));
+  int x0 = (int)std::floor(x);
+  int y0 = (int)std::floor(y);
+  float fx = x - x0;
+  float fy = y - y0;
+  int x1 = x0 + 1;
+  int y1 = y0 + 1 < h ? y0 + 1 : h - 1;
+  x0 = ((x0 % w) + w) % w;
+  x1 = ((x1 % w) + w) % w;
+  glm::vec3 result(0.0f);
+  int xs[2] = {x0, x1};
+  int ys[2] = {y0, y1};
+  float wx[2] = {1.0f - fx, fx};
+  float wy[2] = {1.0f - fy, fy};
+  for (int j = 0; j < 2; j++) {
+    for (int i = 0; i < 2; i++) {
+      const float *p = &img[(ys[j] * w + xs[i]) * 3];
+      result += glm::vec3(p[0], p[1], p[2]) * (wx[i] * wy[j]);
+    }
+  }
+  return result;
+}
+
+glm::vec3 EquirectEnvironment::sample(glm::vec3 dir, float lod) const {
+  float u = std::atan2(dir.z, dir.x) / (2.0f * IBL_PI) + 0.5f;
+  float v = std::acos(glm::clamp(dir.y, -1.0f, 1.0f)) / IBL_PI;
+  float maxLod = (float)(this->levels.size() - 1);
+  lod = glm::clamp(lod, 0.0f, maxLod);
+  unsigned int l0 = (unsigned int)lod;
+  unsigned int l1 = l0 + 1 < this->levels.size() ? l0 + 1 : l0;
+  float t = lod - (float)l0;
+  glm::vec3 c0 = this->sampleLevel(l0, u, v);
+  if (t == 0.0f || l1 == l0) {
+    return c0;
+  }
+  return glm::mix(c0, this->sampleLevel(l1, u, v), t);
+}
+
+// direction through texel (x, y) of cube face, gl face order and orientation
+glm::vec3 cubeTexelDir(unsigned int face, unsigned int x, unsigned int y,
+                       unsigned int size) {
+  float uc = 2.0f * ((float)x + 0.5f) / (float)size - 1.0f;
+  float vc = 2.0f * ((float)y + 0.5f) / (float)size - 1.0f;
+  glm::vec3 dir;
+  switch (face) {
+  case 0:
+    dir = glm::vec3(1.0f, -vc, -uc);
+    break;
+  case 1:
+    dir = glm::vec3(-1.0f, -vc, uc);
+    break;
+  case 2:
+    dir = glm::vec3(uc, 1.0f, vc);
+    break;
+  case 3:
+    dir = glm::vec3(uc, -1.0f, -vc);
+    break;
+  case 4:
+    dir = glm::vec3(uc, -vc, 1.0f);
+    break;
+  default:
+    dir = glm::vec3(-uc, -vc, -1.0f);
+    break;
+  }
+  return glm::normalize(dir);
+}
+
+glm::vec2 hammersley(uint32_t i, uint32_t count) {
+  uint32_t bits = i;
+  bits = (bits << 16u) | (bits >> 16u);
+  bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+  bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+  bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+  bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+  return glm::vec2((float)i / (float)count,
+                   (float)bits * 2.3283064365386963e-10f);
+}
+
+// tangent space sample table shared by every texel of a convolution, stored
+// as structure of arrays so the per texel rotation loop vectorizes
+struct IblSampleTable {
+  std::vector<float> x, y, z;
+  std::vector<float> weight;
+  std::vector<float> lod;
+  float weightSum;
+};
+
+float iblNormalDist(float cosTheta, float alpha, uint32_t distribution) {
+  float cos2 = cosTheta * cosTheta;
+  float a2 = alpha * alpha;
+  if (distribution == IBL_BECKMANN) {
+    float tan2 = (1.0f - cos2) / cos2;
+    return std::exp(-tan2 / a2) / (IBL_PI * a2 * cos2 * cos2);
+  }
+  float d = cos2 * (a2 - 1.0f) + 1.0f;
+  return a2 / (IBL_PI * d * d);
+}
+
+float iblSampleHalfCosTheta(float xi, float alpha, uint32_t distribution) {
+  if (distribution == IBL_BECKMANN) {
+    float tan2 = -alpha * alpha * std::log(1.0f - xi);
+    return 1.0f / std::sqrt(1.0f + tan2);
+  }
+  return std::sqrt((1.0f - xi) / (1.0f + (alpha * alpha - 1.0f) * xi));
+}
+
+float iblLambda(float cosTheta, float alpha, uint32_t distribution) {
+  // same lambda functions as simplepbr.frag
+  float cos2 = cosTheta * cosTheta;
+  float tan2 = (1.0f - cos2) / glm::max(cos2, 1e-7f);
+  if (distribution == IBL_BECKMANN) {
+    float a = 1.0f / (alpha * std::sqrt(tan2) + 1e-7f);
+    if (a >= 1.6f) {
+      return 0.0f;
+    }
+    return (1.0f - 1.259f * a + 0.396f * a * a) / (3.535f * a + 2.181f * a * a);
+  }
+  return (std::sqrt(1.0f + alpha * alpha * tan2) - 1.0f) * 0.5f;
+}
+
+IblSampleTable makeIrradianceSamples(const IblSettings &settings,
+                                     float texelSolidAngle) {
+  // cosine weighted hemisphere, pdf = cos / pi
+  IblSampleTable table;
+  table.weightSum = 0.0f;
+  for (uint32_t i = 0; i < settings.sampleCount; i++) {
+    glm::vec2 xi = hammersley(i, settings.sampleCount);
+    float phi = 2.0f * IBL_PI * xi.x;
+    float cosTheta = std::sqrt(1.0f - xi.y);
+    float sinTheta = std::sqrt(xi.y);
+    float pdf = glm::max(cosTheta / IBL_PI, 1e-6f);
+    float saSample = 1.0f / ((float)settings.sampleCount * pdf);
+    table.x.push_back(sinTheta * std::cos(phi));
+    table.y.push_back(sinTheta * std::sin(phi));
+    table.z.push_back(cosTheta);
+    table.weight.push_back(1.0f);
+    table.lod.push_back(0.5f * std::log2(saSample / texelSolidAngle) + 1.0f);
+    table.weightSum += 1.0f;
+  }
+  return table;
+}
+
+IblSampleTable makePrefilterSamples(const IblSettings &settings,
+                                    float roughness, float texelSolidAngle) {
+  // n = v = r assumption, light directions reflected around sampled
+  // microfacet normals
+  IblSampleTable table;
+  table.weightSum = 0.0f;
+  float alpha = glm::max(roughness * roughness, 1e-3f);
+  for (uint32_t i = 0; i < settings.sampleCount; i++) {
+    glm::vec2 xi = hammersley(i, settings.sampleCount);
+    float phi = 2.0f * IBL_PI * xi.x;
+    float cosTheta = iblSampleHalfCosTheta(xi.y, alpha, settings.distribution);
+    float sinTheta = std::sqrt(glm::max(1.0f - cosTheta * cosTheta, 0.0f));
+    glm::vec3 h(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+    glm::vec3 l = 2.0f * h.z * h - glm::vec3(0.0f, 0.0f, 1.0f);
+    if (l.z <= 0.0f) {
+      continue;
+    }
+    float pdf = iblNormalDist(cosTheta, alpha, settings.distribution) / 4.0f;
+    float saSample = 1.0f / ((float)settings.sampleCount * pdf + 1e-6f);
+    table.x.push_back(l.x);
+    table.y.push_back(l.y);
+    table.z.push_back(l.z);
+    table.weight.push_back(l.z);
+    table.lod.push_back(
+        roughness == 0.0f
+            ? 0.0f
+            : 0.5f * std::log2(saSample / texelSolidAngle) + 1.0f);
+    table.weightSum += l.z;
+  }
+  return table;
+}
+
+void convolveCube(const EquirectEnvironment &env, const IblSampleTable &table,
+                  uint32_t size, std::vector<float> &out, JobPool &pool) {
+  out.assign(6 * size * size * 3, 0.0f);
+  unsigned int count = (unsigned int)table.x.size();
+  pool.parallelFor(6 * size, 1, [&](unsigned int begin, unsigned int end) {
+    // per thread scratch for the rotated directions
+    std::vector<float> dx(count), dy(count), dz(count);
+    for (unsigned int row = begin; row < end; row++) {
+      unsigned int face = row / size;
+      unsigned int y = row % size;
+      for (unsigned int x = 0; x < size; x++) {
+        glm::vec3 n = cubeTexelDir(face, x, y, size);
+        glm::vec3 up = std::abs(n.y) < 0.999f ? glm::vec3(0.0f, 1.0f, 0.0f)
+                                              : glm::vec3(1.0f, 0.0f, 0.0f);
+        glm::vec3 t = glm::normalize(glm::cross(up, n));
+        glm::vec3 b = glm::cross(n, t);
+        const float *sx = table.x.data();
+        const float *sy = table.y.data();
+        const float *sz = table.z.data();
+        for (unsigned int s = 0; s < count; s++) {
+          dx[s] = t.x * sx[s] + b.x * sy[s] + n.x * sz[s];
+          dy[s] = t.y * sx[s] + b.y * sy[s] + n.y * sz[s];
+          dz[s] = t.z * sx[s] + b.z * sy[s] + n.z * sz[s];
+        }
+        glm::vec3 sum(0.0f);
+        for (unsigned int s = 0; s < count; s++) {
+          sum += env.sample(glm::vec3(dx[s], dy[s], dz[s]), table.lod[s]) *
+                 table.weight[s];
+        }
+        sum /= glm::max(table.weightSum, 1e-6f);
+        float *dst = &out[((face * size + y) * size + x) * 3];
+        dst[0] = sum.x;
+        dst[1] = sum.y;
+        dst[2] = sum.z;
+      }
+    }
+  });
+}
+
+void computeBrdfLut(const IblSettings &settings, std::vector<float> &out,
+                    JobPool &pool) {
+  uint32_t size = settings.brdfLutSize;
+  out.assign(size * size * 2, 0.0f);
+  pool.parallelFor(size, 1, [&](unsigned int begin, unsigned int end) {
+    for (unsigned int y = begin; y < end; y++) {
+      float roughness = ((float)y + 0.5f) / (float)size;
+      float alpha = glm::max(roughness * roughness, 1e-3f);
+      for (unsigned int x = 0; x < size; x++) {
+        float nDotV = ((float)x + 0.5f) / (float)size;
+        glm::vec3 v(std::sqrt(1.0f - nDotV * nDotV), 0.0f, nDotV);
+        float lambdaV = iblLambda(nDotV, alpha, settings.distribution);
+        float a = 0.0f;
+        float b = 0.0f;
+        for (uint32_t i = 0; i < settings.sampleCount; i++) {
+          glm::vec2 xi = hammersley(i, settings.sampleCount);
+          float phi = 2.0f * IBL_PI * xi.x;
+          float cosTheta =
+              iblSampleHalfCosTheta(xi.y, alpha, settings.distribution);
+          float sinTheta = std::sqrt(glm::max(1.0f - cosTheta * cosTheta, 0.0f));
+          glm::vec3 h(sinTheta * std::cos(phi), sinTheta * std::sin(phi),
+                      cosTheta);
+          float vDotH = glm::dot(v, h);
+          glm::vec3 l = 2.0f * vDotH * h - v;
+          if (l.z <= 0.0f || vDotH <= 0.0f) {
+            continue;
+          }
+          float lambdaL = iblLambda(l.z, alpha, settings.distribution);
+          float g = 1.0f / (1.0f + lambdaV + lambdaL);
+          float gVis = g * vDotH / (cosTheta * nDotV);
+          float fc = std::pow(1.0f - vDotH, 5.0f);
+          a += (1.0f - fc) * gVis;
+          b += fc * gVis;
+        }
+        out[(y * size + x) * 2 + 0] = a / (float)settings.sampleCount;
+        out[(y * size + x) * 2 + 1] = b / (float)settings.sampleCount;
+      }
+    }
+  });
+}
+
+uint64_t iblCacheKey(const char *hdrPath, const IblSettings &settings) {
+  // fnv-1a over the environment file and the convolution settings
+  uint64_t hash = 1469598103934665603ull;
+  std::ifstream file(hdrPath, std::ios::binary);
+  char buffer[65536];
+  while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
+    std::streamsize n = file.gcount();
+    for (std::streamsize i = 0; i < n; i++) {
+      hash ^= (unsigned char)buffer[i];
+      hash *= 1099511628211ull;
+    }
+  }
+  const unsigned char *sbytes = (const unsigned char *)&settings;
+  for (unsigned int i = 0; i < sizeof(IblSettings); i++) {
+    hash ^= sbytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+bool readIblCache(const std::filesystem::path &cachePath,
+                  const IblSettings &settings, IblData &data) {
+  std::ifstream file(cachePath, std::ios::binary);
+  if (!file) {
+    return false;
+  }
+  uint32_t magic = 0, version = 0;
+  IblSettings stored;
+  file.read((char *)&magic, sizeof(magic));
+  file.read((char *)&version, sizeof(version));
+  file.read((char *)&stored, sizeof(stored));
+  if (!file || magic != IBL_CACHE_MAGIC || version != IBL_CACHE_VERSION ||
+      std::memcmp(&stored, &settings, sizeof(IblSettings)) != 0) {
+    return false;
+  }
+  data.settings = settings;
+  data.irradiance.resize(6 * settings.irradianceSize * settings.irradianceSize *
+                         3);
+  file.read((char *)data.irradiance.data(),
+            data.irradiance.size() * sizeof(float));
+  data.prefiltered.resize(settings.prefilterMips);
+  for (uint32_t m = 0; m < settings.prefilterMips; m++) {
+    uint32_t s = settings.prefilterSize >> m;
+    data.prefiltered[m].resize(6 * s * s * 3);
+    file.read((char *)data.prefiltered[m].data(),
+              data.prefiltered[m].size() * sizeof(float));
+  }
+  data.brdfLut.resize(settings.brdfLutSize * settings.brdfLutSize * 2);
+  file.read((char *)data.brdfLut.data(), data.brdfLut.size() * sizeof(float));
+  return (bool)file;
+}
+
+void writeIblCache(const std::filesystem::path &cachePath,
+                   const IblData &data) {
+  std::filesystem::create_directories(cachePath.parent_path());
+  // write to a temporary file first so a killed process never leaves a
+  // truncated cache behind
+  std::filesystem::path tmpPath = cachePath;
+  tmpPath += ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary);
+    uint32_t magic = IBL_CACHE_MAGIC, version = IBL_CACHE_VERSION;
+    file.write((const char *)&magic, sizeof(magic));
+    file.write((const char *)&version, sizeof(version));
+    file.write((const char *)&data.settings, sizeof(IblSettings));
+    file.write((const char *)data.irradiance.data(),
+               data.irradiance.size() * sizeof(float));
+    for (unsigned int m = 0; m < data.prefiltered.size(); m++) {
+      file.write((const char *)data.prefiltered[m].data(),
+                 data.prefiltered[m].size() * sizeof(float));
+    }
+    file.write((const char *)data.brdfLut.data(),
+               data.brdfLut.size() * sizeof(float));
+    if (!file) {
+      std::cout << "Failed to write ibl cache: " << tmpPath << std::endl;
+      return;
+    }
+  }
+  std::filesystem::rename(tmpPath, cachePath);
+}
+
+bool loadIbl(const char *hdrPath, const std::filesystem::path &cacheDir,
+             const IblSettings &settings, IblData &data, JobPool &pool) {
+  // returns false when the environment can not be loaded
+  if (!std::filesystem::exists(hdrPath)) {
+    std::cout << "Environment map not found: " << hdrPath << std::endl;
+    return false;
+  }
+  char name[32];
+  std::snprintf(name, sizeof(name), "ibl_%016llx.bin",
+                (unsigned long long)iblCacheKey(hdrPath, settings));
+  std::filesystem::path cachePath = cacheDir / name;
+  if (readIblCache(cachePath, settings, data)) {
+    return true;
+  }
+
+  EquirectEnvironment env;
+  if (!env.load(hdrPath)) {
+    return false;
+  }
+  data.settings = settings;
+  IblSampleTable irrTable =
+      makeIrradianceSamples(settings, env.texelSolidAngle());
+  convolveCube(env, irrTable, settings.irradianceSize, data.irradiance, pool);
+
+  data.prefiltered.resize(settings.prefilterMips);
+  for (uint32_t m = 0; m < settings.prefilterMips; m++) {
+    float roughness =
+        settings.prefilterMips > 1
+            ? (float)m / (float)(settings.prefilterMips - 1)
+            : 0.0f;
+    IblSampleTable table =
+        makePrefilterSamples(settings, roughness, env.texelSolidAngle());
+    convolveCube(env, table, settings.prefilterSize >> m, data.prefiltered[m],
+                 pool);
+  }
+  computeBrdfLut(settings, data.brdfLut, pool);
+  writeIblCache(cachePath, data);
+  return true;
+}
+
+IblTextures uploadIbl(const IblData &data) {
+  IblTextures texs;
+  const IblSettings &settings = data.settings;
+  glGenTextures(1, &texs.irradianceMap);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, texs.irradianceMap);
+  uint32_t isize = settings.irradianceSize;
+  for (unsigned int f = 0; f < 6; f++) {
+    glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, 0, GL_RGB16F, isize, isize,
+                 0, GL_RGB, GL_FLOAT, &data.irradiance[f * isize * isize * 3]);
+  }
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+
+  glGenTextures(1, &texs.prefilterMap);
+  glBindTexture(GL_TEXTURE_CUBE_MAP, texs.prefilterMap);
+  for (uint32_t m = 0; m < settings.prefilterMips; m++) {
+    uint32_t s = settings.prefilterSize >> m;
+    for (unsigned int f = 0; f < 6; f++) {
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, m, GL_RGB16F, s, s, 0,
+                   GL_RGB, GL_FLOAT, &data.prefiltered[m][f * s * s * 3]);
+    }
+  }
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL,
+                  settings.prefilterMips - 1);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
+  texs.maxLod = (float)(settings.prefilterMips - 1);
+
+  glGenTextures(1, &texs.brdfLut);
+  glBindTexture(GL_TEXTURE_2D, texs.brdfLut);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16F, settings.brdfLutSize,
+               settings.brdfLutSize, 0, GL_RG, GL_FLOAT, data.brdfLut.data());
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return texs;
+}
+
+void initIblSamplers_proc(Shader &shader, int irradianceUnit,
+                          int prefilterUnit, int brdfUnit) {
+  shader.useProgram();
+  shader.setIntUni("irradianceMap", irradianceUnit);
+  shader.setIntUni("prefilterMap", prefilterUnit);
+  shader.setIntUni("brdfLUT", brdfUnit);
+  shader.setIntUni("iblEnabled", 0);
+}
+
+void bindIbl(IblTextures &texs, Shader &shader, GLenum irradianceUnit,
+             GLenum prefilterUnit, GLenum brdfUnit) {
+  glState().bindTexture(irradianceUnit - GL_TEXTURE0, GL_TEXTURE_CUBE_MAP,
+                        texs.irradianceMap);
+  glState().bindTexture(prefilterUnit - GL_TEXTURE0, GL_TEXTURE_CUBE_MAP,
+                        texs.prefilterMap);
+  glState().bindTexture(brdfUnit - GL_TEXTURE0, GL_TEXTURE_2D,
+                        texs.brdfLut);
+  shader.useProgram();
+  shader.setIntUni("iblEnabled", 1);
+  shader.setFloatUni("prefilterMaxLod", texs.maxLod);
+}
+
+#endif
@@ -0,0 +1,180 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Small fixed size thread pool used for cpu side precomputation
+
+#ifndef JOBPOOL_HPP
+#define JOBPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <custom/trace.hpp>
+
+class JobPool {
+public:
+  // threadCount == 0 uses every hardware thread
+  JobPool(unsigned int threadCount = 0);
+  ~JobPool();
+
+  // number of threads working on a parallelFor, the caller included
+  unsigned int size() const { return (unsigned int)this->workers.size() + 1; }
+
+  // run fn(begin, end) over [0, count) in chunks of grain items, the
+  // calling thread takes part and the call returns once every chunk is done;
+  // completion is tracked per call, so jobs and several threads may call it
+  void parallelFor(unsigned int count, unsigned int grain,
+                   const std::function<void(unsigned int, unsigned int)> &fn);
+
+  // fire and forget job, see wait()
+  void submit(const std::function<void()> &job);
+  void wait();
+
+private:
+  std::vector<std::thread> workers;
+  std::deque<std::function<void()>> jobs;
+  std::mutex mtx;
+  std::condition_variable jobReady;
+  std::condition_variable jobsDone;
+  unsigned int running;
+  bool stopping;
+
+  void workerLoop();
+};
+
+JobPool::JobPool(unsigned int threadCount) : running(0), stopping(false) {
+  if (threadCount == 0) {
+    threadCount = std::thread::hardware_concurrency();
+  }
+  if (threadCount == 0) {
+    threadCount = 1;
+  }
+  for (unsigned int i = 0; i + 1 < threadCount; i++) {
+    this->workers.push_back(std::thread(&JobPool::workerLoop, this));
+  }
+}
+
+JobPool::~JobPool() {
+  {
+    std::unique_lock<std::mutex> lock(this->mtx);
+    this->stopping = true;
+  }
+  this->jobReady.notify_all();
+  for (unsigned int i = 0; i < this->workers.size(); i++) {
+    this->workers[i].join();
+  }
+}
+
+void JobPool::workerLoop() {
+  TRACE_THREAD("worker");
+  while (true) {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(this->mtx);
+      this->jobReady.wait(lock, [this] {
+        return this->stopping || !this->jobs.empty();
+      });
+      if (this->stopping && this->jobs.empty()) {
+        return;
+      }
+      job = this->jobs.front();
+      this->jobs.pop_front();
+      this->running++;
+    }
+    {
+      TRACE_SCOPE("job");
+      job();
+    }
+    {
+      std::unique_lock<std::mutex> lock(this->mtx);
+      this->running--;
+      if (this->running == 0 && this->jobs.empty()) {
+        this->jobsDone.notify_all();
+      }
+    }
+  }
+}
+
+void JobPool::submit(const std::function<void()> &job) {
+  if (this->workers.empty()) {
+    job();
+    return;
+  }
+  {
+    std::unique_lock<std::mutex> lock(this->mtx);
+    this->jobs.push_back(job);
+  }
+  this->jobReady.notify_one();
+}
+
+void JobPool::wait() {
+  std::unique_lock<std::mutex> lock(this->mtx);
+  this->jobsDone.wait(lock, [this] {
+    return this->running == 0 && this->jobs.empty();
+  });
+}
+
+// chunk counters of one parallelFor, shared with its helper jobs since a
+// helper may only start after the call returned
+struct ParallelForState {
+  std::atomic<unsigned int> nextChunk;
+  std::atomic<unsigned int> doneChunks;
+  std::mutex mtx;
+  std::condition_variable finished;
+  ParallelForState() : nextChunk(0), doneChunks(0) {}
+};
+
+void JobPool::parallelFor(
+    unsigned int count, unsigned int grain,
+    const std::function<void(unsigned int, unsigned int)> &fn) {
+  if (count == 0) {
+    return;
+  }
+  if (grain == 0) {
+    grain = 1;
+  }
+  unsigned int chunks = (count + grain - 1) / grain;
+  std::shared_ptr<ParallelForState> state =
+      std::make_shared<ParallelForState>();
+  const std::function<void(unsigned int, unsigned int)> *body = &fn;
+
+  // every participant pulls chunks until none is left, fn is only touched
+  // for a claimed chunk so a helper starting late never reaches it
+  auto drain = [state, body, chunks, grain, count]() {
+    while (true) {
+      unsigned int c = state->nextChunk.fetch_add(1);
+      if (c >= chunks) {
+        break;
+      }
+      unsigned int begin = c * grain;
+      unsigned int end = begin + grain < count ? begin + grain : count;
+      (*body)(begin, end);
+      if (state->doneChunks.fetch_add(1) + 1 == chunks) {
+        std::unique_lock<std::mutex> lock(state->mtx);
+        state->finished.notify_all();
+      }
+    }
+  };
+  unsigned int helpers = (unsigned int)this->workers.size();
+  if (helpers > chunks - 1) {
+    helpers = chunks - 1;
+  }
+  for (unsigned int i = 0; i < helpers; i++) {
+    this->submit(drain);
+  }
+  drain();
+  // every chunk is claimed now, wait only for those other threads are still
+  // running; the pool wide wait() would also wait for unrelated jobs and
+  // for a calling worker itself
+  std::unique_lock<std::mutex> lock(state->mtx);
+  state->finished.wait(
+      lock, [&state, chunks] { return state->doneChunks.load() == chunks; });
+}
+
+#endif
@@ -0,0 +1,246 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Input to photon latency. Input events are timestamped as glfw delivers
+// them, the frame that samples them is tagged with the oldest one, and a
+// fence placed after glfwSwapBuffers tells when the gpu finished that
+// frame. The present time is estimated as the later of the swap return and
+// the fence completion, so it is only as accurate as the polling.
+// glfw delivers events only while it polls or waits. Events that arrive
+// while a frame is being built are stamped at the next poll, so input to
+// photon is a lower bound; only the time spent in the pacer wait is seen.
+//
+// FramePacer is the low latency mode. It waits on the fence of every frame,
+// which keeps the driver from queueing frames ahead, and it delays input
+// sampling to just before the next refresh minus the expected frame cost.
+// It waits for events rather than sleeping, so events arriving during the
+// wait are delivered and stamped as they come.
+
+#ifndef LATENCY_HPP
+#define LATENCY_HPP
+
+#include <glad/glad.h>
+
+#include <GLFW/glfw3.h>
+
+#include <iostream>
+
+const unsigned int LATENCY_FRAMES_IN_FLIGHT = 4;
+
+struct LatencyFrame {
+  GLsync fence;
+  // oldest input event the frame consumed, negative if there was none
+  double inputTime;
+  double sampleTime;
+  double swapTime;
+};
+
+// count, sum, min and max of a series of seconds
+struct LatencyStat {
+  unsigned int count;
+  double sum;
+  double minValue;
+  double maxValue;
+
+  LatencyStat() : count(0), sum(0.0), minValue(0.0), maxValue(0.0) {}
+  void add(double value);
+  double average() const {
+    return this->count == 0 ? 0.0 : this->sum / this->count;
+  }
+};
+
+class LatencyTracker {
+public:
+  // event delivery to present, only frames that consumed an input; a
+  // lower bound of the real input latency
+  LatencyStat inputToPhoton;
+  // input sampling to present, every frame
+  LatencyStat sampleToPhoton;
+
+  LatencyTracker();
+
+  // called from the input callbacks, times are glfwGetTime seconds
+  void inputEvent(double time);
+  // the frame samples input now and consumes the pending events
+  void beginFrame(double sampleTime);
+  // right after glfwSwapBuffers; with waitGpu the call blocks on the fence
+  // and returns the completion time, otherwise it returns -1
+  double endFrame(double swapTime, bool waitGpu);
+  // resolves the frames whose fence has signaled, does not block
+  void poll(double now);
+
+  void report(std::ostream &out) const;
+  // deletes the fences still pending
+  void destroy();
+
+private:
+  LatencyFrame frames[LATENCY_FRAMES_IN_FLIGHT];
+  unsigned int head;
+  unsigned int count;
+  double pendingInput;
+  double frameInput;
+  double frameSample;
+
+  void resolveOldest(double presentTime);
+};
+
+class FramePacer {
+public:
+  bool enabled;
+  double refreshInterval;
+  // slack kept before the refresh, grows when a frame misses it
+  double margin;
+  unsigned int missed;
+
+  FramePacer(double refreshInterval);
+  // waits for events until the last moment the next frame can sample input
+  // and still make the next refresh, returns right away when disabled
+  void waitForSample(double now);
+  // times of the frame that just ended, present as returned by endFrame
+  void frameDone(double sampleTime, double submitTime, double presentTime);
+
+private:
+  double lastPresent;
+  // moving average of sampling to submission
+  double cost;
+};
+
+void LatencyStat::add(double value) {
+  if (this->count == 0 || value < this->minValue) {
+    this->minValue = value;
+  }
+  if (this->count == 0 || value > this->maxValue) {
+    this->maxValue = value;
+  }
+  this->sum += value;
+  this->count++;
+}
+
+LatencyTracker::LatencyTracker()
+    : head(0), count(0), pendingInput(-1.0), frameInput(-1.0),
+      frameSample(0.0) {}
+
+void LatencyTracker::inputEvent(double time) {
+  // the oldest unconsumed event is the one that waited the longest
+  if (this->pendingInput < 0.0) {
+    this->pendingInput = time;
+  }
+}
+void LatencyTracker::beginFrame(double sampleTime) {
+  this->frameInput = this->pendingInput;
+  this->frameSample = sampleTime;
+  this->pendingInput = -1.0;
+}
+double LatencyTracker::endFrame(double swapTime, bool waitGpu) {
+  this->poll(swapTime);
+  if (this->count == LATENCY_FRAMES_IN_FLIGHT) {
+    // the gpu is too far behind to keep polling, wait for the oldest one
+    LatencyFrame &oldest = this->frames[this->head];
+    glClientWaitSync(oldest.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+    this->resolveOldest(glfwGetTime());
+  }
+  unsigned int slot = (this->head + this->count) % LATENCY_FRAMES_IN_FLIGHT;
+  LatencyFrame &f = this->frames[slot];
+  f.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  f.inputTime = this->frameInput;
+  f.sampleTime = this->frameSample;
+  f.swapTime = swapTime;
+  this->frameInput = -1.0;
+  this->count++;
+  if (!waitGpu) {
+    return -1.0;
+  }
+  // frames before this one share the fence order, they are done too
+  glClientWaitSync(f.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+  double done = glfwGetTime();
+  while (this->count > 0) {
+    this->resolveOldest(done);
+  }
+  return done;
+}
+void LatencyTracker::poll(double now) {
+  while (this->count > 0) {
+    LatencyFrame &oldest = this->frames[this->head];
+    GLenum status = glClientWaitSync(oldest.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      break;
+    }
+    this->resolveOldest(now);
+  }
+}
+void LatencyTracker::resolveOldest(double presentTime) {
+  LatencyFrame &f = this->frames[this->head];
+  if (presentTime < f.swapTime) {
+    presentTime = f.swapTime;
+  }
+  this->sampleToPhoton.add(presentTime - f.sampleTime);
+  if (f.inputTime >= 0.0) {
+    this->inputToPhoton.add(presentTime - f.inputTime);
+  }
+  glDeleteSync(f.fence);
+  this->head = (this->head + 1) % LATENCY_FRAMES_IN_FLIGHT;
+  this->count--;
+}
+void LatencyTracker::report(std::ostream &out) const {
+  out << "input to photon (lower bound) over " << this->inputToPhoton.count
+      << " frames: average " << this->inputToPhoton.average() * 1000.0
+      << " ms, min " << this->inputToPhoton.minValue * 1000.0 << " ms, max "
+      << this->inputToPhoton.maxValue * 1000.0 << " ms" << std::endl;
+  out << "sample to photon over " << this->sampleToPhoton.count
+      << " frames: average " << this->sampleToPhoton.average() * 1000.0
+      << " ms" << std::endl;
+}
+void LatencyTracker::destroy() {
+  while (this->count > 0) {
+    glDeleteSync(this->frames[this->head].fence);
+    this->head = (this->head + 1) % LATENCY_FRAMES_IN_FLIGHT;
+    this->count--;
+  }
+}
+
+FramePacer::FramePacer(double interval)
+    : enabled(false), refreshInterval(interval), margin(0.002), missed(0),
+      lastPresent(-1.0), cost(0.0) {}
+
+void FramePacer::waitForSample(double now) {
+  if (!this->enabled || this->lastPresent < 0.0) {
+    return;
+  }
+  double deadline = this->lastPresent + this->refreshInterval;
+  // a refresh already went by, aim at the next one
+  while (deadline < now) {
+    deadline += this->refreshInterval;
+  }
+  // each event wakes the wait up, its callback stamps it on arrival
+  double sample = deadline - this->cost - this->margin;
+  while (now < sample) {
+    glfwWaitEventsTimeout(sample - now);
+    now = glfwGetTime();
+  }
+}
+void FramePacer::frameDone(double sampleTime, double submitTime,
+                           double presentTime) {
+  if (presentTime < 0.0) {
+    // not waiting on the gpu, nothing to pace against
+    this->lastPresent = -1.0;
+    return;
+  }
+  double frameCost = submitTime - sampleTime;
+  this->cost = this->cost == 0.0 ? frameCost
+                                 : this->cost * 0.9 + frameCost * 0.1;
+  // the margin also has to cover the gpu work, missing a refresh grows it
+  // and it creeps back down while frames make it
+  if (this->lastPresent >= 0.0 &&
+      presentTime - this->lastPresent > 1.5 * this->refreshInterval) {
+    this->missed++;
+    this->margin += 0.001;
+    if (this->margin > 0.5 * this->refreshInterval) {
+      this->margin = 0.5 * this->refreshInterval;
+    }
+  } else if (this->margin > 0.0005) {
+    this->margin *= 0.995;
+  }
+  this->lastPresent = presentTime;
+}
+
+#endif
@@ -5,10 +5,12 @@
 #ifndef LIGHT_HPP
 #define LIGHT_HPP
 
+#include <glm/glm.hpp>
+
 class LightSource {
 public:
   void setIntensity(glm::vec3 intensity);
-  void setIntensity(float red, float, green, float blue);
+  void setIntensity(float red, float green, float blue);
   void setCoeff(glm::vec3 coefficient);
   void setCoeff(float redc, float greenc, float bluec);
   glm::vec3 getIntensity(void);
@@ -25,7 +27,7 @@ public:
     this->coefficient = glm::vec3(redc, greenc, bluec);
     this->updateColor();
   }
-  ~LightSource();
+  virtual ~LightSource() {}
 
 protected:
   glm::vec3 intensity;
@@ -45,14 +47,14 @@ void LightSource::updateColor() {
   this->color.z = this->intensity.z * this->coefficient.z;
 }
 
-void LightSource::setIntensty(glm::vec3 intensity) {
+void LightSource::setIntensity(glm::vec3 intensity) {
   /* Set intensity vector to light source
      and update the color afterwards
    */
   this->intensity = intensity;
   this->updateColor();
 }
-void LightSource::setIntensty(float red, float green, float blue) {
+void LightSource::setIntensity(float red, float green, float blue) {
   /* Set intensity values to light source
      and update the color afterwards
    */
@@ -84,19 +86,17 @@ class DirectionalLight : public LightSource {
 public:
     glm::vec3 direction;
     DirectionalLight(glm::vec3 dir, glm::vec3 intval, glm::vec3 coeff)
+        : LightSource(intval, coeff)
     {
         direction = dir;
-        coefficient = coeff;
-        setIntensty(intval);
     }
     DirectionalLight(float dirx, float diry, float dirz, float intx,
             float inty, float intz, float coeffx, float coeffy,
             float coeffz)
+        : LightSource(glm::vec3(intx, inty, intz),
+                      glm::vec3(coeffx, coeffy, coeffz))
     {
         direction = glm::vec3(dirx, diry, dirz);
-        coefficient = glm::vec3(coeffx, coeffy, coeffz);
-        setIntensty(intx, inty, intz);
-
     }
     void setDirection(float dirx, float diry, float dirz)
     {
@@ -110,6 +110,19 @@ class PointLight : public DirectionalLight{
         float attenuationConstant;
         float attenuationLinear;
         float attenuationQuadratic;
+        PointLight(glm::vec3 pos, glm::vec3 intval, glm::vec3 coeff,
+                   float attc = 1.0f, float attl = 0.0f, float attq = 0.0f)
+            : DirectionalLight(glm::vec3(0.0f, -1.0f, 0.0f), intval, coeff)
+        {
+            position = pos;
+            attenuationConstant = attc;
+            attenuationLinear = attl;
+            attenuationQuadratic = attq;
+        }
+        void setPosition(float posx, float posy, float posz)
+        {
+            position = glm::vec3(posx, posy, posz);
+        }
 };
 
 #endif
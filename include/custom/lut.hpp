@@ -0,0 +1,189 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Lookup table for the traditional Beckmann Spizzichino terms of the pbr
+// shaders. The table is indexed by (|cos theta|, sqrt roughness), stores
+//   r: bsLamdaTFn, the lambda of the direction for the given roughness
+//   g: roughnessToAlpha of the roughness
+// so the fragment shaders sample it instead of evaluating the log, the
+// quartic polynomial, the tangent chain and the rational lambda per light.
+
+#ifndef LUT_HPP
+#define LUT_HPP
+
+#include <glad/glad.h>
+
+#include <custom/brdf.hpp>
+#include <custom/shader.hpp>
+
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+// define that switches simplepbr(1).frag to the lookup table variant
+const char *LAMBDA_LUT_DEFINE = "#define USE_LAMBDA_LUT\n";
+
+struct LambdaLut {
+  unsigned int size;
+  // rg, row = lambdaLutRoughnessCoord, column = lambdaLutCoord
+  std::vector<float> texels;
+};
+
+// Lambda is steep both at grazing angles, where tan theta goes to infinity,
+// and around the normal, where it goes to zero. The column coordinate
+//   (sqrt(cos theta) + 1 - sqrt(1 - cos theta)) / 2
+// packs texels towards both ends for the price of two square roots in the
+// shader. The first and last texel centers sit on 0 and 1, shaders map
+// their coordinates with uv * scale + bias.
+float lambdaLutCoord(float cosTheta) {
+  float c = std::fabs(cosTheta);
+  c = c > 1.0f ? 1.0f : c;
+  return 0.5f * (std::sqrt(c) + 1.0f - std::sqrt(1.0f - c));
+}
+// roughnessToAlpha is a polynomial in log(roughness), clamped below 1e-3;
+// on a linear axis the low rows miss its curvature by 10 to 30 percent at
+// any table size. Rows are spaced on sqrt(roughness), which puts the clamp
+// inside the first cell and follows the curve down to small roughness.
+float lambdaLutRoughnessCoord(float roughness) {
+  float r = roughness < 0.0f ? 0.0f : (roughness > 1.0f ? 1.0f : roughness);
+  return std::sqrt(r);
+}
+float lambdaLutScale(unsigned int size) {
+  return (float)(size - 1) / (float)size;
+}
+float lambdaLutBias(unsigned int size) { return 0.5f / (float)size; }
+
+float lambdaLutCosTheta(float coord) {
+  // lambdaLutCoord is monotonic, invert by bisection at bake time
+  float lo = 0.0f;
+  float hi = 1.0f;
+  for (unsigned int i = 0; i < 32; i++) {
+    float mid = 0.5f * (lo + hi);
+    if (lambdaLutCoord(mid) < coord) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return 0.5f * (lo + hi);
+}
+
+LambdaLut bakeLambdaLut(unsigned int size) {
+  LambdaLut lut;
+  lut.size = size;
+  lut.texels.resize(size * size * 2);
+  for (unsigned int y = 0; y < size; y++) {
+    float v = (float)y / (float)(size - 1);
+    float roughness = v * v;
+    float alpha = brdfRoughnessToAlpha(roughness);
+    for (unsigned int x = 0; x < size; x++) {
+      float cosTheta = lambdaLutCosTheta((float)x / (float)(size - 1));
+      // tan theta is infinite at grazing and zero at normal incidence,
+      // both give inf / inf in the rational lambda
+      cosTheta = cosTheta < 1e-3f ? 1e-3f : cosTheta;
+      cosTheta = cosTheta > 0.99999f ? 0.99999f : cosTheta;
+      lut.texels[(y * size + x) * 2 + 0] = brdfBsLambda(cosTheta, alpha);
+      lut.texels[(y * size + x) * 2 + 1] = alpha;
+    }
+  }
+  return lut;
+}
+
+float sampleLambdaLut(const LambdaLut &lut, float cosTheta, float roughness,
+                      unsigned int channel) {
+  // cpu copy of the shader lookup, GL_LINEAR filtering
+  float scale = (float)(lut.size - 1);
+  float x = lambdaLutCoord(cosTheta) * scale;
+  float y = lambdaLutRoughnessCoord(roughness) * scale;
+  x = x < 0.0f ? 0.0f : (x > scale ? scale : x);
+  y = y < 0.0f ? 0.0f : (y > scale ? scale : y);
+  unsigned int x0 = (unsigned int)x;
+  unsigned int y0 = (unsigned int)y;
+  unsigned int x1 = x0 + 1 < lut.size ? x0 + 1 : x0;
+  unsigned int y1 = y0 + 1 < lut.size ? y0 + 1 : y0;
+  float fx = x - (float)x0;
+  float fy = y - (float)y0;
+  const std::vector<float> &t = lut.texels;
+  float c00 = t[(y0 * lut.size + x0) * 2 + channel];
+  float c10 = t[(y0 * lut.size + x1) * 2 + channel];
+  float c01 = t[(y1 * lut.size + x0) * 2 + channel];
+  float c11 = t[(y1 * lut.size + x1) * 2 + channel];
+  float top = c00 + (c10 - c00) * fx;
+  float bottom = c01 + (c11 - c01) * fx;
+  return top + (bottom - top) * fy;
+}
+
+void reportLambdaLutAccuracy(const LambdaLut &lut, unsigned int samples,
+                             std::ostream &out) {
+  // compares the lookup against the analytic shader functions on a dense
+  // grid. Lambda itself is unbounded at grazing angles and crosses zero,
+  // so errors are reported on the masking term 1 / (1 + lambda) that
+  // actually reaches the image, low roughness is reported apart
+  const char *bandNames[] = {"cos [0.0, 0.1)", "cos [0.1, 0.5)",
+                             "cos [0.5, 1.0]", "roughness < 0.05"};
+  double maxErr[4] = {0.0, 0.0, 0.0, 0.0};
+  double sumErr[4] = {0.0, 0.0, 0.0, 0.0};
+  unsigned int count[4] = {0, 0, 0, 0};
+  for (unsigned int j = 0; j < samples; j++) {
+    float roughness = ((float)j + 0.5f) / (float)samples;
+    for (unsigned int i = 0; i < samples; i++) {
+      float cosTheta = ((float)i + 0.5f) / (float)samples;
+      unsigned int band = cosTheta < 0.1f ? 0 : (cosTheta < 0.5f ? 1 : 2);
+      if (roughness < 0.05f) {
+        band = 3;
+      }
+      double exact = 1.0 / (1.0 + brdfBsLambdaT(cosTheta, roughness));
+      double approx =
+          1.0 / (1.0 + sampleLambdaLut(lut, cosTheta, roughness, 0));
+      double err = std::fabs(exact - approx);
+      maxErr[band] = std::fmax(maxErr[band], err);
+      sumErr[band] += err;
+      count[band]++;
+    }
+  }
+  out << "lambda lut " << lut.size << "x" << lut.size << ", G1 abs error"
+      << std::endl;
+  for (unsigned int b = 0; b < 4; b++) {
+    out << "  " << std::left << std::setw(18) << bandNames[b] << std::right
+        << std::scientific << std::setprecision(3) << "  max " << maxErr[b]
+        << "  mean " << (count[b] > 0 ? sumErr[b] / count[b] : 0.0)
+        << std::defaultfloat << std::endl;
+  }
+  // the g channel, read as alpha by the trowbridge reitz path
+  double alphaMax = 0.0;
+  double alphaSum = 0.0;
+  for (unsigned int j = 0; j < samples; j++) {
+    float roughness = ((float)j + 0.5f) / (float)samples;
+    float exact = brdfRoughnessToAlpha(roughness);
+    double err = std::fabs(exact - sampleLambdaLut(lut, 0.5f, roughness, 1));
+    alphaMax = std::fmax(alphaMax, err / exact);
+    alphaSum += err / exact;
+  }
+  out << "  " << std::left << std::setw(18) << "alpha, rel error" << std::right
+      << std::scientific << std::setprecision(3) << "  max " << alphaMax
+      << "  mean " << alphaSum / samples << std::defaultfloat << std::endl;
+}
+
+void initLambdaLut_proc(Shader &shader, const LambdaLut &lut, int unit) {
+  shader.useProgram();
+  shader.setIntUni("lambdaLUT", unit);
+  shader.setVec2Uni("lambdaLutScaleBias", lambdaLutScale(lut.size),
+                    lambdaLutBias(lut.size));
+}
+
+GLuint uploadLambdaLut(const LambdaLut &lut) {
+  GLuint tex;
+  glGenTextures(1, &tex);
+  glBindTexture(GL_TEXTURE_2D, tex);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, lut.size, lut.size, 0, GL_RG,
+               GL_FLOAT, lut.texels.data());
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  glBindTexture(GL_TEXTURE_2D, 0);
+  return tex;
+}
+
+#endif
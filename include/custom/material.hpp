@@ -0,0 +1,297 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Material atlas: the maps of every material live as layers of one
+// GL_TEXTURE_2D_ARRAY per map type, so a single set of bindings serves all
+// materials and the layer is picked in the shader by the material index of
+// the instance. Objects sharing a mesh are then drawn with one instanced
+// call whatever their material.
+// Layers of an array share their size, maps of another size are resampled
+// when they are loaded.
+
+#ifndef MATERIAL_HPP
+#define MATERIAL_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <custom/assetimage.hpp>
+#include <custom/glstate.hpp>
+#include <custom/shader.hpp>
+#include <custom/tangent.hpp>
+#include <custom/trace.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+const unsigned int MATERIAL_MAP_COUNT = 5;
+const unsigned int MATERIAL_ALBEDO = 0;
+const unsigned int MATERIAL_NORMAL = 1;
+const unsigned int MATERIAL_METALLIC = 2;
+const unsigned int MATERIAL_AO = 3;
+const unsigned int MATERIAL_ROUGHNESS = 4;
+
+// sampler names of simplepbr1.frag when MATERIAL_BATCH is defined
+const char *MATERIAL_MAP_UNIFORMS[MATERIAL_MAP_COUNT] = {
+    "albedoMaps", "normalMaps", "metallicMaps", "aoMaps", "roughnessMaps"};
+const char *MATERIAL_BATCH_DEFINE = "#define MATERIAL_BATCH\n";
+
+// texel used for a map the material does not have
+const unsigned char MATERIAL_DEFAULT_TEXEL[MATERIAL_MAP_COUNT][4] = {
+    {255, 255, 255, 255}, // albedo
+    {128, 128, 255, 255}, // flat normal
+    {0, 0, 0, 255},       // metallic
+    {255, 255, 255, 255}, // ao
+    {128, 128, 128, 255}, // roughness
+};
+
+struct MaterialDesc {
+  // file of every map type, empty for the default value
+  std::string maps[MATERIAL_MAP_COUNT];
+};
+
+class MaterialAtlas {
+public:
+  GLuint arrays[MATERIAL_MAP_COUNT];
+  unsigned int size; // width and height of every layer
+
+  MaterialAtlas(unsigned int layerSize);
+  // loads the maps of the material, returns its index which is also its
+  // layer in every array
+  unsigned int add(const MaterialDesc &desc);
+  unsigned int count() const { return this->layerCount; }
+  // creates the arrays and drops the cpu copies
+  void upload();
+  void initSamplers(Shader &shader, unsigned int firstUnit);
+  // arrays on firstUnit and the following units, in map type order
+  void bind(unsigned int firstUnit);
+  void destroy();
+
+private:
+  // rgba8 layers one after the other
+  std::vector<unsigned char> texels[MATERIAL_MAP_COUNT];
+  unsigned int layerCount;
+};
+
+// per instance attributes, locations 4 to 15 of simplepbr1.vert
+struct MaterialInstance {
+  float model[16];
+  float mvp[16];
+  float normalMatrix[9];
+  GLint material;
+};
+
+class MaterialBatch {
+public:
+  std::vector<MaterialInstance> instances;
+
+  MaterialBatch() : vbo(0) {}
+  // adds the per instance attributes to the vertex array of the mesh
+  void attach(const TangentMesh &mesh);
+  void clear() { this->instances.clear(); }
+  void add(const glm::mat4 &model, const glm::mat4 &mvp,
+           const glm::mat3 &normalMatrix, unsigned int material);
+  // every instance in one call
+  void draw(const TangentMesh &mesh);
+  void destroy();
+
+private:
+  GLuint vbo;
+};
+
+void resampleRgba8_proc(const unsigned char *src, int width, int height,
+                        unsigned char *dst, unsigned int size) {
+  // bilinear, texel centers of the source and destination line up
+  for (unsigned int y = 0; y < size; y++) {
+    float fy = ((float)y + 0.5f) * (float)height / (float)size - 0.5f;
+    int y0 = glm::clamp((int)std::floor(fy), 0, height - 1);
+    int y1 = glm::min(y0 + 1, height - 1);
+    float ty = glm::clamp(fy - (float)y0, 0.0f, 1.0f);
+    for (unsigned int x = 0; x < size; x++) {
+      float fx = ((float)x + 0.5f) * (float)width / (float)size - 0.5f;
+      int x0 = glm::clamp((int)std::floor(fx), 0, width - 1);
+      int x1 = glm::min(x0 + 1, width - 1);
+      float tx = glm::clamp(fx - (float)x0, 0.0f, 1.0f);
+      for (unsigned int c = 0; c < 4; c++) {
+        float a = src[(y0 * width + x0) * 4 + c];
+        float b = src[(y0 * width + x1) * 4 + c];
+        float d = src[(y1 * width + x0) * 4 + c];
+        float e = src[(y1 * width + x1) * 4 + c];
+        float top = a + (b - a) * tx;
+        float bottom = d + (e - d) * tx;
+        dst[(y * size + x) * 4 + c] =
+            (unsigned char)(top + (bottom - top) * ty + 0.5f);
+      }
+    }
+  }
+}
+
+MaterialAtlas::MaterialAtlas(unsigned int layerSize)
+    : size(layerSize), layerCount(0) {
+  for (unsigned int m = 0; m < MATERIAL_MAP_COUNT; m++) {
+    this->arrays[m] = 0;
+  }
+}
+
+unsigned int MaterialAtlas::add(const MaterialDesc &desc) {
+  size_t layerBytes = (size_t)this->size * this->size * 4;
+  for (unsigned int m = 0; m < MATERIAL_MAP_COUNT; m++) {
+    std::vector<unsigned char> &arr = this->texels[m];
+    arr.resize(arr.size() + layerBytes);
+    unsigned char *layer = &arr[arr.size() - layerBytes];
+    AssetImage image;
+    image.texels = NULL;
+    if (!desc.maps[m].empty()) {
+      // every map is expanded to rgba so all layers share one format
+      if (!loadAssetImage(desc.maps[m], 4, image)) {
+        std::cout << "Failed to load material map " << desc.maps[m]
+                  << std::endl;
+      }
+    }
+    const unsigned char *data = image.texels;
+    int width = image.width, height = image.height;
+    if (data == NULL) {
+      for (size_t i = 0; i < layerBytes; i += 4) {
+        std::memcpy(layer + i, MATERIAL_DEFAULT_TEXEL[m], 4);
+      }
+      continue;
+    }
+    if ((unsigned int)width == this->size &&
+        (unsigned int)height == this->size) {
+      std::memcpy(layer, data, layerBytes);
+    } else {
+      std::cout << "material map " << desc.maps[m] << " is resampled from "
+                << width << "x" << height << " to the layer size "
+                << this->size << std::endl;
+      resampleRgba8_proc(data, width, height, layer, this->size);
+    }
+    freeAssetImage(image);
+  }
+  this->layerCount++;
+  return this->layerCount - 1;
+}
+
+void MaterialAtlas::upload() {
+  glGenTextures(MATERIAL_MAP_COUNT, this->arrays);
+  for (unsigned int m = 0; m < MATERIAL_MAP_COUNT; m++) {
+    glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, this->arrays[m]);
+    // albedo is srgb encoded and decoded by the texture unit, the other
+    // maps hold linear data
+    GLint internalFormat = m == MATERIAL_ALBEDO ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    {
+      TRACE_SCOPE("glTexImage3D");
+      glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internalFormat, this->size,
+                   this->size, this->layerCount, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                   this->texels[m].data());
+    }
+    {
+      TRACE_SCOPE("glGenerateMipmap");
+      glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    }
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                    GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    std::vector<unsigned char>().swap(this->texels[m]);
+  }
+}
+
+void MaterialAtlas::initSamplers(Shader &shader, unsigned int firstUnit) {
+  shader.useProgram();
+  for (unsigned int m = 0; m < MATERIAL_MAP_COUNT; m++) {
+    shader.setIntUni(MATERIAL_MAP_UNIFORMS[m], firstUnit + m);
+  }
+}
+
+void MaterialAtlas::bind(unsigned int firstUnit) {
+  for (unsigned int m = 0; m < MATERIAL_MAP_COUNT; m++) {
+    glState().bindTexture(firstUnit + m, GL_TEXTURE_2D_ARRAY,
+                          this->arrays[m]);
+  }
+}
+
+void MaterialAtlas::destroy() {
+  for (unsigned int m = 0; m < MATERIAL_MAP_COUNT; m++) {
+    glState().deleteTexture(this->arrays[m]);
+    this->arrays[m] = 0;
+  }
+}
+
+void MaterialBatch::attach(const TangentMesh &mesh) {
+  if (this->vbo == 0) {
+    glGenBuffers(1, &this->vbo);
+  }
+  glState().bindVertexArray(mesh.vao);
+  glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+  // plain draws of the mesh, the shadow casters, fetch the first instance
+  MaterialInstance empty;
+  std::memset(&empty, 0, sizeof(empty));
+  glBufferData(GL_ARRAY_BUFFER, sizeof(empty), &empty, GL_STREAM_DRAW);
+  GLsizei stride = sizeof(MaterialInstance);
+  // a matrix attribute takes one location per column
+  for (unsigned int c = 0; c < 4; c++) {
+    size_t column = c * 4 * sizeof(float);
+    glEnableVertexAttribArray(4 + c);
+    glVertexAttribPointer(
+        4 + c, 4, GL_FLOAT, GL_FALSE, stride,
+        (void *)(offsetof(MaterialInstance, model) + column));
+    glVertexAttribDivisor(4 + c, 1);
+    glEnableVertexAttribArray(8 + c);
+    glVertexAttribPointer(8 + c, 4, GL_FLOAT, GL_FALSE, stride,
+                          (void *)(offsetof(MaterialInstance, mvp) + column));
+    glVertexAttribDivisor(8 + c, 1);
+  }
+  for (unsigned int c = 0; c < 3; c++) {
+    size_t column = c * 3 * sizeof(float);
+    glEnableVertexAttribArray(12 + c);
+    glVertexAttribPointer(
+        12 + c, 3, GL_FLOAT, GL_FALSE, stride,
+        (void *)(offsetof(MaterialInstance, normalMatrix) + column));
+    glVertexAttribDivisor(12 + c, 1);
+  }
+  glEnableVertexAttribArray(15);
+  glVertexAttribIPointer(15, 1, GL_INT, stride,
+                         (void *)offsetof(MaterialInstance, material));
+  glVertexAttribDivisor(15, 1);
+}
+
+void MaterialBatch::add(const glm::mat4 &model, const glm::mat4 &mvp,
+                        const glm::mat3 &normalMatrix, unsigned int material) {
+  MaterialInstance inst;
+  std::memcpy(inst.model, glm::value_ptr(model), sizeof(inst.model));
+  std::memcpy(inst.mvp, glm::value_ptr(mvp), sizeof(inst.mvp));
+  std::memcpy(inst.normalMatrix, glm::value_ptr(normalMatrix),
+              sizeof(inst.normalMatrix));
+  inst.material = (GLint)material;
+  this->instances.push_back(inst);
+}
+
+void MaterialBatch::draw(const TangentMesh &mesh) {
+  if (this->instances.empty()) {
+    return;
+  }
+  glBindBuffer(GL_ARRAY_BUFFER, this->vbo);
+  // orphan the old storage, the previous frame may still read it
+  GLsizeiptr bytes =
+      (GLsizeiptr)(this->instances.size() * sizeof(MaterialInstance));
+  glBufferData(GL_ARRAY_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+  glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, this->instances.data());
+  glState().bindVertexArray(mesh.vao);
+  glDrawElementsInstanced(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, 0,
+                          (GLsizei)this->instances.size());
+}
+
+void MaterialBatch::destroy() {
+  if (this->vbo != 0) {
+    glDeleteBuffers(1, &this->vbo);
+    this->vbo = 0;
+  }
+}
+
+#endif
@@ -15,8 +15,11 @@
 #include <custom/stb_image.h>
 
 // mesh shader
+#include <custom/hierarchy.hpp>
 #include <custom/mesh.hpp>
 #include <custom/shader.hpp>
+#include <custom/trace.hpp>
+#include <custom/transform.hpp>
 
 // assimp model loading library
 #include <assimp/Importer.hpp>
@@ -43,32 +46,48 @@ public:
 
   bool gammaCorrection;
   std::vector<Mesh> meshes;
+  // the node tree of the file, meshNodes[i] is the node of meshes[i]
+  TransformHierarchy nodes;
+  std::vector<unsigned int> meshNodes;
   std::vector<Texture> loadedTextures;
   std::string directory;
   // constructor
   Model(const char* path, bool gamma = false) : gammaCorrection(gamma)
   { loadModel(path); }
   // functions
-  void draw(Shader shader);
+  // placement is the model matrix of the whole model, each mesh gets the
+  // model, mvp and normalMatrix uniforms of placement times its node
+  void draw(Shader shader, const glm::mat4 &viewProj,
+            const glm::mat4 &placement = glm::mat4(1.0f));
 
 private:
   // model data
   // functions
   void loadModel(std::string path);
-  void processNode(aiNode *node, const aiScene *scene);
+  void processNode(aiNode *node, const aiScene *scene, unsigned int parent);
   Mesh processMesh(aiMesh *mesh, const aiScene *scene);
   std::vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type,
                                             std::string typeName);
 };
 
 // defining methods
-void Model::draw(Shader shader) {
+void Model::draw(Shader shader, const glm::mat4 &viewProj,
+                 const glm::mat4 &placement) {
+  // only nodes moved since the last draw are recomputed
+  this->nodes.update();
   for (unsigned int i = 0; i < this->meshes.size(); i++) {
+    glm::mat4 model = placement * this->nodes.world(this->meshNodes[i]);
+    shader.setMat4Uni("model", model);
+    glm::mat4 mvp = viewProj * model;
+    shader.setMat4Uni("mvp", mvp);
+    glm::mat3 normals = normalMatrix(model);
+    shader.setMat3Uni("normalMatrix", normals);
     this->meshes[i].draw(shader);
   }
 }
 
 void Model::loadModel(std::string path) {
+  TRACE_SCOPE_DETAIL("Model::loadModel", path.c_str());
   // read the file with assimp
   Assimp::Importer importer;
   const aiScene *scene =
@@ -110,19 +129,30 @@ translate the loaded data to an array of Mesh objects.
   directory = path.substr(0, path.find_last_of('/'));
 
   // start processing from root node recursively
-  this->processNode(scene->mRootNode, scene);
+  this->processNode(scene->mRootNode, scene, HIERARCHY_ROOT);
 }
 
-void Model::processNode(aiNode *node, const aiScene *scene) {
+void Model::processNode(aiNode *node, const aiScene *scene,
+                        unsigned int parent) {
+  // the transformation of the node is relative to its parent, kept as
+  // translation, rotation and scale so it can be animated
+  aiVector3D scaling, position;
+  aiQuaternion rotation;
+  node->mTransformation.Decompose(scaling, rotation, position);
+  unsigned int handle = this->nodes.add(
+      parent, glm::vec3(position.x, position.y, position.z),
+      glm::quat(rotation.w, rotation.x, rotation.y, rotation.z),
+      glm::vec3(scaling.x, scaling.y, scaling.z));
   // process the meshes of the given node on scene
   for (unsigned int i = 0; i < node->mNumMeshes; i++) {
     aiMesh *mesh = scene->mMeshes[node->mMeshes[i]];
     this->meshes.push_back(this->processMesh(mesh, scene));
+    this->meshNodes.push_back(handle);
   }
   // now all meshes of this node has been processed
   // we should continue to meshes of child nodes
   for (unsigned int k = 0; k < node->mNumChildren; k++) {
-    this->processNode(node->mChildren[k], scene);
+    this->processNode(node->mChildren[k], scene, handle);
   }
 }
 
@@ -248,7 +278,9 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial *mat,
     }
     if (!skipCheck) { // texture is not loaded so let's load it
       Texture tex;
-      tex.id = loadTextureFromFile(newTexPath, this->directory);
+      // only color maps are srgb encoded, data maps stay linear
+      bool srgb = this->gammaCorrection && type == aiTextureType_DIFFUSE;
+      tex.id = loadTextureFromFile(newTexPath, this->directory, srgb);
       tex.type = typeName;
       tex.path = newTexPath;
       texvec.push_back(tex);
@@ -269,25 +301,39 @@ unsigned int loadTextureFromFile(const char *path, const std::string &directory,
 
   // load the image with stb image
   int width, height, nrComponents;
-  unsigned char *data =
-      stbi_load(fname.c_str(), &width, &height, &nrComponents, 0);
+  unsigned char *data = NULL;
+  {
+    TRACE_SCOPE_DETAIL("stbi_load", fname.c_str());
+    data = stbi_load(fname.c_str(), &width, &height, &nrComponents, 0);
+  }
   if (data) {
     GLenum format;
+    GLint internalFormat;
     switch (nrComponents) {
     case 1:
       format = GL_RED;
+      internalFormat = GL_RED;
       break;
     case 3:
       format = GL_RGB;
+      internalFormat = gamma ? GL_SRGB8 : GL_RGB;
       break;
     case 4:
       format = GL_RGBA;
+      internalFormat = gamma ? GL_SRGB8_ALPHA8 : GL_RGBA;
       break;
     }
     glBindTexture(GL_TEXTURE_2D, texId);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
-                 GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    // with gamma the texture unit decodes srgb to linear before filtering
+    {
+      TRACE_SCOPE("glTexImage2D");
+      glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0,
+                   format, GL_UNSIGNED_BYTE, data);
+    }
+    {
+      TRACE_SCOPE("glGenerateMipmap");
+      glGenerateMipmap(GL_TEXTURE_2D);
+    }
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
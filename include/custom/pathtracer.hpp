@@ -0,0 +1,616 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Cpu reference path tracer for the pbr demos.
+// Scenes are built from the same meshes, texture maps and point lights as
+// simplepbr.cpp, surfaces use the microfacet models of brdf.hpp with a
+// lambertian base and every bounce importance samples them. The image is
+// cut into tiles that are spread over the job pool, the result is linear
+// radiance written as a radiance hdr file.
+
+#ifndef PATHTRACER_HPP
+#define PATHTRACER_HPP
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <custom/brdf.hpp>
+#include <custom/bvh.hpp>
+#include <custom/camera.hpp>
+#include <custom/ibl.hpp>
+#include <custom/jobpool.hpp>
+#include <custom/light.hpp>
+// the executables define the stb implementation themselves
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include <custom/stb_image.h>
+#endif
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+const float PT_RAY_EPSILON = 1e-4f;
+const float PT_MIN_ALPHA = 1e-3f;
+
+// small pcg32 generator, one per pixel
+struct PtRng {
+  uint64_t state;
+  uint64_t inc;
+  PtRng(uint64_t seed, uint64_t sequence) : state(0), inc((sequence << 1) | 1) {
+    this->next();
+    this->state += seed;
+    this->next();
+  }
+  uint32_t next() {
+    uint64_t old = this->state;
+    this->state = old * 6364136223846793005ULL + this->inc;
+    uint32_t xorshifted = (uint32_t)(((old >> 18u) ^ old) >> 27u);
+    uint32_t rot = (uint32_t)(old >> 59u);
+    return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+  }
+  // uniform in [0, 1)
+  float uniform() {
+    return (float)(this->next() >> 8) * (1.0f / 16777216.0f);
+  }
+};
+
+// rgb float texture with repeat wrapping and bilinear filtering
+struct PtTexture {
+  int width = 0;
+  int height = 0;
+  std::vector<float> texels;
+
+  // srgb maps are converted to linear the same way getAlbedo does
+  bool load(const char *path, bool srgb);
+  bool loaded() const { return this->width > 0; }
+  glm::vec3 sample(glm::vec2 uv) const;
+};
+
+bool PtTexture::load(const char *path, bool srgb) {
+  int nbChannels;
+  unsigned char *data = stbi_load(path, &this->width, &this->height,
+                                  &nbChannels, 3);
+  if (!data) {
+    std::cout << "Failed to load texture: " << path << std::endl;
+    this->width = 0;
+    this->height = 0;
+    return false;
+  }
+  this->texels.resize(this->width * this->height * 3);
+  for (int i = 0; i < this->width * this->height * 3; i++) {
+    float c = (float)data[i] / 255.0f;
+    this->texels[i] = srgb ? std::pow(c, 2.2f) : c;
+  }
+  stbi_image_free(data);
+  return true;
+}
+
+glm::vec3 PtTexture::sample(glm::vec2 uv) const {
+  // texture coordinates follow gl, v = 0 is the last row of the file
+  float x = (uv.x - std::floor(uv.x)) * this->width - 0.5f;
+  float y = (1.0f - (uv.y - std::floor(uv.y))) * this->height - 0.5f;
+  int x0 = (int)std::floor(x);
+  int y0 = (int)std::floor(y);
+  float fx = x - (float)x0;
+  float fy = y - (float)y0;
+  int xs[2] = {((x0 % this->width) + this->width) % this->width,
+               (((x0 + 1) % this->width) + this->width) % this->width};
+  int ys[2] = {((y0 % this->height) + this->height) % this->height,
+               (((y0 + 1) % this->height) + this->height) % this->height};
+  float wx[2] = {1.0f - fx, fx};
+  float wy[2] = {1.0f - fy, fy};
+  glm::vec3 result(0.0f);
+  for (int j = 0; j < 2; j++) {
+    for (int i = 0; i < 2; i++) {
+      const float *p = &this->texels[(ys[j] * this->width + xs[i]) * 3];
+      result += glm::vec3(p[0], p[1], p[2]) * (wx[i] * wy[j]);
+    }
+  }
+  return result;
+}
+
+// maps override the constants when they are loaded, the specular and ao
+// maps are only read by the phong and pbr shading of raster.hpp
+struct PtMaterial {
+  PtTexture albedoMap;
+  PtTexture normalMap;
+  PtTexture metallicMap;
+  PtTexture roughnessMap;
+  PtTexture specularMap;
+  PtTexture aoMap;
+  glm::vec3 albedo = glm::vec3(0.8f);
+  float metallic = 0.0f;
+  glm::vec2 roughness = glm::vec2(0.5f); // x, y for anisotropic models
+  unsigned int model = BRDF_BECKMANN;
+};
+
+// hit point data in world space, tangent and bitangent span the shading
+// frame around normal
+struct PtSurface {
+  glm::vec3 pos;
+  glm::vec3 geomNormal;
+  glm::vec3 normal;
+  glm::vec3 tangent;
+  glm::vec3 bitangent;
+  glm::vec2 uv;
+  uint32_t material;
+};
+
+class PtScene {
+public:
+  // three entries per triangle
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals;
+  std::vector<glm::vec2> uvs;
+  // one entry per triangle
+  std::vector<glm::vec3> tangents;
+  std::vector<glm::vec3> bitangents;
+  std::vector<uint32_t> materialIds;
+
+  std::vector<PtMaterial> materials;
+  std::vector<PointLight> lights;
+  EquirectEnvironment environment;
+  bool hasEnvironment = false;
+  glm::vec3 background = glm::vec3(0.0f);
+  Bvh bvh;
+
+  void addTriangle(const glm::vec3 p[3], const glm::vec3 &normal,
+                   const glm::vec2 uv[3], uint32_t material);
+  // same cube as renderCube in simplepbr.cpp
+  void addCube(const glm::mat4 &model, uint32_t material);
+  // tangent frames and the bvh, call after the geometry is in place
+  void commit();
+
+  bool intersect(BvhRay &ray, PtSurface &surface) const;
+  bool occluded(const glm::vec3 &from, const glm::vec3 &to) const;
+  glm::vec3 environmentRadiance(const glm::vec3 &dir) const;
+};
+
+void PtScene::addTriangle(const glm::vec3 p[3], const glm::vec3 &normal,
+                          const glm::vec2 uv[3], uint32_t material) {
+  for (int i = 0; i < 3; i++) {
+    this->positions.push_back(p[i]);
+    this->normals.push_back(normal);
+    this->uvs.push_back(uv[i]);
+  }
+  this->materialIds.push_back(material);
+}
+
+void PtScene::addCube(const glm::mat4 &model, uint32_t material) {
+  // positions and texture coordinates per triangle, face normal last
+  static const float cube[12][18] = {
+      {-0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.5f,
+       0.5f, -0.5f, 1.0f, 1.0f, 0.0f, 0.0f, -1.0f},
+      {0.5f, 0.5f, -0.5f, 1.0f, 1.0f, -0.5f, 0.5f, -0.5f, 0.0f, 1.0f, -0.5f,
+       -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f},
+      {-0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 0.5f, -0.5f, 0.5f, 1.0f, 0.0f, 0.5f,
+       0.5f, 0.5f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f},
+      {0.5f, 0.5f, 0.5f, 1.0f, 1.0f, -0.5f, 0.5f, 0.5f, 0.0f, 1.0f, -0.5f,
+       -0.5f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f},
+      {-0.5f, 0.5f, 0.5f, 1.0f, 0.0f, -0.5f, 0.5f, -0.5f, 1.0f, 1.0f, -0.5f,
+       -0.5f, -0.5f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f},
+      {-0.5f, -0.5f, -0.5f, 0.0f, 1.0f, -0.5f, -0.5f, 0.5f, 0.0f, 0.0f,
+       -0.5f, 0.5f, 0.5f, 1.0f, 0.0f, -1.0f, 0.0f, 0.0f},
+      {0.5f, 0.5f, 0.5f, 1.0f, 0.0f, 0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.5f,
+       -0.5f, -0.5f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f},
+      {0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 0.5f,
+       0.5f, 0.5f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f},
+      {-0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 0.5f, -0.5f, -0.5f, 1.0f, 1.0f, 0.5f,
+       -0.5f, 0.5f, 1.0f, 0.0f, 0.0f, -1.0f, 0.0f},
+      {0.5f, -0.5f, 0.5f, 1.0f, 0.0f, -0.5f, -0.5f, 0.5f, 0.0f, 0.0f, -0.5f,
+       -0.5f, -0.5f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f},
+      {-0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.5f,
+       0.5f, 0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f},
+      {0.5f, 0.5f, 0.5f, 1.0f, 0.0f, -0.5f, 0.5f, 0.5f, 0.0f, 0.0f, -0.5f,
+       0.5f, -0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f},
+  };
+  glm::mat3 normalMat = glm::transpose(glm::inverse(glm::mat3(model)));
+  for (int t = 0; t < 12; t++) {
+    glm::vec3 p[3];
+    glm::vec2 uv[3];
+    for (int i = 0; i < 3; i++) {
+      const float *v = &cube[t][i * 5];
+      p[i] = glm::vec3(model * glm::vec4(v[0], v[1], v[2], 1.0f));
+      uv[i] = glm::vec2(v[3], v[4]);
+    }
+    glm::vec3 n(cube[t][15], cube[t][16], cube[t][17]);
+    this->addTriangle(p, glm::normalize(normalMat * n), uv, material);
+  }
+}
+
+void PtScene::commit() {
+  uint32_t triCount = (uint32_t)this->materialIds.size();
+  this->tangents.resize(triCount);
+  this->bitangents.resize(triCount);
+  for (uint32_t i = 0; i < triCount; i++) {
+    // dp/du and dp/dv of the triangle, taken from pbr-book 3rd edition
+    glm::vec3 e1 = this->positions[i * 3 + 1] - this->positions[i * 3];
+    glm::vec3 e2 = this->positions[i * 3 + 2] - this->positions[i * 3];
+    glm::vec2 d1 = this->uvs[i * 3 + 1] - this->uvs[i * 3];
+    glm::vec2 d2 = this->uvs[i * 3 + 2] - this->uvs[i * 3];
+    float det = d1.x * d2.y - d1.y * d2.x;
+    glm::vec3 n = glm::normalize(glm::cross(e1, e2));
+    if (std::fabs(det) < 1e-12f) {
+      // degenerate uvs, any frame around the normal
+      glm::vec3 a = std::fabs(n.x) > 0.9f ? glm::vec3(0.0f, 1.0f, 0.0f)
+                                          : glm::vec3(1.0f, 0.0f, 0.0f);
+      this->tangents[i] = glm::normalize(glm::cross(a, n));
+      this->bitangents[i] = glm::cross(n, this->tangents[i]);
+      continue;
+    }
+    float invDet = 1.0f / det;
+    this->tangents[i] = (e1 * d2.y - e2 * d1.y) * invDet;
+    this->bitangents[i] = (e2 * d1.x - e1 * d2.x) * invDet;
+  }
+  this->bvh.build(this->positions);
+}
+
+bool PtScene::intersect(BvhRay &ray, PtSurface &surface) const {
+  BvhHit hit;
+  if (!this->bvh.intersect(ray, hit)) {
+    return false;
+  }
+  uint32_t tri = hit.triangle;
+  float w = 1.0f - hit.u - hit.v;
+  const glm::vec3 *p = &this->positions[tri * 3];
+  const glm::vec3 *n = &this->normals[tri * 3];
+  const glm::vec2 *uv = &this->uvs[tri * 3];
+  surface.pos = p[0] * w + p[1] * hit.u + p[2] * hit.v;
+  surface.geomNormal = glm::normalize(glm::cross(p[1] - p[0], p[2] - p[0]));
+  surface.uv = uv[0] * w + uv[1] * hit.u + uv[2] * hit.v;
+  surface.material = this->materialIds[tri];
+  glm::vec3 normal = glm::normalize(n[0] * w + n[1] * hit.u + n[2] * hit.v);
+  if (glm::dot(surface.geomNormal, normal) < 0.0f) {
+    surface.geomNormal = -surface.geomNormal;
+  }
+
+  // perturb with the normal map in the tangent frame of the triangle
+  glm::vec3 tangent = this->tangents[tri];
+  glm::vec3 bitangent = this->bitangents[tri];
+  const PtMaterial &mat = this->materials[surface.material];
+  if (mat.normalMap.loaded()) {
+    glm::vec3 t = glm::normalize(tangent - normal * glm::dot(normal, tangent));
+    glm::vec3 b = glm::cross(normal, t);
+    if (glm::dot(b, bitangent) < 0.0f) {
+      b = -b;
+    }
+    glm::vec3 ts = mat.normalMap.sample(surface.uv) * 2.0f - 1.0f;
+    glm::vec3 mapped = t * ts.x + b * ts.y + normal * ts.z;
+    if (glm::dot(mapped, mapped) > 0.0f) {
+      normal = glm::normalize(mapped);
+    }
+  }
+  surface.normal = normal;
+  surface.tangent =
+      glm::normalize(tangent - normal * glm::dot(normal, tangent));
+  surface.bitangent = glm::cross(normal, surface.tangent);
+  return true;
+}
+
+bool PtScene::occluded(const glm::vec3 &from, const glm::vec3 &to) const {
+  glm::vec3 d = to - from;
+  float dist = glm::length(d);
+  BvhRay ray(from, d / dist, PT_RAY_EPSILON, dist * (1.0f - 1e-4f));
+  return this->bvh.occluded(ray);
+}
+
+glm::vec3 PtScene::environmentRadiance(const glm::vec3 &dir) const {
+  if (this->hasEnvironment) {
+    return this->environment.sample(dir, 0.0f);
+  }
+  return this->background;
+}
+
+// pinhole camera matching glm::perspective(radians(zoom), aspect, ...)
+struct PtCamera {
+  glm::vec3 pos;
+  glm::vec3 front;
+  glm::vec3 up;
+  glm::vec3 right;
+  float tanHalfFov;
+  float aspect;
+  PtCamera(const Camera &camera, float aspectRatio)
+      : pos(camera.pos), front(glm::normalize(camera.getFront())),
+        up(glm::normalize(camera.getUp())),
+        right(glm::normalize(camera.getRight())),
+        tanHalfFov(std::tan(glm::radians(camera.zoom) * 0.5f)),
+        aspect(aspectRatio) {}
+  // film coordinates in [0, 1], y goes down
+  glm::vec3 rayDir(float sx, float sy) const {
+    float x = (2.0f * sx - 1.0f) * this->aspect * this->tanHalfFov;
+    float y = (1.0f - 2.0f * sy) * this->tanHalfFov;
+    return glm::normalize(this->front + this->right * x + this->up * y);
+  }
+};
+
+// material evaluated at a hit point, directions are in the shading frame
+struct PtBsdf {
+  glm::vec3 albedo;
+  glm::vec3 refAtZero;
+  float metallic;
+  float alphaX;
+  float alphaY;
+  unsigned int model;
+
+  PtBsdf(const PtMaterial &mat, glm::vec2 uv);
+  glm::vec3 eval(const glm::vec3 &wo, const glm::vec3 &wi) const;
+  float pdf(const glm::vec3 &wo, const glm::vec3 &wi) const;
+  // returns f * cos / pdf, zero when the sample is below the surface
+  glm::vec3 sample(const glm::vec3 &wo, PtRng &rng, glm::vec3 &wi) const;
+
+private:
+  float specularProbability(const glm::vec3 &wo) const;
+};
+
+PtBsdf::PtBsdf(const PtMaterial &mat, glm::vec2 uv) {
+  this->albedo = mat.albedoMap.loaded() ? mat.albedoMap.sample(uv) : mat.albedo;
+  this->metallic =
+      mat.metallicMap.loaded() ? mat.metallicMap.sample(uv).x : mat.metallic;
+  glm::vec2 rough = mat.roughness;
+  if (mat.roughnessMap.loaded()) {
+    glm::vec3 r = mat.roughnessMap.sample(uv);
+    rough = glm::vec2(r.x, r.y);
+  }
+  // roughness is used as alpha like the normal distributions of the
+  // shaders, the isotropic models only read the first channel
+  this->model = mat.model;
+  this->alphaX = glm::max(rough.x, PT_MIN_ALPHA);
+  this->alphaY = this->alphaX;
+  if (mat.model == BRDF_BECKMANN_ANISO || mat.model == BRDF_TROWREITZ_ANISO) {
+    this->alphaY = glm::max(rough.y, PT_MIN_ALPHA);
+  }
+  this->refAtZero = glm::mix(glm::vec3(0.04f), this->albedo, this->metallic);
+}
+
+glm::vec3 PtBsdf::eval(const glm::vec3 &wo, const glm::vec3 &wi) const {
+  if (wo.z <= 0.0f || wi.z <= 0.0f) {
+    return glm::vec3(0.0f);
+  }
+  glm::vec3 wh = glm::normalize(wo + wi);
+  glm::vec3 fresnel = brdfFresnelSchlick(glm::dot(wh, wo), this->refAtZero);
+  float d = brdfNormalDist(wh, this->alphaX, this->alphaY, this->model);
+  float g = brdfGeometry(wo, wi, this->alphaX, this->alphaY, this->model);
+  glm::vec3 specular = d * g * fresnel / (4.0f * wo.z * wi.z);
+  glm::vec3 kd = (glm::vec3(1.0f) - fresnel) * (1.0f - this->metallic);
+  return kd * this->albedo / BRDF_PI + specular;
+}
+
+float PtBsdf::specularProbability(const glm::vec3 &wo) const {
+  // pick the lobe by its rough share of the reflected energy
+  glm::vec3 fresnel = brdfFresnelSchlick(wo.z, this->refAtZero);
+  glm::vec3 diffuse =
+      (glm::vec3(1.0f) - fresnel) * (1.0f - this->metallic) * this->albedo;
+  float spec = fresnel.x + fresnel.y + fresnel.z;
+  float diff = diffuse.x + diffuse.y + diffuse.z;
+  if (spec + diff <= 0.0f) {
+    return 0.5f;
+  }
+  return glm::clamp(spec / (spec + diff), 0.1f, 0.9f);
+}
+
+float PtBsdf::pdf(const glm::vec3 &wo, const glm::vec3 &wi) const {
+  if (wo.z <= 0.0f || wi.z <= 0.0f) {
+    return 0.0f;
+  }
+  glm::vec3 wh = glm::normalize(wo + wi);
+  float specPdf = brdfHalfVectorPdf(wh, this->alphaX, this->alphaY,
+                                    this->model) /
+                  (4.0f * glm::dot(wo, wh));
+  float diffPdf = wi.z / BRDF_PI;
+  float ps = this->specularProbability(wo);
+  return ps * specPdf + (1.0f - ps) * diffPdf;
+}
+
+glm::vec3 PtBsdf::sample(const glm::vec3 &wo, PtRng &rng,
+                         glm::vec3 &wi) const {
+  if (wo.z <= 0.0f) {
+    return glm::vec3(0.0f);
+  }
+  float u0 = rng.uniform();
+  float u1 = rng.uniform();
+  float u2 = rng.uniform();
+  if (u0 < this->specularProbability(wo)) {
+    glm::vec3 wh = brdfSampleHalfVector(wo, u1, u2, this->alphaX,
+                                        this->alphaY, this->model);
+    wi = glm::reflect(-wo, wh);
+  } else {
+    // cosine weighted hemisphere
+    float r = std::sqrt(u1);
+    float phi = 2.0f * BRDF_PI * u2;
+    wi = glm::vec3(r * std::cos(phi), r * std::sin(phi),
+                   std::sqrt(std::fmax(0.0f, 1.0f - u1)));
+  }
+  float p = this->pdf(wo, wi);
+  if (wi.z <= 0.0f || p <= 0.0f) {
+    return glm::vec3(0.0f);
+  }
+  return this->eval(wo, wi) * wi.z / p;
+}
+
+struct PtSettings {
+  unsigned int width = 800;
+  unsigned int height = 600;
+  unsigned int samplesPerPixel = 64;
+  unsigned int maxDepth = 6;
+  unsigned int tileSize = 16;
+  unsigned int seed = 1;
+};
+
+float ptAttenuation(const PointLight &light, float dist) {
+  // computeAttenuation of simplepbr.frag
+  float result = light.attenuationConstant + light.attenuationLinear * dist +
+                 light.attenuationQuadratic * dist * dist;
+  return glm::min(1.0f / result, 1.0f);
+}
+
+glm::vec3 ptRadiance(const PtScene &scene, BvhRay ray, PtRng &rng,
+                     unsigned int maxDepth) {
+  glm::vec3 radiance(0.0f);
+  glm::vec3 throughput(1.0f);
+  for (unsigned int depth = 0; depth < maxDepth; depth++) {
+    PtSurface surf;
+    if (!scene.intersect(ray, surf)) {
+      radiance += throughput * scene.environmentRadiance(ray.dir);
+      break;
+    }
+    glm::vec3 wWorld = -ray.dir;
+    // two sided, shade the side the ray came from
+    if (glm::dot(surf.geomNormal, wWorld) < 0.0f) {
+      surf.geomNormal = -surf.geomNormal;
+      surf.normal = -surf.normal;
+      surf.bitangent = -surf.bitangent;
+    }
+    glm::vec3 wo(glm::dot(wWorld, surf.tangent),
+                 glm::dot(wWorld, surf.bitangent),
+                 glm::dot(wWorld, surf.normal));
+    PtBsdf bsdf(scene.materials[surf.material], surf.uv);
+    glm::vec3 origin = surf.pos + surf.geomNormal * PT_RAY_EPSILON;
+
+    // point lights are sampled directly
+    for (unsigned int i = 0; i < scene.lights.size(); i++) {
+      const PointLight &light = scene.lights[i];
+      glm::vec3 toLight = light.position - surf.pos;
+      float dist = glm::length(toLight);
+      glm::vec3 wiWorld = toLight / dist;
+      if (glm::dot(wiWorld, surf.geomNormal) <= 0.0f ||
+          scene.occluded(origin, light.position)) {
+        continue;
+      }
+      glm::vec3 wi(glm::dot(wiWorld, surf.tangent),
+                   glm::dot(wiWorld, surf.bitangent),
+                   glm::dot(wiWorld, surf.normal));
+      // getColor is not const
+      PointLight l = light;
+      glm::vec3 lightRadiance = l.getColor() * ptAttenuation(light, dist);
+      radiance += throughput * bsdf.eval(wo, wi) * lightRadiance *
+                  glm::max(wi.z, 0.0f);
+    }
+
+    glm::vec3 wi;
+    glm::vec3 weight = bsdf.sample(wo, rng, wi);
+    if (weight.x + weight.y + weight.z <= 0.0f) {
+      break;
+    }
+    glm::vec3 wiWorld =
+        surf.tangent * wi.x + surf.bitangent * wi.y + surf.normal * wi.z;
+    if (glm::dot(wiWorld, surf.geomNormal) <= 0.0f) {
+      break;
+    }
+    throughput *= weight;
+    // russian roulette once the path had a few bounces
+    if (depth >= 3) {
+      float q = glm::min(glm::max(throughput.x, glm::max(throughput.y,
+                                                          throughput.z)),
+                         0.95f);
+      if (rng.uniform() >= q) {
+        break;
+      }
+      throughput /= q;
+    }
+    ray = BvhRay(origin, wiWorld);
+  }
+  return radiance;
+}
+
+void renderTile_proc(const PtScene &scene, const PtCamera &camera,
+                     const PtSettings &settings, unsigned int tile,
+                     std::vector<float> &image) {
+  unsigned int tilesX = (settings.width + settings.tileSize - 1) /
+                        settings.tileSize;
+  unsigned int x0 = (tile % tilesX) * settings.tileSize;
+  unsigned int y0 = (tile / tilesX) * settings.tileSize;
+  unsigned int x1 = glm::min(x0 + settings.tileSize, settings.width);
+  unsigned int y1 = glm::min(y0 + settings.tileSize, settings.height);
+  for (unsigned int y = y0; y < y1; y++) {
+    for (unsigned int x = x0; x < x1; x++) {
+      // per pixel stream so the result does not depend on the schedule
+      PtRng rng(settings.seed, (uint64_t)y * settings.width + x);
+      glm::vec3 sum(0.0f);
+      for (unsigned int s = 0; s < settings.samplesPerPixel; s++) {
+        float sx = ((float)x + rng.uniform()) / (float)settings.width;
+        float sy = ((float)y + rng.uniform()) / (float)settings.height;
+        BvhRay ray(camera.pos, camera.rayDir(sx, sy), 0.0f);
+        glm::vec3 l = ptRadiance(scene, ray, rng, settings.maxDepth);
+        if (std::isfinite(l.x) && std::isfinite(l.y) && std::isfinite(l.z)) {
+          sum += l;
+        }
+      }
+      sum /= (float)settings.samplesPerPixel;
+      float *px = &image[(y * settings.width + x) * 3];
+      px[0] = sum.x;
+      px[1] = sum.y;
+      px[2] = sum.z;
+    }
+  }
+}
+
+// renders rgb radiance, rows top to bottom
+void renderPathTraced(const PtScene &scene, const PtCamera &camera,
+                      const PtSettings &settings, JobPool &pool,
+                      std::vector<float> &image) {
+  image.assign(settings.width * settings.height * 3, 0.0f);
+  unsigned int tilesX = (settings.width + settings.tileSize - 1) /
+                        settings.tileSize;
+  unsigned int tilesY = (settings.height + settings.tileSize - 1) /
+                        settings.tileSize;
+  pool.parallelFor(tilesX * tilesY, 1,
+                   [&](unsigned int begin, unsigned int end) {
+                     for (unsigned int t = begin; t < end; t++) {
+                       renderTile_proc(scene, camera, settings, t, image);
+                     }
+                   });
+}
+
+bool writeHdrImage(const char *path, unsigned int width, unsigned int height,
+                   const std::vector<float> &rgb) {
+  // radiance rgbe, scanlines are run length encoded without runs, every
+  // chunk is a literal of at most 128 bytes
+  FILE *f = std::fopen(path, "wb");
+  if (!f) {
+    std::cout << "Failed to open hdr output: " << path << std::endl;
+    return false;
+  }
+  std::fprintf(f, "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %u +X %u\n",
+               height, width);
+  std::vector<unsigned char> line(width * 4);
+  for (unsigned int y = 0; y < height; y++) {
+    for (unsigned int x = 0; x < width; x++) {
+      const float *p = &rgb[(y * width + x) * 3];
+      float m = glm::max(p[0], glm::max(p[1], p[2]));
+      unsigned char *e = &line[x * 4];
+      if (m < 1e-32f) {
+        e[0] = e[1] = e[2] = e[3] = 0;
+        continue;
+      }
+      int exponent;
+      float scale = std::frexp(m, &exponent) * 256.0f / m;
+      e[0] = (unsigned char)(glm::max(p[0], 0.0f) * scale);
+      e[1] = (unsigned char)(glm::max(p[1], 0.0f) * scale);
+      e[2] = (unsigned char)(glm::max(p[2], 0.0f) * scale);
+      e[3] = (unsigned char)(exponent + 128);
+    }
+    if (width < 8 || width > 0x7fff) {
+      std::fwrite(line.data(), 1, line.size(), f);
+      continue;
+    }
+    unsigned char header[4] = {2, 2, (unsigned char)(width >> 8),
+                               (unsigned char)(width & 0xff)};
+    std::fwrite(header, 1, 4, f);
+    for (unsigned int c = 0; c < 4; c++) {
+      for (unsigned int x = 0; x < width; x += 128) {
+        unsigned int n = glm::min(128u, width - x);
+        std::fputc((int)n, f);
+        for (unsigned int i = 0; i < n; i++) {
+          std::fputc(line[(x + i) * 4 + c], f);
+        }
+      }
+    }
+  }
+  bool ok = std::ferror(f) == 0;
+  std::fclose(f);
+  return ok;
+}
+
+#endif
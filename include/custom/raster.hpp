@@ -0,0 +1,636 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Tile parallel software rasterizer for machines without a gpu.
+// Renders the cpu scene of pathtracer.hpp with the shading of phong.frag or
+// simplepbr1.frag written out in c++. A frame runs in two parallel passes:
+//   - triangles are split into chunks, each chunk clips its triangles in
+//     homogeneous space, sets up fixed point edge functions and bins them
+//     into the screen tiles they touch
+//   - every tile is rasterized by one thread. Blocks of 8x8 pixels are
+//     rejected against the edges and a per block max depth, then four
+//     pixels at a time are tested with sse half space edge functions into
+//     a visibility buffer that is shaded once per pixel at the end.
+// Binning keeps the chunk order so the result matches the submission order
+// of gl for equal depths.
+
+#ifndef RASTER_HPP
+#define RASTER_HPP
+
+#include <glm/glm.hpp>
+
+#include <custom/brdf.hpp>
+#include <custom/jobpool.hpp>
+#include <custom/pathtracer.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RASTER_USE_SSE 1
+#endif
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+const int RASTER_TILE_SIZE = 64;
+const int RASTER_BLOCK_SIZE = 8;
+const int RASTER_SUBPIXEL_BITS = 4;
+const int RASTER_SUBPIXEL = 1 << RASTER_SUBPIXEL_BITS;
+// vertices are clipped to this many pixels around the screen so fixed point
+// coordinates stay below 2^17
+const float RASTER_GUARD_BAND = 4096.0f;
+const uint32_t RASTER_MAX_CHUNKS = 64;
+const uint32_t RASTER_EMPTY = 0xffffffffu;
+
+enum RasterShadingModel { RASTER_PHONG = 0, RASTER_PBR = 1 };
+
+struct RasterShading {
+  unsigned int model = RASTER_PBR;
+  glm::vec3 clearColor = glm::vec3(0.0f, 0.1f, 0.2f);
+  glm::vec3 viewPos = glm::vec3(0.0f);
+  // phong.frag uniforms, values of cubeShaderInit_proc in phong.cpp
+  float ambientCoeff = 0.1f;
+  float shininess = 200.0f;
+  float lightIntensity = 1.0f;
+};
+
+// screen space setup of a clipped triangle
+struct RasterTriangle {
+  // edge i is opposite vertex i, E = A x + B y + C in subpixel units and
+  // is >= 0 inside, the top left rule is folded into C
+  int32_t edgeA[3];
+  int32_t edgeB[3];
+  int64_t edgeC[3];
+  int64_t area; // twice the area, subpixel units
+  int minX, minY, maxX, maxY; // pixel bounds, inclusive
+  // depth plane in pixel units
+  float zOrigin, zdx, zdy;
+  float zMin;
+  float invW[3];
+  // barycentrics of the clipped vertices in the source triangle
+  glm::vec3 bary[3];
+  uint32_t source;
+};
+
+// clip space vertex while clipping
+struct RasterClipVertex {
+  glm::vec4 pos;
+  glm::vec3 bary;
+};
+
+class SoftRasterizer {
+public:
+  unsigned int width;
+  unsigned int height;
+  std::vector<unsigned char> color; // rgb8, rows top to bottom
+  std::vector<float> depth;
+
+  SoftRasterizer(unsigned int width, unsigned int height);
+
+  void render(const PtScene &scene, const glm::mat4 &view,
+              const glm::mat4 &projection, const RasterShading &shading,
+              JobPool &pool);
+  bool writePpm(const char *path) const;
+
+private:
+  unsigned int tilesX;
+  unsigned int tilesY;
+  // per chunk triangle setups and per chunk, per tile bins
+  std::vector<std::vector<RasterTriangle>> setups;
+  std::vector<std::vector<std::vector<uint32_t>>> bins;
+
+  void setupChunk(const PtScene &scene, const glm::mat4 &viewProj,
+                  uint32_t chunk, uint32_t begin, uint32_t end);
+  void addTriangle(const RasterClipVertex v[3], uint32_t source,
+                   uint32_t chunk);
+  void rasterTile(const PtScene &scene, const RasterShading &shading,
+                  unsigned int tile);
+  void rasterBlock(const RasterTriangle &tri, uint32_t id, int bx, int by,
+                   int tileX, int tileY, float *tileDepth, uint32_t *tileVis,
+                   float &blockZMax);
+  glm::vec3 shadePixel(const PtScene &scene, const RasterShading &shading,
+                       uint32_t id, int x, int y) const;
+};
+
+SoftRasterizer::SoftRasterizer(unsigned int w, unsigned int h)
+    : width(w), height(h) {
+  this->color.assign(w * h * 3, 0);
+  this->depth.assign(w * h, 1.0f);
+  this->tilesX = (w + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+  this->tilesY = (h + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+}
+
+float rasterClipDistance(const glm::vec4 &p, int plane, float gx, float gy) {
+  switch (plane) {
+  case 0:
+    return p.z + p.w; // near
+  case 1:
+    return p.w - p.z; // far
+  case 2:
+    return gx * p.w + p.x;
+  case 3:
+    return gx * p.w - p.x;
+  case 4:
+    return gy * p.w + p.y;
+  default:
+    return gy * p.w - p.y;
+  }
+}
+
+void SoftRasterizer::setupChunk(const PtScene &scene,
+                                const glm::mat4 &viewProj, uint32_t chunk,
+                                uint32_t begin, uint32_t end) {
+  // guard band in ndc units
+  float gx = 1.0f + 2.0f * RASTER_GUARD_BAND / (float)this->width;
+  float gy = 1.0f + 2.0f * RASTER_GUARD_BAND / (float)this->height;
+  for (uint32_t t = begin; t < end; t++) {
+    RasterClipVertex poly[9];
+    RasterClipVertex tmp[9];
+    int count = 3;
+    int outside = 0;
+    for (int i = 0; i < 3; i++) {
+      poly[i].pos = viewProj * glm::vec4(scene.positions[t * 3 + i], 1.0f);
+      poly[i].bary = glm::vec3(i == 0, i == 1, i == 2);
+    }
+    // trivial reject and accept against every plane
+    bool rejected = false;
+    for (int plane = 0; plane < 6 && !rejected; plane++) {
+      int out = 0;
+      for (int i = 0; i < 3; i++) {
+        if (rasterClipDistance(poly[i].pos, plane, gx, gy) < 0.0f) {
+          out++;
+        }
+      }
+      rejected = out == 3;
+      outside |= out > 0 ? 1 << plane : 0;
+    }
+    if (rejected) {
+      continue;
+    }
+    // sutherland hodgman on the planes that cut the triangle
+    for (int plane = 0; plane < 6 && count >= 3; plane++) {
+      if ((outside & (1 << plane)) == 0) {
+        continue;
+      }
+      int n = 0;
+      for (int i = 0; i < count; i++) {
+        const RasterClipVertex &a = poly[i];
+        const RasterClipVertex &b = poly[(i + 1) % count];
+        float da = rasterClipDistance(a.pos, plane, gx, gy);
+        float db = rasterClipDistance(b.pos, plane, gx, gy);
+        if (da >= 0.0f) {
+          tmp[n++] = a;
+        }
+        if ((da >= 0.0f) != (db >= 0.0f)) {
+          float s = da / (da - db);
+          tmp[n].pos = glm::mix(a.pos, b.pos, s);
+          tmp[n].bary = glm::mix(a.bary, b.bary, s);
+          n++;
+        }
+      }
+      count = n;
+      for (int i = 0; i < count; i++) {
+        poly[i] = tmp[i];
+      }
+    }
+    for (int i = 1; i + 1 < count; i++) {
+      RasterClipVertex tri[3] = {poly[0], poly[i], poly[i + 1]};
+      this->addTriangle(tri, t, chunk);
+    }
+  }
+}
+
+void SoftRasterizer::addTriangle(const RasterClipVertex v[3],
+                                 uint32_t source, uint32_t chunk) {
+  RasterTriangle tri;
+  int32_t sx[3], sy[3];
+  float fx[3], fy[3], fz[3];
+  for (int i = 0; i < 3; i++) {
+    float invW = 1.0f / v[i].pos.w;
+    glm::vec3 ndc = glm::vec3(v[i].pos) * invW;
+    fx[i] = (ndc.x * 0.5f + 0.5f) * (float)this->width;
+    fy[i] = (0.5f - ndc.y * 0.5f) * (float)this->height;
+    fz[i] = ndc.z * 0.5f + 0.5f;
+    sx[i] = (int32_t)std::lround(fx[i] * RASTER_SUBPIXEL);
+    sy[i] = (int32_t)std::lround(fy[i] * RASTER_SUBPIXEL);
+    tri.invW[i] = invW;
+    tri.bary[i] = v[i].bary;
+  }
+  int64_t area = (int64_t)(sx[1] - sx[0]) * (sy[2] - sy[0]) -
+                 (int64_t)(sx[2] - sx[0]) * (sy[1] - sy[0]);
+  if (area == 0) {
+    return;
+  }
+  if (area < 0) {
+    // gl draws both windings here, bring it to one orientation
+    std::swap(sx[1], sx[2]);
+    std::swap(sy[1], sy[2]);
+    std::swap(fx[1], fx[2]);
+    std::swap(fy[1], fy[2]);
+    std::swap(fz[1], fz[2]);
+    std::swap(tri.invW[1], tri.invW[2]);
+    std::swap(tri.bary[1], tri.bary[2]);
+    area = -area;
+  }
+  tri.area = area;
+  for (int i = 0; i < 3; i++) {
+    int a = (i + 1) % 3;
+    int b = (i + 2) % 3;
+    tri.edgeA[i] = sy[a] - sy[b];
+    tri.edgeB[i] = sx[b] - sx[a];
+    tri.edgeC[i] = (int64_t)sx[a] * sy[b] - (int64_t)sy[a] * sx[b];
+    // a shared edge is seen with opposite signs by its two triangles,
+    // exactly one of them owns the pixels on it
+    bool topLeft = tri.edgeA[i] > 0 || (tri.edgeA[i] == 0 && tri.edgeB[i] > 0);
+    if (!topLeft) {
+      tri.edgeC[i] -= 1;
+    }
+  }
+  int minSx = glm::min(sx[0], glm::min(sx[1], sx[2]));
+  int maxSx = glm::max(sx[0], glm::max(sx[1], sx[2]));
+  int minSy = glm::min(sy[0], glm::min(sy[1], sy[2]));
+  int maxSy = glm::max(sy[0], glm::max(sy[1], sy[2]));
+  tri.minX = glm::max(minSx >> RASTER_SUBPIXEL_BITS, 0);
+  tri.minY = glm::max(minSy >> RASTER_SUBPIXEL_BITS, 0);
+  tri.maxX = glm::min(maxSx >> RASTER_SUBPIXEL_BITS, (int)this->width - 1);
+  tri.maxY = glm::min(maxSy >> RASTER_SUBPIXEL_BITS, (int)this->height - 1);
+  if (tri.minX > tri.maxX || tri.minY > tri.maxY) {
+    return;
+  }
+  // depth is affine in screen space
+  float det = (fx[1] - fx[0]) * (fy[2] - fy[0]) -
+              (fx[2] - fx[0]) * (fy[1] - fy[0]);
+  tri.zdx = ((fz[1] - fz[0]) * (fy[2] - fy[0]) -
+             (fz[2] - fz[0]) * (fy[1] - fy[0])) /
+            det;
+  tri.zdy = ((fz[2] - fz[0]) * (fx[1] - fx[0]) -
+             (fz[1] - fz[0]) * (fx[2] - fx[0])) /
+            det;
+  tri.zOrigin = fz[0] - tri.zdx * fx[0] - tri.zdy * fy[0];
+  tri.zMin = glm::min(fz[0], glm::min(fz[1], fz[2]));
+  tri.source = source;
+
+  std::vector<RasterTriangle> &chunkSetups = this->setups[chunk];
+  uint32_t index = (uint32_t)chunkSetups.size();
+  chunkSetups.push_back(tri);
+  int tx0 = tri.minX / RASTER_TILE_SIZE;
+  int tx1 = tri.maxX / RASTER_TILE_SIZE;
+  int ty0 = tri.minY / RASTER_TILE_SIZE;
+  int ty1 = tri.maxY / RASTER_TILE_SIZE;
+  for (int ty = ty0; ty <= ty1; ty++) {
+    for (int tx = tx0; tx <= tx1; tx++) {
+      this->bins[chunk][ty * this->tilesX + tx].push_back(index);
+    }
+  }
+}
+
+void SoftRasterizer::rasterBlock(const RasterTriangle &tri, uint32_t id,
+                                 int bx, int by, int tileX, int tileY,
+                                 float *tileDepth, uint32_t *tileVis,
+                                 float &blockZMax) {
+  // edges at the center of the first pixel of the block, exact in 64 bit
+  int64_t cx = (int64_t)bx * RASTER_SUBPIXEL + RASTER_SUBPIXEL / 2;
+  int64_t cy = (int64_t)by * RASTER_SUBPIXEL + RASTER_SUBPIXEL / 2;
+  int64_t span = (int64_t)(RASTER_BLOCK_SIZE - 1) * RASTER_SUBPIXEL;
+  int32_t rowStart[3];
+  int32_t stepX[3];
+  int32_t stepY[3];
+  for (int i = 0; i < 3; i++) {
+    int64_t e = tri.edgeA[i] * cx + tri.edgeB[i] * cy + tri.edgeC[i];
+    int64_t dx = (int64_t)tri.edgeA[i] * span;
+    int64_t dy = (int64_t)tri.edgeB[i] * span;
+    int64_t emin = e + glm::min(dx, (int64_t)0) + glm::min(dy, (int64_t)0);
+    int64_t emax = e + glm::max(dx, (int64_t)0) + glm::max(dy, (int64_t)0);
+    if (emax < 0) {
+      return;
+    }
+    if (emin >= 0) {
+      // edge covers the whole block, drop it from the pixel tests
+      rowStart[i] = 0;
+      stepX[i] = 0;
+      stepY[i] = 0;
+    } else {
+      // inside the block the edge is bounded by the block span so 32 bits
+      // are enough
+      rowStart[i] = (int32_t)e;
+      stepX[i] = tri.edgeA[i] * RASTER_SUBPIXEL;
+      stepY[i] = tri.edgeB[i] * RASTER_SUBPIXEL;
+    }
+  }
+  int limitX = glm::min(RASTER_BLOCK_SIZE, (int)this->width - bx);
+  int limitY = glm::min(RASTER_BLOCK_SIZE, (int)this->height - by);
+  int localX = bx - tileX;
+  int localY = by - tileY;
+  float zRow = tri.zOrigin + tri.zdx * ((float)bx + 0.5f) +
+               tri.zdy * ((float)by + 0.5f);
+  bool written = false;
+  for (int y = 0; y < limitY; y++) {
+    int rowOffset = (localY + y) * RASTER_TILE_SIZE + localX;
+    for (int x = 0; x < RASTER_BLOCK_SIZE; x += 4) {
+      int valid = (1 << glm::clamp(limitX - x, 0, 4)) - 1;
+      if (valid == 0) {
+        break;
+      }
+      float *dp = tileDepth + rowOffset + x;
+      uint32_t *vp = tileVis + rowOffset + x;
+#ifdef RASTER_USE_SSE
+      __m128i lanes = _mm_set_epi32(3, 2, 1, 0);
+      __m128i inside = _mm_setzero_si128();
+      for (int i = 0; i < 3; i++) {
+        __m128i e = _mm_set1_epi32(rowStart[i] + stepX[i] * x);
+        // lanes * step without sse4.1 mullo
+        __m128i s = _mm_set1_epi32(stepX[i]);
+        __m128i ls = _mm_add_epi32(
+            _mm_and_si128(_mm_cmpeq_epi32(lanes, _mm_set1_epi32(1)), s),
+            _mm_and_si128(_mm_cmpeq_epi32(lanes, _mm_set1_epi32(2)),
+                          _mm_add_epi32(s, s)));
+        ls = _mm_add_epi32(
+            ls, _mm_and_si128(_mm_cmpeq_epi32(lanes, _mm_set1_epi32(3)),
+                              _mm_add_epi32(s, _mm_add_epi32(s, s))));
+        inside = _mm_or_si128(inside, _mm_add_epi32(e, ls));
+      }
+      // sign bit set means some edge was negative
+      int cover = ~_mm_movemask_ps(_mm_castsi128_ps(inside)) & valid;
+      if (cover == 0) {
+        continue;
+      }
+      float z0 = zRow + tri.zdx * (float)x;
+      __m128 z = _mm_add_ps(_mm_set1_ps(z0),
+                            _mm_mul_ps(_mm_set1_ps(tri.zdx),
+                                       _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f)));
+      __m128 dOld = _mm_loadu_ps(dp);
+      int pass = _mm_movemask_ps(_mm_cmplt_ps(z, dOld)) & cover;
+      if (pass == 0) {
+        continue;
+      }
+      float zs[4];
+      _mm_storeu_ps(zs, z);
+      for (int lane = 0; lane < 4; lane++) {
+        if (pass & (1 << lane)) {
+          dp[lane] = zs[lane];
+          vp[lane] = id;
+        }
+      }
+#else
+      for (int lane = 0; lane < 4; lane++) {
+        if ((valid & (1 << lane)) == 0) {
+          continue;
+        }
+        bool in = true;
+        for (int i = 0; i < 3; i++) {
+          in = in && rowStart[i] + stepX[i] * (x + lane) >= 0;
+        }
+        float z = zRow + tri.zdx * (float)(x + lane);
+        if (in && z < dp[lane]) {
+          dp[lane] = z;
+          vp[lane] = id;
+        }
+      }
+#endif
+      written = true;
+    }
+    for (int i = 0; i < 3; i++) {
+      rowStart[i] += stepY[i];
+    }
+    zRow += tri.zdy;
+  }
+  if (written) {
+    float zmax = 0.0f;
+    for (int y = 0; y < limitY; y++) {
+      for (int x = 0; x < limitX; x++) {
+        zmax = glm::max(
+            zmax, tileDepth[(localY + y) * RASTER_TILE_SIZE + localX + x]);
+      }
+    }
+    blockZMax = zmax;
+  }
+}
+
+void SoftRasterizer::rasterTile(const PtScene &scene,
+                                const RasterShading &shading,
+                                unsigned int tile) {
+  const int blocksPerRow = RASTER_TILE_SIZE / RASTER_BLOCK_SIZE;
+  float tileDepth[RASTER_TILE_SIZE * RASTER_TILE_SIZE];
+  uint32_t tileVis[RASTER_TILE_SIZE * RASTER_TILE_SIZE];
+  float blockZMax[blocksPerRow * blocksPerRow];
+  for (int i = 0; i < RASTER_TILE_SIZE * RASTER_TILE_SIZE; i++) {
+    tileDepth[i] = 1.0f;
+    tileVis[i] = RASTER_EMPTY;
+  }
+  for (int i = 0; i < blocksPerRow * blocksPerRow; i++) {
+    blockZMax[i] = 1.0f;
+  }
+  int tileX = (int)(tile % this->tilesX) * RASTER_TILE_SIZE;
+  int tileY = (int)(tile / this->tilesX) * RASTER_TILE_SIZE;
+  int tileX1 = glm::min(tileX + RASTER_TILE_SIZE, (int)this->width) - 1;
+  int tileY1 = glm::min(tileY + RASTER_TILE_SIZE, (int)this->height) - 1;
+
+  for (uint32_t chunk = 0; chunk < this->bins.size(); chunk++) {
+    const std::vector<uint32_t> &bin = this->bins[chunk][tile];
+    for (uint32_t k = 0; k < bin.size(); k++) {
+      const RasterTriangle &tri = this->setups[chunk][bin[k]];
+      uint32_t id = (chunk << 24) | bin[k];
+      int x0 = glm::max(tri.minX, tileX);
+      int y0 = glm::max(tri.minY, tileY);
+      int x1 = glm::min(tri.maxX, tileX1);
+      int y1 = glm::min(tri.maxY, tileY1);
+      int bx0 = (x0 - tileX) / RASTER_BLOCK_SIZE;
+      int by0 = (y0 - tileY) / RASTER_BLOCK_SIZE;
+      int bx1 = (x1 - tileX) / RASTER_BLOCK_SIZE;
+      int by1 = (y1 - tileY) / RASTER_BLOCK_SIZE;
+      for (int by = by0; by <= by1; by++) {
+        for (int bx = bx0; bx <= bx1; bx++) {
+          // hierarchical depth, nothing of the triangle can pass
+          float &zmax = blockZMax[by * blocksPerRow + bx];
+          if (tri.zMin >= zmax) {
+            continue;
+          }
+          this->rasterBlock(tri, id, tileX + bx * RASTER_BLOCK_SIZE,
+                            tileY + by * RASTER_BLOCK_SIZE, tileX, tileY,
+                            tileDepth, tileVis, zmax);
+        }
+      }
+    }
+  }
+
+  // resolve, every visible pixel is shaded once
+  for (int y = tileY; y <= tileY1; y++) {
+    for (int x = tileX; x <= tileX1; x++) {
+      int local = (y - tileY) * RASTER_TILE_SIZE + (x - tileX);
+      uint32_t id = tileVis[local];
+      glm::vec3 c = shading.clearColor;
+      if (id != RASTER_EMPTY) {
+        c = this->shadePixel(scene, shading, id, x, y);
+      }
+      c = glm::clamp(c, 0.0f, 1.0f);
+      unsigned char *px = &this->color[(y * this->width + x) * 3];
+      px[0] = (unsigned char)(c.x * 255.0f + 0.5f);
+      px[1] = (unsigned char)(c.y * 255.0f + 0.5f);
+      px[2] = (unsigned char)(c.z * 255.0f + 0.5f);
+      this->depth[y * this->width + x] = tileDepth[local];
+    }
+  }
+}
+
+glm::vec3 rasterShadePhong(const PtMaterial &mat, const PtSurface &surf,
+                           const glm::vec3 &tangent, const PointLight &light,
+                           const RasterShading &shading) {
+  // phong.frag, the tangent space vectors of the shader are replaced by
+  // the world space normal since the tbn matrix is orthonormal
+  glm::vec3 n = surf.normal;
+  glm::vec3 t = glm::normalize(tangent - glm::dot(tangent, n) * n);
+  glm::vec3 b = glm::cross(n, t);
+  glm::vec3 normal = n;
+  if (mat.normalMap.loaded()) {
+    glm::vec3 ts = glm::normalize(mat.normalMap.sample(surf.uv) * 2.0f - 1.0f);
+    normal = t * ts.x + b * ts.y + n * ts.z;
+  }
+  glm::vec3 color =
+      mat.albedoMap.loaded() ? mat.albedoMap.sample(surf.uv) : mat.albedo;
+  glm::vec3 ambient = color * shading.ambientCoeff;
+  glm::vec3 lightDir = glm::normalize(light.position - surf.pos);
+  glm::vec3 diffuseColor = glm::max(glm::dot(lightDir, normal), 0.0f) * color;
+  float attenuation = ptAttenuation(light, glm::distance(light.position,
+                                                         surf.pos));
+  glm::vec3 diffuse = attenuation * diffuseColor * shading.lightIntensity;
+  glm::vec3 viewDir = glm::normalize(shading.viewPos - surf.pos);
+  glm::vec3 spec = mat.specularMap.loaded() ? mat.specularMap.sample(surf.uv)
+                                            : glm::vec3(0.0f);
+  glm::vec3 refdir = glm::reflect(-lightDir, normal);
+  glm::vec3 hwaydir = glm::normalize(lightDir + viewDir);
+  float specAngle = glm::max(glm::dot(refdir, hwaydir), 0.0f);
+  glm::vec3 specular = std::pow(specAngle, shading.shininess) * spec;
+  return ambient + diffuse + specular;
+}
+
+glm::vec3 rasterShadePbr(const PtMaterial &mat, const PtSurface &surf,
+                         const glm::vec3 &tangent, const PointLight &light,
+                         const RasterShading &shading) {
+  // simplepbr1.frag without image based lighting and shadows
+  glm::vec3 n = surf.normal;
+  glm::vec3 normal = n;
+  if (mat.normalMap.loaded()) {
+    // derivative tbn of getSurfaceNormal, its tangent is dp/du
+    glm::vec3 t = glm::normalize(tangent);
+    glm::vec3 b = -glm::normalize(glm::cross(n, t));
+    glm::vec3 ts = glm::normalize(mat.normalMap.sample(surf.uv) * 2.0f - 1.0f);
+    normal = glm::normalize(t * ts.x + b * ts.y + n * ts.z);
+  }
+  glm::vec3 viewDir = glm::normalize(shading.viewPos - surf.pos);
+  glm::vec3 albedo =
+      mat.albedoMap.loaded() ? mat.albedoMap.sample(surf.uv) : mat.albedo;
+  float metallic =
+      mat.metallicMap.loaded() ? mat.metallicMap.sample(surf.uv).x : mat.metallic;
+  glm::vec3 ao =
+      mat.aoMap.loaded() ? mat.aoMap.sample(surf.uv) : glm::vec3(1.0f);
+  float rough = mat.roughnessMap.loaded() ? mat.roughnessMap.sample(surf.uv).x
+                                          : mat.roughness.x;
+  glm::vec3 lightDir = glm::normalize(light.position - surf.pos);
+  glm::vec3 halfDir = glm::normalize(viewDir + lightDir);
+  glm::vec3 ambient = 0.2f * albedo * ao;
+  glm::vec3 refAtZero = glm::mix(glm::vec3(0.04f), albedo, metallic);
+  glm::vec3 fresnel =
+      brdfFresnelSchlick(glm::dot(halfDir, viewDir), refAtZero);
+  float dN = brdfBsNormalDistTraditional(glm::dot(normal, halfDir), rough);
+  float lambdaIn = brdfBsLambdaT(glm::dot(normal, halfDir), rough);
+  float lambdaOut = brdfBsLambdaT(glm::dot(normal, viewDir), rough);
+  float gD = brdfGeometryInOut(lambdaIn, lambdaOut);
+  glm::vec3 kd = (glm::vec3(1.0f) - fresnel) * (1.0f - metallic);
+  float outDir = glm::max(glm::dot(normal, viewDir), 0.0f);
+  float inDir = glm::max(glm::dot(normal, lightDir), 0.0f);
+  glm::vec3 specular =
+      dN * gD * fresnel / glm::max(4.0f * outDir * inDir, 0.0001f);
+  glm::vec3 lout = (kd * albedo / BRDF_PI + specular) * inDir;
+  lout += ambient;
+  lout = lout / (lout + glm::vec3(1.0f));
+  return glm::pow(lout, glm::vec3(1.0f / 2.2f));
+}
+
+glm::vec3 SoftRasterizer::shadePixel(const PtScene &scene,
+                                     const RasterShading &shading,
+                                     uint32_t id, int x, int y) const {
+  const RasterTriangle &tri = this->setups[id >> 24][id & 0xffffff];
+  // perspective correct barycentrics from the edge functions
+  int64_t cx = (int64_t)x * RASTER_SUBPIXEL + RASTER_SUBPIXEL / 2;
+  int64_t cy = (int64_t)y * RASTER_SUBPIXEL + RASTER_SUBPIXEL / 2;
+  float w[3];
+  float sum = 0.0f;
+  for (int i = 0; i < 3; i++) {
+    int64_t e = tri.edgeA[i] * cx + tri.edgeB[i] * cy + tri.edgeC[i];
+    w[i] = (float)e / (float)tri.area * tri.invW[i];
+    sum += w[i];
+  }
+  glm::vec3 bary = (tri.bary[0] * w[0] + tri.bary[1] * w[1] +
+                    tri.bary[2] * w[2]) /
+                   sum;
+  uint32_t s = tri.source;
+  PtSurface surf;
+  surf.pos = scene.positions[s * 3] * bary.x +
+             scene.positions[s * 3 + 1] * bary.y +
+             scene.positions[s * 3 + 2] * bary.z;
+  surf.normal = glm::normalize(scene.normals[s * 3] * bary.x +
+                               scene.normals[s * 3 + 1] * bary.y +
+                               scene.normals[s * 3 + 2] * bary.z);
+  surf.uv = scene.uvs[s * 3] * bary.x + scene.uvs[s * 3 + 1] * bary.y +
+            scene.uvs[s * 3 + 2] * bary.z;
+  surf.material = scene.materialIds[s];
+  const PtMaterial &mat = scene.materials[surf.material];
+  glm::vec3 result(0.0f);
+  // the shaders take a single light
+  if (!scene.lights.empty()) {
+    if (shading.model == RASTER_PHONG) {
+      result = rasterShadePhong(mat, surf, scene.tangents[s], scene.lights[0],
+                                shading);
+    } else {
+      result = rasterShadePbr(mat, surf, scene.tangents[s], scene.lights[0],
+                              shading);
+    }
+  }
+  return result;
+}
+
+void SoftRasterizer::render(const PtScene &scene, const glm::mat4 &view,
+                            const glm::mat4 &projection,
+                            const RasterShading &shading, JobPool &pool) {
+  uint32_t triCount = (uint32_t)scene.materialIds.size();
+  uint32_t tileCount = this->tilesX * this->tilesY;
+  uint32_t chunkCount = glm::min(RASTER_MAX_CHUNKS, pool.size() * 4);
+  uint32_t grain = glm::max((triCount + chunkCount - 1) / chunkCount, 1u);
+  chunkCount = glm::max((triCount + grain - 1) / grain, 1u);
+  // containers keep their capacity from frame to frame
+  this->setups.resize(chunkCount);
+  this->bins.resize(chunkCount);
+  for (uint32_t c = 0; c < chunkCount; c++) {
+    this->setups[c].clear();
+    this->bins[c].resize(tileCount);
+    for (uint32_t t = 0; t < tileCount; t++) {
+      this->bins[c][t].clear();
+    }
+  }
+  glm::mat4 viewProj = projection * view;
+  pool.parallelFor(triCount, grain, [&](unsigned int begin, unsigned int end) {
+    this->setupChunk(scene, viewProj, begin / grain, begin, end);
+  });
+  pool.parallelFor(tileCount, 1, [&](unsigned int begin, unsigned int end) {
+    for (unsigned int t = begin; t < end; t++) {
+      this->rasterTile(scene, shading, t);
+    }
+  });
+}
+
+bool SoftRasterizer::writePpm(const char *path) const {
+  FILE *f = std::fopen(path, "wb");
+  if (!f) {
+    std::cout << "Failed to open image output: " << path << std::endl;
+    return false;
+  }
+  std::fprintf(f, "P6\n%u %u\n255\n", this->width, this->height);
+  std::fwrite(this->color.data(), 1, this->color.size(), f);
+  bool ok = std::ferror(f) == 0;
+  std::fclose(f);
+  return ok;
+}
+
+#endif
@@ -0,0 +1,316 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Draw queue sorted on 64 bit keys. A submission packs its pass,
+// translucency, program, material, vertex array and depth bucket into one
+// key, the keys are radix sorted once per frame and the submission loop
+// switches programs, textures and vertex arrays only where the relevant
+// bits change from one draw to the next.
+
+#ifndef RENDERQUEUE_HPP
+#define RENDERQUEUE_HPP
+
+#include <glad/glad.h>
+
+#include <custom/glstate.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+// key layout from the high bits down, opaque draws sort by state and then
+// front to back:
+//   pass 4 | translucent 1 | program 10 | material 12 | vao 12 | depth 24
+// translucent draws have to blend back to front, the inverted depth goes
+// above the state bits:
+//   pass 4 | translucent 1 | far depth 24 | program 10 | material 12 | vao 12
+const unsigned int RQ_PASS_BITS = 4;
+const unsigned int RQ_PROGRAM_BITS = 10;
+const unsigned int RQ_MATERIAL_BITS = 12;
+const unsigned int RQ_VAO_BITS = 12;
+const unsigned int RQ_DEPTH_BITS = 24;
+const unsigned int RQ_PASS_SHIFT = 64 - RQ_PASS_BITS;
+const unsigned int RQ_TRANSLUCENT_SHIFT = RQ_PASS_SHIFT - 1;
+const unsigned int RQ_MAX_MATERIAL_TEXTURES = 8;
+const unsigned int RQ_NONE = 0xffffffffu;
+
+// textures bound together, one entry per unit
+struct RenderMaterial {
+  unsigned int count;
+  unsigned int units[RQ_MAX_MATERIAL_TEXTURES];
+  GLenum targets[RQ_MAX_MATERIAL_TEXTURES];
+  GLuint textures[RQ_MAX_MATERIAL_TEXTURES];
+};
+
+// the state fields of a key
+struct RenderKeyState {
+  unsigned int pass;
+  bool translucent;
+  unsigned int program;
+  unsigned int material;
+  unsigned int vao;
+};
+
+struct RenderEntry {
+  uint64_t key;
+  unsigned int draw;
+};
+
+uint64_t makeRenderKey(unsigned int pass, bool translucent,
+                       unsigned int program, unsigned int material,
+                       unsigned int vao, float depth);
+RenderKeyState decodeRenderKey(uint64_t key);
+// linear view depth to [0, 1] for the depth bucket
+float renderDepth(float viewDepth, float nearPlane, float farPlane);
+// stable lsd radix sort on 8 bit digits, digits every key shares are skipped
+void radixSortEntries(std::vector<RenderEntry> &entries,
+                      std::vector<RenderEntry> &scratch);
+
+class RenderQueue {
+public:
+  // state switches issued by execute since resetCounters, next to the draws
+  unsigned int draws;
+  unsigned int programSwitches;
+  unsigned int materialSwitches;
+  unsigned int vaoSwitches;
+
+  RenderQueue();
+
+  // states are registered once, keys carry their index
+  unsigned int addProgram(GLuint program);
+  unsigned int addMaterial();
+  void addMaterialTexture(unsigned int material, unsigned int unit,
+                          GLenum target, GLuint tex);
+  unsigned int addVertexArray(GLuint vao);
+
+  void clear();
+  // the draw callback sets per object uniforms and issues the draw call, the
+  // queue has bound the program, material and vertex array before it runs
+  void submit(unsigned int pass, bool translucent, unsigned int program,
+              unsigned int material, unsigned int vao, float depth,
+              const std::function<void()> &draw);
+  void sort();
+  // draws the submissions of one pass in key order, sorts first if needed
+  void execute(unsigned int pass);
+
+  void resetCounters();
+  void report(std::ostream &out) const;
+
+private:
+  std::vector<GLuint> programs;
+  std::vector<RenderMaterial> materials;
+  std::vector<GLuint> vaos;
+  std::vector<std::function<void()>> drawCalls;
+  std::vector<RenderEntry> entries;
+  std::vector<RenderEntry> scratch;
+  bool sorted;
+  unsigned int frames;
+};
+
+uint64_t makeRenderKey(unsigned int pass, bool translucent,
+                       unsigned int program, unsigned int material,
+                       unsigned int vao, float depth) {
+  if (depth < 0.0f) {
+    depth = 0.0f;
+  } else if (depth > 1.0f) {
+    depth = 1.0f;
+  }
+  const uint64_t depthMax = (uint64_t(1) << RQ_DEPTH_BITS) - 1;
+  uint64_t depthBucket = uint64_t(depth * float(depthMax));
+  uint64_t state =
+      (uint64_t(program) << (RQ_MATERIAL_BITS + RQ_VAO_BITS)) |
+      (uint64_t(material) << RQ_VAO_BITS) | uint64_t(vao);
+  uint64_t key = (uint64_t(pass) << RQ_PASS_SHIFT) |
+                 (uint64_t(translucent) << RQ_TRANSLUCENT_SHIFT);
+  if (translucent) {
+    const unsigned int stateBits =
+        RQ_PROGRAM_BITS + RQ_MATERIAL_BITS + RQ_VAO_BITS;
+    key |= ((depthMax - depthBucket) << stateBits) | state;
+  } else {
+    key |= (state << RQ_DEPTH_BITS) | depthBucket;
+  }
+  return key;
+}
+RenderKeyState decodeRenderKey(uint64_t key) {
+  RenderKeyState s;
+  s.pass = unsigned(key >> RQ_PASS_SHIFT);
+  s.translucent = ((key >> RQ_TRANSLUCENT_SHIFT) & 1) != 0;
+  uint64_t state = s.translucent ? key : key >> RQ_DEPTH_BITS;
+  s.vao = unsigned(state & ((1u << RQ_VAO_BITS) - 1));
+  state >>= RQ_VAO_BITS;
+  s.material = unsigned(state & ((1u << RQ_MATERIAL_BITS) - 1));
+  state >>= RQ_MATERIAL_BITS;
+  s.program = unsigned(state & ((1u << RQ_PROGRAM_BITS) - 1));
+  return s;
+}
+float renderDepth(float viewDepth, float nearPlane, float farPlane) {
+  return (viewDepth - nearPlane) / (farPlane - nearPlane);
+}
+void radixSortEntries(std::vector<RenderEntry> &entries,
+                      std::vector<RenderEntry> &scratch) {
+  size_t n = entries.size();
+  if (n < 2) {
+    return;
+  }
+  scratch.resize(n);
+  // bits that differ somewhere, the digits without any are already sorted
+  uint64_t varying = 0;
+  for (size_t i = 1; i < n; i++) {
+    varying |= entries[i].key ^ entries[0].key;
+  }
+  RenderEntry *src = entries.data();
+  RenderEntry *dst = scratch.data();
+  for (unsigned int shift = 0; shift < 64; shift += 8) {
+    if (((varying >> shift) & 0xff) == 0) {
+      continue;
+    }
+    size_t offsets[256] = {0};
+    for (size_t i = 0; i < n; i++) {
+      offsets[(src[i].key >> shift) & 0xff]++;
+    }
+    size_t sum = 0;
+    for (unsigned int d = 0; d < 256; d++) {
+      size_t c = offsets[d];
+      offsets[d] = sum;
+      sum += c;
+    }
+    for (size_t i = 0; i < n; i++) {
+      dst[offsets[(src[i].key >> shift) & 0xff]++] = src[i];
+    }
+    RenderEntry *tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+  if (src != entries.data()) {
+    entries.swap(scratch);
+  }
+}
+
+RenderQueue::RenderQueue()
+    : draws(0), programSwitches(0), materialSwitches(0), vaoSwitches(0),
+      sorted(true), frames(0) {}
+
+unsigned int RenderQueue::addProgram(GLuint program) {
+  if (this->programs.size() >= (1u << RQ_PROGRAM_BITS)) {
+    std::cout << "render queue: too many programs" << std::endl;
+    return 0;
+  }
+  this->programs.push_back(program);
+  return (unsigned int)this->programs.size() - 1;
+}
+unsigned int RenderQueue::addMaterial() {
+  if (this->materials.size() >= (1u << RQ_MATERIAL_BITS)) {
+    std::cout << "render queue: too many materials" << std::endl;
+    return 0;
+  }
+  RenderMaterial m;
+  m.count = 0;
+  this->materials.push_back(m);
+  return (unsigned int)this->materials.size() - 1;
+}
+void RenderQueue::addMaterialTexture(unsigned int material, unsigned int unit,
+                                     GLenum target, GLuint tex) {
+  RenderMaterial &m = this->materials[material];
+  if (m.count == RQ_MAX_MATERIAL_TEXTURES) {
+    std::cout << "render queue: too many textures in material " << material
+              << std::endl;
+    return;
+  }
+  m.units[m.count] = unit;
+  m.targets[m.count] = target;
+  m.textures[m.count] = tex;
+  m.count++;
+}
+unsigned int RenderQueue::addVertexArray(GLuint vao) {
+  if (this->vaos.size() >= (1u << RQ_VAO_BITS)) {
+    std::cout << "render queue: too many vertex arrays" << std::endl;
+    return 0;
+  }
+  this->vaos.push_back(vao);
+  return (unsigned int)this->vaos.size() - 1;
+}
+
+void RenderQueue::clear() {
+  // keeps the capacity, a frame submits about as much as the last one
+  this->entries.clear();
+  this->drawCalls.clear();
+  this->sorted = true;
+  this->frames++;
+}
+void RenderQueue::submit(unsigned int pass, bool translucent,
+                         unsigned int program, unsigned int material,
+                         unsigned int vao, float depth,
+                         const std::function<void()> &draw) {
+  RenderEntry e;
+  e.key = makeRenderKey(pass, translucent, program, material, vao, depth);
+  e.draw = (unsigned int)this->drawCalls.size();
+  this->entries.push_back(e);
+  this->drawCalls.push_back(draw);
+  this->sorted = false;
+}
+void RenderQueue::sort() {
+  if (!this->sorted) {
+    radixSortEntries(this->entries, this->scratch);
+    this->sorted = true;
+  }
+}
+void RenderQueue::execute(unsigned int pass) {
+  this->sort();
+  // the pass is the top of the key, its draws are one run
+  RenderEntry first;
+  first.key = uint64_t(pass) << RQ_PASS_SHIFT;
+  size_t begin =
+      std::lower_bound(this->entries.begin(), this->entries.end(), first,
+                       [](const RenderEntry &a, const RenderEntry &b) {
+                         return a.key < b.key;
+                       }) -
+      this->entries.begin();
+  unsigned int program = RQ_NONE;
+  unsigned int material = RQ_NONE;
+  unsigned int vao = RQ_NONE;
+  for (size_t i = begin; i < this->entries.size(); i++) {
+    RenderKeyState s = decodeRenderKey(this->entries[i].key);
+    if (s.pass != pass) {
+      break;
+    }
+    if (s.program != program) {
+      program = s.program;
+      glState().useProgram(this->programs[program]);
+      this->programSwitches++;
+    }
+    if (s.material != material) {
+      material = s.material;
+      const RenderMaterial &m = this->materials[material];
+      for (unsigned int t = 0; t < m.count; t++) {
+        glState().bindTexture(m.units[t], m.targets[t], m.textures[t]);
+      }
+      this->materialSwitches++;
+    }
+    if (s.vao != vao) {
+      vao = s.vao;
+      glState().bindVertexArray(this->vaos[vao]);
+      this->vaoSwitches++;
+    }
+    this->drawCalls[this->entries[i].draw]();
+    this->draws++;
+  }
+}
+
+void RenderQueue::resetCounters() {
+  this->draws = 0;
+  this->programSwitches = 0;
+  this->materialSwitches = 0;
+  this->vaoSwitches = 0;
+  this->frames = 0;
+}
+void RenderQueue::report(std::ostream &out) const {
+  unsigned int n = this->frames == 0 ? 1 : this->frames;
+  out << "render queue over " << this->frames << " frames, per frame: "
+      << this->draws / n << " draws, " << this->programSwitches / n
+      << " program, " << this->materialSwitches / n << " material, "
+      << this->vaoSwitches / n << " vertex array switches" << std::endl;
+}
+
+#endif
@@ -3,10 +3,14 @@
 
 // includes
 #include <fstream>
+#include <custom/assetpack.hpp>
+#include <custom/glstate.hpp>
+#include <custom/trace.hpp>
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <iostream>
+#include <map>
 #include <sstream>
 #include <string>
 
@@ -36,6 +40,23 @@ void checkShaderProgramCompilation(GLuint program) {
   }
 }
 
+// compiled stages by type, path and defines. Programs sharing a stage, the
+// fullscreen vertex shader for one, attach the same object instead of
+// running the source through the compiler again.
+std::map<std::string, GLuint> &shaderStageCache() {
+  static std::map<std::string, GLuint> stages;
+  return stages;
+}
+// once every program is linked the stages are only kept alive by them
+void releaseShaderStages() {
+  std::map<std::string, GLuint> &stages = shaderStageCache();
+  for (std::map<std::string, GLuint>::iterator it = stages.begin();
+       it != stages.end(); it++) {
+    glDeleteShader(it->second);
+  }
+  stages.clear();
+}
+
 void checkUniformLocation(int locVal, std::string uniName) {
   if (locVal == -1) {
     std::cout << "Shader program can not find the uniform location for "
@@ -49,7 +70,9 @@ public:
   GLuint programId;
 
   // constructor takes the path of the shaders and builts them
-  Shader(const GLchar *vertexPath, const GLchar *fragmentPath);
+  // defines are inserted after the #version line of both stages
+  Shader(const GLchar *vertexPath, const GLchar *fragmentPath,
+         const std::string &defines = "");
 
   void useProgram();
 
@@ -119,65 +142,94 @@ public:
     checkUniformLocation(uniLocation, name);
     glUniformMatrix4fv(uniLocation, 1, GL_FALSE, glm::value_ptr(value));
   }
-  // load shader from file path
-  GLuint loadShader(const GLchar *shaderFpath, const char *shdrType);
+  // load shader from file path, the compile status is checked only when
+  // the program fails to link
+  GLuint loadShader(const GLchar *shaderFpath, const char *shdrType,
+                    const std::string &defines = "");
 };
 
 GLuint Shader::loadShader(const GLchar *shaderFilePath,
-                          const char *shaderType) {
+                          const char *shaderType,
+                          const std::string &defines) {
   // load shader file from system
-  GLuint shader;
-  bool isFrag;
+  TRACE_SCOPE_DETAIL("Shader::loadShader", shaderFilePath);
   std::string stype(shaderType);
+  std::string key = stype + "\n" + shaderFilePath + "\n" + defines;
+  std::map<std::string, GLuint>::iterator cached =
+      shaderStageCache().find(key);
+  if (cached != shaderStageCache().end()) {
+    return cached->second;
+  }
+  GLuint shader = 0;
   if (stype == "FRAGMENT") {
     shader = glCreateShader(GL_FRAGMENT_SHADER);
-    isFrag = true;
   } else if (stype == "VERTEX") {
     shader = glCreateShader(GL_VERTEX_SHADER);
-    isFrag = false;
   } else {
     std::cout << "Unknown shader type:\n" << shaderType << std::endl;
   }
-  std::ifstream shdrFileStream;
-  shdrFileStream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+  // the asset pack hands out the source in place, the file is read only
+  // when the pack does not have it
+  AssetSpan span;
   std::string shaderCodeStr;
-  try {
-    shdrFileStream.open(shaderFilePath);
-    std::stringstream shaderSStream;
-    shaderSStream << shdrFileStream.rdbuf();
-    shdrFileStream.close();
-    shaderCodeStr = shaderSStream.str();
-  } catch (std::ifstream::failure e) {
-    //
-    std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
-  }
-  const char *shaderCode = shaderCodeStr.c_str();
+  if (!assetPack().findPath(shaderFilePath, span)) {
+    std::ifstream shdrFileStream;
+    shdrFileStream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+    try {
+      shdrFileStream.open(shaderFilePath);
+      std::stringstream shaderSStream;
+      shaderSStream << shdrFileStream.rdbuf();
+      shdrFileStream.close();
+      shaderCodeStr = shaderSStream.str();
+    } catch (std::ifstream::failure e) {
+      //
+      std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+    }
+    span.data = (const unsigned char *)shaderCodeStr.data();
+    span.size = shaderCodeStr.size();
+  }
+  // #version has to stay the first statement, the defines go in between
+  // as a separate string so the source itself is never copied
+  const char *code = (const char *)span.data;
+  std::size_t versionEnd = 0;
+  while (versionEnd < span.size && code[versionEnd] != '\n') {
+    versionEnd++;
+  }
+  if (versionEnd < span.size) {
+    versionEnd++;
+  }
+  const GLchar *sources[3] = {code, defines.c_str(), code + versionEnd};
+  GLint lengths[3] = {(GLint)versionEnd, (GLint)defines.size(),
+                      (GLint)(span.size - versionEnd)};
 
   // lets source the shader
-  glShaderSource(shader, 1, &shaderCode, NULL);
+  glShaderSource(shader, 3, sources, lengths);
   glCompileShader(shader);
-
-  // a sanity check for unsuccessful compilations
-  if (isFrag == true) {
-    checkShaderCompilation(shader, "FRAGMENT");
-  } else {
-    checkShaderCompilation(shader, "VERTEX");
-  }
+  // asking for the status here would wait for the compiler, the driver may
+  // keep compiling while the next stage is read
+  shaderStageCache()[key] = shader;
   return shader;
 }
 
-Shader::Shader(const GLchar *vertexPath, const GLchar *fragmentPath) {
+Shader::Shader(const GLchar *vertexPath, const GLchar *fragmentPath,
+               const std::string &defines) {
   // loading shaders
-  GLuint vshader = this->loadShader(vertexPath, "VERTEX");
-  GLuint fshader = this->loadShader(fragmentPath, "FRAGMENT");
+  GLuint vshader = this->loadShader(vertexPath, "VERTEX", defines);
+  GLuint fshader = this->loadShader(fragmentPath, "FRAGMENT", defines);
+  TRACE_SCOPE("Shader link");
   this->programId = glCreateProgram();
   glAttachShader(this->programId, vshader);
   glAttachShader(this->programId, fshader);
   glLinkProgram(this->programId);
-  checkShaderProgramCompilation(this->programId);
-  glDeleteShader(vshader);
-  glDeleteShader(fshader);
+  int linked;
+  glGetProgramiv(this->programId, GL_LINK_STATUS, &linked);
+  if (linked == 0) {
+    // a stage that did not compile is the usual cause
+    checkShaderCompilation(vshader, "VERTEX");
+    checkShaderCompilation(fshader, "FRAGMENT");
+    checkShaderProgramCompilation(this->programId);
+  }
 }
-void Shader::useProgram() { glUseProgram(this->programId); }
+void Shader::useProgram() { glState().useProgram(this->programId); }
 
 #endif
@@ -0,0 +1,534 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Cached shadow maps: cascaded shadow maps for directional lights and depth
+// cube maps for point lights. Depth of static casters is kept in a cache
+// texture, a layer/face is redrawn only when its light matrix changes or a
+// dynamic caster touching it moved.
+
+#ifndef SHADOW_HPP
+#define SHADOW_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <custom/camera.hpp>
+#include <custom/glstate.hpp>
+#include <custom/light.hpp>
+#include <custom/shader.hpp>
+
+#include <cmath>
+#include <functional>
+#include <string>
+#include <vector>
+
+const unsigned int SHADOW_CASCADE_COUNT = 4;
+const unsigned int SHADOW_CUBE_FACE_COUNT = 6;
+
+// shadow modes understood by the phong and pbr fragment shaders
+const int SHADOW_MODE_NONE = 0;
+const int SHADOW_MODE_DIRECTIONAL = 1;
+const int SHADOW_MODE_POINT = 2;
+
+// an object as seen by the shadow system
+struct ShadowCaster {
+  glm::mat4 model;
+  glm::vec3 center; // world space bounding sphere
+  float radius;
+  bool isStatic;
+  // set by the owner when a dynamic caster moves, cleared by
+  // resetShadowCasters once every shadow map had a chance to see it
+  bool dirty;
+  glm::vec3 lastCenter; // bounding sphere used in the last shadow update
+  std::function<void()> draw;
+
+  ShadowCaster(glm::mat4 m, glm::vec3 c, float r, bool stat,
+               std::function<void()> drawFn)
+      : model(m), center(c), radius(r), isStatic(stat), dirty(true),
+        lastCenter(c), draw(drawFn) {}
+  void moveTo(glm::mat4 m, glm::vec3 c) {
+    this->model = m;
+    this->center = c;
+    this->dirty = true;
+  }
+};
+
+void resetShadowCasters(std::vector<ShadowCaster> &casters) {
+  // call after all shadow maps are updated for the frame
+  for (unsigned int i = 0; i < casters.size(); i++) {
+    casters[i].lastCenter = casters[i].center;
+    casters[i].dirty = false;
+  }
+}
+
+void initShadowSamplers_proc(Shader &shader, int cascadeUnit, int cubeUnit) {
+  // both shadow samplers must point at distinct units even if a mode is
+  // unused, otherwise draw calls fail on mixed sampler types
+  shader.useProgram();
+  shader.setIntUni("shadowCascades", cascadeUnit);
+  shader.setIntUni("shadowCube", cubeUnit);
+  shader.setIntUni("shadowMode", SHADOW_MODE_NONE);
+}
+
+// common gl objects of the shadow maps
+class ShadowMap {
+public:
+  GLuint depthTex;  // sampled by the lighting shaders, compare mode on
+  GLuint staticTex; // depth of static casters only
+  unsigned int resolution;
+  // number of layers or faces redrawn in the last update
+  unsigned int redrawCount;
+
+  ShadowMap(unsigned int res) : resolution(res), redrawCount(0) {
+    glGenFramebuffers(1, &this->drawFbo);
+    glGenFramebuffers(1, &this->readFbo);
+  }
+  void destroy() {
+    glState().deleteFramebuffer(this->drawFbo);
+    glState().deleteFramebuffer(this->readFbo);
+    glState().deleteTexture(this->depthTex);
+    glState().deleteTexture(this->staticTex);
+  }
+
+protected:
+  GLuint drawFbo;
+  GLuint readFbo;
+  GLint savedViewport[4];
+  GLuint savedFbo;
+
+  void beginPass() {
+    glState().getViewport(this->savedViewport);
+    this->savedFbo = glState().framebuffer(GL_DRAW_FRAMEBUFFER);
+    glState().viewport(0, 0, this->resolution, this->resolution);
+    // casters between the light and the near plane are flattened onto it
+    glState().setCapability(GL_DEPTH_CLAMP, true);
+  }
+  void endPass() {
+    glState().setCapability(GL_DEPTH_CLAMP, false);
+    glState().bindFramebuffer(GL_FRAMEBUFFER, this->savedFbo);
+    glState().viewport(this->savedViewport[0], this->savedViewport[1],
+                       this->savedViewport[2], this->savedViewport[3]);
+  }
+  void attachTarget(GLuint fbo, GLenum fboTarget, GLuint tex, int layer,
+                    bool isCube) {
+    glState().bindFramebuffer(fboTarget, fbo);
+    if (isCube) {
+      glFramebufferTexture2D(fboTarget, GL_DEPTH_ATTACHMENT,
+                             GL_TEXTURE_CUBE_MAP_POSITIVE_X + layer, tex, 0);
+    } else {
+      glFramebufferTextureLayer(fboTarget, GL_DEPTH_ATTACHMENT, tex, 0, layer);
+    }
+    if (fboTarget == GL_READ_FRAMEBUFFER) {
+      glReadBuffer(GL_NONE);
+    } else {
+      glDrawBuffer(GL_NONE);
+    }
+  }
+  void drawCasters(std::vector<ShadowCaster> &casters, Shader &depthShader,
+                   bool staticPass) {
+    for (unsigned int i = 0; i < casters.size(); i++) {
+      if (casters[i].isStatic != staticPass) {
+        continue;
+      }
+      glm::mat4 model = casters[i].model;
+      depthShader.setMat4Uni("model", model);
+      casters[i].draw();
+    }
+  }
+  void redrawLayer(int layer, bool isCube, bool staticDirty,
+                   std::vector<ShadowCaster> &casters, Shader &depthShader) {
+    // static casters go to the cache, the cache is then copied to the
+    // sampled texture and dynamic casters are drawn on top of it
+    if (staticDirty) {
+      this->attachTarget(this->drawFbo, GL_FRAMEBUFFER, this->staticTex, layer,
+                         isCube);
+      glClear(GL_DEPTH_BUFFER_BIT);
+      this->drawCasters(casters, depthShader, true);
+    }
+    this->attachTarget(this->readFbo, GL_READ_FRAMEBUFFER, this->staticTex,
+                       layer, isCube);
+    this->attachTarget(this->drawFbo, GL_DRAW_FRAMEBUFFER, this->depthTex,
+                       layer, isCube);
+    GLint res = (GLint)this->resolution;
+    glBlitFramebuffer(0, 0, res, res, 0, 0, res, res, GL_DEPTH_BUFFER_BIT,
+                      GL_NEAREST);
+    glState().bindFramebuffer(GL_FRAMEBUFFER, this->drawFbo);
+    this->drawCasters(casters, depthShader, false);
+    this->redrawCount++;
+  }
+};
+
+void setShadowTextureParams_proc(GLenum target, bool compare) {
+  GLint filter = compare ? GL_LINEAR : GL_NEAREST;
+  glTexParameteri(target, GL_TEXTURE_MIN_FILTER, filter);
+  glTexParameteri(target, GL_TEXTURE_MAG_FILTER, filter);
+  if (target == GL_TEXTURE_CUBE_MAP) {
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+  } else {
+    // outside of the cascade counts as lit
+    float border[] = {1.0f, 1.0f, 1.0f, 1.0f};
+    glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameterfv(target, GL_TEXTURE_BORDER_COLOR, border);
+  }
+  if (compare) {
+    // hardware 2x2 pcf on each tap
+    glTexParameteri(target, GL_TEXTURE_COMPARE_MODE,
+                    GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(target, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+  }
+}
+
+bool sphereIntersectsBox(glm::vec3 center, float radius, glm::vec3 bmin,
+                         glm::vec3 bmax) {
+  glm::vec3 closest = glm::clamp(center, bmin, bmax);
+  glm::vec3 diff = center - closest;
+  return glm::dot(diff, diff) <= radius * radius;
+}
+
+// cascaded shadow map of a directional light
+class DirectionalShadowMap : public ShadowMap {
+public:
+  glm::mat4 cascadeMats[SHADOW_CASCADE_COUNT];
+  float cascadeSplits[SHADOW_CASCADE_COUNT];
+
+  DirectionalShadowMap(unsigned int res, float shadowDistance,
+                       float splitLambda = 0.75f);
+  // redraw cascades whose light matrix changed or which contain a moved
+  // dynamic caster, returns the number of redrawn cascades
+  unsigned int update(DirectionalLight &light, Camera &camera, float aspect,
+                      float nearPlane, std::vector<ShadowCaster> &casters,
+                      Shader &depthShader);
+  void bind(Shader &shader, GLenum unit, glm::vec3 viewDir);
+
+private:
+  float shadowDistance;
+  float splitLambda;
+  bool valid;
+  glm::mat4 lightView[SHADOW_CASCADE_COUNT];
+  glm::vec3 boxMin[SHADOW_CASCADE_COUNT]; // cascade box in light view space
+  glm::vec3 boxMax[SHADOW_CASCADE_COUNT];
+
+  void computeSplits(float nearPlane);
+  glm::mat4 fitCascade(unsigned int cascade, glm::vec3 lightDir,
+                       Camera &camera, float aspect, float splitNear,
+                       float splitFar);
+};
+
+DirectionalShadowMap::DirectionalShadowMap(unsigned int res, float distance,
+                                           float lambda)
+    : ShadowMap(res), shadowDistance(distance), splitLambda(lambda),
+      valid(false) {
+  GLuint texs[2];
+  glGenTextures(2, texs);
+  this->depthTex = texs[0];
+  this->staticTex = texs[1];
+  for (unsigned int t = 0; t < 2; t++) {
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texs[t]);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT32F, res, res,
+                 SHADOW_CASCADE_COUNT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    setShadowTextureParams_proc(GL_TEXTURE_2D_ARRAY, t == 0);
+  }
+  glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+  for (unsigned int i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+    this->cascadeMats[i] = glm::mat4(1.0f);
+    this->cascadeSplits[i] = 0.0f;
+  }
+}
+
+void DirectionalShadowMap::computeSplits(float nearPlane) {
+  // practical split scheme: blend of logarithmic and uniform splits
+  float ratio = this->shadowDistance / nearPlane;
+  for (unsigned int i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+    float p = (float)(i + 1) / (float)SHADOW_CASCADE_COUNT;
+    float logSplit = nearPlane * std::pow(ratio, p);
+    float uniSplit = nearPlane + (this->shadowDistance - nearPlane) * p;
+    this->cascadeSplits[i] =
+        this->splitLambda * logSplit + (1.0f - this->splitLambda) * uniSplit;
+  }
+}
+
+glm::mat4 DirectionalShadowMap::fitCascade(unsigned int cascade,
+                                           glm::vec3 lightDir, Camera &camera,
+                                           float aspect, float splitNear,
+                                           float splitFar) {
+  // bounding sphere of the sub frustum, its radius does not depend on the
+  // camera orientation so the cascade size stays constant while looking
+  // around
+  float tanY = std::tan(glm::radians(camera.zoom) * 0.5f);
+  float tanX = tanY * aspect;
+  glm::vec3 front = camera.getFront();
+  glm::vec3 right = camera.getRight();
+  glm::vec3 cameraUp = camera.getUp();
+  glm::vec3 corners[8];
+  float dists[2] = {splitNear, splitFar};
+  for (unsigned int d = 0; d < 2; d++) {
+    glm::vec3 mid = camera.pos + front * dists[d];
+    glm::vec3 dx = right * (tanX * dists[d]);
+    glm::vec3 dy = cameraUp * (tanY * dists[d]);
+    corners[d * 4 + 0] = mid - dx - dy;
+    corners[d * 4 + 1] = mid + dx - dy;
+    corners[d * 4 + 2] = mid + dx + dy;
+    corners[d * 4 + 3] = mid - dx + dy;
+  }
+  glm::vec3 center(0.0f);
+  for (unsigned int i = 0; i < 8; i++) {
+    center += corners[i];
+  }
+  center /= 8.0f;
+  float radius = 0.0f;
+  for (unsigned int i = 0; i < 8; i++) {
+    radius = glm::max(radius, glm::length(corners[i] - center));
+  }
+  radius = std::ceil(radius * 16.0f) / 16.0f;
+
+  // light view anchored at the origin so only the direction matters
+  glm::vec3 up = std::abs(lightDir.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f)
+                                               : glm::vec3(0.0f, 1.0f, 0.0f);
+  glm::mat4 view = glm::lookAt(glm::vec3(0.0f), lightDir, up);
+  glm::vec3 lc = glm::vec3(view * glm::vec4(center, 1.0f));
+
+  // snap the cascade to whole texels to avoid shimmering and to keep the
+  // matrix bitwise stable for small camera moves
+  float texel = (2.0f * radius) / (float)this->resolution;
+  lc.x = std::floor(lc.x / texel) * texel;
+  lc.y = std::floor(lc.y / texel) * texel;
+  lc.z = std::floor(lc.z / texel) * texel;
+
+  this->lightView[cascade] = view;
+  this->boxMin[cascade] = lc - glm::vec3(radius);
+  this->boxMax[cascade] = lc + glm::vec3(radius);
+  // looking down -z in light view, depth clamp catches casters in front
+  glm::mat4 proj = glm::ortho(lc.x - radius, lc.x + radius, lc.y - radius,
+                              lc.y + radius, -lc.z - radius, -lc.z + radius);
+  return proj * view;
+}
+
+unsigned int DirectionalShadowMap::update(DirectionalLight &light,
+                                          Camera &camera, float aspect,
+                                          float nearPlane,
+                                          std::vector<ShadowCaster> &casters,
+                                          Shader &depthShader) {
+  this->redrawCount = 0;
+  glm::vec3 lightDir = glm::normalize(light.direction);
+  this->computeSplits(nearPlane);
+
+  bool staticDirty[SHADOW_CASCADE_COUNT];
+  bool needsRedraw[SHADOW_CASCADE_COUNT];
+  float splitNear = nearPlane;
+  for (unsigned int i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+    glm::mat4 mat = this->fitCascade(i, lightDir, camera, aspect, splitNear,
+                                     this->cascadeSplits[i]);
+    splitNear = this->cascadeSplits[i];
+    staticDirty[i] = !this->valid || mat != this->cascadeMats[i];
+    this->cascadeMats[i] = mat;
+    needsRedraw[i] = staticDirty[i];
+  }
+  // a moved dynamic caster dirties the cascades of its old and new bounds
+  for (unsigned int c = 0; c < casters.size(); c++) {
+    if (casters[c].isStatic) {
+      if (casters[c].dirty) {
+        // moving a static caster invalidates the whole cache
+        for (unsigned int i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+          staticDirty[i] = needsRedraw[i] = true;
+        }
+      }
+      continue;
+    }
+    if (!casters[c].dirty) {
+      continue;
+    }
+    for (unsigned int i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+      if (needsRedraw[i]) {
+        continue;
+      }
+      // anything towards the light is clamped onto the near plane
+      glm::vec3 bmax = this->boxMax[i];
+      bmax.z = 1e30f;
+      glm::vec3 cnew =
+          glm::vec3(this->lightView[i] * glm::vec4(casters[c].center, 1.0f));
+      glm::vec3 cold = glm::vec3(this->lightView[i] *
+                                 glm::vec4(casters[c].lastCenter, 1.0f));
+      needsRedraw[i] =
+          sphereIntersectsBox(cnew, casters[c].radius, this->boxMin[i], bmax) ||
+          sphereIntersectsBox(cold, casters[c].radius, this->boxMin[i], bmax);
+    }
+  }
+  this->valid = true;
+
+  bool anyRedraw = false;
+  for (unsigned int i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+    anyRedraw = anyRedraw || needsRedraw[i];
+  }
+  if (!anyRedraw) {
+    return 0;
+  }
+  this->beginPass();
+  depthShader.useProgram();
+  depthShader.setIntUni("linearDepth", 0);
+  for (unsigned int i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+    if (!needsRedraw[i]) {
+      continue;
+    }
+    depthShader.setMat4Uni("lightSpace", this->cascadeMats[i]);
+    this->redrawLayer(i, false, staticDirty[i], casters, depthShader);
+  }
+  this->endPass();
+  return this->redrawCount;
+}
+
+void DirectionalShadowMap::bind(Shader &shader, GLenum unit,
+                                glm::vec3 viewDir) {
+  glState().bindTexture(unit - GL_TEXTURE0, GL_TEXTURE_2D_ARRAY,
+                        this->depthTex);
+  shader.useProgram();
+  shader.setIntUni("shadowMode", SHADOW_MODE_DIRECTIONAL);
+  for (unsigned int i = 0; i < SHADOW_CASCADE_COUNT; i++) {
+    shader.setMat4Uni("cascadeMats[" + std::to_string(i) + "]",
+                      this->cascadeMats[i]);
+  }
+  shader.setVec4Uni("cascadeSplits",
+                    glm::vec4(this->cascadeSplits[0], this->cascadeSplits[1],
+                              this->cascadeSplits[2], this->cascadeSplits[3]));
+  shader.setVec3Uni("cascadeViewDir", viewDir);
+}
+
+// omnidirectional shadow map of a point light
+class PointShadowMap : public ShadowMap {
+public:
+  glm::mat4 faceMats[SHADOW_CUBE_FACE_COUNT];
+  float nearPlane;
+  float farPlane;
+
+  PointShadowMap(unsigned int res, float nearp, float farp);
+  // redraw faces touched by the light move or moved dynamic casters,
+  // returns the number of redrawn faces
+  unsigned int update(glm::vec3 lightPos, std::vector<ShadowCaster> &casters,
+                      Shader &depthShader);
+  void bind(Shader &shader, GLenum unit);
+
+private:
+  bool valid;
+  glm::vec3 lastLightPos;
+
+  bool faceTouchesSphere(unsigned int face, glm::vec3 relCenter, float radius);
+};
+
+PointShadowMap::PointShadowMap(unsigned int res, float nearp, float farp)
+    : ShadowMap(res), nearPlane(nearp), farPlane(farp), valid(false),
+      lastLightPos(0.0f) {
+  GLuint texs[2];
+  glGenTextures(2, texs);
+  this->depthTex = texs[0];
+  this->staticTex = texs[1];
+  for (unsigned int t = 0; t < 2; t++) {
+    glBindTexture(GL_TEXTURE_CUBE_MAP, texs[t]);
+    for (unsigned int f = 0; f < SHADOW_CUBE_FACE_COUNT; f++) {
+      glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + f, 0, GL_DEPTH_COMPONENT32F,
+                   res, res, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+    }
+    setShadowTextureParams_proc(GL_TEXTURE_CUBE_MAP, t == 0);
+  }
+  glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
+
+bool PointShadowMap::faceTouchesSphere(unsigned int face, glm::vec3 rel,
+                                       float radius) {
+  // a face sees the pyramid where its major axis dominates the two others
+  int axis = face / 2;
+  float sign = (face % 2 == 0) ? 1.0f : -1.0f;
+  float major = rel[axis] * sign;
+  float planeDist = radius * 1.41421356f; // planes have 1/sqrt(2) normals
+  for (int other = 0; other < 3; other++) {
+    if (other == axis) {
+      continue;
+    }
+    if (major - rel[other] < -planeDist || major + rel[other] < -planeDist) {
+      return false;
+    }
+  }
+  return major > -radius;
+}
+
+unsigned int PointShadowMap::update(glm::vec3 lightPos,
+                                    std::vector<ShadowCaster> &casters,
+                                    Shader &depthShader) {
+  this->redrawCount = 0;
+  bool lightMoved = !this->valid || lightPos != this->lastLightPos;
+  bool staticDirty[SHADOW_CUBE_FACE_COUNT];
+  bool needsRedraw[SHADOW_CUBE_FACE_COUNT];
+  for (unsigned int f = 0; f < SHADOW_CUBE_FACE_COUNT; f++) {
+    staticDirty[f] = needsRedraw[f] = lightMoved;
+  }
+  for (unsigned int c = 0; c < casters.size(); c++) {
+    if (!casters[c].dirty) {
+      continue;
+    }
+    glm::vec3 centers[2] = {casters[c].center, casters[c].lastCenter};
+    for (unsigned int k = 0; k < 2; k++) {
+      glm::vec3 rel = centers[k] - lightPos;
+      if (glm::length(rel) - casters[c].radius > this->farPlane) {
+        continue;
+      }
+      for (unsigned int f = 0; f < SHADOW_CUBE_FACE_COUNT; f++) {
+        if (this->faceTouchesSphere(f, rel, casters[c].radius)) {
+          needsRedraw[f] = true;
+          staticDirty[f] = staticDirty[f] || casters[c].isStatic;
+        }
+      }
+    }
+  }
+  if (lightMoved) {
+    glm::mat4 proj =
+        glm::perspective(glm::radians(90.0f), 1.0f, this->nearPlane,
+                         this->farPlane);
+    glm::vec3 dirs[] = {glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+                        glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+                        glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)};
+    glm::vec3 ups[] = {glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+                       glm::vec3(0.0f, 0.0f, 1.0f),  glm::vec3(0.0f, 0.0f, -1.0f),
+                       glm::vec3(0.0f, -1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f)};
+    for (unsigned int f = 0; f < SHADOW_CUBE_FACE_COUNT; f++) {
+      this->faceMats[f] =
+          proj * glm::lookAt(lightPos, lightPos + dirs[f], ups[f]);
+    }
+  }
+  this->valid = true;
+  this->lastLightPos = lightPos;
+
+  bool anyRedraw = false;
+  for (unsigned int f = 0; f < SHADOW_CUBE_FACE_COUNT; f++) {
+    anyRedraw = anyRedraw || needsRedraw[f];
+  }
+  if (!anyRedraw) {
+    return 0;
+  }
+  this->beginPass();
+  depthShader.useProgram();
+  depthShader.setIntUni("linearDepth", 1);
+  depthShader.setVec3Uni("shadowLightPos", lightPos);
+  depthShader.setFloatUni("shadowFar", this->farPlane);
+  for (unsigned int f = 0; f < SHADOW_CUBE_FACE_COUNT; f++) {
+    if (!needsRedraw[f]) {
+      continue;
+    }
+    depthShader.setMat4Uni("lightSpace", this->faceMats[f]);
+    this->redrawLayer(f, true, staticDirty[f], casters, depthShader);
+  }
+  this->endPass();
+  return this->redrawCount;
+}
+
+void PointShadowMap::bind(Shader &shader, GLenum unit) {
+  glState().bindTexture(unit - GL_TEXTURE0, GL_TEXTURE_CUBE_MAP,
+                        this->depthTex);
+  shader.useProgram();
+  shader.setIntUni("shadowMode", SHADOW_MODE_POINT);
+  shader.setVec3Uni("shadowLightPos", this->lastLightPos);
+  shader.setFloatUni("shadowFar", this->farPlane);
+}
+
+#endif
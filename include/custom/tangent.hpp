@@ -0,0 +1,286 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Tangent frames generated once per mesh when it is loaded. The generator
+// follows the MikkTSpace conventions: every triangle corner gets the uv
+// gradients projected into the tangent plane of its vertex normal, weighted
+// by the corner angle, the corners of a vertex are summed, the tangent is
+// orthogonalized against the normal and the bitangent is rebuilt in the
+// shader as sign * cross(normal, tangent).
+// Frames are stored as QTangents, a unit quaternion in four snorm16 whose
+// w sign is the bitangent sign, so a vertex carries normal, tangent and
+// bitangent in 8 bytes.
+
+#ifndef TANGENT_HPP
+#define TANGENT_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <custom/glstate.hpp>
+#include <custom/jobpool.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+struct MeshData {
+  std::vector<glm::vec3> positions;
+  std::vector<glm::vec3> normals;
+  std::vector<glm::vec2> uvs;
+  std::vector<unsigned int> indices; // three per triangle
+};
+
+struct QTangent {
+  int16_t q[4]; // x, y, z, w
+};
+
+// vertex layout of uploadTangentMesh, locations 0 aPos, 2 aTexCoord and
+// 3 aQTangent
+struct TangentVertex {
+  float pos[3];
+  float uv[2];
+  int16_t qtangent[4];
+};
+
+struct TangentMesh {
+  GLuint vao = 0;
+  GLuint vbo = 0;
+  GLuint ebo = 0;
+  GLsizei indexCount = 0;
+};
+
+// cube of the demos, positions and texture coordinates per triangle with
+// the face normal last
+const float CUBE_TRIANGLES[12][18] = {
+    {-0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.5f,
+     0.5f, -0.5f, 1.0f, 1.0f, 0.0f, 0.0f, -1.0f},
+    {0.5f, 0.5f, -0.5f, 1.0f, 1.0f, -0.5f, 0.5f, -0.5f, 0.0f, 1.0f, -0.5f,
+     -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f},
+    {-0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 0.5f, -0.5f, 0.5f, 1.0f, 0.0f, 0.5f,
+     0.5f, 0.5f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f},
+    {0.5f, 0.5f, 0.5f, 1.0f, 1.0f, -0.5f, 0.5f, 0.5f, 0.0f, 1.0f, -0.5f,
+     -0.5f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f},
+    {-0.5f, 0.5f, 0.5f, 1.0f, 0.0f, -0.5f, 0.5f, -0.5f, 1.0f, 1.0f, -0.5f,
+     -0.5f, -0.5f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f},
+    {-0.5f, -0.5f, -0.5f, 0.0f, 1.0f, -0.5f, -0.5f, 0.5f, 0.0f, 0.0f, -0.5f,
+     0.5f, 0.5f, 1.0f, 0.0f, -1.0f, 0.0f, 0.0f},
+    {0.5f, 0.5f, 0.5f, 1.0f, 0.0f, 0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.5f,
+     -0.5f, -0.5f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f},
+    {0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 0.5f,
+     0.5f, 0.5f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f},
+    {-0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 0.5f, -0.5f, -0.5f, 1.0f, 1.0f, 0.5f,
+     -0.5f, 0.5f, 1.0f, 0.0f, 0.0f, -1.0f, 0.0f},
+    {0.5f, -0.5f, 0.5f, 1.0f, 0.0f, -0.5f, -0.5f, 0.5f, 0.0f, 0.0f, -0.5f,
+     -0.5f, -0.5f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f},
+    {-0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.5f,
+     0.5f, 0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f},
+    {0.5f, 0.5f, 0.5f, 1.0f, 0.0f, -0.5f, 0.5f, 0.5f, 0.0f, 0.0f, -0.5f,
+     0.5f, -0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f},
+};
+
+MeshData makeCubeMesh() {
+  // corners with the same position, normal and uv share a vertex
+  MeshData mesh;
+  for (unsigned int t = 0; t < 12; t++) {
+    glm::vec3 n(CUBE_TRIANGLES[t][15], CUBE_TRIANGLES[t][16],
+                CUBE_TRIANGLES[t][17]);
+    for (unsigned int i = 0; i < 3; i++) {
+      const float *v = &CUBE_TRIANGLES[t][i * 5];
+      glm::vec3 p(v[0], v[1], v[2]);
+      glm::vec2 uv(v[3], v[4]);
+      unsigned int index = (unsigned int)mesh.positions.size();
+      for (unsigned int k = 0; k < mesh.positions.size(); k++) {
+        if (mesh.positions[k] == p && mesh.normals[k] == n &&
+            mesh.uvs[k] == uv) {
+          index = k;
+          break;
+        }
+      }
+      if (index == mesh.positions.size()) {
+        mesh.positions.push_back(p);
+        mesh.normals.push_back(n);
+        mesh.uvs.push_back(uv);
+      }
+      mesh.indices.push_back(index);
+    }
+  }
+  return mesh;
+}
+
+glm::vec3 projectOnPlane(const glm::vec3 &v, const glm::vec3 &n) {
+  glm::vec3 p = v - n * glm::dot(n, v);
+  float len = glm::length(p);
+  return len > 1e-20f ? p / len : glm::vec3(0.0f);
+}
+
+void generateTangents(const MeshData &mesh, JobPool &pool,
+                      std::vector<glm::vec4> &tangents) {
+  // xyz tangent, w bitangent sign
+  unsigned int triCount = (unsigned int)mesh.indices.size() / 3;
+  unsigned int vertexCount = (unsigned int)mesh.positions.size();
+  std::vector<glm::vec3> cornerS(triCount * 3);
+  std::vector<glm::vec3> cornerT(triCount * 3);
+
+  // corners in parallel over the triangles
+  pool.parallelFor(triCount, 256, [&](unsigned int begin, unsigned int end) {
+    for (unsigned int t = begin; t < end; t++) {
+      const unsigned int *idx = &mesh.indices[t * 3];
+      glm::vec3 e1 = mesh.positions[idx[1]] - mesh.positions[idx[0]];
+      glm::vec3 e2 = mesh.positions[idx[2]] - mesh.positions[idx[0]];
+      glm::vec2 d1 = mesh.uvs[idx[1]] - mesh.uvs[idx[0]];
+      glm::vec2 d2 = mesh.uvs[idx[2]] - mesh.uvs[idx[0]];
+      // MikkTSpace keeps the gradient directions and flips both with the
+      // sign of the uv area instead of dividing by it
+      float area = d1.x * d2.y - d2.x * d1.y;
+      float flip = area < 0.0f ? -1.0f : 1.0f;
+      glm::vec3 s = (e1 * d2.y - e2 * d1.y) * flip;
+      glm::vec3 tt = (e2 * d1.x - e1 * d2.x) * flip;
+      for (unsigned int c = 0; c < 3; c++) {
+        const glm::vec3 &p = mesh.positions[idx[c]];
+        const glm::vec3 &n = mesh.normals[idx[c]];
+        glm::vec3 a = projectOnPlane(mesh.positions[idx[(c + 1) % 3]] - p, n);
+        glm::vec3 b = projectOnPlane(mesh.positions[idx[(c + 2) % 3]] - p, n);
+        float angle = std::acos(glm::clamp(glm::dot(a, b), -1.0f, 1.0f));
+        cornerS[t * 3 + c] = projectOnPlane(s, n) * angle;
+        cornerT[t * 3 + c] = projectOnPlane(tt, n) * angle;
+      }
+    }
+  });
+
+  // corners of every vertex, counting sort keeps the sums deterministic
+  std::vector<unsigned int> offsets(vertexCount + 1, 0);
+  for (unsigned int i = 0; i < triCount * 3; i++) {
+    offsets[mesh.indices[i] + 1]++;
+  }
+  for (unsigned int v = 0; v < vertexCount; v++) {
+    offsets[v + 1] += offsets[v];
+  }
+  std::vector<unsigned int> corners(triCount * 3);
+  std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+  for (unsigned int i = 0; i < triCount * 3; i++) {
+    corners[fill[mesh.indices[i]]++] = i;
+  }
+
+  tangents.resize(vertexCount);
+  pool.parallelFor(vertexCount, 1024, [&](unsigned int begin,
+                                          unsigned int end) {
+    for (unsigned int v = begin; v < end; v++) {
+      glm::vec3 s(0.0f);
+      glm::vec3 t(0.0f);
+      for (unsigned int k = offsets[v]; k < offsets[v + 1]; k++) {
+        s += cornerS[corners[k]];
+        t += cornerT[corners[k]];
+      }
+      const glm::vec3 &n = mesh.normals[v];
+      glm::vec3 tangent = projectOnPlane(s, n);
+      if (tangent == glm::vec3(0.0f)) {
+        // no usable uv gradient, any vector in the tangent plane will do
+        glm::vec3 axis = std::fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f)
+                                               : glm::vec3(0.0f, 1.0f, 0.0f);
+        tangent = projectOnPlane(axis, n);
+      }
+      float sign = glm::dot(glm::cross(n, tangent), t) < 0.0f ? -1.0f : 1.0f;
+      tangents[v] = glm::vec4(tangent, sign);
+    }
+  });
+}
+
+QTangent encodeQTangent(const glm::vec3 &normal, const glm::vec4 &tangent) {
+  glm::vec3 t(tangent);
+  glm::vec3 b = glm::cross(normal, t);
+  glm::quat q = glm::normalize(glm::quat_cast(glm::mat3(t, b, normal)));
+  if (q.w < 0.0f) {
+    q = -q;
+  }
+  // w must survive the quantization so its sign can hold the handedness
+  const float bias = 1.0f / 32767.0f;
+  if (q.w < bias) {
+    float scale = std::sqrt(1.0f - bias * bias) /
+                  glm::length(glm::vec3(q.x, q.y, q.z));
+    q = glm::quat(bias, q.x * scale, q.y * scale, q.z * scale);
+  }
+  if (tangent.w < 0.0f) {
+    q = -q;
+  }
+  QTangent packed;
+  float c[4] = {q.x, q.y, q.z, q.w};
+  for (unsigned int i = 0; i < 4; i++) {
+    packed.q[i] =
+        (int16_t)std::lround(glm::clamp(c[i], -1.0f, 1.0f) * 32767.0f);
+  }
+  return packed;
+}
+
+void decodeQTangent(const QTangent &packed, glm::vec3 &normal,
+                    glm::vec3 &tangent, glm::vec3 &bitangent) {
+  // cpu copy of the vertex shader decode
+  glm::quat q((float)packed.q[3], (float)packed.q[0], (float)packed.q[1],
+              (float)packed.q[2]);
+  q = glm::normalize(q);
+  normal = q * glm::vec3(0.0f, 0.0f, 1.0f);
+  tangent = q * glm::vec3(1.0f, 0.0f, 0.0f);
+  float sign = packed.q[3] < 0 ? -1.0f : 1.0f;
+  bitangent = sign * glm::cross(normal, tangent);
+}
+
+void generateQTangents(const MeshData &mesh, JobPool &pool,
+                       std::vector<QTangent> &qtangents) {
+  std::vector<glm::vec4> tangents;
+  generateTangents(mesh, pool, tangents);
+  qtangents.resize(tangents.size());
+  for (unsigned int v = 0; v < tangents.size(); v++) {
+    qtangents[v] = encodeQTangent(mesh.normals[v], tangents[v]);
+  }
+}
+
+TangentMesh uploadTangentMesh(const MeshData &mesh,
+                              const std::vector<QTangent> &qtangents) {
+  std::vector<TangentVertex> vertices(mesh.positions.size());
+  for (unsigned int v = 0; v < vertices.size(); v++) {
+    for (unsigned int i = 0; i < 3; i++) {
+      vertices[v].pos[i] = mesh.positions[v][i];
+    }
+    vertices[v].uv[0] = mesh.uvs[v].x;
+    vertices[v].uv[1] = mesh.uvs[v].y;
+    for (unsigned int i = 0; i < 4; i++) {
+      vertices[v].qtangent[i] = qtangents[v].q[i];
+    }
+  }
+  TangentMesh gpu;
+  gpu.indexCount = (GLsizei)mesh.indices.size();
+  glGenVertexArrays(1, &gpu.vao);
+  glGenBuffers(1, &gpu.vbo);
+  glGenBuffers(1, &gpu.ebo);
+  glState().bindVertexArray(gpu.vao);
+  glBindBuffer(GL_ARRAY_BUFFER, gpu.vbo);
+  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(TangentVertex),
+               vertices.data(), GL_STATIC_DRAW);
+  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, gpu.ebo);
+  glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+               mesh.indices.size() * sizeof(unsigned int), mesh.indices.data(),
+               GL_STATIC_DRAW);
+  GLsizei stride = sizeof(TangentVertex);
+  glEnableVertexAttribArray(0);
+  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride,
+                        (void *)offsetof(TangentVertex, pos));
+  glEnableVertexAttribArray(2);
+  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride,
+                        (void *)offsetof(TangentVertex, uv));
+  // snorm16, the shader sees the quaternion in [-1, 1]
+  glEnableVertexAttribArray(3);
+  glVertexAttribPointer(3, 4, GL_SHORT, GL_TRUE, stride,
+                        (void *)offsetof(TangentVertex, qtangent));
+  glState().bindVertexArray(0);
+  return gpu;
+}
+
+void drawTangentMesh(const TangentMesh &mesh) {
+  // left bound, the next draw of the same mesh skips the bind
+  glState().bindVertexArray(mesh.vao);
+  glDrawElements(GL_TRIANGLES, mesh.indexCount, GL_UNSIGNED_INT, 0);
+}
+
+#endif
@@ -0,0 +1,275 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Cpu timeline in the chrome trace event format, for chrome://tracing or
+// ui.perfetto.dev. TRACE_SCOPE marks a block, the time from the macro to
+// the end of the scope becomes one complete event on the timeline of the
+// thread. Every thread writes to its own buffer, blocks of events that only
+// it fills; the event count is published with a release store so the
+// writer can read a buffer while its thread keeps going, without a lock.
+// Building with -DTRACE_DISABLE removes the macros, at run time nothing is
+// recorded until TRACE_START().
+// Names have to outlive the tracer, string literals. A detail, a file name
+// say, has to last until the end of its scope; it is copied into the event
+// then, its end when it is longer than TRACE_DETAIL_SIZE.
+
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+const unsigned int TRACE_BLOCK_EVENTS = 4096;
+// per thread, events past it are counted as dropped
+const unsigned int TRACE_MAX_BLOCKS = 64;
+const unsigned int TRACE_DETAIL_SIZE = 48;
+
+struct TraceEvent {
+  const char *name;
+  uint64_t start; // nanoseconds since start()
+  uint64_t duration;
+  char detail[TRACE_DETAIL_SIZE];
+};
+
+struct TraceBuffer {
+  std::string threadName;
+  unsigned int id;
+  // written by the owning thread only
+  std::atomic<TraceEvent *> blocks[TRACE_MAX_BLOCKS];
+  std::atomic<uint64_t> count;
+  std::atomic<uint64_t> dropped;
+
+  TraceBuffer(unsigned int id);
+};
+
+class Tracer {
+public:
+  Tracer();
+  ~Tracer();
+
+  void start();
+  void stop() { this->enabled.store(false, std::memory_order_relaxed); }
+  bool isEnabled() const {
+    return this->enabled.load(std::memory_order_relaxed);
+  }
+  uint64_t now() const;
+
+  // the buffer of the calling thread, made on first use
+  TraceBuffer &threadBuffer();
+  void nameThread(const char *name);
+  void record(const char *name, uint64_t start, uint64_t end,
+              const char *detail);
+
+  // the events recorded so far, threads may keep recording meanwhile
+  bool write(const std::string &path);
+
+private:
+  std::atomic<bool> enabled;
+  std::chrono::steady_clock::time_point epoch;
+  // only registration takes the lock
+  std::mutex registry;
+  std::vector<TraceBuffer *> buffers;
+};
+
+Tracer &tracer() {
+  static Tracer t;
+  return t;
+}
+
+class TraceScope {
+public:
+  TraceScope(const char *name, const char *detail = NULL);
+  ~TraceScope();
+
+private:
+  const char *name;
+  const char *detail;
+  uint64_t start;
+  bool active;
+};
+
+#ifndef TRACE_DISABLE
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+#define TRACE_SCOPE_DETAIL(name, detail)                                      \
+  TraceScope TRACE_CONCAT(traceScope, __LINE__)(name, detail)
+#define TRACE_THREAD(name) tracer().nameThread(name)
+#define TRACE_START() tracer().start()
+#define TRACE_WRITE(path) tracer().write(path)
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_SCOPE_DETAIL(name, detail)
+#define TRACE_THREAD(name)
+#define TRACE_START()
+#define TRACE_WRITE(path)
+#endif
+
+TraceBuffer::TraceBuffer(unsigned int i) : id(i), count(0), dropped(0) {
+  for (unsigned int b = 0; b < TRACE_MAX_BLOCKS; b++) {
+    this->blocks[b].store(NULL, std::memory_order_relaxed);
+  }
+}
+
+Tracer::Tracer() : enabled(false), epoch(std::chrono::steady_clock::now()) {}
+Tracer::~Tracer() {
+  // the buffers are left to the os, a thread outliving main may still
+  // hold one
+  this->stop();
+}
+
+void Tracer::start() {
+  this->epoch = std::chrono::steady_clock::now();
+  this->enabled.store(true, std::memory_order_relaxed);
+}
+
+uint64_t Tracer::now() const {
+  return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now() - this->epoch)
+      .count();
+}
+
+TraceBuffer &Tracer::threadBuffer() {
+  // the tracer is one per program, so is the pointer
+  thread_local TraceBuffer *buffer = NULL;
+  if (buffer == NULL) {
+    std::lock_guard<std::mutex> lock(this->registry);
+    buffer = new TraceBuffer((unsigned int)this->buffers.size());
+    buffer->threadName = "thread";
+    this->buffers.push_back(buffer);
+  }
+  return *buffer;
+}
+
+void Tracer::nameThread(const char *name) {
+  TraceBuffer &buffer = this->threadBuffer();
+  std::lock_guard<std::mutex> lock(this->registry);
+  buffer.threadName = name;
+}
+
+void Tracer::record(const char *name, uint64_t start, uint64_t end,
+                    const char *detail) {
+  TraceBuffer &buffer = this->threadBuffer();
+  uint64_t index = buffer.count.load(std::memory_order_relaxed);
+  unsigned int block = (unsigned int)(index / TRACE_BLOCK_EVENTS);
+  if (block >= TRACE_MAX_BLOCKS) {
+    buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  TraceEvent *events = buffer.blocks[block].load(std::memory_order_relaxed);
+  if (events == NULL) {
+    events = new TraceEvent[TRACE_BLOCK_EVENTS];
+    buffer.blocks[block].store(events, std::memory_order_relaxed);
+  }
+  TraceEvent &e = events[index % TRACE_BLOCK_EVENTS];
+  e.name = name;
+  e.start = start;
+  e.duration = end - start;
+  e.detail[0] = '\0';
+  if (detail != NULL) {
+    // the end is kept, a path keeps its file name
+    size_t length = std::strlen(detail);
+    size_t skip =
+        length < TRACE_DETAIL_SIZE ? 0 : length - TRACE_DETAIL_SIZE + 1;
+    std::memcpy(e.detail, detail + skip, length - skip + 1);
+  }
+  // the event and its block are visible to whoever reads this count
+  buffer.count.store(index + 1, std::memory_order_release);
+}
+
+void traceWriteString_proc(std::ostream &out, const char *s) {
+  out << '"';
+  for (; *s != '\0'; s++) {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\') {
+      out << '\\' << (char)c;
+    } else if (c < 0x20) {
+      // control characters do not show up in names, drop them
+      out << ' ';
+    } else {
+      out << (char)c;
+    }
+  }
+  out << '"';
+}
+
+bool Tracer::write(const std::string &path) {
+  std::ofstream out(path);
+  if (!out) {
+    std::cout << "Failed to write trace: " << path << std::endl;
+    return false;
+  }
+  std::vector<TraceBuffer *> snapshot;
+  {
+    std::lock_guard<std::mutex> lock(this->registry);
+    snapshot = this->buffers;
+  }
+  out << "{\"traceEvents\":[\n";
+  bool first = true;
+  uint64_t total = 0, dropped = 0;
+  char ts[64];
+  for (unsigned int b = 0; b < snapshot.size(); b++) {
+    TraceBuffer &buffer = *snapshot[b];
+    std::string threadName;
+    {
+      std::lock_guard<std::mutex> lock(this->registry);
+      threadName = buffer.threadName;
+    }
+    out << (first ? "" : ",\n")
+        << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":"
+        << buffer.id << ",\"args\":{\"name\":";
+    traceWriteString_proc(out, threadName.c_str());
+    out << "}}";
+    first = false;
+    uint64_t count = buffer.count.load(std::memory_order_acquire);
+    for (uint64_t i = 0; i < count; i++) {
+      const TraceEvent &e =
+          buffer.blocks[i / TRACE_BLOCK_EVENTS].load(
+              std::memory_order_relaxed)[i % TRACE_BLOCK_EVENTS];
+      // microseconds, the fraction keeps the nanoseconds
+      std::snprintf(ts, sizeof(ts), "\"ts\":%.3f,\"dur\":%.3f",
+                    e.start / 1000.0, e.duration / 1000.0);
+      out << ",\n{\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer.id << ","
+          << ts << ",\"name\":";
+      traceWriteString_proc(out, e.name);
+      if (e.detail[0] != '\0') {
+        out << ",\"args\":{\"detail\":";
+        traceWriteString_proc(out, e.detail);
+        out << "}";
+      }
+      out << "}";
+    }
+    total += count;
+    dropped += buffer.dropped.load(std::memory_order_relaxed);
+  }
+  out << "\n]}\n";
+  std::cout << "trace: " << total << " events from " << snapshot.size()
+            << " threads written to " << path;
+  if (dropped > 0) {
+    std::cout << ", " << dropped << " dropped";
+  }
+  std::cout << std::endl;
+  return (bool)out;
+}
+
+TraceScope::TraceScope(const char *n, const char *d)
+    : name(n), detail(d), start(0), active(tracer().isEnabled()) {
+  if (this->active) {
+    this->start = tracer().now();
+  }
+}
+TraceScope::~TraceScope() {
+  if (this->active) {
+    tracer().record(this->name, this->start, tracer().now(), this->detail);
+  }
+}
+
+#endif
@@ -0,0 +1,150 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Per object matrices computed on the cpu once per frame. The vertex
+// shaders read the model view projection and the normal matrix as uniforms
+// instead of rebuilding them, an inverse included, for every vertex.
+
+#ifndef TRANSFORM_HPP
+#define TRANSFORM_HPP
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define TRANSFORM_USE_SSE 1
+#endif
+
+#include <vector>
+
+class ObjectTransforms {
+public:
+  std::vector<glm::mat4> models;
+  // outputs of update
+  std::vector<glm::mat4> mvps;
+  std::vector<glm::mat3> normals;
+
+  // returns the index of the object
+  unsigned int add(const glm::mat4 &model);
+  // recomputes every mvp and normal matrix in one pass
+  void update(const glm::mat4 &viewProj);
+};
+
+// true unless a sphere of the given radius around the object origin lies
+// outside one of the frustum planes of mvp
+bool sphereVisible(const glm::mat4 &mvp, float radius);
+
+unsigned int ObjectTransforms::add(const glm::mat4 &model) {
+  this->models.push_back(model);
+  this->mvps.push_back(model);
+  this->normals.push_back(glm::mat3(1.0f));
+  return (unsigned int)this->models.size() - 1;
+}
+
+glm::mat3 normalMatrix(const glm::mat4 &model) {
+  // transpose(inverse(mat3(model))) from the cofactors, the columns of the
+  // inverse transpose are the cross products of the other two columns
+  glm::vec3 a(model[0]);
+  glm::vec3 b(model[1]);
+  glm::vec3 c(model[2]);
+  glm::vec3 bc = glm::cross(b, c);
+  float invDet = 1.0f / glm::dot(a, bc);
+  return glm::mat3(bc * invDet, glm::cross(c, a) * invDet,
+                   glm::cross(a, b) * invDet);
+}
+
+#ifdef TRANSFORM_USE_SSE
+void normalMatrices4_proc(const glm::mat4 *models, glm::mat3 *normals) {
+  // normalMatrix for four objects at once, lane k holds object k
+  __m128 col[3][4];
+  for (unsigned int j = 0; j < 3; j++) {
+    for (unsigned int k = 0; k < 4; k++) {
+      col[j][k] = _mm_loadu_ps(&models[k][j][0]);
+    }
+    // rows become x, y, z, w of the column across the objects
+    _MM_TRANSPOSE4_PS(col[j][0], col[j][1], col[j][2], col[j][3]);
+  }
+  __m128 *a = col[0];
+  __m128 *b = col[1];
+  __m128 *c = col[2];
+  __m128 cof[3][3];
+  __m128 *pairs[3][2] = {{b, c}, {c, a}, {a, b}};
+  for (unsigned int j = 0; j < 3; j++) {
+    __m128 *u = pairs[j][0];
+    __m128 *v = pairs[j][1];
+    cof[j][0] = _mm_sub_ps(_mm_mul_ps(u[1], v[2]), _mm_mul_ps(u[2], v[1]));
+    cof[j][1] = _mm_sub_ps(_mm_mul_ps(u[2], v[0]), _mm_mul_ps(u[0], v[2]));
+    cof[j][2] = _mm_sub_ps(_mm_mul_ps(u[0], v[1]), _mm_mul_ps(u[1], v[0]));
+  }
+  __m128 det = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(a[0], cof[0][0]), _mm_mul_ps(a[1], cof[0][1])),
+      _mm_mul_ps(a[2], cof[0][2]));
+  __m128 invDet = _mm_div_ps(_mm_set1_ps(1.0f), det);
+  float out[3][3][4];
+  for (unsigned int j = 0; j < 3; j++) {
+    for (unsigned int i = 0; i < 3; i++) {
+      _mm_storeu_ps(out[j][i], _mm_mul_ps(cof[j][i], invDet));
+    }
+  }
+  for (unsigned int k = 0; k < 4; k++) {
+    for (unsigned int j = 0; j < 3; j++) {
+      normals[k][j] = glm::vec3(out[j][0][k], out[j][1][k], out[j][2][k]);
+    }
+  }
+}
+#endif
+
+void ObjectTransforms::update(const glm::mat4 &viewProj) {
+  unsigned int count = (unsigned int)this->models.size();
+  this->mvps.resize(count);
+  this->normals.resize(count);
+#ifdef TRANSFORM_USE_SSE
+  __m128 vp[4];
+  for (unsigned int j = 0; j < 4; j++) {
+    vp[j] = _mm_loadu_ps(&viewProj[j][0]);
+  }
+  for (unsigned int i = 0; i < count; i++) {
+    // column j of the product mixes the columns of viewProj by column j
+    // of the model
+    const glm::mat4 &m = this->models[i];
+    for (unsigned int j = 0; j < 4; j++) {
+      __m128 r = _mm_mul_ps(vp[0], _mm_set1_ps(m[j][0]));
+      r = _mm_add_ps(r, _mm_mul_ps(vp[1], _mm_set1_ps(m[j][1])));
+      r = _mm_add_ps(r, _mm_mul_ps(vp[2], _mm_set1_ps(m[j][2])));
+      r = _mm_add_ps(r, _mm_mul_ps(vp[3], _mm_set1_ps(m[j][3])));
+      _mm_storeu_ps(&this->mvps[i][j][0], r);
+    }
+  }
+  unsigned int i = 0;
+  for (; i + 4 <= count; i += 4) {
+    normalMatrices4_proc(&this->models[i], &this->normals[i]);
+  }
+  for (; i < count; i++) {
+    this->normals[i] = normalMatrix(this->models[i]);
+  }
+#else
+  for (unsigned int i = 0; i < count; i++) {
+    this->mvps[i] = viewProj * this->models[i];
+    this->normals[i] = normalMatrix(this->models[i]);
+  }
+#endif
+}
+
+bool sphereVisible(const glm::mat4 &mvp, float radius) {
+  // the planes are sums of the rows of mvp, already in object space so the
+  // origin distance is the plane offset
+  glm::vec4 x(mvp[0][0], mvp[1][0], mvp[2][0], mvp[3][0]);
+  glm::vec4 y(mvp[0][1], mvp[1][1], mvp[2][1], mvp[3][1]);
+  glm::vec4 z(mvp[0][2], mvp[1][2], mvp[2][2], mvp[3][2]);
+  glm::vec4 w(mvp[0][3], mvp[1][3], mvp[2][3], mvp[3][3]);
+  glm::vec4 planes[6] = {w + x, w - x, w + y, w - y, w + z, w - z};
+  for (unsigned int i = 0; i < 6; i++) {
+    glm::vec3 n(planes[i]);
+    if (planes[i].w < -radius * glm::length(n)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+#endif
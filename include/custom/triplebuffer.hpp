@@ -0,0 +1,58 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Lock free triple buffer between one producer and one consumer thread.
+// The producer fills its slot and publishes it, the consumer picks up the
+// latest published slot whenever it starts a frame. Neither side waits on
+// the other and a slot is never written while it is being read.
+
+#ifndef TRIPLEBUFFER_HPP
+#define TRIPLEBUFFER_HPP
+
+#include <atomic>
+
+template <typename T> class TripleBuffer {
+public:
+  TripleBuffer();
+
+  // producer side, the slot stays the producer's until publish
+  T &writeSlot() { return this->slots[this->writeIndex]; }
+  void publish();
+
+  // consumer side, true if a newer slot was published since the last call;
+  // readSlot stays valid and unchanged until the next acquire
+  bool acquire();
+  const T &readSlot() const { return this->slots[this->readIndex]; }
+
+private:
+  // set on the shared index while it holds a slot the consumer has not seen
+  static const unsigned int FRESH = 4;
+
+  T slots[3];
+  unsigned int writeIndex;
+  unsigned int readIndex;
+  std::atomic<unsigned int> shared;
+};
+
+template <typename T>
+TripleBuffer<T>::TripleBuffer() : writeIndex(0), readIndex(2), shared(1) {}
+
+template <typename T> void TripleBuffer<T>::publish() {
+  // release makes the slot contents visible before its index, acquire gets
+  // the slot the consumer gave back
+  unsigned int old = this->shared.exchange(this->writeIndex | FRESH,
+                                           std::memory_order_acq_rel);
+  this->writeIndex = old & 3;
+}
+
+template <typename T> bool TripleBuffer<T>::acquire() {
+  if ((this->shared.load(std::memory_order_relaxed) & FRESH) == 0) {
+    return false;
+  }
+  unsigned int old =
+      this->shared.exchange(this->readIndex, std::memory_order_acq_rel);
+  this->readIndex = old & 3;
+  return true;
+}
+
+#endif
@@ -0,0 +1,837 @@
+// author: Kaan Eraslan
+// license: see, LICENSE
+
+// Streaming virtual texture for the material maps. An offline bake cuts the
+// mip chain of every material into pages with a border and writes them to a
+// page file, the maps of a page side by side. At run time only a fixed
+// cache of pages lives on the gpu: one texture per map type holding the
+// pages in slots, and an indirection array with a texel per page and mip
+// telling where the best resident page for that spot is.
+// A low resolution feedback pass writes the page and mip every pixel wants,
+// it is read back through pixel buffers a few frames later. Missing pages
+// are read from the page file on a loader thread and uploaded a few per
+// frame into the least recently seen slot. The coarsest page of every
+// material is pinned so a lookup always finds something.
+// Pages are sampled without mips, the page borders only cover the bilinear
+// footprint.
+
+#ifndef VTEXTURE_HPP
+#define VTEXTURE_HPP
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <custom/assetimage.hpp>
+#include <custom/glstate.hpp>
+#include <custom/jobpool.hpp>
+#include <custom/material.hpp>
+#include <custom/shader.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+const uint32_t VT_FILE_MAGIC = 0x58545642; // "BVTX"
+const uint32_t VT_FILE_VERSION = 1;
+const unsigned int VT_PAGE_SIZE = 128;
+const unsigned int VT_PAGE_BORDER = 1;
+const unsigned int VT_PAGE_PADDED = VT_PAGE_SIZE + 2 * VT_PAGE_BORDER;
+// feedback is rendered at the framebuffer size divided by this
+const unsigned int VT_FEEDBACK_DIVISOR = 8;
+const unsigned int VT_FEEDBACK_FRAMES = 3;
+// page reads queued on the loader and page uploads per frame
+const unsigned int VT_MAX_LOADS = 16;
+const unsigned int VT_UPLOADS_PER_FRAME = 8;
+const uint32_t VT_NONE = 0xffffffffu;
+
+// page states
+const uint8_t VT_PAGE_ABSENT = 0;
+const uint8_t VT_PAGE_LOADING = 1;
+const uint8_t VT_PAGE_RESIDENT = 2;
+
+const char *VIRTUAL_TEXTURE_DEFINE = "#define VIRTUAL_TEXTURE\n";
+// cache samplers of simplepbr1.frag when VIRTUAL_TEXTURE is defined
+const char *VT_CACHE_UNIFORMS[MATERIAL_MAP_COUNT] = {
+    "albedoCache", "normalCache", "metallicCache", "aoCache",
+    "roughnessCache"};
+
+// start of the page file, the pages follow ordered by layer, mip, row and
+// column; a page is the padded maps in map type order, rgba8
+struct VtFileHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t layerSize;
+  uint32_t pageSize;
+  uint32_t border;
+  uint32_t mipCount; // down to a single page
+  uint32_t layerCount;
+  uint32_t mapCount;
+};
+
+uint32_t vtPagesAtMip(const VtFileHeader &h, uint32_t mip) {
+  return (h.layerSize / h.pageSize) >> mip;
+}
+uint32_t vtPagesPerLayer(const VtFileHeader &h) {
+  uint32_t count = 0;
+  for (uint32_t m = 0; m < h.mipCount; m++) {
+    count += vtPagesAtMip(h, m) * vtPagesAtMip(h, m);
+  }
+  return count;
+}
+uint32_t vtPageIndex(const VtFileHeader &h, uint32_t layer, uint32_t mip,
+                     uint32_t x, uint32_t y) {
+  uint32_t index = layer * vtPagesPerLayer(h);
+  for (uint32_t m = 0; m < mip; m++) {
+    index += vtPagesAtMip(h, m) * vtPagesAtMip(h, m);
+  }
+  return index + y * vtPagesAtMip(h, mip) + x;
+}
+size_t vtPageBytes(const VtFileHeader &h) {
+  size_t padded = h.pageSize + 2 * h.border;
+  return h.mapCount * padded * padded * 4;
+}
+
+// albedo is averaged in linear light when the mips are built
+float vtSrgbToLinear(float c) {
+  return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+float vtLinearToSrgb(float c) {
+  return c <= 0.0031308f ? c * 12.92f
+                         : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+}
+
+void vtDownsample_proc(const unsigned char *src, unsigned int size,
+                       unsigned char *dst, bool srgb) {
+  // 2x2 box filter, alpha is always linear
+  unsigned int half = size / 2;
+  for (unsigned int y = 0; y < half; y++) {
+    for (unsigned int x = 0; x < half; x++) {
+      const unsigned char *t[4] = {
+          src + ((2 * y) * size + 2 * x) * 4,
+          src + ((2 * y) * size + 2 * x + 1) * 4,
+          src + ((2 * y + 1) * size + 2 * x) * 4,
+          src + ((2 * y + 1) * size + 2 * x + 1) * 4};
+      for (unsigned int c = 0; c < 4; c++) {
+        float sum = 0.0f;
+        for (unsigned int i = 0; i < 4; i++) {
+          float v = t[i][c] / 255.0f;
+          sum += srgb && c < 3 ? vtSrgbToLinear(v) : v;
+        }
+        float avg = sum * 0.25f;
+        if (srgb && c < 3) {
+          avg = vtLinearToSrgb(avg);
+        }
+        dst[(y * half + x) * 4 + c] = (unsigned char)(avg * 255.0f + 0.5f);
+      }
+    }
+  }
+}
+
+void vtCopyPage_proc(const unsigned char *level, unsigned int size,
+                     unsigned int pageX, unsigned int pageY,
+                     unsigned char *dst) {
+  // the border wraps around like GL_REPEAT
+  int isize = (int)size;
+  for (unsigned int y = 0; y < VT_PAGE_PADDED; y++) {
+    int sy = (int)(pageY * VT_PAGE_SIZE + y) - (int)VT_PAGE_BORDER;
+    sy = ((sy % isize) + isize) % isize;
+    for (unsigned int x = 0; x < VT_PAGE_PADDED; x++) {
+      int sx = (int)(pageX * VT_PAGE_SIZE + x) - (int)VT_PAGE_BORDER;
+      sx = ((sx % isize) + isize) % isize;
+      std::memcpy(dst + (y * VT_PAGE_PADDED + x) * 4,
+                  level + ((size_t)sy * size + sx) * 4, 4);
+    }
+  }
+}
+
+// page file of the materials in the cache directory, named after the map
+// files, their modification times and the layer size
+std::filesystem::path
+virtualTexturePath(const std::filesystem::path &cacheDir,
+                   const std::vector<MaterialDesc> &descs,
+                   unsigned int layerSize) {
+  // fnv-1a, a changed map gives a new name and so a new bake
+  uint64_t hash = 1469598103934665603ull;
+  auto mix = [&hash](const void *bytes, size_t count) {
+    const unsigned char *b = (const unsigned char *)bytes;
+    for (size_t i = 0; i < count; i++) {
+      hash ^= b[i];
+      hash *= 1099511628211ull;
+    }
+  };
+  uint32_t key[2] = {VT_FILE_VERSION, layerSize};
+  mix(key, sizeof(key));
+  for (unsigned int d = 0; d < descs.size(); d++) {
+    for (unsigned int m = 0; m < MATERIAL_MAP_COUNT; m++) {
+      const std::string &path = descs[d].maps[m];
+      mix(path.data(), path.size() + 1);
+      std::error_code err;
+      auto time = std::filesystem::last_write_time(path, err);
+      if (!err) {
+        auto ticks = time.time_since_epoch().count();
+        mix(&ticks, sizeof(ticks));
+      }
+    }
+  }
+  char name[32];
+  std::snprintf(name, sizeof(name), "vt_%016llx.bin",
+                (unsigned long long)hash);
+  return cacheDir / name;
+}
+
+bool bakeVirtualTexture(const std::vector<MaterialDesc> &descs,
+                        unsigned int layerSize,
+                        const std::filesystem::path &pagePath,
+                        JobPool &pool) {
+  // layerSize has to be the page size times a power of two
+  unsigned int pages = layerSize / VT_PAGE_SIZE;
+  if (pages == 0 || layerSize % VT_PAGE_SIZE != 0 ||
+      (pages & (pages - 1)) != 0) {
+    std::cout << "virtual texture: layer size " << layerSize
+              << " is not a power of two multiple of " << VT_PAGE_SIZE
+              << std::endl;
+    return false;
+  }
+  if (descs.empty() || descs.size() >= 255) {
+    std::cout << "virtual texture: " << descs.size()
+              << " materials, between 1 and 254 are supported" << std::endl;
+    return false;
+  }
+  VtFileHeader h;
+  h.magic = VT_FILE_MAGIC;
+  h.version = VT_FILE_VERSION;
+  h.layerSize = layerSize;
+  h.pageSize = VT_PAGE_SIZE;
+  h.border = VT_PAGE_BORDER;
+  h.mipCount = 1;
+  while ((pages >> h.mipCount) > 0) {
+    h.mipCount++;
+  }
+  h.layerCount = (uint32_t)descs.size();
+  h.mapCount = MATERIAL_MAP_COUNT;
+
+  if (pagePath.has_parent_path()) {
+    std::filesystem::create_directories(pagePath.parent_path());
+  }
+  // written to a temporary file first like the ibl cache
+  std::filesystem::path tmpPath = pagePath;
+  tmpPath += ".tmp";
+  {
+    std::ofstream file(tmpPath, std::ios::binary);
+    file.write((const char *)&h, sizeof(h));
+    std::vector<unsigned char> page(vtPageBytes(h));
+    size_t mapBytes = page.size() / MATERIAL_MAP_COUNT;
+    // one material at a time, the whole set never sits in memory
+    for (unsigned int d = 0; d < descs.size(); d++) {
+      std::vector<std::vector<unsigned char>> levels[MATERIAL_MAP_COUNT];
+      pool.parallelFor(
+          MATERIAL_MAP_COUNT, 1, [&](unsigned int begin, unsigned int end) {
+            for (unsigned int m = begin; m < end; m++) {
+              const MaterialDesc &desc = descs[d];
+              std::vector<std::vector<unsigned char>> &chain = levels[m];
+              chain.resize(h.mipCount);
+              chain[0].resize((size_t)layerSize * layerSize * 4);
+              AssetImage image;
+              image.texels = NULL;
+              if (!desc.maps[m].empty() &&
+                  !loadAssetImage(desc.maps[m], 4, image)) {
+                std::cout << "Failed to load material map " << desc.maps[m]
+                          << std::endl;
+              }
+              const unsigned char *data = image.texels;
+              int width = image.width, height = image.height;
+              if (data == NULL) {
+                for (size_t i = 0; i < chain[0].size(); i += 4) {
+                  std::memcpy(&chain[0][i], MATERIAL_DEFAULT_TEXEL[m], 4);
+                }
+              } else if ((unsigned int)width == layerSize &&
+                         (unsigned int)height == layerSize) {
+                std::memcpy(chain[0].data(), data, chain[0].size());
+              } else {
+                resampleRgba8_proc(data, width, height, chain[0].data(),
+                                   layerSize);
+              }
+              freeAssetImage(image);
+              for (uint32_t mip = 1; mip < h.mipCount; mip++) {
+                unsigned int size = layerSize >> mip;
+                chain[mip].resize((size_t)size * size * 4);
+                vtDownsample_proc(chain[mip - 1].data(), size * 2,
+                                  chain[mip].data(), m == MATERIAL_ALBEDO);
+              }
+            }
+          });
+      for (uint32_t mip = 0; mip < h.mipCount; mip++) {
+        uint32_t n = vtPagesAtMip(h, mip);
+        for (uint32_t y = 0; y < n; y++) {
+          for (uint32_t x = 0; x < n; x++) {
+            for (unsigned int m = 0; m < MATERIAL_MAP_COUNT; m++) {
+              vtCopyPage_proc(levels[m][mip].data(), layerSize >> mip, x, y,
+                              &page[m * mapBytes]);
+            }
+            file.write((const char *)page.data(), page.size());
+          }
+        }
+      }
+    }
+    if (!file) {
+      std::cout << "Failed to write virtual texture: " << tmpPath
+                << std::endl;
+      return false;
+    }
+  }
+  std::filesystem::rename(tmpPath, pagePath);
+  std::cout << "virtual texture: baked " << h.layerCount * vtPagesPerLayer(h)
+            << " pages to " << pagePath << std::endl;
+  return true;
+}
+
+struct VtSlot {
+  uint32_t page; // VT_NONE when free
+  uint32_t lastUsed; // frame the feedback last asked for the page
+  bool pinned;
+};
+
+struct VtLoadedPage {
+  uint32_t page;
+  std::vector<unsigned char> texels; // empty if the read failed
+};
+
+struct VtFeedbackBuffer {
+  GLuint pbo;
+  GLsync fence;
+  GLsizei width;
+  GLsizei height;
+  size_t capacity;
+};
+
+class VirtualTexture {
+public:
+  // page cache, one texture per map type, and the page table
+  GLuint cache[MATERIAL_MAP_COUNT];
+  GLuint indirection;
+  // statistics since open
+  unsigned int requested;
+  unsigned int uploaded;
+  unsigned int evicted;
+  unsigned int dropped; // loaded but no slot was free to take it
+
+  // the cache holds cachePagesPerSide squared pages
+  VirtualTexture(unsigned int cachePagesPerSide);
+  // reads the header, creates the textures and uploads the pinned pages
+  bool open(const std::filesystem::path &pagePath);
+  unsigned int layers() const { return this->header.layerCount; }
+
+  // cache textures on firstUnit and the following units in map type order
+  void initSamplers(Shader &shader, unsigned int firstUnit,
+                    unsigned int indirectionUnit);
+  void initFeedback(Shader &shader);
+  void bind(unsigned int firstUnit, unsigned int indirectionUnit);
+  GLsizei feedbackSize(GLsizei size) const;
+  // inside the feedback pass after its draws, queues the read back of the
+  // bound target; skipped while every buffer is still in flight
+  void readFeedback(GLsizei width, GLsizei height);
+  // once per frame on the gl thread: reads the finished feedback, queues
+  // the missing pages, uploads the loaded ones and updates the page table
+  void update();
+
+  size_t residentBytes() const;
+  size_t assetBytes() const;
+  void report(std::ostream &out) const;
+  void destroy();
+
+private:
+  VtFileHeader header;
+  unsigned int cacheSide;
+  uint32_t pageCount;
+  uint32_t frame;
+  uint32_t feedbackStamp; // counts the feedback buffers processed
+  std::vector<VtSlot> slots;
+  // per page
+  std::vector<uint32_t> slotOf;
+  std::vector<uint8_t> state;
+  std::vector<uint8_t> mipOf;
+  std::vector<uint32_t> seen; // stamp of the last request, dedups feedback
+  std::vector<uint32_t> wanted;
+  // page table entries per mip, layer after layer: slot x, slot y, mip of
+  // the page in the slot, 255
+  std::vector<std::vector<unsigned char>> table;
+  std::vector<bool> dirty; // per layer
+  VtFeedbackBuffer feedback[VT_FEEDBACK_FRAMES];
+  unsigned int feedbackHead;
+  unsigned int feedbackCount;
+  unsigned int loadsInFlight;
+
+  std::ifstream file;
+  std::mutex fileMtx;
+  std::deque<VtLoadedPage> loaded;
+  std::vector<std::vector<unsigned char>> spare; // page buffers to reuse
+  std::mutex loadedMtx;
+  // declared last so it drains its jobs before the members above go away
+  JobPool loader;
+
+  bool readPage(uint32_t page, std::vector<unsigned char> &texels);
+  void setParams(Shader &shader);
+  void requestPage(uint32_t page);
+  void processFeedback(const unsigned char *pixels, GLsizei width,
+                       GLsizei height);
+  uint32_t pickSlot();
+  void uploadPage(uint32_t page, const std::vector<unsigned char> &texels,
+                  bool pinned);
+  void rebuildLayer(uint32_t layer);
+};
+
+VirtualTexture::VirtualTexture(unsigned int cachePagesPerSide)
+    : indirection(0), requested(0), uploaded(0), evicted(0), dropped(0),
+      cacheSide(cachePagesPerSide), pageCount(0), frame(0),
+      feedbackStamp(0), feedbackHead(0), feedbackCount(0), loadsInFlight(0),
+      loader(2) {
+  std::memset(&this->header, 0, sizeof(this->header));
+  for (unsigned int m = 0; m < MATERIAL_MAP_COUNT; m++) {
+    this->cache[m] = 0;
+  }
+  for (unsigned int i = 0; i < VT_FEEDBACK_FRAMES; i++) {
+    this->feedback[i].pbo = 0;
+    this->feedback[i].fence = 0;
+    this->feedback[i].width = 0;
+    this->feedback[i].height = 0;
+    this->feedback[i].capacity = 0;
+  }
+}
+
+bool VirtualTexture::open(const std::filesystem::path &pagePath) {
+  this->file.open(pagePath, std::ios::binary);
+  VtFileHeader &h = this->header;
+  this->file.read((char *)&h, sizeof(h));
+  if (!this->file || h.magic != VT_FILE_MAGIC ||
+      h.version != VT_FILE_VERSION || h.pageSize != VT_PAGE_SIZE ||
+      h.border != VT_PAGE_BORDER || h.mapCount != MATERIAL_MAP_COUNT) {
+    std::cout << "virtual texture: can not read page file " << pagePath
+              << std::endl;
+    // a partly read header would look open to setParams
+    std::memset(&h, 0, sizeof(h));
+    return false;
+  }
+  // slot coordinates go into the bytes of the page table
+  if (this->cacheSide > 255 ||
+      this->cacheSide * this->cacheSide <= h.layerCount) {
+    std::cout << "virtual texture: a cache of " << this->cacheSide << "x"
+              << this->cacheSide << " pages does not fit " << h.layerCount
+              << " materials" << std::endl;
+    std::memset(&h, 0, sizeof(h));
+    return false;
+  }
+  this->pageCount = h.layerCount * vtPagesPerLayer(h);
+  this->slots.assign(this->cacheSide * this->cacheSide, {VT_NONE, 0, false});
+  this->slotOf.assign(this->pageCount, VT_NONE);
+  this->state.assign(this->pageCount, VT_PAGE_ABSENT);
+  this->seen.assign(this->pageCount, VT_NONE);
+  this->mipOf.resize(this->pageCount);
+  for (uint32_t layer = 0; layer < h.layerCount; layer++) {
+    for (uint32_t mip = 0; mip < h.mipCount; mip++) {
+      uint32_t first = vtPageIndex(h, layer, mip, 0, 0);
+      uint32_t n = vtPagesAtMip(h, mip);
+      for (uint32_t i = 0; i < n * n; i++) {
+        this->mipOf[first + i] = (uint8_t)mip;
+      }
+    }
+  }
+
+  GLsizei cacheTexels = (GLsizei)(this->cacheSide * VT_PAGE_PADDED);
+  glGenTextures(MATERIAL_MAP_COUNT, this->cache);
+  for (unsigned int m = 0; m < MATERIAL_MAP_COUNT; m++) {
+    glState().bindTexture(0, GL_TEXTURE_2D, this->cache[m]);
+    // albedo pages are srgb encoded like the atlas
+    GLint internalFormat = m == MATERIAL_ALBEDO ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, cacheTexels, cacheTexels,
+                 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+  }
+  glGenTextures(1, &this->indirection);
+  glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, this->indirection);
+  this->table.resize(h.mipCount);
+  for (uint32_t mip = 0; mip < h.mipCount; mip++) {
+    GLsizei n = (GLsizei)vtPagesAtMip(h, mip);
+    this->table[mip].assign((size_t)n * n * h.layerCount * 4, 0);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, mip, GL_RGBA8UI, n, n, h.layerCount, 0,
+                 GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, NULL);
+  }
+  // integer textures are only complete with nearest filtering
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                  GL_NEAREST_MIPMAP_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, h.mipCount - 1);
+  this->dirty.assign(h.layerCount, true);
+
+  for (unsigned int i = 0; i < VT_FEEDBACK_FRAMES; i++) {
+    glGenBuffers(1, &this->feedback[i].pbo);
+  }
+  // the coarsest page of every layer stays resident
+  std::vector<unsigned char> texels;
+  for (uint32_t layer = 0; layer < h.layerCount; layer++) {
+    uint32_t page = vtPageIndex(h, layer, h.mipCount - 1, 0, 0);
+    if (!this->readPage(page, texels)) {
+      std::cout << "virtual texture: page file " << pagePath
+                << " is truncated" << std::endl;
+      return false;
+    }
+    this->uploadPage(page, texels, true);
+  }
+  for (uint32_t layer = 0; layer < h.layerCount; layer++) {
+    this->rebuildLayer(layer);
+  }
+  return true;
+}
+
+bool VirtualTexture::readPage(uint32_t page,
+                              std::vector<unsigned char> &texels) {
+  size_t bytes = vtPageBytes(this->header);
+  texels.resize(bytes);
+  std::unique_lock<std::mutex> lock(this->fileMtx);
+  this->file.clear();
+  this->file.seekg(sizeof(VtFileHeader) + (std::streamoff)page * bytes);
+  this->file.read((char *)texels.data(), bytes);
+  return (bool)this->file;
+}
+
+void VirtualTexture::setParams(Shader &shader) {
+  // nothing is open, the page counts below would divide by zero
+  if (this->header.pageSize == 0) {
+    return;
+  }
+  float cacheTexels = (float)(this->cacheSide * VT_PAGE_PADDED);
+  shader.setFloatUni("vtPages", (float)vtPagesAtMip(this->header, 0));
+  shader.setFloatUni("vtMaxMip", (float)(this->header.mipCount - 1));
+  shader.setFloatUni("vtPageTexels", (float)VT_PAGE_SIZE);
+  // padded page, border and page content over the cache size
+  shader.setVec3Uni("vtCache", VT_PAGE_PADDED / cacheTexels,
+                    VT_PAGE_BORDER / cacheTexels,
+                    VT_PAGE_SIZE / cacheTexels);
+  shader.setFloatUni("vtLodBias", 0.0f);
+}
+
+void VirtualTexture::initSamplers(Shader &shader, unsigned int firstUnit,
+                                  unsigned int indirectionUnit) {
+  shader.useProgram();
+  for (unsigned int m = 0; m < MATERIAL_MAP_COUNT; m++) {
+    shader.setIntUni(VT_CACHE_UNIFORMS[m], firstUnit + m);
+  }
+  shader.setIntUni("vtIndirection", indirectionUnit);
+  this->setParams(shader);
+}
+
+void VirtualTexture::initFeedback(Shader &shader) {
+  shader.useProgram();
+  this->setParams(shader);
+}
+
+void VirtualTexture::bind(unsigned int firstUnit,
+                          unsigned int indirectionUnit) {
+  for (unsigned int m = 0; m < MATERIAL_MAP_COUNT; m++) {
+    glState().bindTexture(firstUnit + m, GL_TEXTURE_2D, this->cache[m]);
+  }
+  glState().bindTexture(indirectionUnit, GL_TEXTURE_2D_ARRAY,
+                        this->indirection);
+}
+
+GLsizei VirtualTexture::feedbackSize(GLsizei size) const {
+  GLsizei s = size / (GLsizei)VT_FEEDBACK_DIVISOR;
+  return s < 1 ? 1 : s;
+}
+
+void VirtualTexture::readFeedback(GLsizei width, GLsizei height) {
+  if (this->feedbackCount == VT_FEEDBACK_FRAMES) {
+    return;
+  }
+  unsigned int slot =
+      (this->feedbackHead + this->feedbackCount) % VT_FEEDBACK_FRAMES;
+  VtFeedbackBuffer &fb = this->feedback[slot];
+  size_t bytes = (size_t)width * height * 4;
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, fb.pbo);
+  if (fb.capacity < bytes) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+    fb.capacity = bytes;
+  }
+  glReadBuffer(GL_COLOR_ATTACHMENT0);
+  // lands in the buffer, nothing waits for the gpu here
+  glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  fb.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  fb.width = width;
+  fb.height = height;
+  this->feedbackCount++;
+}
+
+void VirtualTexture::processFeedback(const unsigned char *pixels,
+                                     GLsizei width, GLsizei height) {
+  const VtFileHeader &h = this->header;
+  this->wanted.clear();
+  this->feedbackStamp++;
+  size_t count = (size_t)width * height;
+  for (size_t i = 0; i < count; i++) {
+    const unsigned char *px = pixels + i * 4;
+    // cleared pixels carry 255 as layer
+    uint32_t layer = px[3], mip = px[2], x = px[0], y = px[1];
+    if (layer >= h.layerCount || mip >= h.mipCount) {
+      continue;
+    }
+    uint32_t n = vtPagesAtMip(h, mip);
+    if (x >= n || y >= n) {
+      continue;
+    }
+    uint32_t page = vtPageIndex(h, layer, mip, x, y);
+    if (this->seen[page] == this->feedbackStamp) {
+      continue;
+    }
+    this->seen[page] = this->feedbackStamp;
+    if (this->state[page] == VT_PAGE_ABSENT) {
+      this->wanted.push_back(page);
+    }
+    // the page drawn in its place, itself or a coarser one, stays cached
+    for (uint32_t m = mip; m < h.mipCount; m++) {
+      uint32_t p = vtPageIndex(h, layer, m, x >> (m - mip), y >> (m - mip));
+      if (this->slotOf[p] != VT_NONE) {
+        this->slots[this->slotOf[p]].lastUsed = this->frame;
+        break;
+      }
+    }
+  }
+  // coarse pages first, they cover the most pixels
+  std::stable_sort(this->wanted.begin(), this->wanted.end(),
+                   [this](uint32_t a, uint32_t b) {
+                     return this->mipOf[a] > this->mipOf[b];
+                   });
+}
+
+void VirtualTexture::requestPage(uint32_t page) {
+  this->state[page] = VT_PAGE_LOADING;
+  this->loadsInFlight++;
+  this->requested++;
+  this->loader.submit([this, page]() {
+    VtLoadedPage result;
+    result.page = page;
+    {
+      std::unique_lock<std::mutex> lock(this->loadedMtx);
+      if (!this->spare.empty()) {
+        result.texels.swap(this->spare.back());
+        this->spare.pop_back();
+      }
+    }
+    if (!this->readPage(page, result.texels)) {
+      result.texels.clear();
+    }
+    std::unique_lock<std::mutex> lock(this->loadedMtx);
+    this->loaded.push_back(std::move(result));
+  });
+}
+
+uint32_t VirtualTexture::pickSlot() {
+  // a free slot, else the one seen least recently; pages the last feedback
+  // asked for are never evicted, the new page is dropped instead
+  uint32_t best = VT_NONE;
+  for (uint32_t s = 0; s < this->slots.size(); s++) {
+    const VtSlot &slot = this->slots[s];
+    if (slot.page == VT_NONE) {
+      return s;
+    }
+    if (slot.pinned || slot.lastUsed == this->frame) {
+      continue;
+    }
+    if (best == VT_NONE || slot.lastUsed < this->slots[best].lastUsed) {
+      best = s;
+    }
+  }
+  return best;
+}
+
+void VirtualTexture::uploadPage(uint32_t page,
+                                const std::vector<unsigned char> &texels,
+                                bool pinned) {
+  uint32_t s = this->pickSlot();
+  if (s == VT_NONE) {
+    this->state[page] = VT_PAGE_ABSENT;
+    this->dropped++;
+    return;
+  }
+  VtSlot &slot = this->slots[s];
+  uint32_t perLayer = vtPagesPerLayer(this->header);
+  if (slot.page != VT_NONE) {
+    this->slotOf[slot.page] = VT_NONE;
+    this->state[slot.page] = VT_PAGE_ABSENT;
+    this->dirty[slot.page / perLayer] = true;
+    this->evicted++;
+  }
+  GLint x = (GLint)((s % this->cacheSide) * VT_PAGE_PADDED);
+  GLint y = (GLint)((s / this->cacheSide) * VT_PAGE_PADDED);
+  size_t mapBytes = texels.size() / MATERIAL_MAP_COUNT;
+  for (unsigned int m = 0; m < MATERIAL_MAP_COUNT; m++) {
+    glState().bindTexture(0, GL_TEXTURE_2D, this->cache[m]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, VT_PAGE_PADDED, VT_PAGE_PADDED,
+                    GL_RGBA, GL_UNSIGNED_BYTE, &texels[m * mapBytes]);
+  }
+  slot.page = page;
+  slot.lastUsed = this->frame;
+  slot.pinned = pinned;
+  this->slotOf[page] = s;
+  this->state[page] = VT_PAGE_RESIDENT;
+  this->dirty[page / perLayer] = true;
+  this->uploaded++;
+}
+
+void VirtualTexture::rebuildLayer(uint32_t layer) {
+  const VtFileHeader &h = this->header;
+  glState().bindTexture(0, GL_TEXTURE_2D_ARRAY, this->indirection);
+  // coarse to fine, a missing page takes the entry of its parent
+  for (int mip = (int)h.mipCount - 1; mip >= 0; mip--) {
+    uint32_t n = vtPagesAtMip(h, mip);
+    unsigned char *entries = &this->table[mip][(size_t)layer * n * n * 4];
+    for (uint32_t y = 0; y < n; y++) {
+      for (uint32_t x = 0; x < n; x++) {
+        unsigned char *e = entries + (y * n + x) * 4;
+        uint32_t s = this->slotOf[vtPageIndex(h, layer, mip, x, y)];
+        if (s != VT_NONE) {
+          e[0] = (unsigned char)(s % this->cacheSide);
+          e[1] = (unsigned char)(s / this->cacheSide);
+          e[2] = (unsigned char)mip;
+          e[3] = 255;
+        } else if (mip + 1 < (int)h.mipCount) {
+          uint32_t pn = n / 2;
+          const unsigned char *parent =
+              &this->table[mip + 1][((size_t)layer * pn * pn +
+                                     (y / 2) * pn + x / 2) *
+                                    4];
+          std::memcpy(e, parent, 4);
+        }
+      }
+    }
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, mip, 0, 0, layer, n, n, 1,
+                    GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, entries);
+  }
+  this->dirty[layer] = false;
+}
+
+void VirtualTexture::update() {
+  this->frame++;
+  // the oldest feedback first, each one replaces the wanted list
+  while (this->feedbackCount > 0) {
+    VtFeedbackBuffer &fb = this->feedback[this->feedbackHead];
+    GLenum status = glClientWaitSync(fb.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      break;
+    }
+    glDeleteSync(fb.fence);
+    fb.fence = 0;
+    size_t bytes = (size_t)fb.width * fb.height * 4;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, fb.pbo);
+    const unsigned char *pixels = (const unsigned char *)glMapBufferRange(
+        GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+    if (pixels != NULL) {
+      this->processFeedback(pixels, fb.width, fb.height);
+      glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    this->feedbackHead = (this->feedbackHead + 1) % VT_FEEDBACK_FRAMES;
+    this->feedbackCount--;
+  }
+
+  // pages left over wait for the next feedback to ask again
+  unsigned int issued = 0;
+  while (issued < this->wanted.size() &&
+         this->loadsInFlight < VT_MAX_LOADS) {
+    uint32_t page = this->wanted[issued++];
+    if (this->state[page] == VT_PAGE_ABSENT) {
+      this->requestPage(page);
+    }
+  }
+  this->wanted.erase(this->wanted.begin(), this->wanted.begin() + issued);
+
+  std::vector<VtLoadedPage> ready;
+  {
+    std::unique_lock<std::mutex> lock(this->loadedMtx);
+    while (!this->loaded.empty() && ready.size() < VT_UPLOADS_PER_FRAME) {
+      ready.push_back(std::move(this->loaded.front()));
+      this->loaded.pop_front();
+    }
+  }
+  for (unsigned int i = 0; i < ready.size(); i++) {
+    this->loadsInFlight--;
+    if (ready[i].texels.empty()) {
+      this->state[ready[i].page] = VT_PAGE_ABSENT;
+      continue;
+    }
+    this->uploadPage(ready[i].page, ready[i].texels, false);
+  }
+  if (!ready.empty()) {
+    std::unique_lock<std::mutex> lock(this->loadedMtx);
+    for (unsigned int i = 0; i < ready.size(); i++) {
+      this->spare.push_back(std::move(ready[i].texels));
+    }
+  }
+
+  for (uint32_t layer = 0; layer < this->header.layerCount; layer++) {
+    if (this->dirty[layer]) {
+      this->rebuildLayer(layer);
+    }
+  }
+}
+
+size_t VirtualTexture::residentBytes() const {
+  size_t cacheTexels = this->cacheSide * VT_PAGE_PADDED;
+  size_t bytes = cacheTexels * cacheTexels * 4 * MATERIAL_MAP_COUNT;
+  for (unsigned int mip = 0; mip < this->table.size(); mip++) {
+    bytes += this->table[mip].size();
+  }
+  return bytes;
+}
+
+size_t VirtualTexture::assetBytes() const {
+  return (size_t)this->pageCount * VT_PAGE_SIZE * VT_PAGE_SIZE * 4 *
+         MATERIAL_MAP_COUNT;
+}
+
+void VirtualTexture::report(std::ostream &out) const {
+  unsigned int resident = 0;
+  for (unsigned int s = 0; s < this->slots.size(); s++) {
+    if (this->slots[s].page != VT_NONE) {
+      resident++;
+    }
+  }
+  out << "virtual texture: " << resident << " of " << this->slots.size()
+      << " cache pages resident, " << this->requested << " requested, "
+      << this->uploaded << " uploaded, " << this->evicted << " evicted, "
+      << this->dropped << " dropped; " << this->residentBytes()
+      << " bytes on the gpu for " << this->assetBytes()
+      << " bytes of pages" << std::endl;
+}
+
+void VirtualTexture::destroy() {
+  for (unsigned int m = 0; m < MATERIAL_MAP_COUNT; m++) {
+    glState().deleteTexture(this->cache[m]);
+    this->cache[m] = 0;
+  }
+  glState().deleteTexture(this->indirection);
+  this->indirection = 0;
+  for (unsigned int i = 0; i < VT_FEEDBACK_FRAMES; i++) {
+    if (this->feedback[i].fence != 0) {
+      glDeleteSync(this->feedback[i].fence);
+      this->feedback[i].fence = 0;
+    }
+    glDeleteBuffers(1, &this->feedback[i].pbo);
+    this->feedback[i].pbo = 0;
+  }
+  this->feedbackCount = 0;
+}
+
+#endif
@@ -0,0 +1,105 @@
+/*
+   World matrix propagation of a large transform hierarchy, everything
+   changed and a few animated subtrees changed
+ */
+// license: see, LICENSE
+#include <custom/hierarchy.hpp>
+#include <custom/jobpool.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <vector>
+
+void buildHierarchy_proc(TransformHierarchy &nodes, unsigned int count,
+                         unsigned int branching) {
+  // a full tree added depth first, like the node tree of a model, so the
+  // first update sorts it
+  std::mt19937 rng(7);
+  std::uniform_real_distribution<float> offset(-1.0f, 1.0f);
+  std::vector<unsigned int> stack;
+  std::vector<unsigned int> children;
+  stack.push_back(HIERARCHY_ROOT);
+  children.push_back(0);
+  while (nodes.size() < count && !stack.empty()) {
+    if (children.back() == branching) {
+      stack.pop_back();
+      children.pop_back();
+      continue;
+    }
+    children.back()++;
+    glm::vec3 position(offset(rng), offset(rng), offset(rng));
+    glm::quat rotation = glm::angleAxis(offset(rng), glm::vec3(0, 1, 0));
+    unsigned int node =
+        nodes.add(stack.back(), position, rotation, glm::vec3(1.0f));
+    // keep the tree shallow enough for the stack
+    if (stack.size() < 12) {
+      stack.push_back(node);
+      children.push_back(0);
+    }
+  }
+}
+
+template <class Fn> double averageMs_proc(unsigned int rounds, Fn fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned int i = 0; i < rounds; i++) {
+    fn(i);
+  }
+  std::chrono::duration<double, std::milli> took =
+      std::chrono::steady_clock::now() - start;
+  return took.count() / rounds;
+}
+
+int main(int argc, char *argv[]) {
+  // usage: hierarchyBench.out [nodes] [animated nodes]
+  unsigned int count = 100000;
+  unsigned int animated = 64;
+  if (argc > 1) {
+    count = (unsigned int)std::atoi(argv[1]);
+  }
+  if (argc > 2) {
+    animated = (unsigned int)std::atoi(argv[2]);
+  }
+  TransformHierarchy nodes;
+  buildHierarchy_proc(nodes, count, 4);
+  count = nodes.size();
+  JobPool pool;
+  nodes.update(pool);
+  std::cout << count << " nodes, " << pool.size() << " threads" << std::endl;
+
+  const unsigned int rounds = 200;
+  std::mt19937 rng(11);
+  std::vector<unsigned int> movers(animated);
+  for (unsigned int i = 0; i < animated; i++) {
+    movers[i] = rng() % count;
+  }
+  auto touchAll = [&](unsigned int round) {
+    for (unsigned int i = 0; i < count; i++) {
+      nodes.setRotation(i, glm::angleAxis(0.01f * round, glm::vec3(0, 1, 0)));
+    }
+  };
+  double touch = averageMs_proc(rounds, touchAll);
+  double serial = averageMs_proc(rounds, [&](unsigned int round) {
+    touchAll(round);
+    nodes.update();
+  });
+  double parallel = averageMs_proc(rounds, [&](unsigned int round) {
+    touchAll(round);
+    nodes.update(pool);
+  });
+  double subtrees = averageMs_proc(rounds, [&](unsigned int round) {
+    for (unsigned int i = 0; i < animated; i++) {
+      nodes.setRotation(movers[i],
+                        glm::angleAxis(0.01f * round, glm::vec3(0, 1, 0)));
+    }
+    nodes.update(pool);
+  });
+  std::cout << "every node changed, serial:   " << serial - touch << " ms"
+            << std::endl;
+  std::cout << "every node changed, parallel: " << parallel - touch << " ms"
+            << std::endl;
+  std::cout << animated << " animated subtrees:       " << subtrees << " ms"
+            << std::endl;
+  return 0;
+}
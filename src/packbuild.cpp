@@ -0,0 +1,94 @@
+/*
+   Offline build of the asset pack the demos map instead of reading the
+   media directory file by file
+ */
+// license: see, LICENSE
+#define STB_IMAGE_IMPLEMENTATION
+#include <custom/stb_image.h>
+#include <custom/assetpack.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+bool isCookedImage(const fs::path &path) {
+  std::string ext = path.extension().string();
+  std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+  return ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".tga" ||
+         ext == ".bmp";
+}
+
+int main(int argc, char *argv[]) {
+  // usage: packBuild.out [-lz4] <media dir> <pack file>
+  // images are cooked to texels, everything else is stored as it is; the
+  // cache directory and the pack itself are left out
+  bool compress = argc == 4 && std::string(argv[1]) == "-lz4";
+  if (argc != 3 && !compress) {
+    std::cout << "usage: packBuild.out [-lz4] <media dir> <pack file>"
+              << std::endl;
+    return 1;
+  }
+  fs::path mediaDir = argv[argc - 2];
+  fs::path packPath = argv[argc - 1];
+  std::vector<fs::path> files;
+  for (fs::recursive_directory_iterator it(mediaDir), end; it != end; ++it) {
+    if (it->is_directory() && it->path().filename() == "cache") {
+      it.disable_recursion_pending();
+      continue;
+    }
+    fs::path name = it->path().filename();
+    if (!it->is_regular_file() || name == packPath.filename() ||
+        name == packPath.filename().string() + ".tmp") {
+      continue;
+    }
+    files.push_back(it->path());
+  }
+  // same media, same pack
+  std::sort(files.begin(), files.end());
+
+  AssetPackWriter writer;
+  size_t rawBytes = 0;
+  for (unsigned int i = 0; i < files.size(); i++) {
+    std::string name = files[i].lexically_relative(mediaDir).generic_string();
+    int width, height, nbChannels;
+    unsigned char *data = NULL;
+    if (isCookedImage(files[i])) {
+      data = stbi_load(files[i].c_str(), &width, &height, &nbChannels, 0);
+      if (data == NULL) {
+        std::cout << "can not decode " << files[i] << ", stored as is"
+                  << std::endl;
+      }
+    }
+    std::vector<unsigned char> bytes;
+    uint32_t flags = 0;
+    if (data != NULL) {
+      AssetTextureHeader info = {(uint32_t)width, (uint32_t)height,
+                                 (uint32_t)nbChannels, 0};
+      size_t texelBytes = (size_t)width * height * nbChannels;
+      bytes.resize(sizeof(info) + texelBytes);
+      std::memcpy(bytes.data(), &info, sizeof(info));
+      std::memcpy(bytes.data() + sizeof(info), data, texelBytes);
+      stbi_image_free(data);
+      flags = ASSET_ENTRY_TEXTURE;
+    } else {
+      std::ifstream file(files[i], std::ios::binary);
+      bytes.assign(std::istreambuf_iterator<char>(file),
+                   std::istreambuf_iterator<char>());
+    }
+    rawBytes += bytes.size();
+    writer.add(name, bytes.data(), bytes.size(), flags, compress);
+  }
+  if (!writer.write(packPath)) {
+    return 1;
+  }
+  std::cout << writer.count() << " files, " << rawBytes / 1024
+            << " kb unpacked, " << fs::file_size(packPath) / 1024
+            << " kb in " << packPath << std::endl;
+  return 0;
+}
@@ -0,0 +1,87 @@
+/*
+   Throughput and accuracy of the brdf packet kernels against the scalar
+   version of simplepbr.frag
+ */
+// license: see, LICENSE
+#include <custom/brdfpacket.hpp>
+#include <custom/jobpool.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+double benchmarkBrdf_proc(BrdfPacket &packet, unsigned int model,
+                          BrdfIsa isa, double seconds) {
+  // single thread samples per second, repeats until the time is used up
+  unsigned int rounds = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> took(0.0);
+  while (took.count() < seconds) {
+    brdfEvaluatePacket(packet, model, 0, packet.count, isa);
+    rounds++;
+    took = std::chrono::steady_clock::now() - start;
+  }
+  return (double)rounds * packet.count / took.count();
+}
+
+double benchmarkBrdfParallel_proc(BrdfPacket &packet, unsigned int model,
+                                  BrdfIsa isa, JobPool &pool,
+                                  double seconds) {
+  unsigned int grain = BRDF_PACKET_PAD * 256;
+  unsigned int rounds = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> took(0.0);
+  while (took.count() < seconds) {
+    pool.parallelFor(packet.count, grain,
+                     [&](unsigned int begin, unsigned int end) {
+                       brdfEvaluatePacket(packet, model, begin, end, isa);
+                     });
+    rounds++;
+    took = std::chrono::steady_clock::now() - start;
+  }
+  return (double)rounds * packet.count / took.count();
+}
+
+int main(int argc, char *argv[]) {
+  // usage: brdfBench.out [samples] [seconds per measurement]
+  unsigned int samples = 1 << 16;
+  double seconds = 0.5;
+  if (argc > 1) {
+    samples = (unsigned int)std::atoi(argv[1]);
+  }
+  if (argc > 2) {
+    seconds = std::atof(argv[2]);
+  }
+  BrdfPacket packet;
+  brdfRandomPacket(packet, samples, 1);
+  BrdfIsa best = brdfDetectIsa();
+  std::cout << "cpu supports up to " << brdfIsaName(best) << ", " << samples
+            << " samples" << std::endl;
+
+  std::cout << "accuracy against the scalar reference" << std::endl;
+  for (unsigned int isa = BRDF_ISA_SSE2; isa <= (unsigned int)best; isa++) {
+    reportBrdfPacketAccuracy(packet, (BrdfIsa)isa, std::cout);
+  }
+
+  JobPool pool;
+  const char *modelNames[] = {"beckmann", "beckmann aniso", "trowreitz",
+                              "trowreitz aniso"};
+  std::cout << "throughput, million samples per second per core ("
+            << pool.size() << " threads)" << std::endl;
+  for (unsigned int model = 0; model < 4; model++) {
+    std::cout << "  " << modelNames[model] << std::endl;
+    double scalar = 0.0;
+    for (unsigned int isa = BRDF_ISA_SCALAR; isa <= (unsigned int)best;
+         isa++) {
+      double single =
+          benchmarkBrdf_proc(packet, model, (BrdfIsa)isa, seconds);
+      double all = benchmarkBrdfParallel_proc(packet, model, (BrdfIsa)isa,
+                                              pool, seconds);
+      scalar = isa == BRDF_ISA_SCALAR ? single : scalar;
+      std::cout << "    " << brdfIsaName(isa) << "  one thread "
+                << single * 1e-6 << "  all threads " << all * 1e-6 / pool.size()
+                << "  speedup " << single / scalar << "x" << std::endl;
+    }
+  }
+  return 0;
+}
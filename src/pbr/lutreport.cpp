@@ -0,0 +1,23 @@
+/*
+   Accuracy report of the lambda lookup table used by the pbr shaders
+   against the analytic functions
+ */
+// license: see, LICENSE
+#include <custom/lut.hpp>
+
+#include <cstdlib>
+#include <iostream>
+
+int main(int argc, char *argv[]) {
+  // usage: lutReport.out [samples per axis]
+  unsigned int samples = 1024;
+  if (argc > 1) {
+    samples = (unsigned int)std::atoi(argv[1]);
+  }
+  unsigned int sizes[] = {16, 32, 64, 128, 256};
+  for (unsigned int i = 0; i < 5; i++) {
+    LambdaLut lut = bakeLambdaLut(sizes[i]);
+    reportLambdaLutAccuracy(lut, samples, std::cout);
+  }
+  return 0;
+}
@@ -0,0 +1,93 @@
+/*
+   Cpu reference render of the simple pbr scene
+ */
+// license: see, LICENSE
+#define STB_IMAGE_IMPLEMENTATION
+#include <custom/stb_image.h>
+
+#include <custom/pathtracer.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+fs::path current_dir = fs::current_path();
+fs::path textureDirPath = current_dir / "media" / "textures";
+
+const unsigned int WINWIDTH = 800;
+const unsigned int WINHEIGHT = 600;
+
+glm::vec3 lightPos = glm::vec3(0.2f, 1.0f, 0.5f);
+
+int main(int argc, char *argv[]) {
+  // usage: pathTracer.out [output.hdr] [samples per pixel] [ndf 0-3]
+  //                       [camera distance]
+  std::string outPath = "reference.hdr";
+  PtSettings settings;
+  settings.width = WINWIDTH;
+  settings.height = WINHEIGHT;
+  unsigned int ndf = BRDF_BECKMANN;
+  float cameraDistance = 2.0f;
+  if (argc > 1) {
+    outPath = argv[1];
+  }
+  if (argc > 2) {
+    settings.samplesPerPixel = (unsigned int)std::atoi(argv[2]);
+  }
+  if (argc > 3) {
+    ndf = (unsigned int)std::atoi(argv[3]) % 4;
+  }
+  if (argc > 4) {
+    cameraDistance = (float)std::atof(argv[4]);
+  }
+
+  // same cube, maps and light as simplepbr.cpp
+  PtScene scene;
+  PtMaterial cliff;
+  cliff.model = ndf;
+  cliff.albedoMap.load((textureDirPath / "layered-cliff-albedo.png").c_str(),
+                       true);
+  cliff.normalMap.load(
+      (textureDirPath / "layered-cliff-normal-ogl.png").c_str(), false);
+  cliff.metallicMap.load(
+      (textureDirPath / "layered-cliff-metallic.png").c_str(), false);
+  cliff.roughnessMap.load(
+      (textureDirPath / "layered-cliff-roughness.png").c_str(), false);
+  scene.materials.push_back(cliff);
+  scene.addCube(glm::mat4(1.0f), 0);
+  scene.lights.push_back(
+      PointLight(lightPos, glm::vec3(1.0f), glm::vec3(1.0f)));
+  // the clear color of the demo stands in for the sky without an environment
+  scene.background = glm::vec3(0.0f, 0.1f, 0.2f);
+  fs::path envPath = textureDirPath / "environment.hdr";
+  if (fs::exists(envPath)) {
+    scene.hasEnvironment = scene.environment.load(envPath.c_str());
+  }
+  scene.commit();
+
+  // looks down at the cube so the lit top face is in view
+  Camera camera(glm::vec3(0.0f, 0.5f * cameraDistance, cameraDistance),
+                glm::vec3(0.0f, 1.0f, 0.0f), YAW, -26.5f);
+  PtCamera ptCamera(camera, (float)settings.width / (float)settings.height);
+
+  JobPool pool;
+  std::cout << "rendering " << settings.width << "x" << settings.height
+            << " at " << settings.samplesPerPixel << " spp on " << pool.size()
+            << " threads" << std::endl;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<float> image;
+  renderPathTraced(scene, ptCamera, settings, pool, image);
+  std::chrono::duration<double> took = std::chrono::steady_clock::now() - start;
+  std::cout << "done in " << took.count() << " s" << std::endl;
+
+  if (!writeHdrImage(outPath.c_str(), settings.width, settings.height,
+                     image)) {
+    return -1;
+  }
+  std::cout << "wrote " << outPath << std::endl;
+  return 0;
+}
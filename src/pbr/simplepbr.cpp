@@ -5,14 +5,30 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include <custom/assetpack.hpp>
 #include <custom/camera.hpp>
+#include <custom/dynres.hpp>
+#include <custom/exposure.hpp>
+#include <custom/framegraph.hpp>
+#include <custom/glresources.hpp>
+#include <custom/glstate.hpp>
 #include <custom/shader.hpp>
+#include <custom/shadow.hpp>
+#include <custom/tangent.hpp>
+#include <custom/trace.hpp>
+#include <custom/transform.hpp>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 #include <string>
+#include <vector>
 #define STB_IMAGE_IMPLEMENTATION
 #include <custom/stb_image.h>
+#include <custom/ibl.hpp>
+#include <custom/lut.hpp>
+#include <custom/material.hpp>
+#include <custom/vtexture.hpp>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
@@ -22,11 +38,19 @@ namespace fs = std::filesystem;
 fs::path current_dir = fs::current_path();
 fs::path shaderDirPath = current_dir / "media" / "shaders";
 fs::path textureDirPath = current_dir / "media" / "textures";
+fs::path cacheDirPath = current_dir / "media" / "cache";
+fs::path assetPackPath = current_dir / "media" / "assets.pack";
+fs::path tracePath = current_dir / "trace.json";
 
 // initialization code
 
 const unsigned int WINWIDTH = 800;
 const unsigned int WINHEIGHT = 600;
+// gpu milliseconds the scene pass may take, the render scale follows it
+const double SCENE_GPU_BUDGET_MS = 12.0;
+// material pages kept on the gpu per side of the virtual texture cache, the
+// material maps stream through it instead of being loaded whole
+const unsigned int VT_CACHE_PAGES = 10;
 
 // camera related
 
@@ -41,6 +65,14 @@ float lastTime = 0.0f;
 
 bool inTangent = false;
 
+// cube with its qtangents, built once before the render loop
+TangentMesh cubeMesh;
+GLuint lampVao = 0;
+GLuint lampVbo = 0;
+
+// sample baked lambda/alpha tables instead of evaluating them per light
+bool useLambdaLut = true;
+
 glm::vec3 lightPos = glm::vec3(0.2f, 1.0f, 0.5f);
 // function declarations
 
@@ -49,13 +81,22 @@ void initializeGLFWMajorMinor(unsigned int maj, unsigned int min);
 void framebuffer_size_callback(GLFWwindow *window, int newWidth, int newHeight);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void mouse_scroll_callback(GLFWwindow *window, double xpos, double ypos);
-GLuint loadTexture2d_proc(const char *texturePath, GLuint tex);
 void processInput_proc(GLFWwindow *window);
-void cubeShaderInit_proc(Shader myShader);
 void renderCube();
+void uploadLamp_proc();
 void renderLamp();
 
-int main() {
+int main(int argc, char *argv[]) {
+  // usage: pbr.out [page file]
+  // a page file from vtBake.out, made from the cliff and rustediron2 maps
+  // in that order, replaces the one baked into the cache directory
+  // loading and every frame on a timeline, written to tracePath at exit
+  TRACE_START();
+  TRACE_THREAD("main");
+  // the packed media when packBuild.out made one, the files otherwise
+  if (assetPack().open(assetPackPath, current_dir / "media")) {
+    std::cout << "media is read from " << assetPackPath << std::endl;
+  }
   initializeGLFWMajorMinor(4, 2);
   GLFWwindow *window = glfwCreateWindow(WINWIDTH, WINHEIGHT,
                                         "Simple PBR With Texture", NULL, NULL);
@@ -82,6 +123,8 @@ int main() {
     glfwTerminate();
     return -1;
   }
+  // every gl object from here on is accounted for
+  glResources().install();
 
   // set default view port
   glViewport(0, 0, WINWIDTH, WINHEIGHT);
@@ -105,31 +148,57 @@ int main() {
   // layered-cliff-preview.jpg
   // layered-cliff-roughness.png
 
-  fs::path diffmapPath = textureDirPath / "layered-cliff-albedo.png";
-  fs::path nmapPath = textureDirPath / "layered-cliff-normal-ogl.png";
-  fs::path mmapPath = textureDirPath / "layered-cliff-metallic.png";
-  fs::path aomapPath = textureDirPath / "layered-cliff-ao.png";
-  fs::path romapPath = textureDirPath / "layered-cliff-roughness.png";
-
-  GLuint albedoMap;
-  glGenTextures(1, &albedoMap);
-  loadTexture2d_proc(diffmapPath.c_str(), albedoMap);
-
-  GLuint normalMap;
-  glGenTextures(1, &normalMap);
-  loadTexture2d_proc(nmapPath.c_str(), normalMap);
-
-  GLuint metallicMap;
-  glGenTextures(1, &metallicMap);
-  loadTexture2d_proc(mmapPath.c_str(), metallicMap);
-
-  GLuint aoMap;
-  glGenTextures(1, &aoMap);
-  loadTexture2d_proc(aomapPath.c_str(), aoMap);
-
-  GLuint roMap;
-  glGenTextures(1, &roMap);
-  loadTexture2d_proc(romapPath.c_str(), aoMap);
+  // both materials share the texture arrays or the virtual texture, a layer
+  // per material
+  MaterialDesc cliff;
+  cliff.maps[MATERIAL_ALBEDO] = textureDirPath / "layered-cliff-albedo.png";
+  cliff.maps[MATERIAL_NORMAL] =
+      textureDirPath / "layered-cliff-normal-ogl.png";
+  cliff.maps[MATERIAL_METALLIC] =
+      textureDirPath / "layered-cliff-metallic.png";
+  cliff.maps[MATERIAL_AO] = textureDirPath / "layered-cliff-ao.png";
+  cliff.maps[MATERIAL_ROUGHNESS] =
+      textureDirPath / "layered-cliff-roughness.png";
+  MaterialDesc rustedIron;
+  rustedIron.maps[MATERIAL_ALBEDO] =
+      textureDirPath / "rustediron2_basecolor.png";
+  rustedIron.maps[MATERIAL_NORMAL] = textureDirPath / "rustediron2_normal.png";
+  rustedIron.maps[MATERIAL_METALLIC] =
+      textureDirPath / "rustediron2_metallic.png";
+  rustedIron.maps[MATERIAL_ROUGHNESS] =
+      textureDirPath / "rustediron2_roughness.png";
+  std::vector<MaterialDesc> materialDescs;
+  materialDescs.push_back(cliff);
+  materialDescs.push_back(rustedIron);
+  unsigned int cliffMaterial = 0;
+  unsigned int ironMaterial = 1;
+
+  // the page file is baked once and then streamed from, the whole atlas is
+  // only loaded when the page file can not be used
+  JobPool pool;
+  fs::path pageFilePath =
+      virtualTexturePath(cacheDirPath, materialDescs, 1024);
+  if (argc > 1) {
+    pageFilePath = argv[1];
+  } else if (!fs::exists(pageFilePath)) {
+    bakeVirtualTexture(materialDescs, 1024, pageFilePath, pool);
+  }
+  VirtualTexture virtualTexture(VT_CACHE_PAGES);
+  bool useVirtualTexture = virtualTexture.open(pageFilePath);
+  if (useVirtualTexture && virtualTexture.layers() < materialDescs.size()) {
+    std::cout << pageFilePath << " has " << virtualTexture.layers()
+              << " materials, the scene needs " << materialDescs.size()
+              << std::endl;
+    virtualTexture.destroy();
+    useVirtualTexture = false;
+  }
+  MaterialAtlas materials(1024);
+  if (!useVirtualTexture) {
+    for (unsigned int i = 0; i < materialDescs.size(); i++) {
+      materials.add(materialDescs[i]);
+    }
+    materials.upload();
+  }
 
   // load shaders
   // cube shader
@@ -139,7 +208,14 @@ int main() {
   fs::path vertPath_t = shaderDirPath / vertFileName_t;
   fs::path fragPath_t = shaderDirPath / fragFileName_t;
 
-  Shader cshader(vertPath_t.c_str(), fragPath_t.c_str());
+  std::string cubeDefines = MATERIAL_BATCH_DEFINE;
+  if (useVirtualTexture) {
+    cubeDefines += VIRTUAL_TEXTURE_DEFINE;
+  }
+  if (useLambdaLut) {
+    cubeDefines += LAMBDA_LUT_DEFINE;
+  }
+  Shader cshader(vertPath_t.c_str(), fragPath_t.c_str(), cubeDefines);
 
   // lamp shader
   fs::path frag2FileName("basic_color_light.frag");
@@ -149,25 +225,141 @@ int main() {
   // let's set up some uniforms
 
   // init proc for uniforms that don't change over rendering
-  cubeShaderInit_proc(cshader);
+  if (useVirtualTexture) {
+    virtualTexture.initSamplers(cshader, 0, 11);
+  } else {
+    materials.initSamplers(cshader, 0);
+  }
+  // pages and mips the visible surfaces want, drawn with the batch layout,
+  // only built when the page file opened
+  std::unique_ptr<Shader> feedbackShader;
+  if (useVirtualTexture) {
+    fs::path feedbackFragPath = shaderDirPath / "vt_feedback.frag";
+    feedbackShader.reset(new Shader(vertPath_t.c_str(),
+                                    feedbackFragPath.c_str(),
+                                    MATERIAL_BATCH_DEFINE));
+    virtualTexture.initFeedback(*feedbackShader);
+  }
+
+  // shadow related
+  // the cube is a static caster, its shadow map is cached and redrawn only
+  // when the light moves
+  fs::path depthVertPath = shaderDirPath / "shadow_depth.vert";
+  fs::path depthFragPath = shaderDirPath / "shadow_depth.frag";
+  Shader depthShader(depthVertPath.c_str(), depthFragPath.c_str());
+  PointShadowMap pointShadow(1024, 0.05f, 25.0f);
+  std::vector<ShadowCaster> casters;
+  casters.push_back(ShadowCaster(glm::mat4(1.0f), glm::vec3(0.0f), 0.87f, true,
+                                 renderCube));
+  glm::vec3 ironCubePos(1.5f, 0.0f, 0.0f);
+  glm::mat4 ironCubeModel = glm::translate(glm::mat4(1.0f), ironCubePos);
+  casters.push_back(
+      ShadowCaster(ironCubeModel, ironCubePos, 0.87f, true, renderCube));
+  initShadowSamplers_proc(cshader, 5, 6);
+
+  // image based lighting, the convolution result is cached on disk
+  fs::path envPath = textureDirPath / "environment.hdr";
+  IblData iblData;
+  IblSettings iblSettings;
+  bool hasIbl = loadIbl(envPath.c_str(), cacheDirPath, iblSettings, iblData,
+                        pool);
+  IblTextures iblTextures;
+  if (hasIbl) {
+    iblTextures = uploadIbl(iblData);
+  }
+  initIblSamplers_proc(cshader, 7, 8, 9);
+
+  // tangent frames of the cube, generated once instead of every frame
+  MeshData cubeData = makeCubeMesh();
+  std::vector<QTangent> cubeQTangents;
+  generateQTangents(cubeData, pool, cubeQTangents);
+  cubeMesh = uploadTangentMesh(cubeData, cubeQTangents);
+  uploadLamp_proc();
+  // the cubes of every material go out in one instanced draw
+  MaterialBatch cubeBatch;
+  cubeBatch.attach(cubeMesh);
+
+  GLuint lambdaLut = 0;
+  if (useLambdaLut) {
+    LambdaLut lut = bakeLambdaLut(128);
+    lambdaLut = uploadLambdaLut(lut);
+    initLambdaLut_proc(cshader, lut, 10);
+  }
+
+  // the scene is lit in hdr, at a reduced resolution when the gpu falls
+  // behind, then exposed, tonemapped and upscaled to the window in one pass
+  fs::path tonemapVertPath = shaderDirPath / "fullscreen.vert";
+  fs::path tonemapFragPath = shaderDirPath / "tonemap.frag";
+  Shader tonemapShader(tonemapVertPath.c_str(), tonemapFragPath.c_str());
+  tonemapShader.useProgram();
+  tonemapShader.setIntUni("sceneColor", 0);
+  tonemapShader.setIntUni("exposure", 1);
+  // the full screen triangle comes from gl_VertexID, the vao stays empty
+  GLuint tonemapVao;
+  glGenVertexArrays(1, &tonemapVao);
+  AutoExposure autoExposure(shaderDirPath);
+  GpuTimer sceneTimer;
+  sceneTimer.init();
+  ResolutionController resolution(SCENE_GPU_BUDGET_MS);
+
+  // passes of a frame, the shadow cube is owned by pointShadow
+  FrameGraph frameGraph;
+  FgTextureDesc shadowDesc = {(GLsizei)pointShadow.resolution,
+                              (GLsizei)pointShadow.resolution,
+                              GL_DEPTH_COMPONENT32F};
+
+  // per object matrices, recomputed once per frame
+  ObjectTransforms transforms;
+  unsigned int cubeObject = transforms.add(glm::mat4(1.0f));
+  unsigned int ironCubeObject = transforms.add(ironCubeModel);
+  unsigned int lampObject = transforms.add(glm::mat4(1.0f));
+
+  // every program is linked, the stages are not needed any more
+  releaseShaderStages();
+
+  // loading talked to gl directly, the state cache starts from scratch
+  glState().invalidate();
+  // objects made from now on belong to a frame
+  glResources().beginLoop();
 
   // let's deal with vertex array objects and buffers
   // render loop
   while (glfwWindowShouldClose(window) == 0) {
+    TRACE_SCOPE("frame");
     float currentTime = (float)glfwGetTime();
     deltaTime = currentTime - lastTime;
     lastTime = currentTime;
 
-    processInput_proc(window);
-    glClearColor(0.0f, 0.1f, 0.2f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    {
+      TRACE_SCOPE("processInput");
+      processInput_proc(window);
+    }
+    if (useVirtualTexture) {
+      // pages asked for by an earlier frame and those the loader finished
+      TRACE_SCOPE("VirtualTexture::update");
+      virtualTexture.update();
+    }
+
+    // the render scale from a timing that came back since last frame,
+    // each one is counted once
+    if (sceneTimer.poll()) {
+      resolution.update(sceneTimer.lastMs, sceneTimer.lastGeneration);
+    }
+    int fbWidth, fbHeight;
+    glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+    if (fbWidth < 1 || fbHeight < 1) {
+      // minimized, nothing to draw into
+      glfwPollEvents();
+      continue;
+    }
+    GLsizei sceneWidth = resolution.scaled(fbWidth);
+    GLsizei sceneHeight = resolution.scaled(fbHeight);
 
     // setting model, view, projection
 
-    glm::mat4 projection =
-        glm::perspective(glm::radians(camera.zoom),
-                         (float)WINWIDTH / (float)WINHEIGHT, 0.1f, 100.0f);
-    glm::mat4 viewMat = camera.getViewMatrix();
+    // recomputed by the camera only after it moved or the window resized
+    camera.setPerspective((float)fbWidth / (float)fbHeight);
+    const glm::mat4 &viewProj = camera.getViewProjectionMatrix();
     glm::vec3 viewPos = camera.pos;
 
     // float lightIntensity = sin(glfwGetTime() * 1.0f);
@@ -175,49 +367,170 @@ int main() {
 
     // render cube object
     glm::mat4 cubeModel(1.0f);
-    // float angle = 20.0f;
-    // render cube
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, albedoMap);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, normalMap);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, metallicMap);
-    glActiveTexture(GL_TEXTURE3);
-    glBindTexture(GL_TEXTURE_2D, aoMap);
-    glActiveTexture(GL_TEXTURE4);
-    glBindTexture(GL_TEXTURE_2D, roMap);
-
-    cshader.useProgram();
-    cshader.setMat4Uni("view", viewMat);
-    cshader.setMat4Uni("model", cubeModel);
-    cshader.setMat4Uni("projection", projection);
-    cshader.setVec3Uni("lightPos", lightPos);
-    cshader.setVec3Uni("viewPos", viewPos);
-
-    renderCube();
-
-    // unbind the light vertex array object
     glm::mat4 lampModel(1.0f);
     lampModel = glm::translate(lampModel, lightPos);
     lampModel = glm::scale(lampModel, glm::vec3(0.2f));
-    lampShader.useProgram();
-    lampShader.setMat4Uni("model", lampModel);
-    lampShader.setMat4Uni("projection", projection);
-    lampShader.setMat4Uni("view", viewMat);
-    lampShader.setFloatUni("lightIntensity", 1.0f);
-    // render lamp
-    renderLamp();
-
-    glfwSwapBuffers(window);
+    {
+      TRACE_SCOPE("uniforms");
+      transforms.models[cubeObject] = cubeModel;
+      transforms.models[lampObject] = lampModel;
+      transforms.update(viewProj);
+      cubeBatch.clear();
+      cubeBatch.add(transforms.models[cubeObject],
+                    transforms.mvps[cubeObject],
+                    transforms.normals[cubeObject], cliffMaterial);
+      cubeBatch.add(transforms.models[ironCubeObject],
+                    transforms.mvps[ironCubeObject],
+                    transforms.normals[ironCubeObject], ironMaterial);
+    }
+    // float angle = 20.0f;
+    // the frame as passes over the textures they read and write, rebuilt
+    // every frame since it is cheap next to the draws
+    frameGraph.reset();
+    FgResource backbuffer = frameGraph.importBackbuffer(fbWidth, fbHeight);
+    FgResource shadowCube = frameGraph.importTexture(
+        "shadowCube", pointShadow.depthTex, shadowDesc);
+    frameGraph.addPass(
+        "shadow", [&](FgPassBuilder &builder) { builder.write(shadowCube); },
+        [&]() {
+          pointShadow.update(lightPos, casters, depthShader);
+          resetShadowCasters(casters);
+        });
+    if (useVirtualTexture) {
+      GLsizei feedbackWidth = virtualTexture.feedbackSize(fbWidth);
+      GLsizei feedbackHeight = virtualTexture.feedbackSize(fbHeight);
+      FgTextureDesc feedbackDesc = {feedbackWidth, feedbackHeight, GL_RGBA8};
+      FgTextureDesc feedbackDepthDesc = {feedbackWidth, feedbackHeight,
+                                         GL_DEPTH_COMPONENT32F};
+      // the target is read back by the virtual texture, not by a pass
+      frameGraph.addPass(
+          "vtFeedback",
+          [&](FgPassBuilder &builder) {
+            builder.renderTarget(builder.create("vtFeedback", feedbackDesc));
+            builder.renderTarget(
+                builder.create("vtFeedbackDepth", feedbackDepthDesc));
+            builder.sideEffect();
+          },
+          [&, feedbackWidth, feedbackHeight]() {
+            glClearColor(1.0f, 1.0f, 1.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            feedbackShader->useProgram();
+            // the mips the scene pass would pick at its own resolution
+            feedbackShader->setFloatUni(
+                "vtLodBias",
+                std::log2((float)feedbackWidth / (float)sceneWidth));
+            cubeBatch.draw(cubeMesh);
+            virtualTexture.readFeedback(feedbackWidth, feedbackHeight);
+          });
+    }
+    // the scene targets keep the window size so the graph reuses them
+    // while the scale changes, only their lower left part is drawn
+    FgTextureDesc sceneColorDesc = {fbWidth, fbHeight, GL_RGBA16F};
+    FgTextureDesc sceneDepthDesc = {fbWidth, fbHeight, GL_DEPTH_COMPONENT32F};
+    FgResource sceneColor = FG_INVALID;
+    frameGraph.addPass(
+        "forward",
+        [&](FgPassBuilder &builder) {
+          builder.read(shadowCube);
+          sceneColor = builder.renderTarget(
+              builder.create("sceneColor", sceneColorDesc));
+          builder.renderTarget(builder.create("sceneDepth", sceneDepthDesc));
+        },
+        [&]() {
+          glState().viewport(0, 0, sceneWidth, sceneHeight);
+          sceneTimer.begin(resolution.generation);
+          glClearColor(0.0f, 0.1f, 0.2f, 1.0f);
+          glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+          // render cubes
+          if (useVirtualTexture) {
+            virtualTexture.bind(0, 11);
+          } else {
+            materials.bind(0);
+          }
+          pointShadow.bind(cshader, GL_TEXTURE6);
+          if (hasIbl) {
+            bindIbl(iblTextures, cshader, GL_TEXTURE7, GL_TEXTURE8,
+                    GL_TEXTURE9);
+          }
+          if (useLambdaLut) {
+            glState().bindTexture(10, GL_TEXTURE_2D, lambdaLut);
+          }
+
+          cshader.useProgram();
+          cshader.setVec3Uni("lightPos", lightPos);
+          cshader.setVec3Uni("viewPos", viewPos);
+
+          cubeBatch.draw(cubeMesh);
+
+          // unbind the light vertex array object
+          lampShader.useProgram();
+          lampShader.setMat4Uni("mvp", transforms.mvps[lampObject]);
+          lampShader.setFloatUni("lightIntensity", 1.0f);
+          // render lamp
+          renderLamp();
+          sceneTimer.end();
+        });
+    FgResource exposure = autoExposure.addPasses(
+        frameGraph, sceneColor, sceneWidth, sceneHeight, deltaTime);
+    frameGraph.addPass(
+        "tonemap",
+        [&](FgPassBuilder &builder) {
+          builder.read(sceneColor);
+          builder.read(exposure);
+          builder.renderTarget(backbuffer);
+        },
+        [&]() {
+          glState().setCapability(GL_DEPTH_TEST, false);
+          tonemapShader.useProgram();
+          tonemapShader.setVec2Uni("renderSize", (float)sceneWidth,
+                                   (float)sceneHeight);
+          glState().bindTexture(0, GL_TEXTURE_2D,
+                                frameGraph.getTexture(sceneColor));
+          glState().bindTexture(1, GL_TEXTURE_2D,
+                                frameGraph.getTexture(exposure));
+          glState().bindVertexArray(tonemapVao);
+          // only the backbuffer is encoded, the float targets stay linear
+          glState().setCapability(GL_FRAMEBUFFER_SRGB, true);
+          glDrawArrays(GL_TRIANGLES, 0, 3);
+          glState().setCapability(GL_FRAMEBUFFER_SRGB, false);
+          glState().setCapability(GL_DEPTH_TEST, true);
+        });
+    frameGraph.compile();
+    frameGraph.execute();
+
+    {
+      TRACE_SCOPE("glfwSwapBuffers");
+      glfwSwapBuffers(window);
+    }
     glfwPollEvents();
+    glState().endFrame();
+    glResources().endFrame();
   }
+  glState().report(std::cout);
+  assetPack().report(std::cout);
+  std::cout << "last render scale: " << resolution.scale
+            << ", scene gpu time: " << sceneTimer.lastMs << " ms" << std::endl;
+  if (useVirtualTexture) {
+    virtualTexture.report(std::cout);
+  }
+  frameGraph.destroy();
+  sceneTimer.destroy();
+  glState().deleteVertexArray(tonemapVao);
+  autoExposure.destroy();
+  cubeBatch.destroy();
+  materials.destroy();
+  virtualTexture.destroy();
+  glState().deleteVertexArray(lampVao);
+  glDeleteBuffers(1, &lampVbo);
+  glResources().report(std::cout);
+  glResources().reportLive(std::cout);
+  TRACE_WRITE(tracePath.string());
   glfwTerminate();
   return 0;
 }
 void framebuffer_size_callback(GLFWwindow *window, int newWidth,
                                int newHeight) {
-  glViewport(0, 0, newWidth, newHeight);
+  glState().viewport(0, 0, newWidth, newHeight);
 }
 void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
   if (firstMouse) {
@@ -295,189 +608,27 @@ void initializeGLFWMajorMinor(unsigned int maj, unsigned int min) {
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, maj);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, min);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  // the default framebuffer encodes the linear output to srgb
+  glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
 }
-GLuint loadTexture2d_proc(const char *texturePath, GLuint tex) {
-  // create and load, bind texture to gl
-
-  int width, height, nbChannels;
-  unsigned char *data = stbi_load(texturePath, &width, &height, &nbChannels, 0);
-  if (data) {
-    GLenum format;
-    if (nbChannels == 1) {
-      format = GL_RED;
-    } else if (nbChannels == 3) {
-      format = GL_RGB;
-    } else if (nbChannels == 4) {
-      format = GL_RGBA;
-    }
-    glBindTexture(GL_TEXTURE_2D, tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
-                 GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-    // use nearest neighbor interpolation when zooming out
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-
-    // use nearest neighbor interpolation when zooming out
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
-                    GL_LINEAR_MIPMAP_LINEAR);
-
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-  } else {
-    std::cout << "Failed to load texture" << std::endl;
-  }
-  stbi_image_free(data);
-  return tex;
-}
-
-void cubeShaderInit_proc(Shader myShader) {
-  myShader.useProgram();
-  myShader.setIntUni("albedoMap", 0);
-  myShader.setIntUni("normalMap", 1);
-  myShader.setIntUni("metallicMap", 2);
-  myShader.setIntUni("aoMap", 3);
-  myShader.setIntUni("aoMap", 4);
-}
-
-void renderTriangle(float vert[15], float normal[3]) {
-  GLuint triVBO, triVAO;
-  glGenBuffers(1, &triVBO);
-  glGenVertexArrays(1, &triVAO);
-
-  // there are two triangles in a square
-  float trivert[] = {
-      vert[0],   vert[1],   vert[2],   normal[0], normal[1], normal[2],
-      vert[3],   vert[4],   vert[5],   vert[6],   vert[7],   normal[0],
-      normal[1], normal[2], vert[8],   vert[9],   vert[10],  vert[11],
-      vert[12],  normal[0], normal[1], normal[2], vert[13],  vert[14],
-  };
-  glBindVertexArray(triVAO);
-  glBindBuffer(GL_ARRAY_BUFFER, triVBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(trivert), trivert, GL_STATIC_DRAW);
-  // specify attributes
-  GLsizei fsize = 8 * sizeof(float);
-  glVertexAttribPointer(0, // location ==  aPos
-                        3, // vec3
-                        GL_FLOAT, GL_FALSE, fsize, (void *)0);
-  glEnableVertexAttribArray(0); // location
-  glVertexAttribPointer(1,      // location ==  aNormal
-                        3,      // vec3
-                        GL_FLOAT, GL_FALSE, fsize, (void *)(3 * sizeof(float)));
-  glEnableVertexAttribArray(1); // location
-  glVertexAttribPointer(2,      // location ==  aTexCoord
-                        2,      // vec2
-                        GL_FLOAT, GL_FALSE, fsize, (void *)(6 * sizeof(float)));
-  glEnableVertexAttribArray(2); // location
-  glBindVertexArray(triVAO);
-  glDrawArrays(GL_TRIANGLES, 0, 6);
-  glBindVertexArray(0);
-}
-void renderLamp() {
-  GLuint vbo, lightVao;
-  glGenBuffers(1, &vbo);
-  glGenVertexArrays(1, &lightVao); // separate object to isolate lamp from
+void uploadLamp_proc() {
+  // made once, the lamp used to get a new buffer and vertex array per draw
+  glGenBuffers(1, &lampVbo);
+  glGenVertexArrays(1, &lampVao); // separate object to isolate lamp from
   float vert[] = {-0.5f, -0.5f, -0.5f, -0.5f, 0.5f, -0.5f, 0.5f, -0.5f, -0.5f};
 
-  glBindVertexArray(lightVao);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glState().bindVertexArray(lampVao);
+  glBindBuffer(GL_ARRAY_BUFFER, lampVbo);
   glBufferData(GL_ARRAY_BUFFER, sizeof(vert), vert, GL_STATIC_DRAW);
   glEnableVertexAttribArray(0);
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-  glBindVertexArray(lightVao);
-  glDrawArrays(GL_TRIANGLES, 0, 6);
-  glBindVertexArray(0);
+}
+void renderLamp() {
+  glState().bindVertexArray(lampVao);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
 }
 
 void renderCube() {
-  /*
-     Draw cube
-   */
-  float s1n[] = {0.0f, 0.0f, -1.0f};
-  float s2n[] = {0.0f, 0.0f, 1.0f};
-  float s3n[] = {-1.0f, 0.0f, 0.0f};
-  float s4n[] = {1.0f, 0.0f, 0.0f};
-  float s5n[] = {0.0f, -1.0f, 0.0f};
-  float s6n[] = {0.0f, 1.0f, 0.0f};
-
-  // positions        // texture coords
-  float t1[] = {
-      -0.5f, -0.5f, -0.5f, 0.0f, 0.0f,  0.5f, -0.5f, -0.5f,
-      1.0f,  0.0f,  0.5f,  0.5f, -0.5f, 1.0f, 1.0f,
-  };
-  renderTriangle(t1, s1n);
-  float tt1[] = {
-      0.5f, 0.5f, -0.5f, 1.0f,  1.0f,  -0.5f, 0.5f, -0.5f,
-      0.0f, 1.0f, -0.5f, -0.5f, -0.5f, 0.0f,  0.0f,
-  };
-  renderTriangle(tt1, s1n);
-
-  float t2[] = {
-      -0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 0.5f, -0.5f, 0.5f,
-      1.0f,  0.0f,  0.5f, 0.5f, 0.5f, 1.0f, 1.0f,
-  };
-
-  renderTriangle(t2, s2n);
-  float tt2[] = {
-      0.5f, 0.5f, 0.5f,  1.0f,  1.0f, -0.5f, 0.5f, 0.5f,
-      0.0f, 1.0f, -0.5f, -0.5f, 0.5f, 0.0f,  0.0f,
-  };
-
-  renderTriangle(tt2, s2n);
-
-  float t3[] = {
-      -0.5f, 0.5f, 0.5f,  1.0f,  0.0f,  -0.5f, 0.5f, -0.5f,
-      1.0f,  1.0f, -0.5f, -0.5f, -0.5f, 0.0f,  1.0f,
-  };
-  renderTriangle(t3, s3n);
-
-  float tt3[] = {
-      -0.5f, -0.5f, -0.5f, 0.0f, 1.0f, -0.5f, -0.5f, 0.5f,
-      0.0f,  0.0f,  -0.5f, 0.5f, 0.5f, 1.0f,  0.0f,
-  };
-  renderTriangle(tt3, s3n);
-
-  float t4[] = {
-      0.5f, 0.5f, 0.5f, 1.0f,  0.0f,  0.5f, 0.5f, -0.5f,
-      1.0f, 1.0f, 0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-  };
-
-  renderTriangle(t4, s4n);
-  float tt4[] = {
-      0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 0.5f, -0.5f, 0.5f,
-      0.0f, 0.0f,  0.5f,  0.5f, 0.5f, 1.0f, 0.0f,
-  };
-
-  renderTriangle(tt4, s4n);
-
-  float t5[] = {
-      -0.5f, -0.5f, -0.5f, 0.0f,  1.0f, 0.5f, -0.5f, -0.5f,
-      1.0f,  1.0f,  0.5f,  -0.5f, 0.5f, 1.0f, 0.0f,
-  };
-
-  renderTriangle(t5, s5n);
-
-  float tt5[] = {
-      0.5f, -0.5f, 0.5f,  1.0f,  0.0f,  -0.5f, -0.5f, 0.5f,
-      0.0f, 0.0f,  -0.5f, -0.5f, -0.5f, 0.0f,  1.0f,
-  };
-
-  renderTriangle(tt5, s5n);
-
-  float t6[] = {
-      -0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.5f, 0.5f, -0.5f,
-      1.0f,  1.0f, 0.5f,  0.5f, 0.5f, 1.0f, 0.0f,
-  };
-
-  renderTriangle(t6, s6n);
-
-  float tt6[] = {0.5f, 0.5f, 0.5f,  1.0f, 0.0f,  -0.5f, 0.5f, 0.5f,
-                 0.0f, 0.0f, -0.5f, 0.5f, -0.5f, 0.0f,  1.0f};
-
-  renderTriangle(tt6, s6n);
+  // tangent frames are generated once when the mesh is built
+  drawTangentMesh(cubeMesh);
 }
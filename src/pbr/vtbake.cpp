@@ -0,0 +1,44 @@
+/*
+   Offline bake of the virtual texture page file streamed by the pbr demo
+ */
+// license: see, LICENSE
+#include <glad/glad.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <custom/stb_image.h>
+#include <custom/jobpool.hpp>
+#include <custom/material.hpp>
+#include <custom/vtexture.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+int main(int argc, char *argv[]) {
+  // usage: vtBake.out <page file> <layer size> <albedo> <normal> <metallic>
+  //                   <ao> <roughness> [<albedo> ...]
+  // a layer per group of five maps, "-" leaves a map at its default value;
+  // pbr.out streams the page file given as its argument
+  if (argc < 3 + (int)MATERIAL_MAP_COUNT ||
+      (argc - 3) % MATERIAL_MAP_COUNT != 0) {
+    std::cout << "usage: vtBake.out <page file> <layer size> <albedo> "
+                 "<normal> <metallic> <ao> <roughness> [<albedo> ...]"
+              << std::endl;
+    return 1;
+  }
+  unsigned int layerSize = (unsigned int)std::atoi(argv[2]);
+  std::vector<MaterialDesc> descs;
+  for (int i = 3; i < argc; i += MATERIAL_MAP_COUNT) {
+    MaterialDesc desc;
+    for (unsigned int m = 0; m < MATERIAL_MAP_COUNT; m++) {
+      std::string path = argv[i + m];
+      if (path != "-") {
+        desc.maps[m] = path;
+      }
+    }
+    descs.push_back(desc);
+  }
+  JobPool pool;
+  return bakeVirtualTexture(descs, layerSize, argv[1], pool) ? 0 : 1;
+}
@@ -3,12 +3,23 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include <custom/assetimage.hpp>
 #include <custom/camera.hpp>
+#include <custom/framegraph.hpp>
+#include <custom/glresources.hpp>
+#include <custom/glstate.hpp>
+#include <custom/latency.hpp>
+#include <custom/renderqueue.hpp>
 #include <custom/shader.hpp>
+#include <custom/shadow.hpp>
+#include <custom/tangent.hpp>
+#include <custom/trace.hpp>
+#include <custom/transform.hpp>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <vector>
 #define STB_IMAGE_IMPLEMENTATION
 #include <custom/stb_image.h>
 #include <glm/glm.hpp>
@@ -20,6 +31,8 @@ namespace fs = std::filesystem;
 fs::path current_dir = fs::current_path();
 fs::path shaderDirPath = current_dir / "media" / "shaders";
 fs::path textureDirPath = current_dir / "media" / "textures";
+fs::path assetPackPath = current_dir / "media" / "assets.pack";
+fs::path tracePath = current_dir / "trace.json";
 
 // initialization code
 
@@ -39,7 +52,17 @@ float lastTime = 0.0f;
 
 bool inTangent = false;
 
+// cube with its qtangents, built once before the render loop
+TangentMesh cubeMesh;
+// lamp triangle, built once as well so the draw queue can key on its vao
+GLuint lampVao = 0;
+GLuint lampVbo = 0;
+
 glm::vec3 lightPos = glm::vec3(0.2f, 1.0f, 0.5f);
+
+// input to photon measurement, P toggles the low latency pacing
+LatencyTracker latency;
+FramePacer pacer(1.0 / 60.0);
 // function declarations
 
 static void glfwErrorCallBack(int id, const char *desc);
@@ -47,19 +70,24 @@ void initializeGLFWMajorMinor(unsigned int maj, unsigned int min);
 void framebuffer_size_callback(GLFWwindow *window, int newWidth, int newHeight);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void mouse_scroll_callback(GLFWwindow *window, double xpos, double ypos);
-GLuint loadTexture2d_proc(const char *texturePath, GLuint tex);
+void key_callback(GLFWwindow *window, int key, int scancode, int action,
+                  int mods);
+GLuint loadTexture2d_proc(const char *texturePath, GLuint tex, bool srgb);
 void processInput_proc(GLFWwindow *window);
 void cubeShaderInit_proc(Shader myShader);
 void renderCube();
 void renderCubeInTangentSpace();
 void renderLamp();
-void renderTriangleInTangentSpace(float vert[15], float normal[3]);
-glm::vec3 getTangent(glm::vec2 deltaUV2, glm::vec2 deltaUV1, glm::vec3 edge1,
-                     glm::vec3 edge2);
-glm::vec3 getBiTangent(glm::vec2 deltaUV2, glm::vec2 deltaUV1, glm::vec3 edge1,
-                       glm::vec3 edge2);
+void uploadLamp_proc();
 
 int main() {
+  // loading and every frame on a timeline, written to tracePath at exit
+  TRACE_START();
+  TRACE_THREAD("main");
+  // the packed media when packBuild.out made one, the files otherwise
+  if (assetPack().open(assetPackPath, current_dir / "media")) {
+    std::cout << "media is read from " << assetPackPath << std::endl;
+  }
   initializeGLFWMajorMinor(4, 2);
   GLFWwindow *window = glfwCreateWindow(
       WINWIDTH, WINHEIGHT, "Basic Phong With Specular Map", NULL, NULL);
@@ -75,6 +103,12 @@ int main() {
   // dealing with mouse actions
   glfwSetCursorPosCallback(window, mouse_callback);
   glfwSetScrollCallback(window, mouse_scroll_callback);
+  glfwSetKeyCallback(window, key_callback);
+  // the pacer aims at the refresh of the monitor the window opens on
+  const GLFWvidmode *videoMode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+  if (videoMode != NULL && videoMode->refreshRate > 0) {
+    pacer.refreshInterval = 1.0 / videoMode->refreshRate;
+  }
 
   // deal with input method
   // glfw should capture cursor movement as well
@@ -86,12 +120,15 @@ int main() {
     glfwTerminate();
     return -1;
   }
+  // every gl object from here on is accounted for
+  glResources().install();
 
   // set default view port
   glViewport(0, 0, WINWIDTH, WINHEIGHT);
 
   // deal with global opengl state
   glEnable(GL_DEPTH_TEST);
+  glEnable(GL_FRAMEBUFFER_SRGB);
 
   // deal with textures
   // Stone_001_Diffuse.png
@@ -107,13 +144,13 @@ int main() {
 
   GLuint diffuseMap;
   glGenTextures(1, &diffuseMap);
-  loadTexture2d_proc(diffmapPath.c_str(), diffuseMap);
+  loadTexture2d_proc(diffmapPath.c_str(), diffuseMap, true);
   GLuint specularMap;
   glGenTextures(1, &specularMap);
-  loadTexture2d_proc(specularMapPath.c_str(), specularMap);
+  loadTexture2d_proc(specularMapPath.c_str(), specularMap, false);
   GLuint normalMap;
   glGenTextures(1, &normalMap);
-  loadTexture2d_proc(normalMapPath.c_str(), normalMap);
+  loadTexture2d_proc(normalMapPath.c_str(), normalMap, false);
 
   // load shaders
   // cube shader
@@ -135,23 +172,89 @@ int main() {
   // init proc for uniforms that don't change over rendering
   cubeShaderInit_proc(tangentCubeShader);
 
+  // tangent frames of the cube, generated once instead of every frame
+  {
+    JobPool pool;
+    MeshData cubeData = makeCubeMesh();
+    std::vector<QTangent> cubeQTangents;
+    generateQTangents(cubeData, pool, cubeQTangents);
+    cubeMesh = uploadTangentMesh(cubeData, cubeQTangents);
+  }
+  uploadLamp_proc();
+
+  // shadow related
+  // the cube is a static caster, its shadow map is cached and redrawn only
+  // when the light moves
+  fs::path depthVertPath = shaderDirPath / "shadow_depth.vert";
+  fs::path depthFragPath = shaderDirPath / "shadow_depth.frag";
+  Shader depthShader(depthVertPath.c_str(), depthFragPath.c_str());
+  PointShadowMap pointShadow(1024, 0.05f, 25.0f);
+  std::vector<ShadowCaster> casters;
+  casters.push_back(ShadowCaster(glm::mat4(1.0f), glm::vec3(0.0f), 0.87f, true,
+                                 renderCubeInTangentSpace));
+  initShadowSamplers_proc(tangentCubeShader, 5, 6);
+
+  // passes of a frame, the shadow cube is owned by pointShadow
+  FrameGraph frameGraph;
+  FgTextureDesc shadowDesc = {(GLsizei)pointShadow.resolution,
+                              (GLsizei)pointShadow.resolution,
+                              GL_DEPTH_COMPONENT32F};
+
+  // per object matrices, recomputed once per frame
+  ObjectTransforms transforms;
+  unsigned int cubeObject = transforms.add(glm::mat4(1.0f));
+  unsigned int lampObject = transforms.add(glm::mat4(1.0f));
+
+  // draws of the forward pass go through a sorted queue, states are
+  // registered once and the keys carry their indices
+  const unsigned int FORWARD_PASS = 0;
+  RenderQueue renderQueue;
+  unsigned int cubeProgram =
+      renderQueue.addProgram(tangentCubeShader.programId);
+  unsigned int lampProgram = renderQueue.addProgram(lampShader.programId);
+  unsigned int stoneMaterial = renderQueue.addMaterial();
+  renderQueue.addMaterialTexture(stoneMaterial, 0, GL_TEXTURE_2D, diffuseMap);
+  renderQueue.addMaterialTexture(stoneMaterial, 1, GL_TEXTURE_2D, specularMap);
+  renderQueue.addMaterialTexture(stoneMaterial, 2, GL_TEXTURE_2D, normalMap);
+  unsigned int noMaterial = renderQueue.addMaterial();
+  unsigned int cubeVao = renderQueue.addVertexArray(cubeMesh.vao);
+  unsigned int lampVertexArray = renderQueue.addVertexArray(lampVao);
+
+  // every program is linked, the stages are not needed any more
+  releaseShaderStages();
+
+  // loading talked to gl directly, the state cache starts from scratch
+  glState().invalidate();
+  // objects made from now on belong to a frame
+  glResources().beginLoop();
+
   // let's deal with vertex array objects and buffers
   // render loop
   while (glfwWindowShouldClose(window) == 0) {
-    float currentTime = (float)glfwGetTime();
+    TRACE_SCOPE("frame");
+    // in low latency mode input is sampled as late as the frame cost allows
+    {
+      TRACE_SCOPE("FramePacer::waitForSample");
+      pacer.waitForSample(glfwGetTime());
+    }
+    glfwPollEvents();
+    double sampleTime = glfwGetTime();
+    latency.beginFrame(sampleTime);
+
+    float currentTime = (float)sampleTime;
     deltaTime = currentTime - lastTime;
     lastTime = currentTime;
 
-    processInput_proc(window);
-    glClearColor(0.0f, 0.1f, 0.2f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    {
+      TRACE_SCOPE("processInput");
+      processInput_proc(window);
+    }
 
     // setting model, view, projection
 
-    glm::mat4 projection =
-        glm::perspective(glm::radians(camera.zoom),
-                         (float)WINWIDTH / (float)WINHEIGHT, 0.1f, 100.0f);
-    glm::mat4 viewMat = camera.getViewMatrix();
+    // recomputed by the camera only after it moved
+    camera.setPerspective((float)WINWIDTH / (float)WINHEIGHT);
+    const glm::mat4 &viewProj = camera.getViewProjectionMatrix();
     glm::vec3 viewPos = camera.pos;
 
     // float lightIntensity = sin(glfwGetTime() * 1.0f);
@@ -159,47 +262,105 @@ int main() {
 
     // render cube object
     glm::mat4 cubeModel(1.0f);
-    // float angle = 20.0f;
-    // render cube
-    tangentCubeShader.useProgram();
-    tangentCubeShader.setMat4Uni("view", viewMat);
-    tangentCubeShader.setMat4Uni("model", cubeModel);
-    tangentCubeShader.setMat4Uni("projection", projection);
-    tangentCubeShader.setVec3Uni("viewPos", viewPos);
-    tangentCubeShader.setVec3Uni("lightPos", lightPos);
-    tangentCubeShader.setFloatUni("lightIntensity", lightIntensity);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, diffuseMap);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, specularMap);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, normalMap);
-
-    renderCubeInTangentSpace();
-
-    // unbind the light vertex array object
     glm::mat4 lampModel(1.0f);
     lampModel = glm::translate(lampModel, lightPos);
     lampModel = glm::scale(lampModel, glm::vec3(0.2f));
-    lampShader.useProgram();
-    lampShader.setMat4Uni("model", lampModel);
-    lampShader.setMat4Uni("projection", projection);
-    lampShader.setMat4Uni("view", viewMat);
-    lampShader.setFloatUni("lightIntensity", lightIntensity);
-    // render lamp
-    renderLamp();
-
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    {
+      TRACE_SCOPE("uniforms");
+      transforms.models[cubeObject] = cubeModel;
+      transforms.models[lampObject] = lampModel;
+      transforms.update(viewProj);
+    }
+    // float angle = 20.0f;
+    // the frame as passes over the textures they read and write, rebuilt
+    // every frame since it is cheap next to the draws
+    int fbWidth, fbHeight;
+    glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+    frameGraph.reset();
+    FgResource backbuffer = frameGraph.importBackbuffer(fbWidth, fbHeight);
+    FgResource shadowCube = frameGraph.importTexture(
+        "shadowCube", pointShadow.depthTex, shadowDesc);
+    frameGraph.addPass(
+        "shadow", [&](FgPassBuilder &builder) { builder.write(shadowCube); },
+        [&]() {
+          pointShadow.update(lightPos, casters, depthShader);
+          resetShadowCasters(casters);
+        });
+    frameGraph.addPass(
+        "forward",
+        [&](FgPassBuilder &builder) {
+          builder.read(shadowCube);
+          builder.renderTarget(backbuffer);
+        },
+        [&]() {
+          glClearColor(0.0f, 0.1f, 0.2f, 1.0f);
+          glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+          // per program uniforms of the frame
+          tangentCubeShader.useProgram();
+          tangentCubeShader.setVec3Uni("viewPos", viewPos);
+          tangentCubeShader.setVec3Uni("lightPos", lightPos);
+          tangentCubeShader.setFloatUni("lightIntensity", lightIntensity);
+          pointShadow.bind(tangentCubeShader, GL_TEXTURE6);
+          lampShader.useProgram();
+          lampShader.setFloatUni("lightIntensity", lightIntensity);
+
+          // the w of the clip space origin is the view depth of the object
+          renderQueue.clear();
+          renderQueue.submit(
+              FORWARD_PASS, false, cubeProgram, stoneMaterial, cubeVao,
+              renderDepth(transforms.mvps[cubeObject][3][3], 0.1f, 100.0f),
+              [&]() {
+                tangentCubeShader.setMat4Uni("model",
+                                             transforms.models[cubeObject]);
+                tangentCubeShader.setMat4Uni("mvp",
+                                             transforms.mvps[cubeObject]);
+                tangentCubeShader.setMat3Uni("normalMatrix",
+                                             transforms.normals[cubeObject]);
+                drawTangentMesh(cubeMesh);
+              });
+          renderQueue.submit(
+              FORWARD_PASS, false, lampProgram, noMaterial, lampVertexArray,
+              renderDepth(transforms.mvps[lampObject][3][3], 0.1f, 100.0f),
+              [&]() {
+                lampShader.setMat4Uni("mvp", transforms.mvps[lampObject]);
+                renderLamp();
+              });
+          renderQueue.execute(FORWARD_PASS);
+        });
+    frameGraph.compile();
+    frameGraph.execute();
+
+    double submitTime = glfwGetTime();
+    {
+      TRACE_SCOPE("glfwSwapBuffers");
+      glfwSwapBuffers(window);
+    }
+    double presentTime = latency.endFrame(glfwGetTime(), pacer.enabled);
+    pacer.frameDone(sampleTime, submitTime, presentTime);
+    glState().endFrame();
+    glResources().endFrame();
   }
+  glState().report(std::cout);
+  assetPack().report(std::cout);
+  latency.report(std::cout);
+  std::cout << "refreshes missed while pacing: " << pacer.missed << std::endl;
+  latency.destroy();
+  renderQueue.report(std::cout);
+  frameGraph.destroy();
+  glState().deleteVertexArray(lampVao);
+  glDeleteBuffers(1, &lampVbo);
+  glResources().report(std::cout);
+  glResources().reportLive(std::cout);
+  TRACE_WRITE(tracePath.string());
   glfwTerminate();
   return 0;
 }
 void framebuffer_size_callback(GLFWwindow *window, int newWidth,
                                int newHeight) {
-  glViewport(0, 0, newWidth, newHeight);
+  glState().viewport(0, 0, newWidth, newHeight);
 }
 void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
+  latency.inputEvent(glfwGetTime());
   if (firstMouse) {
     lastX = xpos;
     lastY = ypos;
@@ -213,8 +374,20 @@ void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
   camera.processMouseMovement(xoffset, yoffset);
 }
 void mouse_scroll_callback(GLFWwindow *window, double xpos, double ypos) {
+  latency.inputEvent(glfwGetTime());
   camera.processMouseScroll(ypos);
 }
+void key_callback(GLFWwindow *, int key, int, int action, int) {
+  // keys are polled by processInput_proc, this only timestamps them
+  if (action != GLFW_RELEASE) {
+    latency.inputEvent(glfwGetTime());
+  }
+  if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+    pacer.enabled = !pacer.enabled;
+    std::cout << "low latency pacing " << (pacer.enabled ? "on" : "off")
+              << std::endl;
+  }
+}
 void processInput_proc(GLFWwindow *window) {
   if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
     glfwSetWindowShouldClose(window, true);
@@ -275,25 +448,41 @@ void initializeGLFWMajorMinor(unsigned int maj, unsigned int min) {
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, maj);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, min);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  // the default framebuffer encodes the linear output to srgb
+  glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
 }
-GLuint loadTexture2d_proc(const char *texturePath, GLuint tex) {
+GLuint loadTexture2d_proc(const char *texturePath, GLuint tex, bool srgb) {
   // create and load, bind texture to gl
-
-  int width, height, nbChannels;
-  unsigned char *data = stbi_load(texturePath, &width, &height, &nbChannels, 0);
-  if (data) {
+  // color maps are srgb encoded, the texture unit decodes them to linear
+  // before filtering
+
+  AssetImage image;
+  if (loadAssetImage(texturePath, 0, image)) {
+    int width = image.width, height = image.height;
+    int nbChannels = image.channels;
+    const unsigned char *data = image.texels;
     GLenum format;
+    GLint internalFormat;
     if (nbChannels == 1) {
       format = GL_RED;
+      internalFormat = GL_RED;
     } else if (nbChannels == 3) {
       format = GL_RGB;
+      internalFormat = srgb ? GL_SRGB8 : GL_RGB;
     } else if (nbChannels == 4) {
       format = GL_RGBA;
+      internalFormat = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA;
     }
     glBindTexture(GL_TEXTURE_2D, tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
-                 GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    {
+      TRACE_SCOPE("glTexImage2D");
+      glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0,
+                   format, GL_UNSIGNED_BYTE, data);
+    }
+    {
+      TRACE_SCOPE("glGenerateMipmap");
+      glGenerateMipmap(GL_TEXTURE_2D);
+    }
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -312,30 +501,9 @@ GLuint loadTexture2d_proc(const char *texturePath, GLuint tex) {
   } else {
     std::cout << "Failed to load texture" << std::endl;
   }
-  stbi_image_free(data);
+  freeAssetImage(image);
   return tex;
 }
-glm::vec3 getTangent(glm::vec2 deltaUV2, glm::vec2 deltaUV1, glm::vec3 edge1,
-                     glm::vec3 edge2) {
-  // Compute tangent
-  GLfloat f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-  glm::vec3 tangent;
-  tangent.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-  tangent.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-  tangent.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-  tangent = glm::normalize(tangent);
-  return tangent;
-}
-glm::vec3 getBiTangent(glm::vec2 deltaUV2, glm::vec2 deltaUV1, glm::vec3 edge1,
-                       glm::vec3 edge2) {
-  GLfloat f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-  glm::vec3 bitangent;
-  bitangent.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
-  bitangent.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
-  bitangent.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
-  bitangent = glm::normalize(bitangent);
-  return bitangent;
-}
 void cubeShaderInit_proc(Shader myShader) {
   myShader.useProgram();
   float ambientCoeff = 0.1f;
@@ -348,71 +516,6 @@ void cubeShaderInit_proc(Shader myShader) {
   myShader.setIntUni("specularMap", 1);
   myShader.setIntUni("normalMap", 2);
 }
-void renderTriangleInTangentSpace(float vert[15], float normal[3]) {
-  GLuint triVBO, triVAO;
-  glGenBuffers(1, &triVBO);
-  glGenVertexArrays(1, &triVAO);
-
-  // triangle points
-  glm::vec3 p1(vert[0], vert[1], vert[2]);
-  glm::vec2 tex1(vert[3], vert[4]);
-  glm::vec3 p2(vert[5], vert[6], vert[7]);
-  glm::vec2 tex2(vert[8], vert[9]);
-  glm::vec3 p3(vert[10], vert[11], vert[12]);
-  glm::vec2 tex3(vert[13], vert[14]);
-
-  // there are two triangles in a square
-  glm::vec3 snormal(normal[0], normal[1], normal[2]);
-
-  // first triangle
-  glm::vec3 edge1 = p2 - p1;
-  glm::vec3 edge2 = p3 - p1;
-  glm::vec2 deltaUV1 = tex2 - tex1;
-  glm::vec2 deltaUV2 = tex3 - tex1;
-
-  glm::vec3 tan = getTangent(deltaUV2, deltaUV1, edge1, edge2);
-  glm::vec3 bitan = getBiTangent(deltaUV2, deltaUV1, edge1, edge2);
-
-  float trivert[] = {
-      p1.x,   p1.y,  p1.z,  snormal.x, snormal.y, snormal.z, tex1.x,
-      tex1.y, tan.x, tan.y, tan.z,     bitan.x,   bitan.y,   bitan.z,
-      p2.x,   p2.y,  p2.z,  snormal.x, snormal.y, snormal.z, tex2.x,
-      tex2.y, tan.x, tan.y, tan.z,     bitan.x,   bitan.y,   bitan.z,
-      p3.x,   p3.y,  p3.z,  snormal.x, snormal.y, snormal.z, tex3.x,
-      tex3.y, tan.x, tan.y, tan.z,     bitan.x,   bitan.y,   bitan.z,
-  };
-  glBindVertexArray(triVAO);
-  glBindBuffer(GL_ARRAY_BUFFER, triVBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(trivert), &trivert, GL_STATIC_DRAW);
-  glEnableVertexAttribArray(0); // location
-  // specify attributes
-  GLsizei fsize = 14 * sizeof(float);
-  glVertexAttribPointer(0, // location ==  aPos
-                        3, // vec3
-                        GL_FLOAT, GL_FALSE, fsize, (void *)0);
-  glEnableVertexAttribArray(1); // location
-  glVertexAttribPointer(1,      // location ==  aNormal
-                        3,      // vec3
-                        GL_FLOAT, GL_FALSE, fsize, (void *)(3 * sizeof(float)));
-  glEnableVertexAttribArray(2); // location
-  glVertexAttribPointer(2,      // location ==  aTexCoord
-                        2,      // vec2
-                        GL_FLOAT, GL_FALSE, fsize, (void *)(6 * sizeof(float)));
-  glEnableVertexAttribArray(3); // location
-  glVertexAttribPointer(3,      // location ==  aTan
-                        3,      // vec3
-                        GL_FLOAT, GL_FALSE, fsize, (void *)(8 * sizeof(float)));
-  glEnableVertexAttribArray(4); // location
-  glVertexAttribPointer(4,      // location ==  aBiTan
-                        3,      // vec3
-                        GL_FLOAT, GL_FALSE, fsize,
-                        (void *)(11 * sizeof(float)));
-  glBindVertexArray(triVAO);
-  glDrawArrays(GL_TRIANGLES, 0, 3);
-  glBindVertexArray(0);
-  glDeleteVertexArrays(1, &triVAO);
-  glDeleteBuffers(1, &triVBO);
-}
 void renderTriangle(float vert[15], float normal[3]) {
   GLuint triVBO, triVAO;
   glGenBuffers(1, &triVBO);
@@ -425,7 +528,7 @@ void renderTriangle(float vert[15], float normal[3]) {
       normal[1], normal[2], vert[8],   vert[9],   vert[10],  vert[11],
       vert[12],  normal[0], normal[1], normal[2], vert[13],  vert[14],
   };
-  glBindVertexArray(triVAO);
+  glState().bindVertexArray(triVAO);
   glBindBuffer(GL_ARRAY_BUFFER, triVBO);
   glBufferData(GL_ARRAY_BUFFER, sizeof(trivert), &trivert, GL_STATIC_DRAW);
   // specify attributes
@@ -442,115 +545,29 @@ void renderTriangle(float vert[15], float normal[3]) {
                         2,      // vec2
                         GL_FLOAT, GL_FALSE, fsize, (void *)6);
   glEnableVertexAttribArray(2); // location
-  glBindVertexArray(triVAO);
   glDrawArrays(GL_TRIANGLES, 0, 3);
-  glBindVertexArray(0);
-  glDeleteVertexArrays(1, &triVAO);
+  glState().deleteVertexArray(triVAO);
   glDeleteBuffers(1, &triVBO);
 }
-void renderLamp() {
-  GLuint vbo, lightVao;
-  glGenBuffers(1, &vbo);
-  glGenVertexArrays(1, &lightVao); // separate object to isolate lamp from
+void uploadLamp_proc() {
+  glGenBuffers(1, &lampVbo);
+  glGenVertexArrays(1, &lampVao); // separate object to isolate lamp from
   float vert[] = {-0.5f, -0.5f, -0.5f, -0.5f, 0.5f, -0.5f, 0.5f, -0.5f, -0.5f};
 
-  glBindVertexArray(lightVao);
-  glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  glBindVertexArray(lampVao);
+  glBindBuffer(GL_ARRAY_BUFFER, lampVbo);
   glBufferData(GL_ARRAY_BUFFER, sizeof(vert), &vert, GL_STATIC_DRAW);
   glEnableVertexAttribArray(0);
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-  glBindVertexArray(lightVao);
-  glDrawArrays(GL_TRIANGLES, 0, 3);
   glBindVertexArray(0);
-  glDeleteVertexArrays(1, &lightVao);
-  glDeleteBuffers(1, &vbo);
+}
+void renderLamp() {
+  glState().bindVertexArray(lampVao);
+  glDrawArrays(GL_TRIANGLES, 0, 3);
 }
 void renderCubeInTangentSpace() {
-  /*
-     Draw cube
-   */
-  float s1n[] = {0.0f, 0.0f, -1.0f};
-  float s2n[] = {0.0f, 0.0f, 1.0f};
-  float s3n[] = {-1.0f, 0.0f, 0.0f};
-  float s4n[] = {1.0f, 0.0f, 0.0f};
-  float s5n[] = {0.0f, -1.0f, 0.0f};
-  float s6n[] = {0.0f, 1.0f, 0.0f};
-
-  // positions        // texture coords
-  float t1[] = {
-      -0.5f, -0.5f, -0.5f, 0.0f, 0.0f,  0.5f, -0.5f, -0.5f,
-      1.0f,  0.0f,  0.5f,  0.5f, -0.5f, 1.0f, 1.0f,
-  };
-  renderTriangleInTangentSpace(t1, s1n);
-  float tt1[] = {
-      0.5f, 0.5f, -0.5f, 1.0f,  1.0f,  -0.5f, 0.5f, -0.5f,
-      0.0f, 1.0f, -0.5f, -0.5f, -0.5f, 0.0f,  0.0f,
-  };
-  renderTriangleInTangentSpace(tt1, s1n);
-
-  float t2[] = {
-      -0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 0.5f, -0.5f, 0.5f,
-      1.0f,  0.0f,  0.5f, 0.5f, 0.5f, 1.0f, 1.0f,
-  };
-
-  renderTriangleInTangentSpace(t2, s2n);
-  float tt2[] = {
-      0.5f, 0.5f, 0.5f,  1.0f,  1.0f, -0.5f, 0.5f, 0.5f,
-      0.0f, 1.0f, -0.5f, -0.5f, 0.5f, 0.0f,  0.0f,
-  };
-
-  renderTriangleInTangentSpace(tt2, s2n);
-
-  float t3[] = {
-      -0.5f, 0.5f, 0.5f,  1.0f,  0.0f,  -0.5f, 0.5f, -0.5f,
-      1.0f,  1.0f, -0.5f, -0.5f, -0.5f, 0.0f,  1.0f,
-  };
-  renderTriangleInTangentSpace(t3, s3n);
-
-  float tt3[] = {
-      -0.5f, -0.5f, -0.5f, 0.0f, 1.0f, -0.5f, -0.5f, 0.5f,
-      0.0f,  0.0f,  -0.5f, 0.5f, 0.5f, 1.0f,  0.0f,
-  };
-  renderTriangleInTangentSpace(tt3, s3n);
-
-  float t4[] = {
-      0.5f, 0.5f, 0.5f, 1.0f,  0.0f,  0.5f, 0.5f, -0.5f,
-      1.0f, 1.0f, 0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-  };
-
-  renderTriangleInTangentSpace(t4, s4n);
-  float tt4[] = {
-      0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 0.5f, -0.5f, 0.5f,
-      0.0f, 0.0f,  0.5f,  0.5f, 0.5f, 1.0f, 0.0f,
-  };
-
-  renderTriangleInTangentSpace(tt4, s4n);
-
-  float t5[] = {
-      -0.5f, -0.5f, -0.5f, 0.0f,  1.0f, 0.5f, -0.5f, -0.5f,
-      1.0f,  1.0f,  0.5f,  -0.5f, 0.5f, 1.0f, 0.0f,
-  };
-
-  renderTriangleInTangentSpace(t5, s5n);
-
-  float tt5[] = {
-      0.5f, -0.5f, 0.5f,  1.0f,  0.0f,  -0.5f, -0.5f, 0.5f,
-      0.0f, 0.0f,  -0.5f, -0.5f, -0.5f, 0.0f,  1.0f,
-  };
-
-  renderTriangleInTangentSpace(tt5, s5n);
-
-  float t6[] = {
-      -0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.5f, 0.5f, -0.5f,
-      1.0f,  1.0f, 0.5f,  0.5f, 0.5f, 1.0f, 0.0f,
-  };
-
-  renderTriangleInTangentSpace(t6, s6n);
-
-  float tt6[] = {0.5f, 0.5f, 0.5f,  1.0f, 0.0f,  -0.5f, 0.5f, 0.5f,
-                 0.0f, 0.0f, -0.5f, 0.5f, -0.5f, 0.0f,  1.0f};
-
-  renderTriangleInTangentSpace(tt6, s6n);
+  // tangent frames are generated once when the mesh is built
+  drawTangentMesh(cubeMesh);
 }
 void renderCube() {
   /*
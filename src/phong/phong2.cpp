@@ -2,12 +2,25 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 
+#include <custom/assetimage.hpp>
 #include <custom/camera.hpp>
+#include <custom/cmdlist.hpp>
+#include <custom/glresources.hpp>
+#include <custom/glstate.hpp>
 #include <custom/shader.hpp>
+#include <custom/tangent.hpp>
+#include <custom/trace.hpp>
+#include <custom/transform.hpp>
+#include <custom/triplebuffer.hpp>
+
+#include <atomic>
+#include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <thread>
+#include <vector>
 #define STB_IMAGE_IMPLEMENTATION
 #include <custom/stb_image.h>
 #include <glm/glm.hpp>
@@ -19,6 +32,8 @@ namespace fs = std::filesystem;
 fs::path current_dir = fs::current_path();
 fs::path shaderDirPath = current_dir / "media" / "shaders";
 fs::path textureDirPath = current_dir / "media" / "textures";
+fs::path assetPackPath = current_dir / "media" / "assets.pack";
+fs::path tracePath = current_dir / "trace.json";
 
 // initialization code
 
@@ -38,27 +53,48 @@ float lastTime = 0.0f;
 
 bool inTangent = false;
 
+// cube with its qtangents, built once before the render loop
+TangentMesh cubeMesh;
+// the field of cubes under the light is CUBE_FIELD x CUBE_FIELD
+const unsigned int CUBE_FIELD = 24;
+// objects each worker records in one command list
+const unsigned int RECORD_GRAIN = 64;
+// simulation steps per second, the render thread draws the latest one
+const unsigned int SIM_HZ = 240;
+
+// everything the render thread needs from one simulation step, left
+// untouched once published
+struct FrameState {
+  glm::vec3 viewPos;
+  glm::vec3 lightPos;
+  float lightIntensity;
+  int fbWidth;
+  int fbHeight;
+  ObjectTransforms transforms;
+};
+
 glm::vec3 lightPos = glm::vec3(0.2f, 1.0f, 0.5f);
 // function declarations
 
 static void glfwErrorCallBack(int id, const char *desc);
 void initializeGLFWMajorMinor(unsigned int maj, unsigned int min);
-void framebuffer_size_callback(GLFWwindow *window, int newWidth, int newHeight);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void mouse_scroll_callback(GLFWwindow *window, double xpos, double ypos);
-GLuint loadTexture2d_proc(const char *texturePath, GLuint tex);
+GLuint loadTexture2d_proc(const char *texturePath, GLuint tex, bool srgb);
 void processInput_proc(GLFWwindow *window);
 void cubeShaderInit_proc(Shader myShader);
 void renderCube();
 void renderCubeInTangentSpace();
 void renderLamp();
-void renderTriangleInTangentSpace(float vert[15], float normal[3]);
-glm::vec3 getTangent(glm::vec2 deltaUV2, glm::vec2 deltaUV1, glm::vec3 edge1,
-                     glm::vec3 edge2);
-glm::vec3 getBiTangent(glm::vec2 deltaUV2, glm::vec2 deltaUV1, glm::vec3 edge1,
-                       glm::vec3 edge2);
 
 int main() {
+  // both loops and the workers on one timeline, written to tracePath at exit
+  TRACE_START();
+  TRACE_THREAD("simulation");
+  // the packed media when packBuild.out made one, the files otherwise
+  if (assetPack().open(assetPackPath, current_dir / "media")) {
+    std::cout << "media is read from " << assetPackPath << std::endl;
+  }
   initializeGLFWMajorMinor(4, 2);
   GLFWwindow *window = glfwCreateWindow(
       WINWIDTH, WINHEIGHT, "Basic Phong With Specular Map", NULL, NULL);
@@ -69,7 +105,6 @@ int main() {
     return -1;
   }
   glfwMakeContextCurrent(window);
-  glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
   //
   // dealing with mouse actions
   glfwSetCursorPosCallback(window, mouse_callback);
@@ -85,12 +120,15 @@ int main() {
     glfwTerminate();
     return -1;
   }
+  // every gl object from here on is accounted for
+  glResources().install();
 
   // set default view port
   glViewport(0, 0, WINWIDTH, WINHEIGHT);
 
   // deal with global opengl state
   glEnable(GL_DEPTH_TEST);
+  glEnable(GL_FRAMEBUFFER_SRGB);
 
   // deal with textures
   // Stone_001_Diffuse.png
@@ -106,13 +144,13 @@ int main() {
 
   GLuint diffuseMap;
   glGenTextures(1, &diffuseMap);
-  loadTexture2d_proc(diffmapPath.c_str(), diffuseMap);
+  loadTexture2d_proc(diffmapPath.c_str(), diffuseMap, true);
   GLuint specularMap;
   glGenTextures(1, &specularMap);
-  loadTexture2d_proc(specularMapPath.c_str(), specularMap);
+  loadTexture2d_proc(specularMapPath.c_str(), specularMap, false);
   GLuint normalMap;
   glGenTextures(1, &normalMap);
-  loadTexture2d_proc(normalMapPath.c_str(), normalMap);
+  loadTexture2d_proc(normalMapPath.c_str(), normalMap, false);
 
   // load shaders
   // cube shader
@@ -136,28 +174,64 @@ int main() {
 
   // init proc for uniforms that don't change over rendering
   cubeShaderInit_proc(tangentCubeShader);
+  // every program is linked, the stages are not needed any more
+  releaseShaderStages();
+
+  // workers of the tangent generation and of the per frame recording
+  JobPool pool;
+
+  // tangent frames of the cube, generated once instead of every frame
+  {
+    MeshData cubeData = makeCubeMesh();
+    std::vector<QTangent> cubeQTangents;
+    generateQTangents(cubeData, pool, cubeQTangents);
+    cubeMesh = uploadTangentMesh(cubeData, cubeQTangents);
+  }
 
-  // let's deal with vertex array objects and buffers
-  // render loop
-  while (glfwWindowShouldClose(window) == 0) {
-    float currentTime = (float)glfwGetTime();
-    deltaTime = currentTime - lastTime;
-    lastTime = currentTime;
-
-    processInput_proc(window);
-    glClearColor(0.0f, 0.1f, 0.2f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  // per object matrices, recomputed once per frame
+  ObjectTransforms transforms;
+  unsigned int cubeObject = transforms.add(glm::mat4(1.0f));
+  for (unsigned int i = 0; i < CUBE_FIELD; i++) {
+    for (unsigned int j = 0; j < CUBE_FIELD; j++) {
+      float half = 0.5f * float(CUBE_FIELD - 1);
+      glm::mat4 model(1.0f);
+      model = glm::translate(model, glm::vec3((float(i) - half) * 1.5f, -2.0f,
+                                              (float(j) - half) * 1.5f));
+      model = glm::scale(model, glm::vec3(0.5f));
+      transforms.add(model);
+    }
+  }
+  unsigned int cubeCount = 1 + CUBE_FIELD * CUBE_FIELD;
+  unsigned int lampObject = transforms.add(glm::mat4(1.0f));
+
+  // per object uniforms are recorded off the gl thread, their locations
+  // are looked up once here
+  GLint modelLoc = glGetUniformLocation(tangentCubeShader.programId, "model");
+  GLint mvpLoc = glGetUniformLocation(tangentCubeShader.programId, "mvp");
+  GLint normalMatrixLoc =
+      glGetUniformLocation(tangentCubeShader.programId, "normalMatrix");
+  std::vector<CommandList> cubeLists;
+
+  // simulation state lives on the main thread, where glfw delivers input;
+  // the render thread takes the context and draws from snapshots
+  TripleBuffer<FrameState> frames;
+  std::atomic<bool> running(true);
+  auto simulate = [&](float currentTime) {
+    FrameState &state = frames.writeSlot();
+    glfwGetFramebufferSize(window, &state.fbWidth, &state.fbHeight);
 
     // setting model, view, projection
 
-    glm::mat4 projection =
-        glm::perspective(glm::radians(camera.zoom),
-                         (float)WINWIDTH / (float)WINHEIGHT, 0.1f, 100.0f);
-    glm::mat4 viewMat = camera.getViewMatrix();
-    glm::vec3 viewPos = camera.pos;
+    // recomputed by the camera only after it moved or the window resized,
+    // a minimized window keeps the last aspect
+    if (state.fbWidth > 0 && state.fbHeight > 0) {
+      camera.setPerspective((float)state.fbWidth / (float)state.fbHeight);
+    }
+    const glm::mat4 &viewProj = camera.getViewProjectionMatrix();
+    state.viewPos = camera.pos;
 
     // float lightIntensity = sin(glfwGetTime() * 1.0f);
-    float lightIntensity = 1.0f;
+    state.lightIntensity = 1.0f;
 
     // render cube object
     glm::mat4 cubeModel(1.0f);
@@ -166,46 +240,130 @@ int main() {
     lightPos.x = 1.0f + sin(currentTime) * 2.0f;
     lightPos.y = sin(currentTime / 2.0f) * 1.0f;
     lightPos.z = sin(currentTime / 5.0f) * 3.0f;
-    // float angle = 20.0f;
-    // render cube
-    tangentCubeShader.useProgram();
-    tangentCubeShader.setMat4Uni("view", viewMat);
-    tangentCubeShader.setMat4Uni("model", cubeModel);
-    tangentCubeShader.setMat4Uni("projection", projection);
-    tangentCubeShader.setVec3Uni("viewPos", viewPos);
-    tangentCubeShader.setVec3Uni("lightPos", lightPos);
-    tangentCubeShader.setFloatUni("lightIntensity", lightIntensity);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, diffuseMap);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, specularMap);
-    glActiveTexture(GL_TEXTURE2);
-    glBindTexture(GL_TEXTURE_2D, normalMap);
-
-    renderCubeInTangentSpace();
-
-    // unbind the light vertex array object
+    state.lightPos = lightPos;
     glm::mat4 lampModel(1.0f);
     lampModel = glm::translate(lampModel, lightPos);
     lampModel = glm::scale(lampModel, glm::vec3(0.2f));
-    lampShader.useProgram();
-    lampShader.setMat4Uni("model", lampModel);
-    lampShader.setMat4Uni("projection", projection);
-    lampShader.setMat4Uni("view", viewMat);
-    lampShader.setFloatUni("lightIntensity", lightIntensity);
-    // render lamp
-    renderLamp();
-
-    glfwSwapBuffers(window);
+    transforms.models[cubeObject] = cubeModel;
+    transforms.models[lampObject] = lampModel;
+    // the slot keeps its vectors, copying reuses their storage
+    state.transforms.models = transforms.models;
+    state.transforms.update(viewProj);
+  };
+  simulate((float)glfwGetTime());
+  frames.publish();
+
+  // the context can be current on one thread only
+  glfwMakeContextCurrent(NULL);
+  std::thread renderThread([&]() {
+    TRACE_THREAD("render");
+    glfwMakeContextCurrent(window);
+    // loading talked to gl directly, the state cache starts from scratch
+    glState().invalidate();
+    glResources().beginLoop();
+    while (running.load(std::memory_order_acquire)) {
+      TRACE_SCOPE("frame");
+      // without a new snapshot the last one is drawn again
+      frames.acquire();
+      const FrameState &state = frames.readSlot();
+      const ObjectTransforms &stateTransforms = state.transforms;
+      glState().viewport(0, 0, state.fbWidth, state.fbHeight);
+      glClearColor(0.0f, 0.1f, 0.2f, 1.0f);
+      glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+      // render cubes, the frame uniforms are set here and the workers cull
+      // and record the per object ones
+      tangentCubeShader.useProgram();
+      tangentCubeShader.setVec3Uni("viewPos", state.viewPos);
+      tangentCubeShader.setVec3Uni("lightPos", state.lightPos);
+      tangentCubeShader.setFloatUni("lightIntensity", state.lightIntensity);
+      glState().bindTexture(0, GL_TEXTURE_2D, diffuseMap);
+      glState().bindTexture(1, GL_TEXTURE_2D, specularMap);
+      glState().bindTexture(2, GL_TEXTURE_2D, normalMap);
+
+      recordCommandLists(
+          pool, cubeLists, cubeCount, RECORD_GRAIN,
+          [&](CommandList &list, unsigned int begin, unsigned int end) {
+            list.bindVertexArray(cubeMesh.vao);
+            for (unsigned int i = cubeObject + begin; i < cubeObject + end;
+                 i++) {
+              // 0.87 bounds the unit cube
+              if (!sphereVisible(stateTransforms.mvps[i], 0.87f)) {
+                continue;
+              }
+              list.uniformMat4(modelLoc, stateTransforms.models[i]);
+              list.uniformMat4(mvpLoc, stateTransforms.mvps[i]);
+              list.uniformMat3(normalMatrixLoc, stateTransforms.normals[i]);
+              list.drawElements(GL_TRIANGLES, cubeMesh.indexCount,
+                                GL_UNSIGNED_INT);
+            }
+          });
+      {
+        TRACE_SCOPE("replayCommandLists");
+        replayCommandLists(cubeLists);
+      }
+
+      // unbind the light vertex array object
+      lampShader.useProgram();
+      glm::mat4 lampMvp = stateTransforms.mvps[lampObject];
+      lampShader.setMat4Uni("mvp", lampMvp);
+      lampShader.setFloatUni("lightIntensity", state.lightIntensity);
+      // render lamp
+      renderLamp();
+
+      {
+        TRACE_SCOPE("glfwSwapBuffers");
+        glfwSwapBuffers(window);
+      }
+      glState().endFrame();
+      glResources().endFrame();
+    }
+    glState().report(std::cout);
+    glResources().report(std::cout);
+    glResources().reportLive(std::cout);
+    glfwMakeContextCurrent(NULL);
+  });
+
+  // simulation loop, runs at its own rate while the render thread submits
+  const std::chrono::nanoseconds simStep(1000000000 / SIM_HZ);
+  std::chrono::steady_clock::time_point nextStep =
+      std::chrono::steady_clock::now();
+  while (glfwWindowShouldClose(window) == 0) {
     glfwPollEvents();
+    float currentTime = (float)glfwGetTime();
+    deltaTime = currentTime - lastTime;
+    lastTime = currentTime;
+
+    {
+      // the step ends before the sleep, stalls show as gaps between steps
+      TRACE_SCOPE("step");
+      {
+        TRACE_SCOPE("processInput");
+        processInput_proc(window);
+      }
+      {
+        TRACE_SCOPE("simulate");
+        simulate(currentTime);
+      }
+      frames.publish();
+    }
+
+    nextStep += simStep;
+    std::chrono::steady_clock::time_point now =
+        std::chrono::steady_clock::now();
+    if (nextStep < now) {
+      // fell behind, do not try to catch up with a burst of steps
+      nextStep = now;
+    }
+    std::this_thread::sleep_until(nextStep);
   }
+  running.store(false, std::memory_order_release);
+  renderThread.join();
+  assetPack().report(std::cout);
+  TRACE_WRITE(tracePath.string());
   glfwTerminate();
   return 0;
 }
-void framebuffer_size_callback(GLFWwindow *window, int newWidth,
-                               int newHeight) {
-  glViewport(0, 0, newWidth, newHeight);
-}
 void mouse_callback(GLFWwindow *window, double xpos, double ypos) {
   if (firstMouse) {
     lastX = xpos;
@@ -282,25 +440,41 @@ void initializeGLFWMajorMinor(unsigned int maj, unsigned int min) {
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, maj);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, min);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  // the default framebuffer encodes the linear output to srgb
+  glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
 }
-GLuint loadTexture2d_proc(const char *texturePath, GLuint tex) {
+GLuint loadTexture2d_proc(const char *texturePath, GLuint tex, bool srgb) {
   // create and load, bind texture to gl
-
-  int width, height, nbChannels;
-  unsigned char *data = stbi_load(texturePath, &width, &height, &nbChannels, 0);
-  if (data) {
+  // color maps are srgb encoded, the texture unit decodes them to linear
+  // before filtering
+
+  AssetImage image;
+  if (loadAssetImage(texturePath, 0, image)) {
+    int width = image.width, height = image.height;
+    int nbChannels = image.channels;
+    const unsigned char *data = image.texels;
     GLenum format;
+    GLint internalFormat;
     if (nbChannels == 1) {
       format = GL_RED;
+      internalFormat = GL_RED;
     } else if (nbChannels == 3) {
       format = GL_RGB;
+      internalFormat = srgb ? GL_SRGB8 : GL_RGB;
     } else if (nbChannels == 4) {
       format = GL_RGBA;
+      internalFormat = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA;
     }
     glBindTexture(GL_TEXTURE_2D, tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format,
-                 GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
+    {
+      TRACE_SCOPE("glTexImage2D");
+      glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0,
+                   format, GL_UNSIGNED_BYTE, data);
+    }
+    {
+      TRACE_SCOPE("glGenerateMipmap");
+      glGenerateMipmap(GL_TEXTURE_2D);
+    }
 
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -319,30 +493,9 @@ GLuint loadTexture2d_proc(const char *texturePath, GLuint tex) {
   } else {
     std::cout << "Failed to load texture" << std::endl;
   }
-  stbi_image_free(data);
+  freeAssetImage(image);
   return tex;
 }
-glm::vec3 getTangent(glm::vec2 deltaUV2, glm::vec2 deltaUV1, glm::vec3 edge1,
-                     glm::vec3 edge2) {
-  // Compute tangent
-  GLfloat f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-  glm::vec3 tangent;
-  tangent.x = f * (deltaUV2.y * edge1.x - deltaUV1.y * edge2.x);
-  tangent.y = f * (deltaUV2.y * edge1.y - deltaUV1.y * edge2.y);
-  tangent.z = f * (deltaUV2.y * edge1.z - deltaUV1.y * edge2.z);
-  tangent = glm::normalize(tangent);
-  return tangent;
-}
-glm::vec3 getBiTangent(glm::vec2 deltaUV2, glm::vec2 deltaUV1, glm::vec3 edge1,
-                       glm::vec3 edge2) {
-  GLfloat f = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV2.x * deltaUV1.y);
-  glm::vec3 bitangent;
-  bitangent.x = f * (-deltaUV2.x * edge1.x + deltaUV1.x * edge2.x);
-  bitangent.y = f * (-deltaUV2.x * edge1.y + deltaUV1.x * edge2.y);
-  bitangent.z = f * (-deltaUV2.x * edge1.z + deltaUV1.x * edge2.z);
-  bitangent = glm::normalize(bitangent);
-  return bitangent;
-}
 void cubeShaderInit_proc(Shader myShader) {
   myShader.useProgram();
   float ambientCoeff = 0.1f;
@@ -355,71 +508,6 @@ void cubeShaderInit_proc(Shader myShader) {
   myShader.setIntUni("specularMap", 1);
   myShader.setIntUni("normalMap", 2);
 }
-void renderTriangleInTangentSpace(float vert[15], float normal[3]) {
-  GLuint triVBO, triVAO;
-  glGenBuffers(1, &triVBO);
-  glGenVertexArrays(1, &triVAO);
-
-  // triangle points
-  glm::vec3 p1(vert[0], vert[1], vert[2]);
-  glm::vec2 tex1(vert[3], vert[4]);
-  glm::vec3 p2(vert[5], vert[6], vert[7]);
-  glm::vec2 tex2(vert[8], vert[9]);
-  glm::vec3 p3(vert[10], vert[11], vert[12]);
-  glm::vec2 tex3(vert[13], vert[14]);
-
-  // there are two triangles in a square
-  glm::vec3 snormal(normal[0], normal[1], normal[2]);
-
-  // first triangle
-  glm::vec3 edge1 = p2 - p1;
-  glm::vec3 edge2 = p3 - p1;
-  glm::vec2 deltaUV1 = tex2 - tex1;
-  glm::vec2 deltaUV2 = tex3 - tex1;
-
-  glm::vec3 tan = getTangent(deltaUV2, deltaUV1, edge1, edge2);
-  glm::vec3 bitan = getBiTangent(deltaUV2, deltaUV1, edge1, edge2);
-
-  float trivert[] = {
-      p1.x,   p1.y,  p1.z,  snormal.x, snormal.y, snormal.z, tex1.x,
-      tex1.y, tan.x, tan.y, tan.z,     bitan.x,   bitan.y,   bitan.z,
-      p2.x,   p2.y,  p2.z,  snormal.x, snormal.y, snormal.z, tex2.x,
-      tex2.y, tan.x, tan.y, tan.z,     bitan.x,   bitan.y,   bitan.z,
-      p3.x,   p3.y,  p3.z,  snormal.x, snormal.y, snormal.z, tex3.x,
-      tex3.y, tan.x, tan.y, tan.z,     bitan.x,   bitan.y,   bitan.z,
-  };
-  glBindVertexArray(triVAO);
-  glBindBuffer(GL_ARRAY_BUFFER, triVBO);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(trivert), &trivert, GL_STATIC_DRAW);
-  glEnableVertexAttribArray(0); // location
-  // specify attributes
-  GLsizei fsize = 14 * sizeof(float);
-  glVertexAttribPointer(0, // location ==  aPos
-                        3, // vec3
-                        GL_FLOAT, GL_FALSE, fsize, (void *)0);
-  glEnableVertexAttribArray(1); // location
-  glVertexAttribPointer(1,      // location ==  aNormal
-                        3,      // vec3
-                        GL_FLOAT, GL_FALSE, fsize, (void *)(3 * sizeof(float)));
-  glEnableVertexAttribArray(2); // location
-  glVertexAttribPointer(2,      // location ==  aTexCoord
-                        2,      // vec2
-                        GL_FLOAT, GL_FALSE, fsize, (void *)(6 * sizeof(float)));
-  glEnableVertexAttribArray(3); // location
-  glVertexAttribPointer(3,      // location ==  aTan
-                        3,      // vec3
-                        GL_FLOAT, GL_FALSE, fsize, (void *)(8 * sizeof(float)));
-  glEnableVertexAttribArray(4); // location
-  glVertexAttribPointer(4,      // location ==  aBiTan
-                        3,      // vec3
-                        GL_FLOAT, GL_FALSE, fsize,
-                        (void *)(11 * sizeof(float)));
-  glBindVertexArray(triVAO);
-  glDrawArrays(GL_TRIANGLES, 0, 3);
-  glBindVertexArray(0);
-  glDeleteVertexArrays(1, &triVAO);
-  glDeleteBuffers(1, &triVBO);
-}
 void renderTriangle(float vert[15], float normal[3]) {
   GLuint triVBO, triVAO;
   glGenBuffers(1, &triVBO);
@@ -432,7 +520,7 @@ void renderTriangle(float vert[15], float normal[3]) {
       normal[1], normal[2], vert[8],   vert[9],   vert[10],  vert[11],
       vert[12],  normal[0], normal[1], normal[2], vert[13],  vert[14],
   };
-  glBindVertexArray(triVAO);
+  glState().bindVertexArray(triVAO);
   glBindBuffer(GL_ARRAY_BUFFER, triVBO);
   glBufferData(GL_ARRAY_BUFFER, sizeof(trivert), &trivert, GL_STATIC_DRAW);
   // specify attributes
@@ -449,10 +537,8 @@ void renderTriangle(float vert[15], float normal[3]) {
                         2,      // vec2
                         GL_FLOAT, GL_FALSE, fsize, (void *)6);
   glEnableVertexAttribArray(2); // location
-  glBindVertexArray(triVAO);
   glDrawArrays(GL_TRIANGLES, 0, 3);
-  glBindVertexArray(0);
-  glDeleteVertexArrays(1, &triVAO);
+  glState().deleteVertexArray(triVAO);
   glDeleteBuffers(1, &triVBO);
 }
 void renderLamp() {
@@ -461,103 +547,18 @@ void renderLamp() {
   glGenVertexArrays(1, &lightVao); // separate object to isolate lamp from
   float vert[] = {-0.5f, -0.5f, -0.5f, -0.5f, 0.5f, -0.5f, 0.5f, -0.5f, -0.5f};
 
-  glBindVertexArray(lightVao);
+  glState().bindVertexArray(lightVao);
   glBindBuffer(GL_ARRAY_BUFFER, vbo);
   glBufferData(GL_ARRAY_BUFFER, sizeof(vert), &vert, GL_STATIC_DRAW);
   glEnableVertexAttribArray(0);
   glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
-  glBindVertexArray(lightVao);
   glDrawArrays(GL_TRIANGLES, 0, 3);
-  glBindVertexArray(0);
-  glDeleteVertexArrays(1, &lightVao);
+  glState().deleteVertexArray(lightVao);
   glDeleteBuffers(1, &vbo);
 }
 void renderCubeInTangentSpace() {
-  /*
-     Draw cube
-   */
-  float s1n[] = {0.0f, 0.0f, -1.0f};
-  float s2n[] = {0.0f, 0.0f, 1.0f};
-  float s3n[] = {-1.0f, 0.0f, 0.0f};
-  float s4n[] = {1.0f, 0.0f, 0.0f};
-  float s5n[] = {0.0f, -1.0f, 0.0f};
-  float s6n[] = {0.0f, 1.0f, 0.0f};
-
-  // positions        // texture coords
-  float t1[] = {
-      -0.5f, -0.5f, -0.5f, 0.0f, 0.0f,  0.5f, -0.5f, -0.5f,
-      1.0f,  0.0f,  0.5f,  0.5f, -0.5f, 1.0f, 1.0f,
-  };
-  renderTriangleInTangentSpace(t1, s1n);
-  float tt1[] = {
-      0.5f, 0.5f, -0.5f, 1.0f,  1.0f,  -0.5f, 0.5f, -0.5f,
-      0.0f, 1.0f, -0.5f, -0.5f, -0.5f, 0.0f,  0.0f,
-  };
-  renderTriangleInTangentSpace(tt1, s1n);
-
-  float t2[] = {
-      -0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 0.5f, -0.5f, 0.5f,
-      1.0f,  0.0f,  0.5f, 0.5f, 0.5f, 1.0f, 1.0f,
-  };
-
-  renderTriangleInTangentSpace(t2, s2n);
-  float tt2[] = {
-      0.5f, 0.5f, 0.5f,  1.0f,  1.0f, -0.5f, 0.5f, 0.5f,
-      0.0f, 1.0f, -0.5f, -0.5f, 0.5f, 0.0f,  0.0f,
-  };
-
-  renderTriangleInTangentSpace(tt2, s2n);
-
-  float t3[] = {
-      -0.5f, 0.5f, 0.5f,  1.0f,  0.0f,  -0.5f, 0.5f, -0.5f,
-      1.0f,  1.0f, -0.5f, -0.5f, -0.5f, 0.0f,  1.0f,
-  };
-  renderTriangleInTangentSpace(t3, s3n);
-
-  float tt3[] = {
-      -0.5f, -0.5f, -0.5f, 0.0f, 1.0f, -0.5f, -0.5f, 0.5f,
-      0.0f,  0.0f,  -0.5f, 0.5f, 0.5f, 1.0f,  0.0f,
-  };
-  renderTriangleInTangentSpace(tt3, s3n);
-
-  float t4[] = {
-      0.5f, 0.5f, 0.5f, 1.0f,  0.0f,  0.5f, 0.5f, -0.5f,
-      1.0f, 1.0f, 0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-  };
-
-  renderTriangleInTangentSpace(t4, s4n);
-  float tt4[] = {
-      0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 0.5f, -0.5f, 0.5f,
-      0.0f, 0.0f,  0.5f,  0.5f, 0.5f, 1.0f, 0.0f,
-  };
-
-  renderTriangleInTangentSpace(tt4, s4n);
-
-  float t5[] = {
-      -0.5f, -0.5f, -0.5f, 0.0f,  1.0f, 0.5f, -0.5f, -0.5f,
-      1.0f,  1.0f,  0.5f,  -0.5f, 0.5f, 1.0f, 0.0f,
-  };
-
-  renderTriangleInTangentSpace(t5, s5n);
-
-  float tt5[] = {
-      0.5f, -0.5f, 0.5f,  1.0f,  0.0f,  -0.5f, -0.5f, 0.5f,
-      0.0f, 0.0f,  -0.5f, -0.5f, -0.5f, 0.0f,  1.0f,
-  };
-
-  renderTriangleInTangentSpace(tt5, s5n);
-
-  float t6[] = {
-      -0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.5f, 0.5f, -0.5f,
-      1.0f,  1.0f, 0.5f,  0.5f, 0.5f, 1.0f, 0.0f,
-  };
-
-  renderTriangleInTangentSpace(t6, s6n);
-
-  float tt6[] = {0.5f, 0.5f, 0.5f,  1.0f, 0.0f,  -0.5f, 0.5f, 0.5f,
-                 0.0f, 0.0f, -0.5f, 0.5f, -0.5f, 0.0f,  1.0f};
-
-  renderTriangleInTangentSpace(tt6, s6n);
+  // tangent frames are generated once when the mesh is built
+  drawTangentMesh(cubeMesh);
 }
 void renderCube() {
   /*
@@ -0,0 +1,96 @@
+/*
+   Software rasterized phong and pbr cubes for machines without a gpu
+ */
+// license: see, LICENSE
+#define STB_IMAGE_IMPLEMENTATION
+#include <custom/stb_image.h>
+
+#include <custom/raster.hpp>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+fs::path current_dir = fs::current_path();
+fs::path textureDirPath = current_dir / "media" / "textures";
+
+const unsigned int WINWIDTH = 800;
+const unsigned int WINHEIGHT = 600;
+
+glm::vec3 lightPos = glm::vec3(0.2f, 1.0f, 0.5f);
+
+int main(int argc, char *argv[]) {
+  // usage: softRaster.out [phong|pbr] [frames] [output.ppm]
+  RasterShading shading;
+  unsigned int frames = 10;
+  std::string outPath = "softraster.ppm";
+  if (argc > 1) {
+    shading.model = std::string(argv[1]) == "phong" ? RASTER_PHONG : RASTER_PBR;
+  }
+  if (argc > 2) {
+    frames = (unsigned int)std::atoi(argv[2]);
+    frames = frames == 0 ? 1 : frames;
+  }
+  if (argc > 3) {
+    outPath = argv[3];
+  }
+
+  // same cube, maps and light as phong.cpp and simplepbr.cpp
+  PtScene scene;
+  PtMaterial mat;
+  if (shading.model == RASTER_PHONG) {
+    // phong.frag reads its maps without gamma correction
+    mat.albedoMap.load((textureDirPath / "Stone_001_Diffuse.png").c_str(),
+                       false);
+    mat.specularMap.load((textureDirPath / "Stone_001_Specular.png").c_str(),
+                         false);
+    mat.normalMap.load((textureDirPath / "Stone_001_Normal.png").c_str(),
+                       false);
+  } else {
+    mat.albedoMap.load((textureDirPath / "layered-cliff-albedo.png").c_str(),
+                       true);
+    mat.normalMap.load(
+        (textureDirPath / "layered-cliff-normal-ogl.png").c_str(), false);
+    mat.metallicMap.load(
+        (textureDirPath / "layered-cliff-metallic.png").c_str(), false);
+    mat.roughnessMap.load(
+        (textureDirPath / "layered-cliff-roughness.png").c_str(), false);
+    mat.aoMap.load((textureDirPath / "layered-cliff-ao.png").c_str(), false);
+  }
+  scene.materials.push_back(mat);
+  scene.addCube(glm::mat4(1.0f), 0);
+  scene.lights.push_back(
+      PointLight(lightPos, glm::vec3(1.0f), glm::vec3(1.0f, 0.0f, 0.0f)));
+  scene.commit();
+
+  Camera camera(glm::vec3(0.0f, 1.0f, 2.0f), glm::vec3(0.0f, 1.0f, 0.0f), YAW,
+                -26.5f);
+  camera.setPerspective((float)WINWIDTH / (float)WINHEIGHT);
+  glm::mat4 view = camera.getViewMatrix();
+  glm::mat4 projection = camera.getProjectionMatrix();
+  shading.viewPos = camera.pos;
+
+  JobPool pool;
+  SoftRasterizer raster(WINWIDTH, WINHEIGHT);
+  std::cout << "rasterizing " << WINWIDTH << "x" << WINHEIGHT << " on "
+            << pool.size() << " threads" << std::endl;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned int i = 0; i < frames; i++) {
+    raster.render(scene, view, projection, shading, pool);
+  }
+  std::chrono::duration<double, std::milli> took =
+      std::chrono::steady_clock::now() - start;
+  std::cout << "frame time " << took.count() / frames << " ms" << std::endl;
+
+  if (!raster.writePpm(outPath.c_str())) {
+    return -1;
+  }
+  std::cout << "wrote " << outPath << std::endl;
+  return 0;
+}
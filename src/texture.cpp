@@ -33,6 +33,8 @@ void initializeGLFWMajorMinor(unsigned int maj, unsigned int min) {
   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, maj);
   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, min);
   glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  // the default framebuffer encodes the linear output to srgb
+  glfwWindowHint(GLFW_SRGB_CAPABLE, GLFW_TRUE);
 }
 
 void framebuffer_size_callback(GLFWwindow *window, int newWidth,
@@ -53,7 +55,8 @@ void processInput_proc(GLFWwindow *window) {
   }
 }
 
-void loadTexture2d_proc(const char *texturePath) {
+void loadTexture2d_proc(const char *texturePath, bool srgb) {
+  // color images are srgb encoded, sampling decodes them to linear
 
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -77,12 +80,12 @@ void loadTexture2d_proc(const char *texturePath) {
                    GL_UNSIGNED_BYTE, data);
       glGenerateMipmap(GL_TEXTURE_2D);
     } else if (nbChannels == 3) {
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB,
-                   GL_UNSIGNED_BYTE, data);
+      glTexImage2D(GL_TEXTURE_2D, 0, srgb ? GL_SRGB8 : GL_RGB, width, height,
+                   0, GL_RGB, GL_UNSIGNED_BYTE, data);
       glGenerateMipmap(GL_TEXTURE_2D);
     } else if (nbChannels == 4) {
-      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
-                   GL_UNSIGNED_BYTE, data);
+      glTexImage2D(GL_TEXTURE_2D, 0, srgb ? GL_SRGB8_ALPHA8 : GL_RGBA, width,
+                   height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
       glGenerateMipmap(GL_TEXTURE_2D);
     }
   } else {
@@ -118,6 +121,7 @@ int main() {
 
   // set default viewport
   glViewport(0, 0, WINWIDTH, WINHEIGHT); // viewport equal to window
+  glEnable(GL_FRAMEBUFFER_SRGB);
 
   /*
   float textureCoords[] = {
@@ -143,6 +147,7 @@ int main() {
   filesystem::path vertFileName("texture.vert");
   filesystem::path vertPath = shaderDirPath / vertFileName;
   Shader myShader(vertPath.c_str(), fragPath.c_str());
+  releaseShaderStages();
 
   // indices
   GLuint indices[] = {
@@ -198,7 +203,7 @@ int main() {
   glGenTextures(1, &texture);
   glBindTexture(GL_TEXTURE_2D, texture);
 
-  loadTexture2d_proc(impath.c_str());
+  loadTexture2d_proc(impath.c_str(), true);
 
   // -------- main loop -----------
   while (glfwWindowShouldClose(window) == 0) {